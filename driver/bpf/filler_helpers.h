@@ -1399,6 +1399,18 @@ static __always_inline int check_skb(struct sk_buff *skb, const char *dev_name,
 	return 0;
 }
 
+static __always_inline void sock_to_tuple(struct sock *sk, struct tuple *tp)
+{
+	const struct inet_sock *inet = inet_sk(sk);
+
+	bpf_probe_read(&tp->sport, sizeof(tp->sport), (void *)&inet->inet_sport);
+	bpf_probe_read(&tp->dport, sizeof(tp->dport), (void *)&inet->inet_dport);
+	bpf_probe_read(&tp->saddr, sizeof(tp->saddr), (void *)&inet->inet_saddr);
+	bpf_probe_read(&tp->daddr, sizeof(tp->daddr), (void *)&inet->inet_daddr);
+	bpf_probe_read(&tp->family, sizeof(tp->family), (void *)&sk->__sk_common.skc_family);
+	tp->pad = 1;
+}
+
 static __always_inline int sock_to_ring(struct filler_data *data, struct sock *sk){
 	u16 sport = 0;
 	u16 dport = 0;
@@ -158,6 +158,7 @@ FILLER_RAW(terminate_filler)
 		break;
 	}
 
+	account_evt_type(state);
 	release_local_state(state);
 	return 0;
 }
@@ -201,6 +202,7 @@ KP_FILLER_RAW(kp_terminate_filler)
 		break;
 	}
 
+	account_evt_type(state);
 	release_local_state(state);
 	return 0;
 }
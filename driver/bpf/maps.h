@@ -106,8 +106,24 @@ struct bpf_map_def __bpf_section("maps") rtt_static_map = {
         .max_entries = 65535,
 };
 
+/*
+ * The per-thread state below is keyed by tid and written on every context
+ * switch and syscall, from whichever CPU the thread runs or is woken up on,
+ * so it can't be per-CPU. Use LRU hashes, so that threads that exited
+ * without their entries being deleted get evicted instead of filling the
+ * maps up. The LRU list is common to all the CPUs: with per-CPU lists
+ * (BPF_F_NO_COMMON_LRU) each CPU only gets max_entries / nr_cpus entries,
+ * and a thread that moved to a busy CPU could lose its live state.
+ * Evictions are counted, see update_lru_state_map().
+ */
+#ifdef BPF_SUPPORTS_LRU_HASH
+#define STATE_MAP_TYPE BPF_MAP_TYPE_LRU_HASH
+#else
+#define STATE_MAP_TYPE BPF_MAP_TYPE_HASH
+#endif
+
 struct bpf_map_def __bpf_section("maps") stash_tuple_map = {
-	.type = BPF_MAP_TYPE_HASH,
+	.type = STATE_MAP_TYPE,
 	.key_size = sizeof(u64),
 	.value_size = sizeof(struct tuple),
 	.max_entries = 65535,
@@ -137,31 +153,31 @@ struct info_t {
 };
 
 struct bpf_map_def __bpf_section("maps") on_start_ts = {
-        .type = BPF_MAP_TYPE_HASH,
-        .key_size = sizeof(u32),
-        .value_size = sizeof(u64),
-        .max_entries = 65535,
+	.type = STATE_MAP_TYPE,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u64),
+	.max_entries = 65535,
 };
 
 struct bpf_map_def __bpf_section("maps") off_start_ts = {
-        .type = BPF_MAP_TYPE_HASH,
-        .key_size = sizeof(u32),
-        .value_size = sizeof(u64),
-        .max_entries = 65535,
+	.type = STATE_MAP_TYPE,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u64),
+	.max_entries = 65535,
 };
 
 struct bpf_map_def __bpf_section("maps") cpu_runq = {
-        .type = BPF_MAP_TYPE_HASH,
-        .key_size = sizeof(u32),
-        .value_size = sizeof(u64),
-        .max_entries = 65535,
+	.type = STATE_MAP_TYPE,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u64),
+	.max_entries = 65535,
 };
 
 struct bpf_map_def __bpf_section("maps") type_map = {
-        .type = BPF_MAP_TYPE_HASH,
-        .key_size = sizeof(u32),
-        .value_size = sizeof(enum offcpu_type),
-        .max_entries = 65535,
+	.type = STATE_MAP_TYPE,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(enum offcpu_type),
+	.max_entries = 65535,
 };
 
 struct bpf_map_def __bpf_section("maps") syscall_map = {
@@ -185,19 +201,85 @@ struct bpf_map_def __bpf_section("maps") cpu_analysis_pid_blacklist = {
         .max_entries = 1000,
 };
 
+/*
+ * Only inserted into on the first switch of a thread
+ */
 struct bpf_map_def __bpf_section("maps") cpu_records = {
-        .type = BPF_MAP_TYPE_HASH,
-        .key_size = sizeof(u32),
-        .value_size = sizeof(struct info_t),
-        .max_entries = 1000,
+	.type = STATE_MAP_TYPE,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(struct info_t),
+	.max_entries = 8192,
 };
 
 struct bpf_map_def __bpf_section("maps") cpu_focus_threads = {
-        .type = BPF_MAP_TYPE_HASH,
-        .key_size = sizeof(u32),
-        .value_size = sizeof(u64),
-        .max_entries = 65535,
+	.type = STATE_MAP_TYPE,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u64),
+	.max_entries = 65535,
+};
+
+/*
+ * Aggregated TCP counters by connection tuple, read and emptied in batches
+ * by userspace, which looks the map up by name. Not preallocated, since
+ * the full map takes ~20MB per possible CPU and is only used with
+ * aggregation enabled.
+ */
+struct bpf_map_def __bpf_section("maps") tcp_stats_map = {
+	.type = BPF_MAP_TYPE_PERCPU_HASH,
+	.key_size = sizeof(struct tuple),
+	.value_size = sizeof(struct tcp_stats),
+	.max_entries = 65535,
+	.map_flags = BPF_F_NO_PREALLOC,
+};
+
+/*
+ * Prefilters applied before dispatching to the fillers, populated by
+ * userspace, which looks them up by name
+ */
+struct bpf_map_def __bpf_section("maps") prefilter_tgids = {
+	.type = BPF_MAP_TYPE_HASH,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u8),
+	.max_entries = PREFILTER_MAX_ENTRIES,
 };
+
+struct bpf_map_def __bpf_section("maps") prefilter_cgroups = {
+	.type = BPF_MAP_TYPE_HASH,
+	.key_size = sizeof(u64),
+	.value_size = sizeof(u8),
+	.max_entries = PREFILTER_MAX_ENTRIES,
+};
+
+struct bpf_map_def __bpf_section("maps") prefilter_sampling = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u32),
+	.max_entries = PPM_EVENT_MAX,
+};
+
+/*
+ * Counters of each event type, read by userspace, which looks it up by name
+ */
+struct bpf_map_def __bpf_section("maps") evt_type_stats_map = {
+	.type = BPF_MAP_TYPE_PERCPU_ARRAY,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(struct evt_type_stats),
+	.max_entries = PPM_EVENT_MAX,
+};
+
+#ifdef BPF_SUPPORTS_RINGBUF
+/*
+ * One BPF_MAP_TYPE_RINGBUF per CPU, created and sized by userspace. Only
+ * used when settings->ringbuf is set, perf_map otherwise. Keep it last, so
+ * that the index of the other maps doesn't depend on the kernel version.
+ */
+struct bpf_map_def __bpf_section("maps") ringbuf_maps = {
+	.type = BPF_MAP_TYPE_ARRAY_OF_MAPS,
+	.key_size = sizeof(u32),
+	.value_size = sizeof(u32),
+	.max_entries = 0,
+};
+#endif
 #endif // __KERNEL__
 
 #endif
@@ -49,15 +49,19 @@ static __always_inline bool prepare_filler(void *ctx,
 					   enum ppm_event_type evt_type,
 					   struct sysdig_bpf_settings *settings,
 					   enum syscall_flags drop_flags);
+static __always_inline int update_state_map(void *map, const void *key, const void *value);
+static __always_inline int update_lru_state_map(void *map, enum sysdig_state_map idx,
+						const void *key, const void *value, u32 size);
+static __always_inline void delete_lru_state_map(void *map, enum sysdig_state_map idx, const void *key);
 #ifdef CPU_ANALYSIS
 static __always_inline int bpf_cpu_analysis(void *ctx, u32 tid);
 static __always_inline void clear_map(u32 tid)
 {
-	bpf_map_delete_elem(&type_map, &tid);
-	bpf_map_delete_elem(&on_start_ts, &tid);
-	bpf_map_delete_elem(&off_start_ts, &tid);
-	bpf_map_delete_elem(&cpu_focus_threads, &tid);
-	bpf_map_delete_elem(&cpu_records, &tid);
+	delete_lru_state_map(&type_map, SYSDIG_STATE_TYPE_MAP, &tid);
+	delete_lru_state_map(&on_start_ts, SYSDIG_STATE_ON_START_TS, &tid);
+	delete_lru_state_map(&off_start_ts, SYSDIG_STATE_OFF_START_TS, &tid);
+	delete_lru_state_map(&cpu_focus_threads, SYSDIG_STATE_CPU_FOCUS_THREADS, &tid);
+	delete_lru_state_map(&cpu_records, SYSDIG_STATE_CPU_RECORDS, &tid);
 }
 
 static __always_inline bool check_filter(u32 pid)
@@ -126,7 +130,7 @@ static __always_inline enum offcpu_type get_syscall_type(int syscall_id) {
 		default:
 			type = OTHER;
 	}
-	bpf_map_update_elem(&syscall_map, &syscall_id, &type, BPF_ANY);
+	update_state_map(&syscall_map, &syscall_id, &type);
 	return type;
 }
 static __always_inline struct info_t* get_cpu_info(u32 pid, u32 tid, u64 real_start_ts)
@@ -140,7 +144,7 @@ static __always_inline struct info_t* get_cpu_info(u32 pid, u32 tid, u64 real_st
 		info.tid = tid;
 		info.start_ts = real_start_ts;
 		info.index = 0;
-		bpf_map_update_elem(&cpu_records, &tid, &info, BPF_ANY);
+		update_lru_state_map(&cpu_records, SYSDIG_STATE_CPU_RECORDS, &tid, &info, sizeof(info));
 		infop = bpf_map_lookup_elem(&cpu_records, &tid);
 	}
 
@@ -433,6 +437,79 @@ static __always_inline struct sysdig_bpf_per_cpu_state *get_local_state(unsigned
 	return state;
 }
 
+/*
+ * Insert into a map that the probe fills by itself, counting the failures
+ * (i.e. the map is full) in the per-CPU stats
+ */
+static __always_inline int update_state_map(void *map, const void *key, const void *value)
+{
+	struct sysdig_bpf_per_cpu_state *state;
+	int ret;
+
+	ret = bpf_map_update_elem(map, key, value, BPF_ANY);
+	if (ret) {
+		state = get_local_state(bpf_get_smp_processor_id());
+		if (state)
+			++state->n_map_insert_failures;
+	}
+
+	return ret;
+}
+
+/*
+ * Insert into or update one of the per-thread LRU state maps. Existing
+ * entries are written in place: an LRU update takes a free node before
+ * looking for the key, and could evict another thread's entry even when
+ * the key is already there. New entries are counted, as are the deletes
+ * in delete_lru_state_map(), so that userspace can tell how many entries
+ * the kernel evicted: the inserts that went beyond max_entries on top of
+ * the deletes.
+ */
+static __always_inline int update_lru_state_map(void *map, enum sysdig_state_map idx,
+						const void *key, const void *value, u32 size)
+{
+	struct sysdig_bpf_per_cpu_state *state;
+	void *cur;
+	int ret;
+
+	cur = bpf_map_lookup_elem(map, key);
+	if (cur) {
+		memcpy(cur, value, size);
+		return 0;
+	}
+
+	state = get_local_state(bpf_get_smp_processor_id());
+
+	ret = bpf_map_update_elem(map, key, value, BPF_NOEXIST);
+	if (ret == 0) {
+		if (state)
+			++state->n_state_map_inserts[idx];
+		return 0;
+	}
+
+	/*
+	 * Either another CPU inserted the key in the meantime, or the map
+	 * (without LRU support) is full
+	 */
+	ret = bpf_map_update_elem(map, key, value, BPF_EXIST);
+	if (ret && state)
+		++state->n_map_insert_failures;
+
+	return ret;
+}
+
+static __always_inline void delete_lru_state_map(void *map, enum sysdig_state_map idx, const void *key)
+{
+	struct sysdig_bpf_per_cpu_state *state;
+
+	if (bpf_map_delete_elem(map, key))
+		return;
+
+	state = get_local_state(bpf_get_smp_processor_id());
+	if (state)
+		++state->n_state_map_deletes[idx];
+}
+
 static __always_inline bool acquire_local_state(struct sysdig_bpf_per_cpu_state *state)
 {
 	if (state->in_use) {
@@ -455,6 +532,41 @@ static __always_inline bool release_local_state(struct sysdig_bpf_per_cpu_state
 	return true;
 }
 
+/*
+ * Account the event that just went through the fillers to its type. The
+ * time is from the tracepoint to now, i.e. it includes the dispatch and
+ * the tail calls.
+ */
+static __always_inline void account_evt_type(struct sysdig_bpf_per_cpu_state *state)
+{
+	struct sysdig_bpf_settings *settings;
+	struct evt_type_stats *stats;
+	u32 evt_type;
+
+	settings = get_bpf_settings();
+	if (!settings || !settings->detailed_stats)
+		return;
+
+	evt_type = state->tail_ctx.evt_type;
+	stats = bpf_map_lookup_elem(&evt_type_stats_map, &evt_type);
+	if (!stats)
+		return;
+
+	switch (state->tail_ctx.prev_res) {
+	case PPM_SUCCESS:
+		++stats->n_evts;
+		stats->n_bytes += state->tail_ctx.len;
+		break;
+	case PPM_FAILURE_BUFFER_FULL:
+		++stats->n_drops_buffer;
+		break;
+	default:
+		break;
+	}
+
+	stats->filler_ns += settings->boot_time + bpf_ktime_get_ns() - state->tail_ctx.ts;
+}
+
 static __always_inline int init_filler_data(void *ctx,
 					    struct filler_data *data,
 					    bool is_syscall)
@@ -604,6 +716,67 @@ static __always_inline bool drop_event(void *ctx,
 	return false;
 }
 
+/*
+ * Drop the event before it gets to the fillers if the process isn't in
+ * one of the enabled sets, pid or cgroup, or if it falls out of the
+ * sampling window of its type. Like the dropping mode, sampling keeps the
+ * first 1/ratio of every second, so that enter and exit events of the
+ * same type are mostly kept or dropped together.
+ */
+static __always_inline bool prefilter_event(struct sysdig_bpf_settings *settings,
+					    enum ppm_event_type evt_type,
+					    enum syscall_flags drop_flags,
+					    unsigned long long ts)
+{
+	uint8_t prefilter = settings->prefilter;
+
+#ifndef BPF_SUPPORTS_CGROUP_ID
+	/* Can't tell the cgroup, keep the events rather than losing them */
+	prefilter &= ~PREFILTER_CGROUPS;
+#endif
+
+	if (!prefilter)
+		return false;
+
+	if (drop_flags & UF_NEVER_DROP)
+		return false;
+
+	if (prefilter & (PREFILTER_TGIDS | PREFILTER_CGROUPS)) {
+		bool keep = false;
+
+		if (prefilter & PREFILTER_TGIDS) {
+			u32 tgid = bpf_get_current_pid_tgid() >> 32;
+
+			if (bpf_map_lookup_elem(&prefilter_tgids, &tgid))
+				keep = true;
+		}
+
+#ifdef BPF_SUPPORTS_CGROUP_ID
+		if (!keep && (prefilter & PREFILTER_CGROUPS)) {
+			u64 cgroup_id = bpf_get_current_cgroup_id();
+
+			if (bpf_map_lookup_elem(&prefilter_cgroups, &cgroup_id))
+				keep = true;
+		}
+#endif
+
+		if (!keep)
+			return true;
+	}
+
+	if (prefilter & PREFILTER_SAMPLING) {
+		u32 key = evt_type;
+		u32 *ratio;
+
+		ratio = bpf_map_lookup_elem(&prefilter_sampling, &key);
+		if (ratio && *ratio > 1 &&
+		    ts % 1000000000 >= 1000000000 / *ratio)
+			return true;
+	}
+
+	return false;
+}
+
 static __always_inline void reset_tail_ctx(struct sysdig_bpf_per_cpu_state *state,
 					   enum ppm_event_type evt_type,
 					   unsigned long long ts)
@@ -647,6 +820,10 @@ static __always_inline void call_filler(void *ctx,
 	}
 
 	ts = settings->boot_time + bpf_ktime_get_ns();
+
+	if (prefilter_event(settings, evt_type, drop_flags, ts))
+		goto cleanup;
+
 	reset_tail_ctx(state, evt_type, ts);
 
 	/* drop_event can change state->tail_ctx.evt_type */
@@ -699,6 +876,10 @@ static __always_inline bool prepare_filler(void *ctx,
 	}
 
 	ts = settings->boot_time + bpf_ktime_get_ns();
+
+	if (prefilter_event(settings, evt_type, drop_flags, ts))
+		goto cleanup;
+
 	reset_tail_ctx(state, evt_type, ts);
 
 	/* drop_event can change state->tail_ctx.evt_type */
@@ -71,10 +71,10 @@ BPF_PROBE("raw_syscalls/", sys_enter, sys_enter_args)
 #ifdef CPU_ANALYSIS
 	enum offcpu_type type = get_syscall_type((int)id);
 	u32 tid = bpf_get_current_pid_tgid();
-	bpf_map_update_elem(&type_map, &tid, &type, BPF_ANY);
+	update_lru_state_map(&type_map, SYSDIG_STATE_TYPE_MAP, &tid, &type, sizeof(type));
 	if(type == NET || type == DISK) {
 		u64 enter_time = bpf_ktime_get_ns();
-		bpf_map_update_elem(&cpu_focus_threads, &tid, &enter_time, BPF_ANY);
+		update_lru_state_map(&cpu_focus_threads, SYSDIG_STATE_CPU_FOCUS_THREADS, &tid, &enter_time, sizeof(enter_time));
 	}
 #endif
 	sc_evt = get_syscall_info(id);
@@ -126,10 +126,10 @@ BPF_PROBE("raw_syscalls/", sys_exit, sys_exit_args)
 	enum offcpu_type type = get_syscall_type((int)id);
 	u32 tid = bpf_get_current_pid_tgid();
 
-	bpf_map_delete_elem(&type_map, &tid);
+	delete_lru_state_map(&type_map, SYSDIG_STATE_TYPE_MAP, &tid);
 	if(type == NET || type == DISK) {
 		u64 exit_time = bpf_ktime_get_ns();
-		bpf_map_update_elem(&cpu_focus_threads, &tid, &exit_time, BPF_ANY);
+		update_lru_state_map(&cpu_focus_threads, SYSDIG_STATE_CPU_FOCUS_THREADS, &tid, &exit_time, sizeof(exit_time));
 	}
 	
 #endif
@@ -240,7 +240,7 @@ BPF_KPROBE(finish_task_switch)
 	if (FILTER) {
 		// record previous thread offcpu start time
 		ts = bpf_ktime_get_ns();
-		bpf_map_update_elem(&off_start_ts, &tid, &ts, BPF_ANY);
+		update_lru_state_map(&off_start_ts, SYSDIG_STATE_OFF_START_TS, &tid, &ts, sizeof(ts));
 
 		u64 *on_ts;
 		on_ts = bpf_map_lookup_elem(&on_start_ts, &tid);
@@ -248,7 +248,7 @@ BPF_KPROBE(finish_task_switch)
 			// calculate previous thread's oncpu delta time
 			u64 delta = ts - *on_ts;
 			u64 delta_us = delta / 1000; // convert to us
-			bpf_map_delete_elem(&on_start_ts, &tid);
+			delete_lru_state_map(&on_start_ts, SYSDIG_STATE_ON_START_TS, &tid);
 			if ((delta_us >= MINBLOCK_US) && (delta_us <= MAXBLOCK_US)) {
 				if (check_filter(pid)) {
 					record_cpu_ontime_and_out(ctx, settings, pid, tid, *on_ts, delta);
@@ -262,7 +262,7 @@ BPF_KPROBE(finish_task_switch)
 		if (_READ(p->state) == TASK_RUNNING) {	
 #endif	
 			u64 ts = bpf_ktime_get_ns();
-			bpf_map_update_elem(&cpu_runq, &tid, &ts, BPF_ANY);
+			update_lru_state_map(&cpu_runq, SYSDIG_STATE_CPU_RUNQ, &tid, &ts, sizeof(ts));
 		}
 	}
 
@@ -273,12 +273,12 @@ BPF_KPROBE(finish_task_switch)
 
 	// record next thread's oncpu start time
 	u64 on_ts = bpf_ktime_get_ns();
-	bpf_map_update_elem(&on_start_ts, &tid, &on_ts, BPF_ANY);
+	update_lru_state_map(&on_start_ts, SYSDIG_STATE_ON_START_TS, &tid, &on_ts, sizeof(on_ts));
 
 	tsp = bpf_map_lookup_elem(&off_start_ts, &tid);
 	if (tsp != 0) {
 		u64 off_ts = *tsp;
-		bpf_map_delete_elem(&off_start_ts, &tid);
+		delete_lru_state_map(&off_start_ts, SYSDIG_STATE_OFF_START_TS, &tid);
 		// calculate next thread's offcpu delta time
 		u64 delta = on_ts - off_ts;
 		u64 delta_us = delta / 1000;
@@ -289,7 +289,7 @@ BPF_KPROBE(finish_task_switch)
 				if (rq_ts != 0) {
 					if (on_ts > *rq_ts)
 						rq_la = (on_ts - *rq_ts) / 1000;
-					bpf_map_delete_elem(&cpu_runq, &tid);
+					delete_lru_state_map(&cpu_runq, SYSDIG_STATE_CPU_RUNQ, &tid);
 				}
 				record_cpu_offtime(ctx, settings, pid, tid, off_ts, rq_la, delta);
 			}
@@ -311,7 +311,7 @@ static __always_inline int bpf_trace_enqueue(struct sched_process_exit_args *ctx
 	if (pid == 0)
 		return 0;
 	u64 ts = bpf_ktime_get_ns();
-	bpf_map_update_elem(&cpu_runq, &pid, &ts, BPF_ANY);
+	update_lru_state_map(&cpu_runq, SYSDIG_STATE_CPU_RUNQ, &pid, &ts, sizeof(ts));
 
 	return 0;
 }
@@ -471,6 +471,84 @@ BPF_PROBE("net/", netif_receive_skb, netif_receive_skb_args)
 }
 */
 
+/*
+ * The TCP kprobes leave out SSH and the sockets without a port
+ */
+static __always_inline bool tcp_tuple_ignored(struct tuple *tp)
+{
+	return ntohs(tp->sport) == 22 || ntohs(tp->dport) == 22 ||
+	       ntohs(tp->sport) == 0 || ntohs(tp->dport) == 0;
+}
+
+/*
+ * In aggregation mode the TCP kprobes only update the per-CPU counters of
+ * the connection in tcp_stats_map, and userspace reads them periodically.
+ */
+static __always_inline struct tcp_stats *get_tcp_stats(struct tuple *tp)
+{
+	struct tcp_stats *st;
+
+	st = bpf_map_lookup_elem(&tcp_stats_map, tp);
+	if (st)
+		return st;
+
+	struct tcp_stats new_st;
+	__builtin_memset(&new_st, 0, sizeof(new_st));
+
+	/*
+	 * Might fail because the map is full, or because another CPU
+	 * raced us, the lookup sorts it out
+	 */
+	bpf_map_update_elem(&tcp_stats_map, tp, &new_st, BPF_NOEXIST);
+
+	st = bpf_map_lookup_elem(&tcp_stats_map, tp);
+	if (!st) {
+		struct sysdig_bpf_per_cpu_state *state;
+
+		state = get_local_state(bpf_get_smp_processor_id());
+		if (state)
+			++state->n_map_insert_failures;
+	}
+
+	return st;
+}
+
+static __always_inline u32 tcp_stats_rtt_bucket(u32 v)
+{
+	u32 r;
+	u32 shift;
+
+	r = (v > 0xFFFF) << 4;
+	v >>= r;
+	shift = (v > 0xFF) << 3;
+	v >>= shift;
+	r |= shift;
+	shift = (v > 0xF) << 2;
+	v >>= shift;
+	r |= shift;
+	shift = (v > 0x3) << 1;
+	v >>= shift;
+	r |= shift;
+	r |= (v >> 1);
+
+	return r & (TCP_STATS_RTT_BUCKETS - 1);
+}
+
+static __always_inline void tcp_stats_add_rtt(struct tuple *tp, u32 srtt)
+{
+	struct tcp_stats *st = get_tcp_stats(tp);
+	if (!st)
+		return;
+
+	if (st->rtt_count == 0 || srtt < st->rtt_min)
+		st->rtt_min = srtt;
+	if (srtt > st->rtt_max)
+		st->rtt_max = srtt;
+	st->rtt_sum += srtt;
+	st->rtt_count++;
+	st->rtt_hist[tcp_stats_rtt_bucket(srtt)]++;
+}
+
 BPF_KPROBE(tcp_drop)
 {
 	struct sysdig_bpf_settings *settings;
@@ -479,6 +557,21 @@ BPF_KPROBE(tcp_drop)
 	if (!settings)
 		return 0;
 
+	if (settings->tcp_stats_aggregation) {
+		struct sock *sk = (struct sock *)_READ(PT_REGS_PARAM1(ctx));
+		struct tuple tp = {0};
+		struct tcp_stats *st;
+
+		sock_to_tuple(sk, &tp);
+		if (tcp_tuple_ignored(&tp))
+			return 0;
+
+		st = get_tcp_stats(&tp);
+		if (st)
+			st->drops++;
+		return 0;
+	}
+
 	evt_type = PPME_TCP_DROP_E;
 	if(prepare_filler(ctx, ctx, evt_type, settings, UF_NEVER_DROP)) {
 		bpf_tcp_drop_kprobe_e(ctx);
@@ -489,34 +582,22 @@ BPF_KPROBE(tcp_drop)
 
 BPF_KPROBE(tcp_rcv_established)
 {
-	u16 sport = 0;
-	u16 dport = 0;
-	u32 saddr = 0;
-	u32 daddr = 0;
-	u16 family = 0;
 	struct sysdig_bpf_settings *settings;
 	enum ppm_event_type evt_type;
 	settings = get_bpf_settings();
 	if (!settings)
 		return 0;
 	struct sock *sk = (struct sock *)_READ(PT_REGS_PARAM1(ctx));
-	struct tcp_sock *ts = tcp_sk(sk);
-	const struct inet_sock *inet = inet_sk(sk);
-
-	bpf_probe_read(&sport, sizeof(sport), (void *)&inet->inet_sport);
-	bpf_probe_read(&dport, sizeof(dport), (void *)&inet->inet_dport);
-	bpf_probe_read(&saddr, sizeof(saddr), (void *)&inet->inet_saddr);
-	bpf_probe_read(&daddr, sizeof(daddr), (void *)&inet->inet_daddr);
-	bpf_probe_read(&family, sizeof(family), (void *)&sk->__sk_common.skc_family);
 
 	struct tuple tp = {0};
-	tp.daddr = daddr;
-	tp.dport = dport;
-	tp.saddr = saddr;
-	tp.sport = sport;
-	tp.family = family;
-	tp.pad = 1;
-	if(ntohs(sport) == 22 || ntohs(dport) == 22 || ntohs(sport) == 0 || ntohs(dport) == 0) {
+	sock_to_tuple(sk, &tp);
+	if (tcp_tuple_ignored(&tp))
+		return 0;
+
+	if (settings->tcp_stats_aggregation) {
+		struct tcp_sock *ts = tcp_sk(sk);
+
+		tcp_stats_add_rtt(&tp, _READ(ts->srtt_us) >> 3);
 		return 0;
 	}
 
@@ -540,11 +621,6 @@ BPF_KPROBE(tcp_rcv_established)
 
 BPF_KPROBE(tcp_close)
 {
-	u16 sport = 0;
-	u16 dport = 0;
-	u32 saddr = 0;
-	u32 daddr = 0;
-	u16 family = 0;
 	struct sysdig_bpf_settings *settings;
 	enum ppm_event_type evt_type;
 	settings = get_bpf_settings();
@@ -552,28 +628,26 @@ BPF_KPROBE(tcp_close)
 		return 0;
 
 	struct sock *sk = (struct sock *)_READ(PT_REGS_PARAM1(ctx));
-	struct tcp_sock *ts = tcp_sk(sk);
-	const struct inet_sock *inet = inet_sk(sk);
-
-	bpf_probe_read(&sport, sizeof(sport), (void *)&inet->inet_sport);
-	bpf_probe_read(&dport, sizeof(dport), (void *)&inet->inet_dport);
-	bpf_probe_read(&saddr, sizeof(saddr), (void *)&inet->inet_saddr);
-	bpf_probe_read(&daddr, sizeof(daddr), (void *)&inet->inet_daddr);
-	bpf_probe_read(&family, sizeof(family), (void *)&sk->__sk_common.skc_family);
 
 	struct tuple tp = {0};
-	tp.daddr = daddr;
-	tp.dport = dport;
-	tp.saddr = saddr;
-	tp.sport = sport;
-	tp.family = family;
-	tp.pad = 1;
+	sock_to_tuple(sk, &tp);
 
 	int res = bpf_map_delete_elem(&rtt_static_map, &tp);
 
-	if(ntohs(sport)==22||ntohs(dport)==22||ntohs(sport)==0||ntohs(dport)==0){
+	if (tcp_tuple_ignored(&tp))
+		return 0;
+
+	if (settings->tcp_stats_aggregation) {
+		struct tcp_sock *ts = tcp_sk(sk);
+		struct tcp_stats *st;
+
+		tcp_stats_add_rtt(&tp, _READ(ts->srtt_us) >> 3);
+		st = bpf_map_lookup_elem(&tcp_stats_map, &tp);
+		if (st)
+			st->closes++;
 		return 0;
 	}
+
 	evt_type = PPME_TCP_CLOSE_E;
 	if(prepare_filler(ctx, ctx, evt_type, settings, UF_NEVER_DROP)){
 		bpf_rtt_kprobe_e(ctx);
@@ -591,6 +665,25 @@ BPF_KPROBE(tcp_retransmit_skb)
 	if (!settings)
 		return 0;
 
+	if (settings->tcp_stats_aggregation) {
+		struct sock *sk = (struct sock *)_READ(PT_REGS_PARAM1(ctx));
+		struct tuple tp = {0};
+		struct tcp_stats *st;
+		int segs = 1;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 7, 0)
+		segs = _READ(PT_REGS_PARAM3(ctx));
+#endif
+
+		sock_to_tuple(sk, &tp);
+		if (tcp_tuple_ignored(&tp))
+			return 0;
+
+		st = get_tcp_stats(&tp);
+		if (st)
+			st->retransmits += segs;
+		return 0;
+	}
+
 	evt_type = PPME_TCP_RETRANCESMIT_SKB_E;
 	if(prepare_filler(ctx, ctx, evt_type, settings, UF_NEVER_DROP)){
 		bpf_tcp_retransmit_skb_kprobe_e(ctx);
@@ -647,7 +740,7 @@ BPF_KPROBE(tcp_connect)
 	tp.pad = 1;
 
 	unsigned long long id = bpf_get_current_pid_tgid() & 0xffffffff;
-	int ret = bpf_map_update_elem(&stash_tuple_map, &id, &tp, BPF_ANY);
+	update_state_map(&stash_tuple_map, &id, &tp);
 
 	return 0;
 }
@@ -737,8 +830,8 @@ BPF_KPROBE(sock_recvmsg) {
 	// update to NET
 	enum offcpu_type type = NET;
 	u64 enter_time = bpf_ktime_get_ns();
-	bpf_map_update_elem(&cpu_focus_threads, &tid, &enter_time, BPF_ANY);
-	bpf_map_update_elem(&type_map, &tid, &type, BPF_ANY);
+	update_lru_state_map(&cpu_focus_threads, SYSDIG_STATE_CPU_FOCUS_THREADS, &tid, &enter_time, sizeof(enter_time));
+	update_lru_state_map(&type_map, SYSDIG_STATE_TYPE_MAP, &tid, &type, sizeof(type));
 	return 0;
 }
 BPF_KPROBE(sock_sendmsg) {
@@ -749,8 +842,8 @@ BPF_KPROBE(sock_sendmsg) {
 	// update to NET
 	enum offcpu_type type = NET;
 	u64 enter_time = bpf_ktime_get_ns();
-	bpf_map_update_elem(&cpu_focus_threads, &tid, &enter_time, BPF_ANY);
-	bpf_map_update_elem(&type_map, &tid, &type, BPF_ANY);
+	update_lru_state_map(&cpu_focus_threads, SYSDIG_STATE_CPU_FOCUS_THREADS, &tid, &enter_time, sizeof(enter_time));
+	update_lru_state_map(&type_map, SYSDIG_STATE_TYPE_MAP, &tid, &type, sizeof(type));
 	return 0;
 }
 #endif
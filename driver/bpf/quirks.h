@@ -35,6 +35,18 @@ or GPL2.txt for full copies of the license.
 #endif
 #endif
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0)
+#define BPF_SUPPORTS_LRU_HASH
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 18, 0)
+#define BPF_SUPPORTS_CGROUP_ID
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+#define BPF_SUPPORTS_RINGBUF
+#endif
+
 /* Redefine asm_volatile_goto to work around clang not supporting it
  */
 #include <linux/types.h>
@@ -42,6 +42,67 @@ static __always_inline void fixup_evt_arg_len(char *p,
 	*((u16 *)&p[sizeof(struct ppm_evt_hdr)] + (argnumv & (PPM_MAX_EVENT_PARAMS - 1))) = arglen;
 }
 
+/*
+ * The channel of this CPU is missing: likely a new CPU that came online
+ * after userspace opened them, or one that went offline. Schedule a
+ * hotplug event on CPU 0
+ */
+static __always_inline int schedule_hotplug(void)
+{
+	struct sysdig_bpf_per_cpu_state *state = get_local_state(0);
+
+	if (!state)
+		return PPM_FAILURE_BUG;
+
+	state->hotplug_cpu = bpf_get_smp_processor_id();
+	bpf_printk("detected hotplug event, cpu=%d\n", state->hotplug_cpu);
+	return PPM_SUCCESS;
+}
+
+#ifdef BPF_SUPPORTS_RINGBUF
+static __always_inline int push_evt_frame_ringbuf(struct filler_data *data)
+{
+	unsigned long len = data->state->tail_ctx.len;
+	u32 cpu = bpf_get_smp_processor_id();
+	u64 flags = 0;
+	void *ringbuf;
+	int res;
+
+	if (len > RINGBUF_EVENT_MAX_SIZE)
+		return PPM_FAILURE_BUFFER_FULL;
+
+	ringbuf = bpf_map_lookup_elem(&ringbuf_maps, &cpu);
+	if (!ringbuf)
+		return schedule_hotplug();
+
+	fixup_evt_len(data->buf, len);
+
+	/*
+	 * Ring buffers wake up the reader on every record, emulate the
+	 * wakeup watermark of the perf buffers
+	 */
+	if (data->settings->wakeup_watermark) {
+		if (bpf_ringbuf_query(ringbuf, BPF_RB_AVAIL_DATA) + len >= data->settings->wakeup_watermark)
+			flags = BPF_RB_FORCE_WAKEUP;
+		else
+			flags = BPF_RB_NO_WAKEUP;
+	}
+
+	res = bpf_ringbuf_output(ringbuf,
+				 data->buf,
+				 len & SCRATCH_SIZE_MAX,
+				 flags);
+	if (res == -ENOSPC) {
+		return PPM_FAILURE_BUFFER_FULL;
+	} else if (res) {
+		bpf_printk("bpf_ringbuf_output failed, res=%d\n", res);
+		return PPM_FAILURE_BUG;
+	}
+
+	return PPM_SUCCESS;
+}
+#endif
+
 static __always_inline int push_evt_frame(void *ctx,
 					  struct filler_data *data)
 {
@@ -53,6 +114,11 @@ static __always_inline int push_evt_frame(void *ctx,
 		return PPM_FAILURE_BUG;
 	}
 
+#ifdef BPF_SUPPORTS_RINGBUF
+	if (data->settings->ringbuf)
+		return push_evt_frame_ringbuf(data);
+#endif
+
 	if (data->state->tail_ctx.len > PERF_EVENT_MAX_SIZE)
 		return PPM_FAILURE_BUFFER_FULL;
 
@@ -78,16 +144,8 @@ static __always_inline int push_evt_frame(void *ctx,
 		 *
 		 * EOPNOTSUPP = likely a perf channel has been closed
 		 *              because a CPU went offline
-		 *
-		 * Schedule a hotplug event on CPU 0
 		 */
-		struct sysdig_bpf_per_cpu_state *state = get_local_state(0);
-
-		if (!state)
-			return PPM_FAILURE_BUG;
-
-		state->hotplug_cpu = bpf_get_smp_processor_id();
-		bpf_printk("detected hotplug event, cpu=%d\n", state->hotplug_cpu);
+		return schedule_hotplug();
 	} else if (res) {
 		bpf_printk("bpf_perf_event_output failed, res=%d\n", res);
 		return PPM_FAILURE_BUG;
@@ -218,6 +218,12 @@ struct perf_event_sample {
 #define SCRATCH_SIZE_MAX (SCRATCH_SIZE - 1)
 #define SCRATCH_SIZE_HALF (SCRATCH_SIZE_MAX >> 1)
 
+/*
+ * Ring buffer records have a u32 length, events are only limited by the
+ * scratch frame they are built in
+ */
+#define RINGBUF_EVENT_MAX_SIZE SCRATCH_SIZE_MAX
+
 #endif /* __KERNEL__ */
 
 struct statistics {
@@ -233,6 +239,38 @@ struct tuple {
 	__u16 pad;
 };
 
+/*
+ * Log2 buckets of the smoothed RTT in microseconds, bucket n counts the
+ * samples in [2^n, 2^(n+1)), 0 goes in the first one.
+ */
+#define TCP_STATS_RTT_BUCKETS 32
+
+/*
+ * Per-CPU counters of a connection, kept in tcp_stats_map when
+ * settings->tcp_stats_aggregation is set instead of emitting events.
+ */
+struct tcp_stats {
+	__u64 rtt_min;
+	__u64 rtt_max;
+	__u64 rtt_sum;
+	__u64 rtt_count;
+	__u64 rtt_hist[TCP_STATS_RTT_BUCKETS];
+	__u64 retransmits;
+	__u64 drops;
+	__u64 closes;
+};
+
+/*
+ * Per-CPU counters of an event type, kept in evt_type_stats_map when
+ * settings->detailed_stats is set.
+ */
+struct evt_type_stats {
+	__u64 n_evts;
+	__u64 n_bytes;
+	__u64 n_drops_buffer;
+	__u64 filler_ns;
+};
+
 #ifdef BPF_SUPPORTS_RAW_TRACEPOINTS
 struct tcp_reset_args {
     struct sock *sk;
@@ -267,6 +305,30 @@ enum sysdig_map_types {
 #endif
 };
 
+/*
+ * The per-thread LRU state maps whose inserts and deletes are counted in
+ * sysdig_bpf_per_cpu_state, so that userspace can tell how many entries
+ * were evicted
+ */
+enum sysdig_state_map {
+	SYSDIG_STATE_ON_START_TS = 0,
+	SYSDIG_STATE_OFF_START_TS = 1,
+	SYSDIG_STATE_CPU_RUNQ = 2,
+	SYSDIG_STATE_TYPE_MAP = 3,
+	SYSDIG_STATE_CPU_FOCUS_THREADS = 4,
+	SYSDIG_STATE_CPU_RECORDS = 5,
+	SYSDIG_STATE_MAP_MAX = 6,
+};
+
+/*
+ * Bits of settings->prefilter, see prefilter_event()
+ */
+#define PREFILTER_TGIDS (1 << 0)
+#define PREFILTER_CGROUPS (1 << 1)
+#define PREFILTER_SAMPLING (1 << 2)
+
+#define PREFILTER_MAX_ENTRIES 16384
+
 struct sysdig_bpf_settings {
 	uint64_t boot_time;
 	void *socket_file_ops;
@@ -283,6 +345,11 @@ struct sysdig_bpf_settings {
 	uint16_t fullcapture_port_range_end;
 	uint16_t statsd_port;
 	uint16_t switch_agg_num;
+	bool ringbuf;
+	uint32_t wakeup_watermark;
+	bool tcp_stats_aggregation;
+	uint8_t prefilter;
+	bool detailed_stats;
 	char if_name[16];
 	bool events_mask[PPM_EVENT_MAX];
 } __attribute__((packed));
@@ -302,6 +369,9 @@ struct sysdig_bpf_per_cpu_state {
 	unsigned long long n_drops_buffer;
 	unsigned long long n_drops_pf;
 	unsigned long long n_drops_bug;
+	unsigned long long n_map_insert_failures;
+	unsigned long long n_state_map_inserts[SYSDIG_STATE_MAP_MAX];
+	unsigned long long n_state_map_deletes[SYSDIG_STATE_MAP_MAX];
 	unsigned int hotplug_cpu;
 	bool in_use;
 } __attribute__((packed));
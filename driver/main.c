@@ -38,6 +38,11 @@ or GPL2.txt for full copies of the license.
 #endif
 #include <linux/vmalloc.h>
 #include <linux/wait.h>
+#include <linux/poll.h>
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(3, 5, 0))
+#include <linux/irq_work.h>
+#define PPM_HAS_IRQ_WORK
+#endif
 #include <linux/tracepoint.h>
 #include <linux/cpu.h>
 #include <linux/jiffies.h>
@@ -98,6 +103,13 @@ struct ppm_device {
 	dev_t dev;
 	struct cdev cdev;
 	wait_queue_head_t read_queue;
+#ifdef PPM_HAS_IRQ_WORK
+	/*
+	 * The producer can run with scheduler locks held (e.g. sched_switch),
+	 * so readers are woken up from an irq_work rather than directly.
+	 */
+	struct irq_work wakeup_work;
+#endif
 };
 
 struct event_data_t {
@@ -143,6 +155,11 @@ static int ppm_open(struct inode *inode, struct file *filp);
 static int ppm_release(struct inode *inode, struct file *filp);
 static long ppm_ioctl(struct file *f, unsigned int cmd, unsigned long arg);
 static int ppm_mmap(struct file *filp, struct vm_area_struct *vma);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 16, 0))
+static __poll_t ppm_poll(struct file *filp, poll_table *wait);
+#else
+static unsigned int ppm_poll(struct file *filp, poll_table *wait);
+#endif
 static int record_event_consumer(struct ppm_consumer_t *consumer,
                                  enum ppm_event_type event_type,
                                  enum syscall_flags drop_flags,
@@ -199,6 +216,7 @@ static const struct file_operations g_ppm_fops = {
 	.open = ppm_open,
 	.release = ppm_release,
 	.mmap = ppm_mmap,
+	.poll = ppm_poll,
 	.unlocked_ioctl = ppm_ioctl,
 	.owner = THIS_MODULE,
 };
@@ -585,6 +603,7 @@ static int ppm_open(struct inode *inode, struct file *filp)
 	consumer->fullcapture_port_range_start = 0;
 	consumer->fullcapture_port_range_end = 0;
 	consumer->statsd_port = PPM_PORT_STATSD;
+	consumer->wakeup_watermark = 0;
 	bitmap_fill(g_events_mask, PPM_EVENT_MAX); /* Enable all syscall to be passed to userspace */
 	reset_ring_buffer(ring);
 	ring->open = true;
@@ -1106,6 +1125,21 @@ cleanup_ioctl_procinfo:
 		ret = 0;
 		goto cleanup_ioctl;
 	}
+	case PPM_IOCTL_SET_WAKEUP_WATERMARK:
+	{
+		if (arg >= RING_BUF_SIZE) {
+			pr_err("invalid wakeup watermark %lu\n", arg);
+			ret = -EINVAL;
+			goto cleanup_ioctl;
+		}
+
+		consumer->wakeup_watermark = (u32)arg;
+
+		pr_info("new wakeup watermark: %u\n", consumer->wakeup_watermark);
+
+		ret = 0;
+		goto cleanup_ioctl;
+	}
 	case PPM_IOCTL_MASK_ZERO_EVENTS:
 	{
 		vpr_info("PPM_IOCTL_MASK_ZERO_EVENTS, consumer %p\n", consumer_id);
@@ -1317,6 +1351,80 @@ cleanup_ioctl_nolock:
 	return ret;
 }
 
+static u32 ring_used_space(struct ppm_ring_buffer_info *info)
+{
+	u32 head = info->head;
+	u32 tail = info->tail;
+
+	if (tail > head)
+		return RING_BUF_SIZE - tail + head;
+
+	return head - tail;
+}
+
+/*
+ * A ring is readable once it holds at least wakeup_watermark bytes (or any
+ * data if the watermark isn't set), so that consumers can block in poll()
+ * instead of sleeping when the buffers are empty.
+ */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 16, 0))
+static __poll_t ppm_poll(struct file *filp, poll_table *wait)
+#else
+static unsigned int ppm_poll(struct file *filp, poll_table *wait)
+#endif
+{
+	unsigned int mask = 0;
+#if LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 20)
+	int ring_no = iminor(filp->f_path.dentry->d_inode);
+#else
+	int ring_no = iminor(filp->f_dentry->d_inode);
+#endif
+	struct task_struct *consumer_id = filp->private_data;
+	struct ppm_consumer_t *consumer = NULL;
+	struct ppm_ring_buffer_context *ring;
+	u32 threshold;
+
+	poll_wait(filp, &g_ppm_devs[ring_no].read_queue, wait);
+
+	/*
+	 * Pairs with the barrier in record_event_consumer(), so that either
+	 * we see the new head or the producer sees us on the wait queue.
+	 */
+	smp_mb();
+
+	mutex_lock(&g_consumer_mutex);
+
+	consumer = ppm_find_consumer(consumer_id);
+	if (!consumer) {
+		mask = POLLERR;
+		goto cleanup_poll;
+	}
+
+	ring = per_cpu_ptr(consumer->ring_buffers, ring_no);
+	if (!ring->info) {
+		mask = POLLERR;
+		goto cleanup_poll;
+	}
+
+	threshold = consumer->wakeup_watermark ? consumer->wakeup_watermark : 1;
+	if (ring_used_space(ring->info) >= threshold)
+		mask = POLLIN | POLLRDNORM;
+
+cleanup_poll:
+	mutex_unlock(&g_consumer_mutex);
+
+	return mask;
+}
+
+#ifdef PPM_HAS_IRQ_WORK
+static void ppm_wakeup_work(struct irq_work *work)
+{
+	struct ppm_device *dev = container_of(work, struct ppm_device, wakeup_work);
+
+	wake_up_interruptible(&dev->read_queue);
+}
+#endif
+
 static int ppm_mmap(struct file *filp, struct vm_area_struct *vma)
 {
 	int ret;
@@ -2050,6 +2158,20 @@ static int record_event_consumer(struct ppm_consumer_t *consumer,
 		ring_info->head = next;
 
 		++ring->nevents;
+
+#ifdef PPM_HAS_IRQ_WORK
+		/*
+		 * Wake up a consumer blocked in poll() once the ring reaches its
+		 * watermark. Consumers that don't use poll() never end up on the
+		 * wait queue, so this costs them a single load.
+		 */
+		if (consumer->wakeup_watermark) {
+			smp_mb();
+			if (waitqueue_active(&g_ppm_devs[cpu].read_queue) &&
+			    ring_used_space(ring_info) >= consumer->wakeup_watermark)
+				irq_work_queue(&g_ppm_devs[cpu].wakeup_work);
+		}
+#endif
 	} else {
 		if (cbres == PPM_SUCCESS) {
 			ASSERT(freespace < sizeof(struct ppm_evt_hdr) + args.arg_data_offset);
@@ -2871,6 +2993,9 @@ int sysdig_init(void)
 		}
 
 		init_waitqueue_head(&g_ppm_devs[j].read_queue);
+#ifdef PPM_HAS_IRQ_WORK
+		init_irq_work(&g_ppm_devs[j].wakeup_work, ppm_wakeup_work);
+#endif
 		n_created_devices++;
 	}
 
@@ -2948,6 +3073,9 @@ void sysdig_exit(void)
 #endif
 				g_ppm_class, g_ppm_devs[j].dev);
 		cdev_del(&g_ppm_devs[j].cdev);
+#ifdef PPM_HAS_IRQ_WORK
+		irq_work_sync(&g_ppm_devs[j].wakeup_work);
+#endif
 	}
 
 	if (g_ppm_class)
@@ -88,6 +88,7 @@ struct ppm_consumer_t {
 	uint16_t fullcapture_port_range_start;
 	uint16_t fullcapture_port_range_end;
 	uint16_t statsd_port;
+	u32 wakeup_watermark;
 };
 #endif // UDIG
 
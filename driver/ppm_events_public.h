@@ -1528,6 +1528,7 @@ struct ppm_evt_hdr {
 #define PPM_IOCTL_SET_STATSD_PORT _IO(PPM_IOCTL_MAGIC, 23)
 #define PPM_IOCTL_MASK_SET_TP _IO(PPM_IOCTL_MAGIC, 24)
 #define PPM_IOCTL_MASK_UNSET_TP _IO(PPM_IOCTL_MAGIC, 25)
+#define PPM_IOCTL_SET_WAKEUP_WATERMARK _IO(PPM_IOCTL_MAGIC, 26)
 #endif // CYGWING_AGENT
 
 extern const struct ppm_name_value socket_families[];
@@ -702,7 +702,7 @@ int lua_cbacks::get_machine_info(lua_State *ls)
 
 int lua_cbacks::get_thread_table_int(lua_State *ls, bool include_fds, bool barebone)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	sinsp_fdtable::table_t::iterator fdit;
 	uint32_t j;
 	sinsp_filter_compiler* compiler = NULL;
 	sinsp_filter* filter = NULL;
@@ -888,7 +888,7 @@ int lua_cbacks::get_thread_table_int(lua_State *ls, bool include_fds, bool bareb
 			//
 			lua_pushstring(ls, "args");
 
-			vector<string>* args = &tinfo.m_args;
+			const vector<string>* args = &tinfo.m_args.get();
 			lua_newtable(ls);
 			for(j = 0; j < args->size(); j++)
 			{
@@ -1123,7 +1123,7 @@ int lua_cbacks::get_thread_table_barebone_nofds(lua_State *ls)
 int lua_cbacks::get_container_table(lua_State *ls)
 {
 #ifndef _WIN32
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	sinsp_fdtable::table_t::iterator fdit;
 	uint32_t j;
 	sinsp_evt tevt;
 
@@ -35,6 +35,8 @@ static void signal_callback(int signal)
 	printf("Number of preemptions: %" PRIu64 "\n", s.n_preemptions);
 	printf("Number of events skipped due to the tid being in a set of suppressed tids: %" PRIu64 "\n", s.n_suppressed);
 	printf("Number of threads currently being suppressed: %" PRIu64 "\n", s.n_tids_suppressed);
+	printf("Number of failed insertions in the eBPF probe's state maps: %" PRIu64 "\n", s.n_map_insert_failures);
+	printf("Number of evictions from the eBPF probe's state maps: %" PRIu64 "\n", s.n_map_evictions);
 	exit(0);
 }
 
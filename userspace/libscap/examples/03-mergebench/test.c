@@ -0,0 +1,293 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Replays synthetic per-CPU ring buffers through scap_next() to compare the
+// cost of the linear and heap merge modes, and through scap_next_batch() for
+// consumers that don't need a global order. No driver is needed: the rings
+// are plain memory laid out the way the kernel module fills them.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <scap.h>
+#include "../../../../driver/ppm_ringbuffer.h"
+#include "scap-int.h"
+#include "../bench_util.h"
+
+static uint32_t g_ncpus = 64;
+static uint32_t g_nevts = 10000;
+static uint32_t g_burst = 1;
+static uint32_t g_rounds = 50;
+
+//
+// Event i of cpu c belongs to burst i / g_burst, and bursts are handed out
+// to the CPUs round robin. With g_burst == 1 the CPUs are perfectly
+// interleaved, which is the worst case for the merge.
+//
+static void fill_ring(char* buf, uint32_t cpu)
+{
+	uint32_t j;
+
+	for(j = 0; j < g_nevts; j++)
+	{
+		scap_evt* e = (scap_evt*)(buf + j * sizeof(scap_evt));
+		uint64_t burst = j / g_burst;
+
+		e->ts = (burst * g_ncpus + cpu) * g_burst + j % g_burst;
+		e->tid = cpu;
+		e->len = sizeof(scap_evt);
+		e->type = PPME_GENERIC_E;
+		e->nparams = 0;
+	}
+}
+
+static void rewind_rings(scap_t* h)
+{
+	uint32_t j;
+
+	for(j = 0; j < h->m_ndevs; j++)
+	{
+		h->m_devs[j].m_bufinfo->head = g_nevts * sizeof(scap_evt);
+		h->m_devs[j].m_bufinfo->tail = 0;
+		h->m_devs[j].m_lastreadsize = 0;
+		h->m_devs[j].m_sn_len = 0;
+	}
+
+	h->m_merge_heap_size = 0;
+	h->m_merge_drained_dev = -1;
+	h->m_batch_next_dev = 0;
+}
+
+static scap_t* open_fake_live(scap_merge_mode_t mode)
+{
+	uint32_t j;
+	scap_t* h = (scap_t*) calloc(sizeof(scap_t), 1);
+
+	h->m_mode = SCAP_MODE_LIVE;
+	h->m_ndevs = g_ncpus;
+	h->m_buffer_empty_wait_time_us = BUFFER_EMPTY_WAIT_TIME_US_START;
+	h->m_devs = (scap_device*) calloc(sizeof(scap_device), g_ncpus);
+
+	for(j = 0; j < g_ncpus; j++)
+	{
+		h->m_devs[j].m_buffer = (char*) malloc(g_nevts * sizeof(scap_evt));
+		h->m_devs[j].m_bufinfo = (struct ppm_ring_buffer_info*) calloc(sizeof(struct ppm_ring_buffer_info), 1);
+		fill_ring(h->m_devs[j].m_buffer, j);
+	}
+
+	if(scap_merge_init(h, mode) != SCAP_SUCCESS)
+	{
+		fprintf(stderr, "can't allocate the merge state\n");
+		exit(1);
+	}
+
+	return h;
+}
+
+static void close_fake_live(scap_t* h)
+{
+	uint32_t j;
+
+	for(j = 0; j < h->m_ndevs; j++)
+	{
+		free(h->m_devs[j].m_buffer);
+		free(h->m_devs[j].m_bufinfo);
+	}
+
+	free(h->m_devs);
+	free(h->m_merge_heap);
+	free(h);
+}
+
+static void print_result(const char* name, uint64_t nevts, uint64_t elapsed)
+{
+	printf("%-8s %u cpus, burst %u: %.1f ns/evt, %.2f Mevt/s\n",
+	       name, g_ncpus, g_burst,
+	       (double) elapsed / nevts,
+	       (double) nevts * 1000 / elapsed);
+}
+
+static int run(scap_merge_mode_t mode, const char* name)
+{
+	scap_t* h = open_fake_live(mode);
+	uint64_t total = (uint64_t) g_ncpus * g_nevts;
+	uint64_t elapsed = 0;
+	uint32_t r;
+
+	for(r = 0; r < g_rounds; r++)
+	{
+		uint64_t n = 0;
+		uint64_t last_ts = 0;
+		uint64_t start;
+
+		rewind_rings(h);
+		start = ns_now();
+
+		//
+		// Stop as soon as the rings are drained, so that the timing
+		// doesn't include the refill backoff sleep
+		//
+		while(n < total)
+		{
+			scap_evt* ev;
+			uint16_t cpuid;
+			int32_t res = scap_next(h, &ev, &cpuid);
+
+			if(res == SCAP_TIMEOUT)
+			{
+				continue;
+			}
+			else if(res != SCAP_SUCCESS)
+			{
+				fprintf(stderr, "%s: %s\n", name, scap_getlasterr(h));
+				close_fake_live(h);
+				return -1;
+			}
+
+			if(ev->ts < last_ts)
+			{
+				fprintf(stderr, "%s: out of order event on cpu %u\n", name, cpuid);
+				close_fake_live(h);
+				return -1;
+			}
+
+			last_ts = ev->ts;
+			n++;
+		}
+
+		elapsed += ns_now() - start;
+	}
+
+	print_result(name, total * g_rounds, elapsed);
+
+	close_fake_live(h);
+	return 0;
+}
+
+static int run_batch()
+{
+	scap_t* h = open_fake_live(SCAP_MERGE_LINEAR);
+	uint64_t total = (uint64_t) g_ncpus * g_nevts;
+	uint64_t elapsed = 0;
+	uint64_t* last_ts = (uint64_t*) calloc(sizeof(uint64_t), g_ncpus);
+	scap_evt* evts[256];
+	uint32_t r;
+
+	for(r = 0; r < g_rounds; r++)
+	{
+		uint64_t n = 0;
+		uint64_t start;
+
+		rewind_rings(h);
+		memset(last_ts, 0, sizeof(uint64_t) * g_ncpus);
+		start = ns_now();
+
+		while(n < total)
+		{
+			uint32_t nevts;
+			uint16_t cpuid;
+			uint32_t j;
+			int32_t res = scap_next_batch(h, evts, sizeof(evts) / sizeof(evts[0]), &nevts, &cpuid);
+
+			if(res == SCAP_TIMEOUT)
+			{
+				continue;
+			}
+			else if(res != SCAP_SUCCESS)
+			{
+				fprintf(stderr, "batch: %s\n", scap_getlasterr(h));
+				free(last_ts);
+				close_fake_live(h);
+				return -1;
+			}
+
+			//
+			// Only the per-CPU order is guaranteed
+			//
+			for(j = 0; j < nevts; j++)
+			{
+				if(evts[j]->ts < last_ts[cpuid] || evts[j]->tid != cpuid)
+				{
+					fprintf(stderr, "batch: out of order event on cpu %u\n", cpuid);
+					free(last_ts);
+					close_fake_live(h);
+					return -1;
+				}
+
+				last_ts[cpuid] = evts[j]->ts;
+			}
+
+			n += nevts;
+		}
+
+		elapsed += ns_now() - start;
+	}
+
+	print_result("batch", total * g_rounds, elapsed);
+
+	free(last_ts);
+	close_fake_live(h);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	int op;
+
+	while((op = getopt(argc, argv, "c:n:b:r:")) != -1)
+	{
+		switch(op)
+		{
+		case 'c':
+			g_ncpus = atoi(optarg);
+			break;
+		case 'n':
+			g_nevts = atoi(optarg);
+			break;
+		case 'b':
+			g_burst = atoi(optarg);
+			break;
+		case 'r':
+			g_rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-c ncpus] [-n events per cpu] [-b burst length] [-r rounds]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if(g_ncpus == 0 || g_nevts == 0 || g_burst == 0 || g_ncpus > 65535 ||
+	   (uint64_t) g_nevts * sizeof(scap_evt) >= RING_BUF_SIZE)
+	{
+		fprintf(stderr, "invalid parameters\n");
+		return -1;
+	}
+
+	if(run(SCAP_MERGE_LINEAR, "linear") != 0 ||
+	   run(SCAP_MERGE_HEAP, "heap") != 0 ||
+	   run_batch() != 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
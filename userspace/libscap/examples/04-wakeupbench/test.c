@@ -0,0 +1,181 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Runs a live capture for a while and reports how long events take to reach
+// userspace and how much CPU the consumer burns, so that the sleep backoff
+// (-w 0) can be compared with the poll() wakeup (-w <watermark bytes>).
+// Run it once on an idle machine and once under load.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <scap.h>
+#include "../bench_util.h"
+
+#define LATENCY_BUCKETS 64
+
+static uint64_t cpu_time_ns()
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * (uint64_t) 1000000000 +
+	       (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * (uint64_t) 1000;
+}
+
+static uint32_t log2_bucket(uint64_t v)
+{
+	uint32_t b = 0;
+
+	while(v >>= 1)
+	{
+		b++;
+	}
+
+	return b;
+}
+
+//
+// Upper bound of the bucket holding the given percentile
+//
+static uint64_t percentile(const uint64_t* buckets, uint64_t total, double pct)
+{
+	uint64_t target = (uint64_t)(total * pct);
+	uint64_t seen = 0;
+	uint32_t j;
+
+	for(j = 0; j < LATENCY_BUCKETS; j++)
+	{
+		seen += buckets[j];
+		if(seen > target)
+		{
+			return (uint64_t) 1 << (j + 1);
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	char error[SCAP_LASTERR_SIZE];
+	scap_open_args oargs;
+	int32_t res;
+	int op;
+	uint32_t duration_s = 10;
+	uint64_t buckets[LATENCY_BUCKETS];
+	uint64_t nevts = 0;
+	uint64_t ntimeouts = 0;
+	uint64_t lat_sum = 0;
+	uint64_t lat_max = 0;
+	uint64_t start_wall;
+	uint64_t start_cpu;
+	uint64_t end;
+	uint64_t wall;
+	uint64_t cpu;
+	scap_t* h;
+
+	memset(&oargs, 0, sizeof(oargs));
+	memset(buckets, 0, sizeof(buckets));
+	oargs.mode = SCAP_MODE_LIVE;
+	oargs.proc_scan_timeout_ms = SCAP_PROC_SCAN_TIMEOUT_NONE;
+	oargs.proc_scan_log_interval_ms = SCAP_PROC_SCAN_LOG_NONE;
+
+	while((op = getopt(argc, argv, "w:d:b:")) != -1)
+	{
+		switch(op)
+		{
+		case 'w':
+			oargs.wakeup_watermark = atoi(optarg);
+			break;
+		case 'd':
+			duration_s = atoi(optarg);
+			break;
+		case 'b':
+			oargs.bpf_probe = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-w wakeup watermark bytes] [-d seconds] [-b bpf probe]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	h = scap_open(oargs, error, &res);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s (%d)\n", error, res);
+		return -1;
+	}
+
+	start_wall = ns_now_clock(CLOCK_MONOTONIC);
+	start_cpu = cpu_time_ns();
+	end = start_wall + duration_s * (uint64_t) 1000000000;
+
+	while(ns_now_clock(CLOCK_MONOTONIC) < end)
+	{
+		scap_evt* ev;
+		uint16_t cpuid;
+		uint64_t lat;
+
+		res = scap_next(h, &ev, &cpuid);
+
+		if(res == SCAP_TIMEOUT)
+		{
+			ntimeouts++;
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_getlasterr(h));
+			scap_close(h);
+			return -1;
+		}
+
+		//
+		// Event timestamps are wall clock based
+		//
+		lat = ns_now_clock(CLOCK_REALTIME);
+		lat = lat > ev->ts ? lat - ev->ts : 0;
+		lat_sum += lat;
+		lat_max = lat > lat_max ? lat : lat_max;
+		buckets[log2_bucket(lat)]++;
+		nevts++;
+	}
+
+	wall = ns_now_clock(CLOCK_MONOTONIC) - start_wall;
+	cpu = cpu_time_ns() - start_cpu;
+
+	printf("watermark: %u\n", oargs.wakeup_watermark);
+	printf("events: %" PRIu64 " (%.0f evt/s)\n", nevts, (double) nevts * 1000000000 / wall);
+	printf("timeouts: %" PRIu64 "\n", ntimeouts);
+	printf("cpu: %.2f%%\n", (double) cpu * 100 / wall);
+	if(nevts != 0)
+	{
+		printf("latency avg: %" PRIu64 " us, p50 < %" PRIu64 " us, p99 < %" PRIu64 " us, max: %" PRIu64 " us\n",
+		       lat_sum / nevts / 1000,
+		       percentile(buckets, nevts, 0.5) / 1000,
+		       percentile(buckets, nevts, 0.99) / 1000,
+		       lat_max / 1000);
+	}
+
+	scap_close(h);
+	return 0;
+}
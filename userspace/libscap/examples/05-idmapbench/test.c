@@ -0,0 +1,390 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Compares the pid/vtid maps with the uthash implementation they replaced,
+// on a put/get/delete pattern similar to container thread churn. Then
+// checks that a reader thread using get_pid_vtid_map() never sees a wrong
+// value while the main thread keeps inserting and deleting.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <scap.h>
+#include "scap-int.h"
+#include "../bench_util.h"
+
+static uint32_t g_nthreads = 100000;
+static uint32_t g_rounds = 20;
+static uint32_t g_check_secs = 2;
+
+//
+// The thread tid lives in process (tid / 8) * 8 with namespace tid
+// tid % 100000 + 1, so that vtids repeat across processes like they do
+// across containers
+//
+static uint64_t tid_of(uint32_t j)
+{
+	return 1000 + j;
+}
+
+static uint64_t pid_of(uint64_t tid)
+{
+	return tid & ~7ULL;
+}
+
+static uint64_t vtid_of(uint64_t tid)
+{
+	return tid % 100000 + 1;
+}
+
+//
+// The uthash maps, as they were implemented in scap.c
+//
+typedef struct pid_vtid_info
+{
+	uint64_t pid_vtid;
+	uint64_t tid;
+	UT_hash_handle hh;
+}pid_vtid_info;
+
+typedef struct tid_vtid_info
+{
+	uint64_t tid;
+	uint64_t vtid;
+	UT_hash_handle hh;
+}tid_vtid_info;
+
+typedef struct uthash_maps
+{
+	pid_vtid_info* m_pid_vtid_info;
+	tid_vtid_info* m_tid_vtid_info;
+}uthash_maps;
+
+static void uthash_put(uthash_maps* m, uint64_t pid, uint64_t tid, uint64_t vtid)
+{
+	uint64_t pid_vtid = pid << 32 | (vtid & 0xFFFFFFFF);
+	int32_t uth_status = SCAP_SUCCESS;
+	pid_vtid_info* pvi;
+	tid_vtid_info* tvi;
+
+	HASH_FIND_INT64(m->m_pid_vtid_info, &pid_vtid, pvi);
+	if(pvi == NULL)
+	{
+		pvi = (pid_vtid_info*)malloc(sizeof(pid_vtid_info));
+		pvi->pid_vtid = pid_vtid;
+		pvi->tid = tid;
+		HASH_ADD_INT64(m->m_pid_vtid_info, pid_vtid, pvi);
+	}
+	else
+	{
+		pvi->tid = tid;
+	}
+
+	HASH_FIND_INT64(m->m_tid_vtid_info, &tid, tvi);
+	if(tvi == NULL)
+	{
+		tvi = (tid_vtid_info*)malloc(sizeof(tid_vtid_info));
+		tvi->tid = tid;
+		tvi->vtid = vtid;
+		HASH_ADD_INT64(m->m_tid_vtid_info, tid, tvi);
+	}
+	else
+	{
+		tvi->vtid = vtid;
+	}
+}
+
+static uint64_t uthash_get(uthash_maps* m, uint64_t pid, uint64_t vtid)
+{
+	uint64_t pid_vtid = pid << 32 | (vtid & 0xFFFFFFFF);
+	pid_vtid_info* pvi;
+
+	HASH_FIND_INT64(m->m_pid_vtid_info, &pid_vtid, pvi);
+	return (pvi != NULL)? pvi->tid : 0;
+}
+
+static void uthash_delete(uthash_maps* m, uint64_t pid, uint64_t tid)
+{
+	tid_vtid_info* tvi;
+	pid_vtid_info* pvi;
+	uint64_t pid_vtid;
+
+	HASH_FIND_INT64(m->m_tid_vtid_info, &tid, tvi);
+	if(tvi == NULL)
+	{
+		return;
+	}
+
+	pid_vtid = pid << 32 | (tvi->vtid & 0xFFFFFFFF);
+	HASH_FIND_INT64(m->m_pid_vtid_info, &pid_vtid, pvi);
+	if(pvi != NULL)
+	{
+		HASH_DEL(m->m_pid_vtid_info, pvi);
+		free(pvi);
+	}
+
+	HASH_DEL(m->m_tid_vtid_info, tvi);
+	free(tvi);
+}
+
+static void print_result(const char* name, const char* op, uint64_t nops, uint64_t elapsed)
+{
+	printf("%-8s %-6s %u threads: %.1f ns/op\n", name, op, g_nthreads, (double) elapsed / nops);
+}
+
+static int run_uthash()
+{
+	uthash_maps m = {NULL, NULL};
+	uint64_t t_put = 0;
+	uint64_t t_get = 0;
+	uint64_t t_del = 0;
+	uint64_t start;
+	uint32_t r;
+	uint32_t j;
+
+	for(r = 0; r < g_rounds; r++)
+	{
+		start = ns_now();
+		for(j = 0; j < g_nthreads; j++)
+		{
+			uint64_t tid = tid_of(j);
+			uthash_put(&m, pid_of(tid), tid, vtid_of(tid));
+		}
+		t_put += ns_now() - start;
+
+		start = ns_now();
+		for(j = 0; j < g_nthreads; j++)
+		{
+			uint64_t tid = tid_of(j);
+			if(uthash_get(&m, pid_of(tid), vtid_of(tid)) != tid)
+			{
+				fprintf(stderr, "uthash: wrong value for tid %" PRIu64 "\n", tid);
+				return -1;
+			}
+		}
+		t_get += ns_now() - start;
+
+		start = ns_now();
+		for(j = 0; j < g_nthreads; j++)
+		{
+			uint64_t tid = tid_of(j);
+			uthash_delete(&m, pid_of(tid), tid);
+		}
+		t_del += ns_now() - start;
+	}
+
+	print_result("uthash", "put", (uint64_t) g_nthreads * g_rounds, t_put);
+	print_result("uthash", "get", (uint64_t) g_nthreads * g_rounds, t_get);
+	print_result("uthash", "delete", (uint64_t) g_nthreads * g_rounds, t_del);
+	return 0;
+}
+
+static int run_idmap()
+{
+	scap_t* h = (scap_t*) calloc(sizeof(scap_t), 1);
+	uint64_t t_put = 0;
+	uint64_t t_get = 0;
+	uint64_t t_del = 0;
+	uint64_t start;
+	uint32_t r;
+	uint32_t j;
+
+	for(r = 0; r < g_rounds; r++)
+	{
+		start = ns_now();
+		for(j = 0; j < g_nthreads; j++)
+		{
+			uint64_t tid = tid_of(j);
+			put_pid_vtid_map(h, pid_of(tid), tid, vtid_of(tid));
+		}
+		t_put += ns_now() - start;
+
+		start = ns_now();
+		for(j = 0; j < g_nthreads; j++)
+		{
+			uint64_t tid = tid_of(j);
+			if(get_pid_vtid_map(h, pid_of(tid), vtid_of(tid)) != tid)
+			{
+				fprintf(stderr, "idmap: wrong value for tid %" PRIu64 "\n", tid);
+				return -1;
+			}
+		}
+		t_get += ns_now() - start;
+
+		start = ns_now();
+		for(j = 0; j < g_nthreads; j++)
+		{
+			uint64_t tid = tid_of(j);
+			delete_pid_vtid_map(h, pid_of(tid), tid);
+		}
+		t_del += ns_now() - start;
+
+		for(j = 0; j < g_nthreads; j += 97)
+		{
+			uint64_t tid = tid_of(j);
+			if(get_pid_vtid_map(h, pid_of(tid), vtid_of(tid)) != 0 || get_tid_vtid_map(h, tid) != 0)
+			{
+				fprintf(stderr, "idmap: tid %" PRIu64 " still there after delete\n", tid);
+				return -1;
+			}
+		}
+	}
+
+	print_result("idmap", "put", (uint64_t) g_nthreads * g_rounds, t_put);
+	print_result("idmap", "get", (uint64_t) g_nthreads * g_rounds, t_get);
+	print_result("idmap", "delete", (uint64_t) g_nthreads * g_rounds, t_del);
+
+	scap_id_map_free(&h->m_pid_vtid_map);
+	scap_id_map_free(&h->m_tid_vtid_map);
+	free(h);
+	return 0;
+}
+
+//
+// The even threads stay in the map for the whole run, the odd ones are
+// added and removed continuously. A reader must always find the even ones
+// and must only ever find the right tid for the odd ones.
+//
+typedef struct check_state
+{
+	scap_t* m_h;
+	volatile int m_stop;
+	uint64_t m_nlookups;
+	int m_failed;
+}check_state;
+
+static void* check_reader(void* arg)
+{
+	check_state* cs = (check_state*) arg;
+	uint32_t j = 0;
+
+	while(!cs->m_stop)
+	{
+		uint64_t tid = tid_of(j);
+		uint64_t res = get_pid_vtid_map(cs->m_h, pid_of(tid), vtid_of(tid));
+
+		if(res != tid && (res != 0 || (j & 1) == 0))
+		{
+			fprintf(stderr, "check: got %" PRIu64 " for tid %" PRIu64 "\n", res, tid);
+			cs->m_failed = 1;
+			break;
+		}
+
+		cs->m_nlookups++;
+		j = (j + 1) % g_nthreads;
+	}
+
+	return NULL;
+}
+
+static int run_check()
+{
+	check_state cs;
+	pthread_t reader;
+	uint64_t start;
+	uint64_t nupdates = 0;
+	uint32_t j;
+
+	memset(&cs, 0, sizeof(cs));
+	cs.m_h = (scap_t*) calloc(sizeof(scap_t), 1);
+
+	for(j = 0; j < g_nthreads; j += 2)
+	{
+		uint64_t tid = tid_of(j);
+		put_pid_vtid_map(cs.m_h, pid_of(tid), tid, vtid_of(tid));
+	}
+
+	if(pthread_create(&reader, NULL, check_reader, &cs) != 0)
+	{
+		fprintf(stderr, "check: can't start the reader thread\n");
+		return -1;
+	}
+
+	start = ns_now();
+	while(!cs.m_failed && ns_now() - start < (uint64_t) g_check_secs * 1000000000)
+	{
+		for(j = 1; j < g_nthreads; j += 2)
+		{
+			uint64_t tid = tid_of(j);
+			put_pid_vtid_map(cs.m_h, pid_of(tid), tid, vtid_of(tid));
+		}
+
+		for(j = 1; j < g_nthreads; j += 2)
+		{
+			uint64_t tid = tid_of(j);
+			delete_pid_vtid_map(cs.m_h, pid_of(tid), tid);
+		}
+
+		nupdates += g_nthreads;
+	}
+
+	cs.m_stop = 1;
+	pthread_join(reader, NULL);
+
+	printf("check    %" PRIu64 " lookups during %" PRIu64 " updates: %s\n",
+	       cs.m_nlookups, nupdates, cs.m_failed? "FAILED" : "ok");
+
+	scap_id_map_free(&cs.m_h->m_pid_vtid_map);
+	scap_id_map_free(&cs.m_h->m_tid_vtid_map);
+	free(cs.m_h);
+	return cs.m_failed? -1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+	int op;
+
+	while((op = getopt(argc, argv, "n:r:s:")) != -1)
+	{
+		switch(op)
+		{
+		case 'n':
+			g_nthreads = atoi(optarg);
+			break;
+		case 'r':
+			g_rounds = atoi(optarg);
+			break;
+		case 's':
+			g_check_secs = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n threads] [-r rounds] [-s check seconds]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if(g_nthreads == 0 || g_nthreads > 100000)
+	{
+		fprintf(stderr, "invalid parameters\n");
+		return -1;
+	}
+
+	if(run_uthash() != 0 ||
+	   run_idmap() != 0 ||
+	   run_check() != 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,191 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Stresses the probe's per-thread state maps: runs a live capture while
+// a few spawner threads keep creating short-lived threads that make a
+// handful of syscalls and exit, far more of them than the maps can hold.
+// Reports the thread churn rate, the events and drops, and how many
+// insertions into the state maps failed. With the LRU maps the failures
+// should stay at 0 however long it runs.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <scap.h>
+#include "../bench_util.h"
+
+static volatile int g_stop = 0;
+static uint64_t g_nthreads[64];
+
+static void* short_lived(void* arg)
+{
+	char buf[16];
+	int fd;
+
+	//
+	// A disk and a lock syscall, so that the thread goes through the
+	// type and focus maps too
+	//
+	fd = open("/dev/null", O_RDONLY);
+	if(fd >= 0)
+	{
+		if(read(fd, buf, sizeof(buf)) < 0)
+		{
+			buf[0] = 0;
+		}
+		close(fd);
+	}
+	usleep(0);
+
+	return NULL;
+}
+
+static void* spawner(void* arg)
+{
+	uint64_t* nthreads = (uint64_t*) arg;
+
+	while(!g_stop)
+	{
+		pthread_t t;
+
+		if(pthread_create(&t, NULL, short_lived, NULL) != 0)
+		{
+			continue;
+		}
+
+		pthread_join(t, NULL);
+		(*nthreads)++;
+	}
+
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	char error[SCAP_LASTERR_SIZE];
+	scap_open_args oargs;
+	pthread_t spawners[64];
+	uint32_t nspawners = 4;
+	uint32_t duration_s = 10;
+	uint64_t nevts = 0;
+	uint64_t nthreads = 0;
+	uint64_t start;
+	uint64_t end;
+	uint64_t elapsed;
+	scap_stats stats;
+	int32_t res;
+	uint32_t j;
+	int op;
+	scap_t* h;
+
+	memset(&oargs, 0, sizeof(oargs));
+	oargs.mode = SCAP_MODE_LIVE;
+	oargs.proc_scan_timeout_ms = SCAP_PROC_SCAN_TIMEOUT_NONE;
+	oargs.proc_scan_log_interval_ms = SCAP_PROC_SCAN_LOG_NONE;
+
+	while((op = getopt(argc, argv, "t:d:b:")) != -1)
+	{
+		switch(op)
+		{
+		case 't':
+			nspawners = atoi(optarg);
+			break;
+		case 'd':
+			duration_s = atoi(optarg);
+			break;
+		case 'b':
+			oargs.bpf_probe = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t spawner threads] [-d seconds] [-b bpf probe]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	if(nspawners == 0 || nspawners > sizeof(spawners) / sizeof(spawners[0]))
+	{
+		fprintf(stderr, "the number of spawner threads must be between 1 and %zu\n", sizeof(spawners) / sizeof(spawners[0]));
+		return -1;
+	}
+
+	h = scap_open(oargs, error, &res);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s (%d)\n", error, res);
+		return -1;
+	}
+
+	for(j = 0; j < nspawners; j++)
+	{
+		pthread_create(&spawners[j], NULL, spawner, &g_nthreads[j]);
+	}
+
+	start = ns_now();
+	end = start + duration_s * (uint64_t) 1000000000;
+
+	while(ns_now() < end)
+	{
+		scap_evt* ev;
+		uint16_t cpuid;
+
+		res = scap_next(h, &ev, &cpuid);
+
+		if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_getlasterr(h));
+			break;
+		}
+
+		nevts++;
+	}
+
+	g_stop = 1;
+	for(j = 0; j < nspawners; j++)
+	{
+		pthread_join(spawners[j], NULL);
+		nthreads += g_nthreads[j];
+	}
+
+	elapsed = ns_now() - start;
+
+	if(scap_get_stats(h, &stats) != SCAP_SUCCESS)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		scap_close(h);
+		return -1;
+	}
+
+	printf("threads: %" PRIu64 " (%.0f threads/s)\n", nthreads, (double) nthreads * 1000000000 / elapsed);
+	printf("events: %" PRIu64 " (%.0f evt/s), seen by driver: %" PRIu64 "\n", nevts, (double) nevts * 1000000000 / elapsed, stats.n_evts);
+	printf("drops: %" PRIu64 " (buffer: %" PRIu64 ", pf: %" PRIu64 ", bug: %" PRIu64 ")\n",
+	       stats.n_drops, stats.n_drops_buffer, stats.n_drops_pf, stats.n_drops_bug);
+	printf("state map insert failures: %" PRIu64 ", evictions: %" PRIu64 "\n", stats.n_map_insert_failures, stats.n_map_evictions);
+
+	scap_close(h);
+	return 0;
+}
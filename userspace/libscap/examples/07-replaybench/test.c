@@ -0,0 +1,200 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Replays an uncompressed capture file through scap_next(), once reading the
+// events in place from the memory mapping and once through zlib, and
+// reports the events/sec of both. With -w, the capture given with -r is
+// first rewritten uncompressed, so that gzipped captures can be used too.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <scap.h>
+#include "../bench_util.h"
+
+static int write_uncompressed(const char* src, const char* dst)
+{
+	char error[SCAP_LASTERR_SIZE];
+	scap_dumper_t* d;
+	scap_evt* e;
+	uint16_t cpuid;
+	int32_t res;
+
+	scap_t* h = scap_open_offline(src, error, &res);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s (%d)\n", error, res);
+		return -1;
+	}
+
+	d = scap_dump_open(h, dst, SCAP_COMPRESSION_NONE, true);
+	if(d == NULL)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		scap_close(h);
+		return -1;
+	}
+
+	while((res = scap_next(h, &e, &cpuid)) == SCAP_SUCCESS)
+	{
+		if(scap_dump(h, d, e, cpuid, scap_event_get_dump_flags(h)) != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_dump_getlasterr(d));
+			res = SCAP_FAILURE;
+			break;
+		}
+	}
+
+	scap_dump_close(d);
+	scap_close(h);
+	return res == SCAP_EOF? 0 : -1;
+}
+
+//
+// Returns the number of events read, and a checksum of their timestamps and
+// lengths so that the two paths can be compared
+//
+static int replay(const char* name, const char* fname, bool mapped, uint64_t* nevts, uint64_t* sum)
+{
+	char error[SCAP_LASTERR_SIZE];
+	uint64_t nbytes = 0;
+	uint64_t start;
+	uint64_t ns;
+	scap_evt* e;
+	uint16_t cpuid;
+	int32_t res;
+
+	scap_t* h = scap_open_offline(fname, error, &res);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s (%d)\n", error, res);
+		return -1;
+	}
+
+	if(!mapped)
+	{
+		scap_disable_file_map(h);
+	}
+
+	*nevts = 0;
+	*sum = 0;
+	start = ns_now();
+
+	while((res = scap_next(h, &e, &cpuid)) == SCAP_SUCCESS)
+	{
+		(*nevts)++;
+		*sum += e->ts + e->len;
+		nbytes += e->len;
+	}
+
+	ns = ns_now() - start;
+	scap_close(h);
+
+	if(res != SCAP_EOF)
+	{
+		fprintf(stderr, "%s: replay failed (%d)\n", name, res);
+		return -1;
+	}
+
+	printf("%-8s %" PRIu64 " events: %.2f M events/sec, %.1f ns/event, %.1f MB/s\n",
+	       name, *nevts,
+	       ns? *nevts * 1000.0 / ns : 0,
+	       *nevts? (double)ns / *nevts : 0,
+	       ns? nbytes * 1000.0 / ns : 0);
+	return 0;
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s -r capture file [-w uncompressed copy] [-n rounds]\n", prog);
+}
+
+int main(int argc, char** argv)
+{
+	const char* src = NULL;
+	const char* dst = NULL;
+	uint32_t rounds = 3;
+	uint32_t j;
+	int op;
+
+	while((op = getopt(argc, argv, "r:w:n:h")) != -1)
+	{
+		switch(op)
+		{
+		case 'r':
+			src = optarg;
+			break;
+		case 'w':
+			dst = optarg;
+			break;
+		case 'n':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if(src == NULL)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	if(dst != NULL)
+	{
+		if(write_uncompressed(src, dst) != 0)
+		{
+			return -1;
+		}
+
+		src = dst;
+	}
+
+	//
+	// Alternate the two, so that both get a warm page cache
+	//
+	for(j = 0; j < rounds; j++)
+	{
+		uint64_t mapped_nevts;
+		uint64_t mapped_sum;
+		uint64_t gz_nevts;
+		uint64_t gz_sum;
+
+		if(replay("mmap", src, true, &mapped_nevts, &mapped_sum) != 0 ||
+		   replay("gzread", src, false, &gz_nevts, &gz_sum) != 0)
+		{
+			return -1;
+		}
+
+		if(mapped_nevts != gz_nevts || mapped_sum != gz_sum)
+		{
+			fprintf(stderr, "mismatch: %" PRIu64 " events mapped, %" PRIu64 " through zlib\n",
+				mapped_nevts, gz_nevts);
+			return -1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,310 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Rewrites a capture file gzipped and chunked, then replays the gzipped
+// copy, the chunked one with parallel decompression, and the chunked one
+// decompressed inline, and reports the events/sec of each. Then times
+// seeking to random timestamps in the chunked copy with scap_fseek_ts(),
+// against reading the gzipped one up to them.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <scap.h>
+#include "../bench_util.h"
+
+static int write_copy(const char* src, const char* dst, compression_mode compress)
+{
+	char error[SCAP_LASTERR_SIZE];
+	scap_dumper_t* d;
+	scap_evt* e;
+	uint16_t cpuid;
+	int32_t res;
+
+	scap_t* h = scap_open_offline(src, error, &res);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s (%d)\n", error, res);
+		return -1;
+	}
+
+	d = scap_dump_open(h, dst, compress, true);
+	if(d == NULL)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		scap_close(h);
+		return -1;
+	}
+
+	while((res = scap_next(h, &e, &cpuid)) == SCAP_SUCCESS)
+	{
+		if(scap_dump(h, d, e, cpuid, scap_event_get_dump_flags(h)) != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_dump_getlasterr(d));
+			res = SCAP_FAILURE;
+			break;
+		}
+	}
+
+	scap_dump_close(d);
+	scap_close(h);
+	return res == SCAP_EOF? 0 : -1;
+}
+
+typedef struct replay_res
+{
+	uint64_t nevts;
+	// Of the timestamps and lengths of the events, to compare the copies
+	uint64_t sum;
+	uint64_t min_ts;
+	uint64_t max_ts;
+}replay_res;
+
+static int replay(const char* name, const char* fname, bool mapped, replay_res* rr)
+{
+	char error[SCAP_LASTERR_SIZE];
+	struct stat st;
+	uint64_t start;
+	uint64_t ns;
+	scap_evt* e;
+	uint16_t cpuid;
+	int32_t res;
+
+	scap_t* h = scap_open_offline(fname, error, &res);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s (%d)\n", error, res);
+		return -1;
+	}
+
+	if(!mapped)
+	{
+		scap_disable_file_map(h);
+	}
+
+	memset(rr, 0, sizeof(*rr));
+	rr->min_ts = UINT64_MAX;
+	start = ns_now();
+
+	while((res = scap_next(h, &e, &cpuid)) == SCAP_SUCCESS)
+	{
+		rr->nevts++;
+		rr->sum += e->ts + e->len;
+		rr->min_ts = e->ts < rr->min_ts? e->ts : rr->min_ts;
+		rr->max_ts = e->ts > rr->max_ts? e->ts : rr->max_ts;
+	}
+
+	ns = ns_now() - start;
+
+	if(res != SCAP_EOF)
+	{
+		fprintf(stderr, "%s: replay failed: %s\n", name, scap_getlasterr(h));
+		scap_close(h);
+		return -1;
+	}
+
+	scap_close(h);
+
+	printf("%-16s %" PRIu64 " events, %.1f MB: %.2f M events/sec, %.1f ns/event\n",
+	       name, rr->nevts,
+	       stat(fname, &st) == 0? st.st_size / 1048576.0 : 0,
+	       ns? rr->nevts * 1000.0 / ns : 0,
+	       rr->nevts? (double)ns / rr->nevts : 0);
+	return 0;
+}
+
+//
+// Time reaching the first event at or after each of the timestamps, with
+// scap_fseek_ts() if seek is set, reading from the start otherwise
+//
+static int seek(const char* name, const char* fname, bool use_seek, const uint64_t* tss, uint32_t nseeks)
+{
+	char error[SCAP_LASTERR_SIZE];
+	uint64_t ns = 0;
+	uint64_t start;
+	scap_evt* e;
+	uint16_t cpuid;
+	int32_t res;
+	uint32_t j;
+
+	scap_t* h = scap_open_offline(fname, error, &res);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s (%d)\n", error, res);
+		return -1;
+	}
+
+	for(j = 0; j < nseeks; j++)
+	{
+		start = ns_now();
+
+		if(use_seek)
+		{
+			if(scap_fseek_ts(h, tss[j]) != SCAP_SUCCESS)
+			{
+				fprintf(stderr, "%s: %s\n", name, scap_getlasterr(h));
+				scap_close(h);
+				return -1;
+			}
+
+			res = scap_next(h, &e, &cpuid);
+		}
+		else
+		{
+			scap_close(h);
+			h = scap_open_offline(fname, error, &res);
+			if(h == NULL)
+			{
+				fprintf(stderr, "%s (%d)\n", error, res);
+				return -1;
+			}
+
+			while((res = scap_next(h, &e, &cpuid)) == SCAP_SUCCESS && e->ts < tss[j])
+			{
+			}
+		}
+
+		ns += ns_now() - start;
+
+		if(res != SCAP_SUCCESS || e->ts < tss[j])
+		{
+			fprintf(stderr, "%s: no event at or after %" PRIu64 "\n", name, tss[j]);
+			scap_close(h);
+			return -1;
+		}
+	}
+
+	scap_close(h);
+
+	printf("%-16s %u seeks: %.3f ms/seek\n", name, nseeks, nseeks? ns / 1000000.0 / nseeks : 0);
+	return 0;
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s -r capture file [-w output prefix] [-n rounds] [-s seeks]\n", prog);
+}
+
+int main(int argc, char** argv)
+{
+	const char* src = NULL;
+	const char* prefix = "chunkbench";
+	char gz_fname[4096];
+	char chunked_fname[4096];
+	uint32_t rounds = 3;
+	uint32_t nseeks = 100;
+	uint64_t* tss;
+	uint32_t j;
+	int op;
+
+	while((op = getopt(argc, argv, "r:w:n:s:h")) != -1)
+	{
+		switch(op)
+		{
+		case 'r':
+			src = optarg;
+			break;
+		case 'w':
+			prefix = optarg;
+			break;
+		case 'n':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			nseeks = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if(src == NULL)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	snprintf(gz_fname, sizeof(gz_fname), "%s.gz.scap", prefix);
+	snprintf(chunked_fname, sizeof(chunked_fname), "%s.chunked.scap", prefix);
+
+	if(write_copy(src, gz_fname, SCAP_COMPRESSION_GZIP) != 0 ||
+	   write_copy(src, chunked_fname, SCAP_COMPRESSION_CHUNKED) != 0)
+	{
+		return -1;
+	}
+
+	replay_res gz_rr;
+
+	for(j = 0; j < rounds; j++)
+	{
+		replay_res parallel_rr;
+		replay_res inline_rr;
+
+		if(replay("gzip", gz_fname, true, &gz_rr) != 0 ||
+		   replay("chunked", chunked_fname, true, &parallel_rr) != 0 ||
+		   replay("chunked inline", chunked_fname, false, &inline_rr) != 0)
+		{
+			return -1;
+		}
+
+		if(parallel_rr.nevts != gz_rr.nevts || parallel_rr.sum != gz_rr.sum ||
+		   inline_rr.nevts != gz_rr.nevts || inline_rr.sum != gz_rr.sum)
+		{
+			fprintf(stderr, "mismatch: %" PRIu64 " events gzipped, %" PRIu64 " chunked, %" PRIu64 " chunked inline\n",
+				gz_rr.nevts, parallel_rr.nevts, inline_rr.nevts);
+			return -1;
+		}
+	}
+
+	if(gz_rr.nevts == 0)
+	{
+		return 0;
+	}
+
+	tss = (uint64_t*)malloc(nseeks * sizeof(uint64_t));
+	if(tss == NULL)
+	{
+		return -1;
+	}
+
+	srand(1);
+	for(j = 0; j < nseeks; j++)
+	{
+		tss[j] = gz_rr.min_ts + (uint64_t)((double)rand() / RAND_MAX * (gz_rr.max_ts - gz_rr.min_ts));
+	}
+
+	//
+	// Reading up to the timestamp is slow, a few are enough
+	//
+	if(seek("chunked seek", chunked_fname, true, tss, nseeks) != 0 ||
+	   seek("gzip scan", gz_fname, false, tss, nseeks < 5? nseeks : 5) != 0)
+	{
+		free(tss);
+		return -1;
+	}
+
+	free(tss);
+	return 0;
+}
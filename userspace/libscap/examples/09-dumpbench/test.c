@@ -0,0 +1,263 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Loads the events of a capture file in memory, then writes them to a new
+// file with scap_dump(), once synchronously and once with
+// scap_dump_enable_async(). Reports how long the scap_dump() calls take,
+// which is what the capture thread pays, and the total with the final
+// close. Both copies are read back and compared.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <scap.h>
+#include "../bench_util.h"
+
+typedef struct loaded_evt
+{
+	scap_evt* m_evt;
+	uint16_t m_cpuid;
+	uint32_t m_flags;
+}loaded_evt;
+
+static loaded_evt* load(scap_t* h, uint64_t* nevts)
+{
+	loaded_evt* evts = NULL;
+	uint64_t size = 0;
+	scap_evt* e;
+	uint16_t cpuid;
+	int32_t res;
+
+	*nevts = 0;
+
+	while((res = scap_next(h, &e, &cpuid)) == SCAP_SUCCESS)
+	{
+		if(*nevts == size)
+		{
+			size = size? size * 2 : 65536;
+			evts = (loaded_evt*)realloc(evts, size * sizeof(loaded_evt));
+			if(evts == NULL)
+			{
+				return NULL;
+			}
+		}
+
+		evts[*nevts].m_evt = (scap_evt*)malloc(e->len);
+		if(evts[*nevts].m_evt == NULL)
+		{
+			return NULL;
+		}
+
+		memcpy(evts[*nevts].m_evt, e, e->len);
+		evts[*nevts].m_cpuid = cpuid;
+		evts[*nevts].m_flags = scap_event_get_dump_flags(h);
+		(*nevts)++;
+	}
+
+	if(res != SCAP_EOF)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		return NULL;
+	}
+
+	return evts;
+}
+
+static int dump(const char* name, scap_t* h, const char* fname, compression_mode compress, bool async,
+		const loaded_evt* evts, uint64_t nevts)
+{
+	scap_dumper_t* d;
+	uint64_t start;
+	uint64_t dump_ns;
+	uint64_t total_ns;
+	uint64_t j;
+
+	d = scap_dump_open(h, fname, compress, true);
+	if(d == NULL)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		return -1;
+	}
+
+	if(async && scap_dump_enable_async(d, 0) != SCAP_SUCCESS)
+	{
+		fprintf(stderr, "%s: can't make the dump asynchronous\n", name);
+		scap_dump_close(d);
+		return -1;
+	}
+
+	start = ns_now();
+
+	for(j = 0; j < nevts; j++)
+	{
+		if(scap_dump(h, d, evts[j].m_evt, evts[j].m_cpuid, evts[j].m_flags) != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s: %s\n", name, scap_dump_getlasterr(d));
+			scap_dump_close(d);
+			return -1;
+		}
+	}
+
+	dump_ns = ns_now() - start;
+	scap_dump_close(d);
+	total_ns = ns_now() - start;
+
+	printf("%-12s %" PRIu64 " events: scap_dump %.1f ns/event (%.2f M events/sec), %.1f ns/event with close\n",
+	       name, nevts,
+	       nevts? (double)dump_ns / nevts : 0,
+	       dump_ns? nevts * 1000.0 / dump_ns : 0,
+	       nevts? (double)total_ns / nevts : 0);
+	return 0;
+}
+
+static int checksum(const char* fname, uint64_t* nevts, uint64_t* sum)
+{
+	char error[SCAP_LASTERR_SIZE];
+	scap_evt* e;
+	uint16_t cpuid;
+	int32_t res;
+
+	scap_t* h = scap_open_offline(fname, error, &res);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s (%d)\n", error, res);
+		return -1;
+	}
+
+	*nevts = 0;
+	*sum = 0;
+
+	while((res = scap_next(h, &e, &cpuid)) == SCAP_SUCCESS)
+	{
+		(*nevts)++;
+		*sum += e->ts + e->len + cpuid;
+	}
+
+	scap_close(h);
+	return res == SCAP_EOF? 0 : -1;
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s -r capture file [-w output prefix] [-n rounds] [-z]\n", prog);
+}
+
+int main(int argc, char** argv)
+{
+	const char* src = NULL;
+	const char* prefix = "dumpbench";
+	char sync_fname[4096];
+	char async_fname[4096];
+	char error[SCAP_LASTERR_SIZE];
+	compression_mode compress = SCAP_COMPRESSION_NONE;
+	uint32_t rounds = 3;
+	loaded_evt* evts;
+	uint64_t nevts;
+	uint32_t j;
+	int32_t res;
+	int op;
+
+	while((op = getopt(argc, argv, "r:w:n:zh")) != -1)
+	{
+		switch(op)
+		{
+		case 'r':
+			src = optarg;
+			break;
+		case 'w':
+			prefix = optarg;
+			break;
+		case 'n':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		case 'z':
+			compress = SCAP_COMPRESSION_GZIP;
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if(src == NULL)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	snprintf(sync_fname, sizeof(sync_fname), "%s.sync.scap", prefix);
+	snprintf(async_fname, sizeof(async_fname), "%s.async.scap", prefix);
+
+	scap_t* h = scap_open_offline(src, error, &res);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s (%d)\n", error, res);
+		return -1;
+	}
+
+	evts = load(h, &nevts);
+	if(evts == NULL)
+	{
+		scap_close(h);
+		return -1;
+	}
+
+	for(j = 0; j < rounds; j++)
+	{
+		uint64_t sync_nevts;
+		uint64_t sync_sum;
+		uint64_t async_nevts;
+		uint64_t async_sum;
+
+		if(dump("sync", h, sync_fname, compress, false, evts, nevts) != 0 ||
+		   dump("async", h, async_fname, compress, true, evts, nevts) != 0)
+		{
+			scap_close(h);
+			return -1;
+		}
+
+		if(checksum(sync_fname, &sync_nevts, &sync_sum) != 0 ||
+		   checksum(async_fname, &async_nevts, &async_sum) != 0)
+		{
+			scap_close(h);
+			return -1;
+		}
+
+		if(sync_nevts != nevts || async_nevts != nevts || sync_sum != async_sum)
+		{
+			fprintf(stderr, "mismatch: %" PRIu64 " events loaded, %" PRIu64 " read back from the sync copy, %" PRIu64 " from the async one\n",
+				nevts, sync_nevts, async_nevts);
+			scap_close(h);
+			return -1;
+		}
+	}
+
+	scap_close(h);
+
+	for(j = 0; j < nevts; j++)
+	{
+		free(evts[j].m_evt);
+	}
+	free(evts);
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Opens a capture a few times for each of a list of proc_scan_threads
+// values and reports how long scap_open() takes, which is mostly the
+// initial /proc scan, and how many threads and fds it found. Nodriver mode
+// by default, which reads the processes and their sockets but neither their
+// tasks nor their other fds; -l opens a live capture and scans everything.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <scap.h>
+#include "../bench_util.h"
+
+#define MAX_THREAD_COUNTS 16
+
+static void count(scap_t* h, uint64_t* nthreads, uint64_t* nfds)
+{
+	scap_threadinfo* tinfo;
+
+	*nthreads = 0;
+	*nfds = 0;
+
+	for(tinfo = scap_get_proc_table(h); tinfo != NULL; tinfo = tinfo->hh.next)
+	{
+		(*nthreads)++;
+		*nfds += HASH_COUNT(tinfo->fdlist);
+	}
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [-t thread counts, e.g. 1,2,4,8] [-n rounds] [-l] [-b bpf probe]\n", prog);
+}
+
+int main(int argc, char** argv)
+{
+	char error[SCAP_LASTERR_SIZE];
+	scap_open_args oargs;
+	uint32_t thread_counts[MAX_THREAD_COUNTS] = {1, 2, 4, 8};
+	uint32_t nthread_counts = 4;
+	uint32_t rounds = 5;
+	int32_t res;
+	int op;
+	uint32_t j;
+	uint32_t k;
+	char* tok;
+
+	memset(&oargs, 0, sizeof(oargs));
+	oargs.mode = SCAP_MODE_NODRIVER;
+	oargs.import_users = false;
+	oargs.proc_scan_timeout_ms = SCAP_PROC_SCAN_TIMEOUT_NONE;
+	oargs.proc_scan_log_interval_ms = SCAP_PROC_SCAN_LOG_NONE;
+
+	while((op = getopt(argc, argv, "t:n:lb:h")) != -1)
+	{
+		switch(op)
+		{
+		case 't':
+			nthread_counts = 0;
+			for(tok = strtok(optarg, ","); tok != NULL && nthread_counts < MAX_THREAD_COUNTS; tok = strtok(NULL, ","))
+			{
+				thread_counts[nthread_counts++] = atoi(tok);
+			}
+			break;
+		case 'n':
+			rounds = atoi(optarg);
+			break;
+		case 'l':
+			oargs.mode = SCAP_MODE_LIVE;
+			break;
+		case 'b':
+			oargs.mode = SCAP_MODE_LIVE;
+			oargs.bpf_probe = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if(nthread_counts == 0 || rounds == 0)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	printf("%-8s %12s %12s %12s %12s\n", "threads", "threads", "fds", "avg ms", "min ms");
+
+	for(j = 0; j < nthread_counts; j++)
+	{
+		uint64_t sum = 0;
+		uint64_t min = UINT64_MAX;
+		uint64_t nthreads = 0;
+		uint64_t nfds = 0;
+
+		oargs.proc_scan_threads = thread_counts[j];
+
+		for(k = 0; k < rounds; k++)
+		{
+			uint64_t start = ns_now();
+			uint64_t ns;
+			scap_t* h;
+
+			h = scap_open(oargs, error, &res);
+			ns = ns_now() - start;
+			if(h == NULL)
+			{
+				fprintf(stderr, "%s (%d)\n", error, res);
+				return -1;
+			}
+
+			count(h, &nthreads, &nfds);
+			scap_close(h);
+
+			sum += ns;
+			if(ns < min)
+			{
+				min = ns;
+			}
+		}
+
+		printf("%-8u %12" PRIu64 " %12" PRIu64 " %12.2f %12.2f\n",
+		       thread_counts[j], nthreads, nfds,
+		       (double)sum / rounds / 1000000, (double)min / 1000000);
+	}
+
+	return 0;
+}
@@ -0,0 +1,484 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Builds a synthetic /proc, with a given number of processes and sockets,
+// in a temporary directory and points the host root at it. Then reports
+// how long a nodriver scap_open() takes to scan it, and how long reading
+// the /proc/net socket tables alone takes, after checking that the values
+// read back are the ones that were written.
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <ftw.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <scap.h>
+#include "scap-int.h"
+#include "../bench_util.h"
+
+#define FIRST_PID 1000
+#define FIRST_TCP_INO 100000
+#define FIRST_TCP6_INO 300000
+#define FIRST_UNIX_INO 500000
+#define FIRST_NETLINK_INO 700000
+
+static char g_root[SCAP_MAX_PATH_SIZE];
+
+static FILE* open_file(const char* dir, const char* name)
+{
+	char path[SCAP_MAX_PATH_SIZE];
+	FILE* f;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	f = fopen(path, "w");
+	if(f == NULL)
+	{
+		perror(path);
+		exit(1);
+	}
+	return f;
+}
+
+static void make_link(const char* target, const char* dir, const char* name)
+{
+	char path[SCAP_MAX_PATH_SIZE];
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	if(symlink(target, path) != 0)
+	{
+		perror(path);
+		exit(1);
+	}
+}
+
+static void make_dir(const char* path)
+{
+	if(mkdir(path, 0755) != 0)
+	{
+		perror(path);
+		exit(1);
+	}
+}
+
+//
+// The connected sockets have even indexes, the listening ones odd ones
+//
+static uint16_t tcp_port(uint32_t j)
+{
+	return 1024 + j % 60000;
+}
+
+static void write_net(const char* netdir, uint32_t nsockets)
+{
+	FILE* f;
+	uint32_t j;
+
+	f = open_file(netdir, "tcp");
+	fprintf(f, "  sl  local_address rem_address   st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode\n");
+	for(j = 0; j < nsockets; j++)
+	{
+		fprintf(f, "%4u: 0100007F:%04X %s %s:00000000 00:00000000 00000000  1000        0 %u 1 0000000096c4b7ac 100 0 0 10 0\n",
+			j, tcp_port(j),
+			(j % 2)? "00000000:0000" : "0A000001:0050",
+			(j % 2)? "0A 00000000" : "01 00000000",
+			FIRST_TCP_INO + j);
+	}
+	fclose(f);
+
+	f = open_file(netdir, "tcp6");
+	fprintf(f, "  sl  local_address                         remote_address                        st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode\n");
+	for(j = 0; j < nsockets / 4; j++)
+	{
+		fprintf(f, "%4u: 00000000000000000000000001000000:%04X 00000000000000000000000000000000:0000 0A 00000000:00000000 00:00000000 00000000     0        0 %u 1 0000000000000000 100 0 0 10 0\n",
+			j, tcp_port(j), FIRST_TCP6_INO + j);
+	}
+	fclose(f);
+
+	f = open_file(netdir, "unix");
+	fprintf(f, "Num       RefCount Protocol Flags    Type St Inode Path\n");
+	for(j = 0; j < nsockets; j++)
+	{
+		fprintf(f, "%016x: 00000003 00000000 00000000 0001 03 %u /run/bench/%u.sock\n",
+			j + 1, FIRST_UNIX_INO + j, j);
+	}
+	fclose(f);
+
+	f = open_file(netdir, "netlink");
+	fprintf(f, "sk               Eth Pid        Groups   Rmem     Wmem     Dump  Locks    Drops    Inode\n");
+	for(j = 0; j < nsockets / 10; j++)
+	{
+		fprintf(f, "%016x 0   %-10u 00000000 0        0        0     2        0        %u\n",
+			j + 1, j, FIRST_NETLINK_INO + j);
+	}
+	fclose(f);
+
+	fclose(open_file(netdir, "udp"));
+	fclose(open_file(netdir, "raw"));
+	fclose(open_file(netdir, "udp6"));
+	fclose(open_file(netdir, "raw6"));
+}
+
+static void write_proc(const char* procdir, uint32_t j, uint32_t nsockets, const char* sockpath)
+{
+	char dir[SCAP_MAX_PATH_SIZE];
+	char fddir[SCAP_MAX_PATH_SIZE];
+	char sockname[64];
+	uint32_t pid = FIRST_PID + j;
+	FILE* f;
+
+	snprintf(dir, sizeof(dir), "%s/%u", procdir, pid);
+	make_dir(dir);
+
+	f = open_file(dir, "status");
+	fprintf(f, "Name:\tbench\nUmask:\t0022\nState:\tS (sleeping)\nTgid:\t%u\nNgid:\t0\nPid:\t%u\nPPid:\t1\nTracerPid:\t0\n"
+		"Uid:\t%u\t%u\t%u\t%u\nGid:\t100\t100\t100\t100\nFDSize:\t64\nGroups:\t \n"
+		"NStgid:\t%u\t%u\nNSpid:\t%u\t%u\nNSpgid:\t%u\t%u\nNSsid:\t%u\t1\nKthread:\t0\n"
+		"VmPeak:\t    2640 kB\nVmSize:\t    %u kB\nVmLck:\t       0 kB\nVmPin:\t       0 kB\nVmHWM:\t    1396 kB\n"
+		"VmRSS:\t    1396 kB\nRssAnon:\t     104 kB\nRssFile:\t    1292 kB\nRssShmem:\t       0 kB\n"
+		"VmData:\t     360 kB\nVmStk:\t     132 kB\nVmExe:\t      20 kB\nVmLib:\t    1528 kB\nVmPTE:\t      40 kB\n"
+		"VmSwap:\t       0 kB\nHugetlbPages:\t       0 kB\nCoreDumping:\t0\nThreads:\t1\nSigQ:\t0/23960\n"
+		"SigPnd:\t0000000000000000\nShdPnd:\t0000000000000000\nSigBlk:\t0000000000000000\n"
+		"SigIgn:\t0000000000000000\nSigCgt:\t0000000000000000\nCapInh:\t0000000000000000\n"
+		"CapPrm:\t000001fffeffffff\nCapEff:\t000001fffeffffff\nCapBnd:\t000001fffeffffff\n"
+		"CapAmb:\t0000000000000000\nNoNewPrivs:\t0\nSeccomp:\t0\nCpus_allowed:\tff\nCpus_allowed_list:\t0-7\n"
+		"Mems_allowed:\t00000001\nMems_allowed_list:\t0\nvoluntary_ctxt_switches:\t1\nnonvoluntary_ctxt_switches:\t0\n",
+		pid, pid, 1000 + j % 10, 1000 + j % 10, 1000 + j % 10, 1000 + j % 10,
+		pid, j + 1, pid, j + 1, pid, j + 1, pid, 2048 + j);
+	fclose(f);
+
+	f = open_file(dir, "stat");
+	fprintf(f, "%u (bench (%u)) S 1 %u %u 34816 -1 4194560 %u 0 7 0 0 0 0 0 20 0 1 0 1550529 2703360 306 18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 0 0 0 0 0 0\n",
+		pid, j, pid, pid, 100 + j);
+	fclose(f);
+
+	f = open_file(dir, "cgroup");
+	fprintf(f, "9:name=systemd:/\n8:pids:/bench/%u\n4:memory:/bench/%u\n1:cpu,cpuacct:/bench/%u\n0::/\n", j, j, j);
+	fclose(f);
+
+	f = open_file(dir, "loginuid");
+	fprintf(f, "%u", 1000 + j % 10);
+	fclose(f);
+
+	f = open_file(dir, "cmdline");
+	fprintf(f, "/usr/bin/bench%c-n%c%u%c", 0, 0, j, 0);
+	fclose(f);
+
+	f = open_file(dir, "environ");
+	fprintf(f, "PATH=/usr/bin:/bin%cHOME=/root%cLANG=C.UTF-8%c", 0, 0, 0);
+	fclose(f);
+
+	make_link("/usr/bin/bench", dir, "exe");
+	make_link("/", dir, "cwd");
+	make_link("/", dir, "root");
+
+	//
+	// fd/3 looks like a link to a socket in the real /proc: it stats as
+	// a socket, through the link named after the inode to the one bound
+	// in the temporary directory, and its link reads socket:[ino]
+	//
+	snprintf(fddir, sizeof(fddir), "%s/fd", dir);
+	make_dir(fddir);
+	snprintf(sockname, sizeof(sockname), "socket:[%u]", FIRST_TCP_INO + j % nsockets);
+	make_link(sockpath, fddir, sockname);
+	make_link(sockname, fddir, "3");
+}
+
+static void build_tree(uint32_t nprocs, uint32_t nsockets)
+{
+	char procdir[SCAP_MAX_PATH_SIZE];
+	char netdir[SCAP_MAX_PATH_SIZE];
+	char sockpath[SCAP_MAX_PATH_SIZE];
+	struct sockaddr_un addr;
+	uint32_t j;
+	int sock;
+
+	snprintf(sockpath, sizeof(sockpath), "%s/sock", g_root);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sockpath);
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		perror(sockpath);
+		exit(1);
+	}
+	close(sock);
+
+	snprintf(procdir, sizeof(procdir), "%s/proc", g_root);
+	make_dir(procdir);
+	snprintf(netdir, sizeof(netdir), "%s/net", procdir);
+	make_dir(netdir);
+	write_net(netdir, nsockets);
+
+	for(j = 0; j < nprocs; j++)
+	{
+		write_proc(procdir, j, nsockets, sockpath);
+	}
+}
+
+static int remove_entry(const char* path, const struct stat* sb, int flag, struct FTW* ftwbuf)
+{
+	return remove(path);
+}
+
+static void remove_tree()
+{
+	nftw(g_root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static void fail(const char* what, uint64_t tid)
+{
+	fprintf(stderr, "unexpected %s for tid %" PRIu64 "\n", what, tid);
+	remove_tree();
+	exit(1);
+}
+
+static void check(scap_t* h, uint32_t nprocs, uint32_t nsockets)
+{
+	scap_threadinfo* tinfo;
+	uint32_t n = 0;
+
+	for(tinfo = scap_get_proc_table(h); tinfo != NULL; tinfo = tinfo->hh.next)
+	{
+		uint32_t j = tinfo->tid - FIRST_PID;
+		char expected[SCAP_MAX_PATH_SIZE];
+		scap_fdinfo* fdi;
+
+		n++;
+		if(tinfo->pid != tinfo->tid || tinfo->ptid != 1 || tinfo->vpid != j + 1 || tinfo->vtid != j + 1)
+		{
+			fail("ids", tinfo->tid);
+		}
+		if(tinfo->uid != 1000 + j % 10 || tinfo->gid != 100 || tinfo->loginuid != (int32_t)(1000 + j % 10))
+		{
+			fail("uid, gid or loginuid", tinfo->tid);
+		}
+		if(tinfo->vmsize_kb != 2048 + j || tinfo->vmrss_kb != 1396 || tinfo->pfminor != 100 + j || tinfo->pfmajor != 7)
+		{
+			fail("memory stats", tinfo->tid);
+		}
+		if(strcmp(tinfo->comm, "bench") != 0 || strcmp(tinfo->exe, "/usr/bin/bench") != 0)
+		{
+			fail("comm or exe", tinfo->tid);
+		}
+
+		snprintf(expected, sizeof(expected), "pids=/bench/%u", j);
+		if(tinfo->cgroups_len == 0 ||
+		   memmem(tinfo->cgroups, tinfo->cgroups_len, expected, strlen(expected) + 1) == NULL)
+		{
+			fail("cgroups", tinfo->tid);
+		}
+
+		HASH_FIND_INT64(tinfo->fdlist, &(int64_t){3}, fdi);
+		if(fdi == NULL || HASH_COUNT(tinfo->fdlist) != 1)
+		{
+			fail("fds", tinfo->tid);
+		}
+		if(j % nsockets % 2 == 0 &&
+		   (fdi->type != SCAP_FD_IPV4_SOCK || fdi->info.ipv4info.sport != tcp_port(j % nsockets) ||
+		    fdi->info.ipv4info.dport != 80 || fdi->info.ipv4info.dip != 0x0A000001))
+		{
+			fail("connected socket", tinfo->tid);
+		}
+		if(j % nsockets % 2 == 1 &&
+		   (fdi->type != SCAP_FD_IPV4_SERVSOCK || fdi->info.ipv4serverinfo.port != tcp_port(j % nsockets)))
+		{
+			fail("listening socket", tinfo->tid);
+		}
+	}
+
+	if(n != nprocs)
+	{
+		fprintf(stderr, "found %u processes out of %u\n", n, nprocs);
+		remove_tree();
+		exit(1);
+	}
+}
+
+static void check_sockets(scap_fdinfo* sockets, uint32_t nsockets)
+{
+	scap_fdinfo* fdi;
+	uint64_t ino = FIRST_UNIX_INO + nsockets - 1;
+	char expected[SCAP_MAX_PATH_SIZE];
+
+	snprintf(expected, sizeof(expected), "/run/bench/%u.sock", nsockets - 1);
+	HASH_FIND_INT64(sockets, &ino, fdi);
+	if(fdi == NULL || fdi->type != SCAP_FD_UNIX_SOCK ||
+	   fdi->info.unix_socket_info.source != nsockets ||
+	   strcmp(fdi->info.unix_socket_info.fname, expected) != 0)
+	{
+		fail("unix socket", 0);
+	}
+
+	ino = FIRST_TCP6_INO;
+	HASH_FIND_INT64(sockets, &ino, fdi);
+	if(fdi == NULL || fdi->type != SCAP_FD_IPV6_SERVSOCK ||
+	   fdi->info.ipv6serverinfo.port != tcp_port(0) || fdi->info.ipv6serverinfo.ip[3] != 0x01000000)
+	{
+		fail("ipv6 socket", 0);
+	}
+
+	ino = FIRST_NETLINK_INO;
+	HASH_FIND_INT64(sockets, &ino, fdi);
+	if(fdi == NULL)
+	{
+		fail("netlink socket", 0);
+	}
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [-p processes] [-s sockets] [-n rounds]\n", prog);
+}
+
+int main(int argc, char** argv)
+{
+	char error[SCAP_LASTERR_SIZE];
+	scap_open_args oargs;
+	uint32_t nprocs = 1000;
+	uint32_t nsockets = 10000;
+	uint32_t rounds = 5;
+	uint64_t sum = 0;
+	uint64_t min = UINT64_MAX;
+	uint64_t sockets_sum = 0;
+	uint64_t sockets_min = UINT64_MAX;
+	uint32_t nread = 0;
+	int32_t res;
+	scap_t* h = NULL;
+	uint32_t k;
+	int op;
+
+	while((op = getopt(argc, argv, "p:s:n:h")) != -1)
+	{
+		switch(op)
+		{
+		case 'p':
+			nprocs = atoi(optarg);
+			break;
+		case 's':
+			nsockets = atoi(optarg);
+			break;
+		case 'n':
+			rounds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if(nprocs == 0 || nsockets < 10 || rounds == 0)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	snprintf(g_root, sizeof(g_root), "/tmp/scap-procfsbench-XXXXXX");
+	if(mkdtemp(g_root) == NULL)
+	{
+		perror("mkdtemp");
+		return -1;
+	}
+
+	build_tree(nprocs, nsockets);
+
+	//
+	// Read once, and cached, by libscap
+	//
+	setenv("SYSDIG_HOST_ROOT", g_root, 1);
+
+	memset(&oargs, 0, sizeof(oargs));
+	oargs.mode = SCAP_MODE_NODRIVER;
+	oargs.import_users = false;
+	oargs.proc_scan_timeout_ms = SCAP_PROC_SCAN_TIMEOUT_NONE;
+	oargs.proc_scan_log_interval_ms = SCAP_PROC_SCAN_LOG_NONE;
+
+	for(k = 0; k < rounds; k++)
+	{
+		uint64_t start = ns_now();
+		uint64_t ns;
+
+		h = scap_open(oargs, error, &res);
+		ns = ns_now() - start;
+		if(h == NULL)
+		{
+			fprintf(stderr, "%s (%d)\n", error, res);
+			remove_tree();
+			return -1;
+		}
+
+		check(h, nprocs, nsockets);
+		if(k != rounds - 1)
+		{
+			scap_close(h);
+		}
+
+		sum += ns;
+		if(ns < min)
+		{
+			min = ns;
+		}
+	}
+
+	//
+	// The socket tables alone, without the per process files
+	//
+	for(k = 0; k < rounds; k++)
+	{
+		struct scap_ns_socket_list sockets = {0};
+		uint64_t start = ns_now();
+		uint64_t ns;
+
+		if(scap_fd_read_sockets(h, "", &sockets, error) != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", error);
+			remove_tree();
+			return -1;
+		}
+		ns = ns_now() - start;
+
+		nread = HASH_COUNT(sockets.sockets);
+		check_sockets(sockets.sockets, nsockets);
+		scap_fd_free_table(h, &sockets.sockets);
+
+		sockets_sum += ns;
+		if(ns < sockets_min)
+		{
+			sockets_min = ns;
+		}
+	}
+
+	scap_close(h);
+	remove_tree();
+
+	printf("%-10s %10s %12s %12s\n", "", "count", "avg ms", "min ms");
+	printf("%-10s %10u %12.2f %12.2f\n", "open", nprocs,
+	       (double)sum / rounds / 1000000, (double)min / 1000000);
+	printf("%-10s %10u %12.2f %12.2f\n", "sockets", nread,
+	       (double)sockets_sum / rounds / 1000000, (double)sockets_min / 1000000);
+
+	return 0;
+}
@@ -0,0 +1,81 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Timing and reporting helpers shared by the libscap and libsinsp
+// benchmarks. Header only, so that each bench stays a single source file.
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+//
+// Current time of the given clock, in nanoseconds
+//
+static inline uint64_t ns_now_clock(clockid_t clk)
+{
+	struct timespec ts;
+	clock_gettime(clk, &ts);
+	return ts.tv_sec * (uint64_t) 1000000000 + ts.tv_nsec;
+}
+
+//
+// Monotonic time in nanoseconds, for measuring elapsed time
+//
+static inline uint64_t ns_now()
+{
+	return ns_now_clock(CLOCK_MONOTONIC);
+}
+
+//
+// Resident set size of the process, in bytes, or 0 if it can't be read
+//
+static inline uint64_t rss_bytes()
+{
+	uint64_t size = 0;
+	uint64_t resident = 0;
+	FILE* f = fopen("/proc/self/statm", "r");
+
+	if(f != NULL)
+	{
+		if(fscanf(f, "%" PRIu64 " %" PRIu64, &size, &resident) != 2)
+		{
+			resident = 0;
+		}
+		fclose(f);
+	}
+
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+//
+// Print the throughput of a run of nevents events that took ns nanoseconds
+//
+static inline void report(const char* name, uint64_t nevents, uint64_t ns)
+{
+	double secs = (double)ns / 1000000000;
+
+	printf("%-10s %8" PRIu64 " events: %.2f M events/sec, %.1f ns/event\n",
+	       name, nevents,
+	       secs > 0? nevents / secs / 1000000 : 0,
+	       nevents? (double)ns / nevents : 0);
+}
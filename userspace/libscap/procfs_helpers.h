@@ -0,0 +1,336 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+#ifndef __PROCFS_HELPERS_H
+#define __PROCFS_HELPERS_H
+
+//
+// Readers and field parsers for /proc files. Files are opened relative to a
+// directory fd (e.g. the one of /proc/<pid>, opened once per process) or
+// AT_FDCWD, read with plain read() calls into buffers owned by the caller
+// and parsed in place, without stdio or allocations.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Read up to size bytes of name, relative to dirfd, into buf. Like fread(),
+ * returns the number of bytes read before the end of the file or the first
+ * error. Returns -1, with errno set, if name can't be opened.
+ */
+static inline ssize_t scap_procfs_read(int dirfd, const char* name, char* buf, size_t size)
+{
+	size_t len = 0;
+	ssize_t r;
+	int fd;
+
+	fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+	{
+		return -1;
+	}
+
+	//
+	// /proc files can come in more than one read even if they fit buf
+	//
+	while(len < size)
+	{
+		r = read(fd, buf + len, size - len);
+		if(r < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else if(r <= 0)
+		{
+			break;
+		}
+		len += r;
+	}
+
+	close(fd);
+	return len;
+}
+
+/**
+ * Like scap_procfs_read(), but reads at most size - 1 bytes and
+ * NUL-terminates them.
+ */
+static inline ssize_t scap_procfs_read_str(int dirfd, const char* name, char* buf, size_t size)
+{
+	ssize_t len = scap_procfs_read(dirfd, name, buf, size - 1);
+
+	if(len >= 0)
+	{
+		buf[len] = 0;
+	}
+	return len;
+}
+
+/**
+ * Line by line reader of files of any size, through a caller buffer
+ */
+typedef struct scap_procfs_reader
+{
+	int m_fd;
+	char* m_buf;
+	size_t m_size;
+	// The unconsumed data is [m_start, m_end)
+	size_t m_start;
+	size_t m_end;
+	bool m_eof;
+	// Discarding the rest of a line longer than the buffer
+	bool m_skip;
+}scap_procfs_reader;
+
+/**
+ * Open name, relative to dirfd, for reading with buf. Returns false, with
+ * errno set, if it can't be opened.
+ */
+static inline bool scap_procfs_reader_open(scap_procfs_reader* r, int dirfd, const char* name, char* buf, size_t size)
+{
+	r->m_fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+	r->m_buf = buf;
+	r->m_size = size;
+	r->m_start = 0;
+	r->m_end = 0;
+	r->m_eof = false;
+	r->m_skip = false;
+	return r->m_fd >= 0;
+}
+
+static inline void scap_procfs_reader_close(scap_procfs_reader* r)
+{
+	if(r->m_fd >= 0)
+	{
+		close(r->m_fd);
+		r->m_fd = -1;
+	}
+}
+
+/**
+ * Return the next line, NUL-terminated and without its newline, or NULL at
+ * the end of the file. The line stays valid until the next call. Lines
+ * longer than the buffer are cut to its size.
+ */
+static inline char* scap_procfs_reader_next_line(scap_procfs_reader* r, size_t* len)
+{
+	char* start;
+	char* nl;
+	ssize_t n;
+
+	while(true)
+	{
+		start = r->m_buf + r->m_start;
+		nl = (char*)memchr(start, '\n', r->m_end - r->m_start);
+		if(nl != NULL)
+		{
+			r->m_start = nl + 1 - r->m_buf;
+			if(r->m_skip)
+			{
+				r->m_skip = false;
+				continue;
+			}
+
+			*nl = 0;
+			*len = nl - start;
+			return start;
+		}
+
+		if(r->m_eof)
+		{
+			if(r->m_start == r->m_end || r->m_skip)
+			{
+				r->m_start = r->m_end;
+				return NULL;
+			}
+
+			//
+			// Last line, without a newline
+			//
+			r->m_buf[r->m_end] = 0;
+			*len = r->m_end - r->m_start;
+			r->m_start = r->m_end;
+			return start;
+		}
+
+		//
+		// Move the partial line to the front of the buffer and read
+		// the rest
+		//
+		if(r->m_start != 0)
+		{
+			memmove(r->m_buf, start, r->m_end - r->m_start);
+			r->m_end -= r->m_start;
+			r->m_start = 0;
+		}
+
+		if(r->m_end == r->m_size - 1)
+		{
+			bool skipping = r->m_skip;
+
+			r->m_end = 0;
+			r->m_skip = true;
+			if(!skipping)
+			{
+				r->m_buf[r->m_size - 1] = 0;
+				*len = r->m_size - 1;
+				return r->m_buf;
+			}
+			continue;
+		}
+
+		n = read(r->m_fd, r->m_buf + r->m_end, r->m_size - 1 - r->m_end);
+		if(n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else if(n <= 0)
+		{
+			r->m_eof = true;
+		}
+		else
+		{
+			r->m_end += n;
+		}
+	}
+}
+
+/**
+ * If line starts with key, return what follows it, otherwise NULL
+ */
+static inline const char* scap_procfs_field(const char* line, const char* key)
+{
+	size_t len = strlen(key);
+
+	if(strncmp(line, key, len) != 0)
+	{
+		return NULL;
+	}
+	return line + len;
+}
+
+static inline const char* scap_procfs_skip_blanks(const char* p)
+{
+	while(*p == ' ' || *p == '\t')
+	{
+		p++;
+	}
+	return p;
+}
+
+/**
+ * Skip the blanks at p, the word after them and the blanks after it
+ */
+static inline const char* scap_procfs_skip_word(const char* p)
+{
+	p = scap_procfs_skip_blanks(p);
+	while(*p != 0 && *p != ' ' && *p != '\t' && *p != '\n')
+	{
+		p++;
+	}
+	return scap_procfs_skip_blanks(p);
+}
+
+/**
+ * Parse the decimal number after the blanks at p. Returns the end of the
+ * number, or NULL if there's none.
+ */
+static inline const char* scap_procfs_parse_u64(const char* p, uint64_t* val)
+{
+	uint64_t v = 0;
+
+	p = scap_procfs_skip_blanks(p);
+	if(*p < '0' || *p > '9')
+	{
+		return NULL;
+	}
+
+	while(*p >= '0' && *p <= '9')
+	{
+		v = v * 10 + (*p - '0');
+		p++;
+	}
+
+	*val = v;
+	return p;
+}
+
+static inline const char* scap_procfs_parse_i64(const char* p, int64_t* val)
+{
+	uint64_t v;
+	bool neg;
+
+	p = scap_procfs_skip_blanks(p);
+	neg = (*p == '-');
+	if(neg)
+	{
+		p++;
+	}
+
+	p = scap_procfs_parse_u64(p, &v);
+	if(p == NULL)
+	{
+		return NULL;
+	}
+
+	*val = neg? -(int64_t)v : (int64_t)v;
+	return p;
+}
+
+/**
+ * Parse up to ndigits hex digits at p, e.g. the fixed width fields of
+ * /proc/net/tcp. Returns their end, or NULL if there's none.
+ */
+static inline const char* scap_procfs_parse_hex(const char* p, uint32_t ndigits, uint64_t* val)
+{
+	const char* start = p;
+	uint64_t v = 0;
+
+	for(; (uint32_t)(p - start) < ndigits; p++)
+	{
+		if(*p >= '0' && *p <= '9')
+		{
+			v = (v << 4) | (*p - '0');
+		}
+		else if(*p >= 'a' && *p <= 'f')
+		{
+			v = (v << 4) | (*p - 'a' + 10);
+		}
+		else if(*p >= 'A' && *p <= 'F')
+		{
+			v = (v << 4) | (*p - 'A' + 10);
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if(p == start)
+	{
+		return NULL;
+	}
+
+	*val = v;
+	return p;
+}
+
+#endif /* __PROCFS_HELPERS_H */
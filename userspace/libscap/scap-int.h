@@ -49,6 +49,14 @@ typedef struct wh_t wh_t;
 #define gztell(F) ftell(F)
 #define gzerror(F, E) ({*E = ferror(F); "error reading file descriptor";})
 #define gzseek fseek
+#define gzdirect(F) 1
+#endif
+
+//
+// Uncompressed capture files are read through a memory mapping
+//
+#ifndef _WIN32
+#define SCAP_HAS_FILE_MAP
 #endif
 
 //
@@ -72,6 +80,7 @@ typedef struct wh_t wh_t;
 //
 #define BPF_PROGS_MAX 128
 #define BPF_MAPS_MAX 32
+#define BPF_STATE_MAPS_MAX 8
 struct bpf_prog {
 	int fd;
 	int efd;
@@ -107,11 +116,28 @@ typedef struct scap_device
 		struct
 		{
 			uint64_t m_evt_lost;
+			// With ring buffers, m_buffer is the consumer page and this
+			// is the producer page, followed by the data mapped twice
+			char* m_ringbuf_producer;
+			uint32_t m_ringbuf_size;
 		};
 	};
+	// The error of the last failed scap_next_dev() on this device, so that
+	// the devices can be read from different threads
+	char m_lasterr[SCAP_LASTERR_SIZE];
 }scap_device;
 
 
+//
+// An entry of the per-CPU merge heap: the timestamp of the event at the head
+// of a device ring, and the index of that device
+//
+typedef struct scap_merge_entry
+{
+	uint64_t ts;
+	uint32_t cpuid;
+}scap_merge_entry;
+
 typedef struct scap_tid
 {
 	uint64_t tid;
@@ -119,6 +145,43 @@ typedef struct scap_tid
 	UT_hash_handle hh; ///< makes this structure hashable
 } scap_tid;
 
+//
+// Flat open-addressing map from a 64-bit id to a 64-bit value, used for
+// the pid/vtid lookups. Each shard is a linear probing table with
+// backward-shift deletion, so there are no tombstones and no per-entry
+// allocations. There is a single writer, while readers on other threads
+// use the per-shard sequence counter to detect concurrent updates and
+// retry.
+//
+#define SCAP_ID_MAP_SHARDS 16
+#define SCAP_ID_MAP_SHARD_INITIAL_SIZE 256
+#define SCAP_ID_MAP_EMPTY_KEY ((uint64_t)-1)
+
+typedef struct scap_id_map_slot
+{
+	uint64_t key;
+	uint64_t value;
+}scap_id_map_slot;
+
+typedef struct scap_id_map_shard
+{
+	// Odd while the writer is updating the shard
+	volatile uint32_t seq;
+	uint32_t mask;
+	uint32_t count;
+	uint32_t nretired;
+	scap_id_map_slot* volatile slots;
+	// Slot arrays replaced by a resize. Concurrent readers may still be
+	// probing them, so they are only freed with the map.
+	scap_id_map_slot** retired;
+	char pad[32];
+}scap_id_map_shard;
+
+typedef struct scap_id_map
+{
+	scap_id_map_shard shards[SCAP_ID_MAP_SHARDS];
+}scap_id_map;
+
 //
 // The open instance handle
 //
@@ -133,6 +196,24 @@ struct scap
 	FILE* m_file;
 #endif
 	char* m_file_evt_buf;
+	// Mapping of an uncompressed capture file, whose events are returned
+	// in place, or NULL. While it's set the read offset is m_file_map_off,
+	// the one of m_file is stale.
+	char* m_file_map;
+	uint64_t m_file_map_size;
+	uint64_t m_file_map_off;
+	// End of the range already requested with MADV_WILLNEED
+	uint64_t m_file_map_readahead;
+	// Decompressed event blocks of the current chunk of a chunked capture,
+	// read until m_chunk_off reaches m_chunk_len. See scap_chunks.c.
+	char* m_chunk_buf;
+	uint32_t m_chunk_len;
+	uint32_t m_chunk_off;
+	// File offset of the current chunk block
+	uint64_t m_chunk_block_off;
+	// Events before this are skipped, after scap_fseek_ts()
+	uint64_t m_chunk_seek_ts;
+	struct scap_chunk_reader* m_chunk_reader;
 	uint32_t m_last_evt_dump_flags;
 	char m_lasterr[SCAP_LASTERR_SIZE];
 
@@ -154,6 +235,20 @@ struct scap
 	uint32_t m_fd_lookup_limit;
 	uint64_t m_unexpected_block_readsize;
 	uint32_t m_ncpus;
+	// Per-CPU merge state. m_merge_heap holds the devices that still have
+	// data to serve, as a binary min-heap on (ts, cpuid).
+	scap_merge_mode_t m_merge_mode;
+	scap_merge_entry* m_merge_heap;
+	uint32_t m_merge_heap_size;
+	// Device drained by the last event returned, whose tail is advanced on
+	// the next call once the caller is done with that event. -1 if none.
+	int32_t m_merge_drained_dev;
+	// Next device to be served by scap_next_batch()
+	uint32_t m_batch_next_dev;
+	// Blocking wait state. When m_wakeup_watermark is non-zero, empty
+	// buffers are waited for with a poll() on m_wakeup_pollfds.
+	uint32_t m_wakeup_watermark;
+	struct pollfd* m_wakeup_pollfds;
 	// Abstraction layer for windows
 #if CYGWING_AGENT || _WIN32
 	wh_t* m_whh;
@@ -172,6 +267,26 @@ struct scap
 		bool m_bpf_fillers[BPF_PROGS_MAX];
 		int m_bpf_map_fds[BPF_MAPS_MAX];
 		int m_bpf_prog_array_map_idx;
+		// Index of the probe's array of per-CPU ring buffers, -1 if
+		// it was built without them
+		int m_bpf_ringbuf_map_idx;
+		// Index of the probe's per-CPU TCP counters, -1 if it has none
+		int m_bpf_tcp_stats_map_idx;
+		// Indexes of the probe's prefilter maps, found by name, -1 if
+		// it has none
+		int m_bpf_prefilter_tgids_map_idx;
+		int m_bpf_prefilter_cgroups_map_idx;
+		int m_bpf_prefilter_sampling_map_idx;
+		// Index of the probe's per-CPU event type counters, -1 if it
+		// has none
+		int m_bpf_evt_type_stats_map_idx;
+		// Size of each of the probe's per-thread LRU state maps, by
+		// enum sysdig_state_map, 0 if it has none
+		uint32_t m_bpf_state_map_max_entries[BPF_STATE_MAPS_MAX];
+		// Number of possible CPUs, i.e. of values in a per-CPU map entry
+		int m_bpf_possible_cpus;
+		// True if events come from the ring buffers instead of perf_map
+		bool m_bpf_ringbuf;
 	};
 	// Anonymous struct with tracepoints and kprobe of interest
 	struct {
@@ -187,9 +302,10 @@ struct scap
 	// The active set of threads that are suppressed
 	scap_tid *m_suppressed_tids;
 
-	pid_vtid_info *m_pid_vtid_info;
-
-	tid_vtid_info *m_tid_vtid_info;
+	// (pid << 32 | vtid) -> tid and tid -> vtid maps for containerized
+	// threads
+	scap_id_map m_pid_vtid_map;
+	scap_id_map m_tid_vtid_map;
 
 	// The number of events that were skipped due to the comm
 	// matching an entry in m_suppressed_comms.
@@ -198,6 +314,9 @@ struct scap
 	// /proc scan parameters
 	uint64_t m_proc_scan_timeout_ms;
 	uint64_t m_proc_scan_log_interval_ms;
+	uint32_t m_proc_scan_threads;
+	// Set while a multi-threaded /proc scan runs, see scap_procs_mt.c
+	struct scap_proc_scan_mt* m_proc_scan_mt;
 
 	// Function which may be called to log a debug event
 	void(*m_debug_log_fn)(const char* msg);
@@ -216,8 +335,30 @@ struct scap_dumper
 	uint8_t* m_targetbuf;
 	uint8_t* m_targetbufcurpos;
 	uint8_t* m_targetbufend;
+	// SCAP_COMPRESSION_CHUNKED dumps collect the event blocks here, and
+	// write them as a compressed chunk block once there are
+	// SCAP_CHUNK_SIZE bytes. NULL for the other dumps.
+	uint8_t* m_chunk;
+	uint32_t m_chunk_len;
+	uint32_t m_chunk_size;
+	uint32_t m_chunk_nevts;
+	uint64_t m_chunk_first_ts;
+	uint64_t m_chunk_last_ts;
+	uint8_t* m_zchunk;
+	uint64_t m_zchunk_size;
+	// Index of the chunks written so far, written when the dump is closed
+	struct _chunk_index_entry* m_chunk_index;
+	uint32_t m_chunk_index_len;
+	uint32_t m_chunk_index_size;
+	// Set by scap_dump_enable_async(), see scap_dump_async.c
+	struct scap_dump_async* m_async;
+	// The error of the last failed scap_dump(), kept here as well as in
+	// the handle so that a dump can be written from its own thread
+	char m_lasterr[SCAP_LASTERR_SIZE];
 };
 
+#define SCAP_CHUNK_SIZE (4 * 1024 * 1024)
+
 struct scap_ns_socket_list
 {
 	int64_t net_ns;
@@ -225,6 +366,12 @@ struct scap_ns_socket_list
 	UT_hash_handle hh;
 };
 
+//
+// Passed as the socket list to read the sockets from the tables shared by
+// the multi-threaded /proc scan, like (void*)-1 skips them
+//
+#define SCAP_NS_SOCKETS_SHARED ((struct scap_ns_socket_list*)-2)
+
 //
 // Misc stuff
 //
@@ -237,6 +384,18 @@ struct scap_ns_socket_list
 
 // Read the full event buffer for the given processor
 int32_t scap_readbuf(scap_t* handle, uint32_t proc, OUT char** buf, OUT uint32_t* len);
+// Allocate the per-CPU merge state for the given mode, once m_ndevs is known
+int32_t scap_merge_init(scap_t* handle, scap_merge_mode_t mode);
+// Insert or update an id map entry. Writer thread only.
+bool scap_id_map_put(scap_id_map* map, uint64_t key, uint64_t value);
+// Look up an id map entry, 0 if missing. Writer thread only.
+uint64_t scap_id_map_get(scap_id_map* map, uint64_t key);
+// Look up an id map entry, 0 if missing. Safe from any thread.
+uint64_t scap_id_map_get_concurrent(scap_id_map* map, uint64_t key);
+// Remove an id map entry. Writer thread only.
+bool scap_id_map_delete(scap_id_map* map, uint64_t key);
+// Release the memory of an id map
+void scap_id_map_free(scap_id_map* map);
 // Read a single thread info from /proc
 int32_t scap_proc_read_thread(scap_t* handle, char* procdirname, uint64_t tid, struct scap_threadinfo** pi, char *error, bool scan_sockets);
 // Scan a directory containing process information
@@ -277,19 +436,48 @@ int32_t scap_fd_write_to_disk(scap_t* handle, scap_fdinfo* fdi, scap_dumper_t* d
 uint32_t scap_fd_read_from_disk(scap_t* handle, OUT scap_fdinfo* fdi, OUT size_t* nbytes, uint32_t block_type, gzFile f);
 // Parse the headers of a trace file and load the tables
 int32_t scap_read_init(scap_t* handle, gzFile f);
-// Add the file descriptor info pointed by fdi to the fd table for process pi.
+// Map the capture file being read, if it's uncompressed. fd is used if non-zero, fname otherwise.
+void scap_map_offline_file(scap_t* handle, const char* fname, int fd);
+// Decompress the chunk block at block_off, whose body (chunk header included) is at body
+int32_t scap_chunk_load(scap_t* handle, uint64_t block_off, const char* body, uint32_t len);
+// Buffer for the body of a chunk block read from an unmapped file
+char* scap_chunk_body_buf(scap_t* handle, uint32_t len);
+// Stop using the file mapping for the chunks, before it's unmapped
+void scap_chunk_reader_unmap(scap_t* handle);
+void scap_chunk_reader_close(scap_t* handle);
+#ifndef _WIN32
+// Asynchronous dumps, see scap_dump_async.c. Room for len bytes in the
+// staging buffer, to be committed once written.
+uint8_t* scap_dump_async_reserve(scap_dumper_t* d, uint32_t len);
+void scap_dump_async_commit(scap_dumper_t* d, uint32_t len);
+// Wait until everything staged is written
+int32_t scap_dump_async_flush(scap_dumper_t* d);
+void scap_dump_async_close(scap_dumper_t* d);
+int64_t scap_dump_async_get_offset(scap_dumper_t* d);
+int64_t scap_dump_async_ftell(scap_dumper_t* d);
+#endif
+// Add the file descriptor info pointed by fdi to the fd table for process pi,
+// or hand it to proc_callback if not NULL.
 // Note: silently skips if fdi->type is SCAP_FD_UNKNOWN.
-int32_t scap_add_fd_to_proc_table(scap_t* handle, scap_threadinfo* pi, scap_fdinfo* fdi, char *error);
+int32_t scap_add_fd_to_proc_table(scap_t* handle, scap_threadinfo* pi, scap_fdinfo* fdi, proc_entry_callback proc_callback, char *error);
 // Remove the given fd from the process table of the process pointed by pi
 void scap_fd_remove(scap_t* handle, scap_threadinfo* pi, int64_t fd);
 // Read an event from disk
 int32_t scap_next_offline(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid);
-// read the file descriptors for a given process directory
-int32_t scap_fd_scan_fd_dir(scap_t* handle, char * procdir, scap_threadinfo* pi, struct scap_ns_socket_list** sockets_by_ns, uint64_t* num_fds_ret, char *error);
+// read the file descriptors for a given process directory, into pi's fd table
+// or through proc_callback if not NULL
+int32_t scap_fd_scan_fd_dir(scap_t* handle, char * procdir, scap_threadinfo* pi, struct scap_ns_socket_list** sockets_by_ns, proc_entry_callback proc_callback, uint64_t* num_fds_ret, char *error);
 // read tcp or udp sockets from the proc filesystem
-int32_t scap_fd_read_ipv4_sockets_from_proc_fs(scap_t* handle, const char * dir, int l4proto, scap_fdinfo ** sockets);
+int32_t scap_fd_read_ipv4_sockets_from_proc_fs(scap_t* handle, const char * dir, int l4proto, scap_fdinfo ** sockets, char *error);
 // read all sockets and add them to the socket table hashed by their ino
 int32_t scap_fd_read_sockets(scap_t* handle, char* procdir, struct scap_ns_socket_list* sockets, char *error);
+// read a process (and its fds) from procdirname/tid, into the process table or
+// through the proc callback, or into *procinfo if not NULL
+int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procdirname, struct scap_ns_socket_list** sockets_by_ns, scap_threadinfo** procinfo, uint64_t* num_fds_ret, char *error);
+// scan procdirname on handle->m_proc_scan_threads threads
+int32_t scap_proc_scan_proc_dir_mt(scap_t* handle, char* procdirname, char *error);
+// get the sockets of net_ns during a multi-threaded /proc scan, reading them from procdir if needed
+int32_t scap_proc_scan_mt_get_sockets(scap_t* handle, char* procdir, uint64_t net_ns, struct scap_ns_socket_list** sockets, char *error);
 // get the device major/minor number for the requested_mount_id, looking in procdir/mountinfo if needed
 uint32_t scap_get_device_by_mount_id(scap_t *handle, const char *procdir, unsigned long requested_mount_id);
 // prints procs details for a give tid
@@ -302,14 +490,14 @@ void scap_free_iflist(scap_addrlist* ifhandle);
 int32_t scap_create_userlist(scap_t* handle);
 // Free a previously allocated list of users
 void scap_free_userlist(scap_userlist* uhandle);
-// Allocate a file descriptor
+// Allocate a file descriptor, the callers report the failure
 int32_t scap_fd_allocate_fdinfo(scap_t *handle, scap_fdinfo **fdi, int64_t fd, scap_fd_type type);
 // Free a file descriptor
 void scap_fd_free_fdinfo(scap_fdinfo **fdi);
 
 int32_t scap_fd_post_process_unix_sockets(scap_t* handle, scap_fdinfo* sockets);
 
-int32_t scap_proc_fill_cgroups(scap_t *handle, struct scap_threadinfo* tinfo, const char* procdirname);
+int32_t scap_proc_fill_cgroups(scap_t *handle, struct scap_threadinfo* tinfo, int procdirfd, const char* procdirname, char *error);
 
 bool scap_alloc_proclist_info(scap_t* handle, uint32_t n_entries);
 
@@ -339,6 +527,8 @@ int32_t scap_update_suppressed(scap_t *handle,
 
 // Wrapper around strerror using buffer in handle
 const char *scap_strerror(scap_t *handle, int errnum);
+// Same as above, into a buffer of SCAP_LASTERR_SIZE bytes owned by the caller
+const char *scap_strerror_r(char *buf, int errnum);
 
 struct ppm_proclist_info *scap_procfs_get_threadlist(scap_t *handle);
 
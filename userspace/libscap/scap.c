@@ -68,6 +68,23 @@ const char* scap_getlasterr(scap_t* handle)
 	return handle ? handle->m_lasterr : "null scap handle";
 }
 
+const char* scap_dev_getlasterr(scap_t* handle, uint16_t cpuid)
+{
+	//
+	// scap_next_dev() reports a bad mode or cpu in the handle, as there's
+	// no device to put it in
+	//
+	if(handle == NULL ||
+	   handle->m_mode != SCAP_MODE_LIVE ||
+	   handle->m_udig ||
+	   cpuid >= handle->m_ndevs)
+	{
+		return scap_getlasterr(handle);
+	}
+
+	return handle->m_devs[cpuid].m_lasterr;
+}
+
 static int32_t copy_comms(scap_t *handle, const char **suppressed_comms)
 {
 	if(suppressed_comms)
@@ -96,7 +113,10 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 			   const char **suppressed_comms,
 			   void(*debug_log_fn)(const char* msg),
 			   uint64_t proc_scan_timeout_ms,
-			   uint64_t proc_scan_log_interval_ms)
+			   uint64_t proc_scan_log_interval_ms,
+			   scap_merge_mode_t merge_mode,
+			   uint32_t wakeup_watermark,
+			   uint32_t proc_scan_threads)
 {
 	snprintf(error, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
 	*rc = SCAP_NOT_SUPPORTED;
@@ -112,7 +132,8 @@ scap_t* scap_open_udig_int(char *error, int32_t *rc,
 			   const char **suppressed_comms,
 			   void(*debug_log_fn)(const char* msg),
 			   uint64_t proc_scan_timeout_ms,
-			   uint64_t proc_scan_log_interval_ms)
+			   uint64_t proc_scan_log_interval_ms,
+			   uint32_t proc_scan_threads)
 {
 	snprintf(error, SCAP_LASTERR_SIZE, "udig capture not supported on %s", PLATFORM_NAME);
 	*rc = SCAP_NOT_SUPPORTED;
@@ -142,6 +163,40 @@ static uint32_t get_max_consumers()
 }
 
 #ifndef _WIN32
+//
+// Set up the blocking wait on the driver. The perf buffers get their
+// watermark when they're created in scap_bpf_load(), while the kernel module
+// takes it as a per-consumer setting.
+//
+static int32_t init_wakeup(scap_t* handle)
+{
+	uint32_t j;
+
+	if(!handle->m_bpf)
+	{
+		if(ioctl(handle->m_devs[0].m_fd, PPM_IOCTL_SET_WAKEUP_WATERMARK, handle->m_wakeup_watermark))
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error setting the wakeup watermark: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+	}
+
+	handle->m_wakeup_pollfds = (struct pollfd*) calloc(sizeof(struct pollfd), handle->m_ndevs);
+	if(handle->m_wakeup_pollfds == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the poll descriptors");
+		return SCAP_FAILURE;
+	}
+
+	for(j = 0; j < handle->m_ndevs; j++)
+	{
+		handle->m_wakeup_pollfds[j].fd = handle->m_devs[j].m_fd;
+		handle->m_wakeup_pollfds[j].events = POLLIN;
+	}
+
+	return SCAP_SUCCESS;
+}
+
 scap_t* scap_open_live_int(char *error, int32_t *rc,
 			   proc_entry_callback proc_callback,
 			   void* proc_callback_context,
@@ -150,7 +205,10 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 			   const char **suppressed_comms,
 			   void(*debug_log_fn)(const char* msg),
 			   uint64_t proc_scan_timeout_ms,
-			   uint64_t proc_scan_log_interval_ms)
+			   uint64_t proc_scan_log_interval_ms,
+			   scap_merge_mode_t merge_mode,
+			   uint32_t wakeup_watermark,
+			   uint32_t proc_scan_threads)
 {
 	uint32_t j;
 	char filename[SCAP_MAX_PATH_SIZE];
@@ -176,6 +234,7 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 	handle->m_debug_log_fn = debug_log_fn;
 	handle->m_proc_scan_timeout_ms = proc_scan_timeout_ms;
 	handle->m_proc_scan_log_interval_ms = proc_scan_log_interval_ms;
+	handle->m_proc_scan_threads = proc_scan_threads;
 
 	//
 	// While in theory we could always rely on the scap caller to properly
@@ -255,6 +314,13 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 
 	handle->m_ndevs = ndevs;
 
+	if((*rc = scap_merge_init(handle, merge_mode)) != SCAP_SUCCESS)
+	{
+		scap_close(handle);
+		snprintf(error, SCAP_LASTERR_SIZE, "error allocating the merge heap");
+		return NULL;
+	}
+
 	//
 	// Extract machine information
 	//
@@ -315,6 +381,7 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 	handle->m_suppressed_tids = NULL;
 	handle->m_num_suppressed_evts = 0;
 	handle->m_buffer_empty_wait_time_us = BUFFER_EMPTY_WAIT_TIME_US_START;
+	handle->m_wakeup_watermark = wakeup_watermark;
 
 	if ((*rc = copy_comms(handle, suppressed_comms)) != SCAP_SUCCESS)
 	{
@@ -442,6 +509,16 @@ scap_t* scap_open_live_int(char *error, int32_t *rc,
 		scap_stop_dropping_mode(handle);
 	}
 
+	if(handle->m_wakeup_watermark != 0)
+	{
+		if((*rc = init_wakeup(handle)) != SCAP_SUCCESS)
+		{
+			snprintf(error, SCAP_LASTERR_SIZE, "%s", handle->m_lasterr);
+			scap_close(handle);
+			return NULL;
+		}
+	}
+
 	//
 	// Create the process list
 	//
@@ -475,7 +552,8 @@ scap_t* scap_open_udig_int(char *error, int32_t *rc,
 			   const char **suppressed_comms,
 			   void(*debug_log_fn)(const char* msg),
 			   uint64_t proc_scan_timeout_ms,
-			   uint64_t proc_scan_log_interval_ms)
+			   uint64_t proc_scan_log_interval_ms,
+			   uint32_t proc_scan_threads)
 {
 	char filename[SCAP_MAX_PATH_SIZE];
 	scap_t* handle = NULL;
@@ -499,6 +577,7 @@ scap_t* scap_open_udig_int(char *error, int32_t *rc,
 	handle->m_debug_log_fn = debug_log_fn;
 	handle->m_proc_scan_timeout_ms = proc_scan_timeout_ms;
 	handle->m_proc_scan_log_interval_ms = proc_scan_log_interval_ms;
+	handle->m_proc_scan_threads = proc_scan_threads;
 	handle->m_bpf = false;
 	handle->m_udig_capturing = false;
 	handle->m_ncpus = 1;
@@ -684,7 +763,9 @@ scap_t* scap_open_offline_int(gzFile gzfile,
 			      void* proc_callback_context,
 			      bool import_users,
 			      uint64_t start_offset,
-			      const char **suppressed_comms)
+			      const char **suppressed_comms,
+			      const char *fname,
+			      int fd)
 {
 	scap_t* handle = NULL;
 
@@ -727,8 +808,6 @@ scap_t* scap_open_offline_int(gzFile gzfile,
 	handle->m_udig = false;
 	handle->m_suppressed_comms = NULL;
 	handle->m_suppressed_tids = NULL;
-	handle->m_pid_vtid_info = NULL;
-	handle->m_tid_vtid_info = NULL;
 
 	handle->m_file_evt_buf = (char*)malloc(FILE_READ_BUF_SIZE);
 	if(!handle->m_file_evt_buf)
@@ -759,6 +838,11 @@ scap_t* scap_open_offline_int(gzFile gzfile,
 		return NULL;
 	}
 
+	//
+	// The events of uncompressed files are read in place from here on
+	//
+	scap_map_offline_file(handle, fname, fd);
+
 	if(!import_users)
 	{
 		if(handle->m_userlist != NULL)
@@ -801,7 +885,7 @@ scap_t* scap_open_offline(const char* fname, char *error, int32_t* rc)
 		return NULL;
 	}
 
-	return scap_open_offline_int(gzfile, error, rc, NULL, NULL, true, 0, NULL);
+	return scap_open_offline_int(gzfile, error, rc, NULL, NULL, true, 0, NULL, fname, 0);
 }
 
 scap_t* scap_open_offline_fd(int fd, char *error, int32_t *rc)
@@ -814,12 +898,12 @@ scap_t* scap_open_offline_fd(int fd, char *error, int32_t *rc)
 		return NULL;
 	}
 
-	return scap_open_offline_int(gzfile, error, rc, NULL, NULL, true, 0, NULL);
+	return scap_open_offline_int(gzfile, error, rc, NULL, NULL, true, 0, NULL, NULL, fd);
 }
 
 scap_t* scap_open_live(char *error, int32_t *rc)
 {
-	return scap_open_live_int(error, rc, NULL, NULL, true, NULL, NULL, NULL, SCAP_PROC_SCAN_TIMEOUT_NONE, SCAP_PROC_SCAN_LOG_NONE);
+	return scap_open_live_int(error, rc, NULL, NULL, true, NULL, NULL, NULL, SCAP_PROC_SCAN_TIMEOUT_NONE, SCAP_PROC_SCAN_LOG_NONE, SCAP_MERGE_LINEAR, 0, 0);
 }
 
 scap_t* scap_open_nodriver_int(char *error, int32_t *rc,
@@ -828,7 +912,8 @@ scap_t* scap_open_nodriver_int(char *error, int32_t *rc,
 			       bool import_users,
 			       void(*debug_log_fn)(const char* msg),
 			       uint64_t proc_scan_timeout_ms,
-			       uint64_t proc_scan_log_interval_ms)
+			       uint64_t proc_scan_log_interval_ms,
+			       uint32_t proc_scan_threads)
 {
 #if !defined(HAS_CAPTURE)
 	snprintf(error, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
@@ -857,6 +942,7 @@ scap_t* scap_open_nodriver_int(char *error, int32_t *rc,
 	handle->m_debug_log_fn = debug_log_fn;
 	handle->m_proc_scan_timeout_ms = proc_scan_timeout_ms;
 	handle->m_proc_scan_log_interval_ms = proc_scan_log_interval_ms;
+	handle->m_proc_scan_threads = proc_scan_threads;
 
 	//
 	// Extract machine information
@@ -979,7 +1065,8 @@ scap_t* scap_open(scap_open_args args, char *error, int32_t *rc)
 		return scap_open_offline_int(gzfile, error, rc,
 					     args.proc_callback, args.proc_callback_context,
 					     args.import_users, args.start_offset,
-					     args.suppressed_comms);
+					     args.suppressed_comms,
+					     args.fname, args.fd);
 	}
 	case SCAP_MODE_LIVE:
 #ifndef CYGWING_AGENT
@@ -991,7 +1078,8 @@ scap_t* scap_open(scap_open_args args, char *error, int32_t *rc)
 						args.suppressed_comms,
 						args.debug_log_fn,
 						args.proc_scan_timeout_ms,
-						args.proc_scan_log_interval_ms);
+						args.proc_scan_log_interval_ms,
+						args.proc_scan_threads);
 		}
 		else
 		{
@@ -1002,7 +1090,10 @@ scap_t* scap_open(scap_open_args args, char *error, int32_t *rc)
 						args.suppressed_comms,
 						args.debug_log_fn,
 						args.proc_scan_timeout_ms,
-						args.proc_scan_log_interval_ms);
+						args.proc_scan_log_interval_ms,
+						args.merge_mode,
+						args.wakeup_watermark,
+						args.proc_scan_threads);
 		}
 #else
 		snprintf(error,	SCAP_LASTERR_SIZE, "scap_open: live mode currently not supported on windows. Use nodriver mode instead.");
@@ -1015,7 +1106,8 @@ scap_t* scap_open(scap_open_args args, char *error, int32_t *rc)
 					      args.import_users,
 					      args.debug_log_fn,
 					      args.proc_scan_timeout_ms,
-					      args.proc_scan_log_interval_ms);
+					      args.proc_scan_log_interval_ms,
+					      args.proc_scan_threads);
 	case SCAP_MODE_NONE:
 		// error
 		break;
@@ -1064,6 +1156,8 @@ void scap_close(scap_t* handle)
 {
 	if(handle->m_file)
 	{
+		scap_chunk_reader_close(handle);
+		scap_disable_file_map(handle);
 		gzclose(handle->m_file);
 	}
 	else if(handle->m_mode == SCAP_MODE_LIVE)
@@ -1113,6 +1207,18 @@ void scap_close(scap_t* handle)
 			//
 			free(handle->m_devs);
 		}
+
+		if(handle->m_merge_heap)
+		{
+			free(handle->m_merge_heap);
+		}
+
+#ifndef _WIN32
+		if(handle->m_wakeup_pollfds)
+		{
+			free(handle->m_wakeup_pollfds);
+		}
+#endif
 #endif // HAS_CAPTURE
 	}
 
@@ -1182,6 +1288,9 @@ void scap_close(scap_t* handle)
 		handle->m_suppressed_tids = NULL;
 	}
 
+	scap_id_map_free(&handle->m_pid_vtid_map);
+	scap_id_map_free(&handle->m_tid_vtid_map);
+
 	//
 	// Release the handle
 	//
@@ -1319,10 +1428,7 @@ static uint64_t buf_size_used(scap_t* handle, uint32_t cpu)
 	if (handle->m_bpf)
 	{
 #ifndef _WIN32
-		uint64_t thead;
-		uint64_t ttail;
-
-		scap_bpf_get_buf_pointers(handle->m_devs[cpu].m_buffer, &thead, &ttail, &read_size);
+		read_size = scap_bpf_buf_size_used(handle, cpu);
 #endif
 	}
 	else
@@ -1351,6 +1457,25 @@ static bool are_buffers_empty(scap_t* handle)
 	return true;
 }
 
+#ifndef _WIN32
+//
+// Block until a buffer reaches the wakeup watermark, or until the longest
+// backoff sleep would have expired, so that callers still get regular
+// timeouts when the system is idle
+//
+static int32_t wait_for_buffers(scap_t* handle)
+{
+	if(poll(handle->m_wakeup_pollfds, handle->m_ndevs, BUFFER_EMPTY_WAIT_TIME_US_MAX / 1000) < 0 &&
+	   errno != EINTR)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error waiting for the buffers: %s", scap_strerror(handle, errno));
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+#endif
+
 int32_t refill_read_buffers(scap_t* handle)
 {
 	uint32_t j;
@@ -1361,7 +1486,18 @@ int32_t refill_read_buffers(scap_t* handle)
 #ifdef _WIN32
 		Sleep((DWORD)handle->m_buffer_empty_wait_time_us / 1000);
 #else
-		usleep(handle->m_buffer_empty_wait_time_us);
+		if(handle->m_wakeup_pollfds != NULL)
+		{
+			int32_t res = wait_for_buffers(handle);
+			if(res != SCAP_SUCCESS)
+			{
+				return res;
+			}
+		}
+		else
+		{
+			usleep(handle->m_buffer_empty_wait_time_us);
+		}
 #endif
 		handle->m_buffer_empty_wait_time_us = MIN(handle->m_buffer_empty_wait_time_us * 2,
 							  BUFFER_EMPTY_WAIT_TIME_US_MAX);
@@ -1398,6 +1534,129 @@ int32_t refill_read_buffers(scap_t* handle)
 	return SCAP_TIMEOUT;
 }
 
+int32_t scap_merge_init(scap_t* handle, scap_merge_mode_t mode)
+{
+	handle->m_merge_mode = mode;
+	handle->m_merge_heap = NULL;
+	handle->m_merge_heap_size = 0;
+	handle->m_merge_drained_dev = -1;
+
+	if(mode == SCAP_MERGE_HEAP)
+	{
+		handle->m_merge_heap = (scap_merge_entry*) malloc(handle->m_ndevs * sizeof(scap_merge_entry));
+		if(handle->m_merge_heap == NULL)
+		{
+			return SCAP_FAILURE;
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
+static inline bool merge_entry_less(const scap_merge_entry* a, const scap_merge_entry* b)
+{
+	//
+	// Break timestamp ties on the device index, so that we pick the same
+	// event the linear scan would
+	//
+	return a->ts < b->ts || (a->ts == b->ts && a->cpuid < b->cpuid);
+}
+
+static void merge_heap_sift_down(scap_merge_entry* heap, uint32_t size, uint32_t j)
+{
+	scap_merge_entry e = heap[j];
+
+	while(true)
+	{
+		uint32_t child = 2 * j + 1;
+
+		if(child >= size)
+		{
+			break;
+		}
+
+		if(child + 1 < size && merge_entry_less(&heap[child + 1], &heap[child]))
+		{
+			child++;
+		}
+
+		if(!merge_entry_less(&heap[child], &e))
+		{
+			break;
+		}
+
+		heap[j] = heap[child];
+		j = child;
+	}
+
+	heap[j] = e;
+}
+
+static inline scap_evt* merge_dev_head(scap_t* handle, scap_device* dev)
+{
+	if(handle->m_bpf)
+	{
+#ifndef _WIN32
+		return scap_bpf_evt_from_sample(handle, dev->m_sn_next_event);
+#endif
+	}
+
+	return (scap_evt *) dev->m_sn_next_event;
+}
+
+//
+// Rebuild the heap from the devices that have data after a refill
+//
+static int32_t merge_heap_build(scap_t* handle)
+{
+	uint32_t j;
+	uint32_t size = 0;
+
+	for(j = 0; j < handle->m_ndevs; j++)
+	{
+		scap_device* dev = &(handle->m_devs[j]);
+		scap_evt* pe;
+
+		if(dev->m_sn_len == 0)
+		{
+			//
+			// Nothing to serve from this ring, so don't sit on
+			// whatever the refill reserved
+			//
+			if(dev->m_lastreadsize > 0)
+			{
+				scap_advance_tail(handle, j);
+			}
+
+			continue;
+		}
+
+		pe = merge_dev_head(handle, dev);
+		if(pe->len > dev->m_sn_len)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next buffer corruption");
+			ASSERT(false);
+			return SCAP_FAILURE;
+		}
+
+		handle->m_merge_heap[size].ts = pe->ts;
+		handle->m_merge_heap[size].cpuid = j;
+		size++;
+	}
+
+	handle->m_merge_heap_size = size;
+
+	if(size > 1)
+	{
+		for(j = size / 2; j-- > 0;)
+		{
+			merge_heap_sift_down(handle->m_merge_heap, size, j);
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
 #endif // HAS_CAPTURE
 
 #ifndef _WIN32
@@ -1442,7 +1701,7 @@ static int32_t scap_next_live(scap_t* handle, OUT scap_evt** pevent, OUT uint16_
 		if(handle->m_bpf)
 		{
 #ifndef _WIN32
-			pe = scap_bpf_evt_from_perf_sample(dev->m_sn_next_event);
+			pe = scap_bpf_evt_from_sample(handle, dev->m_sn_next_event);
 #endif
 		}
 		else
@@ -1512,9 +1771,9 @@ static int32_t scap_next_live(scap_t* handle, OUT scap_evt** pevent, OUT uint16_
 }
 
 #ifndef _WIN32
-static inline int32_t scap_next_udig(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+static inline int32_t scap_next_live_heap(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
 #else
-static int32_t scap_next_udig(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+static int32_t scap_next_live_heap(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
 #endif
 {
 #if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
@@ -1524,98 +1783,324 @@ static int32_t scap_next_udig(scap_t* handle, OUT scap_evt** pevent, OUT uint16_
 	ASSERT(false);
 	return SCAP_FAILURE;
 #else
-	uint32_t j;
-	uint64_t max_ts = 0xffffffffffffffffLL;
-	scap_evt* pe = NULL;
-	uint32_t ndevs = handle->m_ndevs;
-
-	*pcpuid = 65535;
+	scap_merge_entry* heap = handle->m_merge_heap;
+	scap_device* dev;
+	scap_evt* pe;
+	uint32_t cpuid;
 
-	for(j = 0; j < ndevs; j++)
+	//
+	// The caller is done with the event we returned last time, so the
+	// ring it drained can be handed back to the producer
+	//
+	if(handle->m_merge_drained_dev != -1)
 	{
-		scap_device* dev = &(handle->m_devs[j]);
-
-		if(dev->m_sn_len == 0)
-		{
-			//
-			// If we don't have data from this ring, but we are
-			// still occupying, free the resources for the
-			// producer rather than sitting on them.
-			//
-			if(dev->m_lastreadsize > 0)
-			{
-				scap_advance_tail(handle, j);
-			}
-
-			continue;
-		}
-
-		pe = (scap_evt *) dev->m_sn_next_event;
+		scap_advance_tail(handle, handle->m_merge_drained_dev);
+		handle->m_merge_drained_dev = -1;
+	}
 
+	if(handle->m_merge_heap_size == 0)
+	{
 		//
-		// We want to consume the event with the lowest timestamp
+		// All the buffers have been consumed. Refill them and
+		// rebuild the heap; like scap_next_live(), we report a
+		// timeout and start serving events at the next call.
 		//
-		if(pe->ts < max_ts)
+		int32_t res = refill_read_buffers(handle);
+		if(res != SCAP_TIMEOUT)
 		{
-			if(pe->len > dev->m_sn_len)
-			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next buffer corruption");
-
-				//
-				// if you get the following assertion, first recompile the driver and libscap
-				//
-				ASSERT(false);
-				return SCAP_FAILURE;
-			}
+			return res;
+		}
 
-			*pevent = pe;
-			*pcpuid = j;
-			max_ts = pe->ts;
+		if((res = merge_heap_build(handle)) != SCAP_SUCCESS)
+		{
+			return res;
 		}
+
+		return SCAP_TIMEOUT;
 	}
 
+	cpuid = heap[0].cpuid;
+	dev = &handle->m_devs[cpuid];
+	pe = merge_dev_head(handle, dev);
+
+	*pevent = pe;
+	*pcpuid = (uint16_t)cpuid;
+
 	//
-	// Check which buffer has been picked
+	// Update the pointers.
 	//
-	if(*pcpuid != 65535)
+	if(handle->m_bpf)
 	{
-		struct scap_device *dev = &handle->m_devs[*pcpuid];
-		ASSERT(dev->m_sn_len >= (*pevent)->len);
-		dev->m_sn_len -= (*pevent)->len;
-		dev->m_sn_next_event += (*pevent)->len;
+#ifndef _WIN32
+		scap_bpf_advance_to_evt(handle, cpuid, true,
+					dev->m_sn_next_event,
+					&dev->m_sn_next_event,
+					&dev->m_sn_len);
+#endif
+	}
+	else
+	{
+		ASSERT(dev->m_sn_len >= pe->len);
+		dev->m_sn_len -= pe->len;
+		dev->m_sn_next_event += pe->len;
+	}
+
+	if(dev->m_sn_len == 0)
+	{
+		handle->m_merge_drained_dev = cpuid;
+		handle->m_merge_heap_size--;
+		if(handle->m_merge_heap_size > 0)
+		{
+			heap[0] = heap[handle->m_merge_heap_size];
+			merge_heap_sift_down(heap, handle->m_merge_heap_size, 0);
+		}
 
 		return SCAP_SUCCESS;
 	}
-	else
+
+	pe = merge_dev_head(handle, dev);
+	if(pe->len > dev->m_sn_len)
 	{
-		//
-		// All the buffers have been consumed. Check if there's enough data to keep going or
-		// if we should wait.
-		//
-		return refill_read_buffers(handle);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next buffer corruption");
+		ASSERT(false);
+		return SCAP_FAILURE;
 	}
-#endif
-}
 
-#ifndef _WIN32
-static int32_t scap_next_nodriver(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
-{
-	static scap_evt evt;
-	evt.len = 0;
-	evt.tid = -1;
-	evt.type = PPME_SYSDIGEVENT_X;
-	evt.nparams = 0;
+	heap[0].ts = pe->ts;
 
-	usleep(100000);
+	//
+	// Fast path for bursts coming from a single CPU: if the new head of
+	// the ring is still not later than the heads of both children, the
+	// same device stays at the root and there's nothing to reorder.
+	//
+	if((handle->m_merge_heap_size < 2 || !merge_entry_less(&heap[1], &heap[0])) &&
+	   (handle->m_merge_heap_size < 3 || !merge_entry_less(&heap[2], &heap[0])))
+	{
+		return SCAP_SUCCESS;
+	}
 
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
+	merge_heap_sift_down(heap, handle->m_merge_heap_size, 0);
 
-	evt.ts = tv.tv_sec * (uint64_t) 1000000000 + tv.tv_usec * 1000;
-	*pevent = &evt;
 	return SCAP_SUCCESS;
+#endif
 }
-#endif // _WIN32
+
+#ifndef _WIN32
+static inline int32_t scap_next_live_batch(scap_t* handle, OUT scap_evt** pevents, uint32_t max_evts, OUT uint32_t* pnevts, OUT uint16_t* pcpuid)
+#else
+static int32_t scap_next_live_batch(scap_t* handle, OUT scap_evt** pevents, uint32_t max_evts, OUT uint32_t* pnevts, OUT uint16_t* pcpuid)
+#endif
+{
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+	//
+	// this should be prevented at open time
+	//
+	ASSERT(false);
+	return SCAP_FAILURE;
+#else
+	uint32_t k;
+	uint32_t ndevs = handle->m_ndevs;
+
+	for(k = 0; k < ndevs; k++)
+	{
+		uint32_t j = (handle->m_batch_next_dev + k) % ndevs;
+		scap_device* dev = &(handle->m_devs[j]);
+		uint32_t n = 0;
+
+		if(dev->m_sn_len == 0)
+		{
+			//
+			// The caller is done with whatever we returned from
+			// this ring, so hand the whole run back to the producer
+			// in one go.
+			//
+			if(dev->m_lastreadsize > 0)
+			{
+				scap_advance_tail(handle, j);
+			}
+
+			continue;
+		}
+
+		while(dev->m_sn_len > 0 && n < max_evts)
+		{
+			scap_evt* pe;
+			bool suppressed;
+			int32_t res;
+
+			if(handle->m_bpf)
+			{
+#ifndef _WIN32
+				pe = scap_bpf_evt_from_sample(handle, dev->m_sn_next_event);
+#endif
+			}
+			else
+			{
+				pe = (scap_evt *) dev->m_sn_next_event;
+			}
+
+			if(pe->len > dev->m_sn_len)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next buffer corruption");
+				ASSERT(false);
+				return SCAP_FAILURE;
+			}
+
+			if(handle->m_bpf)
+			{
+#ifndef _WIN32
+				scap_bpf_advance_to_evt(handle, j, true,
+							dev->m_sn_next_event,
+							&dev->m_sn_next_event,
+							&dev->m_sn_len);
+#endif
+			}
+			else
+			{
+				dev->m_sn_len -= pe->len;
+				dev->m_sn_next_event += pe->len;
+			}
+
+			if((res = scap_check_suppressed(handle, pe, &suppressed)) != SCAP_SUCCESS)
+			{
+				return res;
+			}
+
+			if(suppressed)
+			{
+				handle->m_num_suppressed_evts++;
+				continue;
+			}
+
+			handle->m_evtcnt++;
+			pevents[n++] = pe;
+		}
+
+		handle->m_batch_next_dev = (j + 1) % ndevs;
+
+		if(n == 0)
+		{
+			return SCAP_TIMEOUT;
+		}
+
+		*pnevts = n;
+		*pcpuid = (uint16_t)j;
+		return SCAP_SUCCESS;
+	}
+
+	//
+	// All the buffers have been consumed. Check if there's enough data to keep going or
+	// if we should wait.
+	//
+	return refill_read_buffers(handle);
+#endif
+}
+
+#ifndef _WIN32
+static inline int32_t scap_next_udig(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+#else
+static int32_t scap_next_udig(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+#endif
+{
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+	//
+	// this should be prevented at open time
+	//
+	ASSERT(false);
+	return SCAP_FAILURE;
+#else
+	uint32_t j;
+	uint64_t max_ts = 0xffffffffffffffffLL;
+	scap_evt* pe = NULL;
+	uint32_t ndevs = handle->m_ndevs;
+
+	*pcpuid = 65535;
+
+	for(j = 0; j < ndevs; j++)
+	{
+		scap_device* dev = &(handle->m_devs[j]);
+
+		if(dev->m_sn_len == 0)
+		{
+			//
+			// If we don't have data from this ring, but we are
+			// still occupying, free the resources for the
+			// producer rather than sitting on them.
+			//
+			if(dev->m_lastreadsize > 0)
+			{
+				scap_advance_tail(handle, j);
+			}
+
+			continue;
+		}
+
+		pe = (scap_evt *) dev->m_sn_next_event;
+
+		//
+		// We want to consume the event with the lowest timestamp
+		//
+		if(pe->ts < max_ts)
+		{
+			if(pe->len > dev->m_sn_len)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next buffer corruption");
+
+				//
+				// if you get the following assertion, first recompile the driver and libscap
+				//
+				ASSERT(false);
+				return SCAP_FAILURE;
+			}
+
+			*pevent = pe;
+			*pcpuid = j;
+			max_ts = pe->ts;
+		}
+	}
+
+	//
+	// Check which buffer has been picked
+	//
+	if(*pcpuid != 65535)
+	{
+		struct scap_device *dev = &handle->m_devs[*pcpuid];
+		ASSERT(dev->m_sn_len >= (*pevent)->len);
+		dev->m_sn_len -= (*pevent)->len;
+		dev->m_sn_next_event += (*pevent)->len;
+
+		return SCAP_SUCCESS;
+	}
+	else
+	{
+		//
+		// All the buffers have been consumed. Check if there's enough data to keep going or
+		// if we should wait.
+		//
+		return refill_read_buffers(handle);
+	}
+#endif
+}
+
+#ifndef _WIN32
+static int32_t scap_next_nodriver(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
+{
+	static scap_evt evt;
+	evt.len = 0;
+	evt.tid = -1;
+	evt.type = PPME_SYSDIGEVENT_X;
+	evt.nparams = 0;
+
+	usleep(100000);
+
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+
+	evt.ts = tv.tv_sec * (uint64_t) 1000000000 + tv.tv_usec * 1000;
+	*pevent = &evt;
+	return SCAP_SUCCESS;
+}
+#endif // _WIN32
 
 uint64_t scap_max_buf_used(scap_t* handle)
 {
@@ -1649,6 +2134,10 @@ int32_t scap_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
 		{
 			res = scap_next_udig(handle, pevent, pcpuid);
 		}
+		else if(handle->m_merge_mode == SCAP_MERGE_HEAP)
+		{
+			res = scap_next_live_heap(handle, pevent, pcpuid);
+		}
 		else
 		{
 			res = scap_next_live(handle, pevent, pcpuid);
@@ -1688,6 +2177,118 @@ int32_t scap_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
 	return res;
 }
 
+int32_t scap_next_batch(scap_t* handle, OUT scap_evt** pevents, uint32_t max_evts, OUT uint32_t* pnevts, OUT uint16_t* pcpuid)
+{
+	int32_t res;
+
+	*pnevts = 0;
+
+	if(max_evts == 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next_batch: empty event array");
+		return SCAP_ILLEGAL_INPUT;
+	}
+
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		//
+		// Offline and nodriver captures have no per-CPU rings,
+		// so just serve them one event at a time
+		//
+		res = scap_next(handle, &pevents[0], pcpuid);
+		if(res == SCAP_SUCCESS)
+		{
+			*pnevts = 1;
+		}
+
+		return res;
+	}
+
+	return scap_next_live_batch(handle, pevents, max_evts, pnevts, pcpuid);
+}
+
+int32_t scap_next_dev(scap_t* handle, uint16_t cpuid, OUT scap_evt** pevent)
+{
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT) || defined(_WIN32)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next_dev not supported on %s", PLATFORM_NAME);
+	return SCAP_NOT_SUPPORTED;
+#else
+	scap_device* dev;
+	scap_evt* pe;
+
+	if(handle->m_mode != SCAP_MODE_LIVE || handle->m_udig)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next_dev only supported on live kernel captures");
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	if(cpuid >= handle->m_ndevs)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_next_dev: invalid cpu %u", cpuid);
+		return SCAP_ILLEGAL_INPUT;
+	}
+
+	dev = &(handle->m_devs[cpuid]);
+
+	if(dev->m_sn_len == 0)
+	{
+		int32_t res;
+
+		//
+		// The caller is done with the previous run, so give it back
+		// to the producer and pick up whatever was written since
+		//
+		if(dev->m_lastreadsize > 0)
+		{
+			scap_advance_tail(handle, cpuid);
+		}
+
+		res = scap_readbuf(handle, cpuid, &dev->m_sn_next_event, &dev->m_sn_len);
+		if(res != SCAP_SUCCESS)
+		{
+			return res;
+		}
+
+		if(dev->m_sn_len == 0)
+		{
+			return SCAP_TIMEOUT;
+		}
+	}
+
+	if(handle->m_bpf)
+	{
+		pe = scap_bpf_evt_from_sample(handle, dev->m_sn_next_event);
+	}
+	else
+	{
+		pe = (scap_evt *) dev->m_sn_next_event;
+	}
+
+	if(pe->len > dev->m_sn_len)
+	{
+		snprintf(dev->m_lasterr, SCAP_LASTERR_SIZE, "scap_next buffer corruption");
+		ASSERT(false);
+		return SCAP_FAILURE;
+	}
+
+	if(handle->m_bpf)
+	{
+		scap_bpf_advance_to_evt(handle, cpuid, true,
+					dev->m_sn_next_event,
+					&dev->m_sn_next_event,
+					&dev->m_sn_len);
+	}
+	else
+	{
+		dev->m_sn_len -= pe->len;
+		dev->m_sn_next_event += pe->len;
+	}
+
+	*pevent = pe;
+	return SCAP_SUCCESS;
+#endif
+}
+
 //
 // Return the process list for the given handle
 //
@@ -1709,6 +2310,8 @@ int32_t scap_get_stats(scap_t* handle, OUT scap_stats* stats)
 	stats->n_preemptions = 0;
 	stats->n_suppressed = handle->m_num_suppressed_evts;
 	stats->n_tids_suppressed = HASH_COUNT(handle->m_suppressed_tids);
+	stats->n_map_insert_failures = 0;
+	stats->n_map_evictions = 0;
 
 #if defined(HAS_CAPTURE) && !defined(CYGWING_AGENT)
 	if(handle->m_bpf)
@@ -2094,6 +2697,11 @@ int64_t scap_get_readfile_offset(scap_t* handle)
 		return -1;
 	}
 
+	if(handle->m_file_map != NULL)
+	{
+		return handle->m_file_map_off;
+	}
+
 	return gzoffset(handle->m_file);
 }
 
@@ -2543,6 +3151,27 @@ bool scap_check_suppressed_tid(scap_t *handle, int64_t tid)
 	return (stid != NULL);
 }
 
+int32_t scap_check_suppressed_evt(scap_t *handle, scap_evt *pevent, OUT bool *suppressed)
+{
+	int32_t res = scap_check_suppressed(handle, pevent, suppressed);
+
+	if(res != SCAP_SUCCESS)
+	{
+		return res;
+	}
+
+	if(*suppressed)
+	{
+		handle->m_num_suppressed_evts++;
+	}
+	else
+	{
+		handle->m_evtcnt++;
+	}
+
+	return SCAP_SUCCESS;
+}
+
 int32_t scap_set_fullcapture_port_range(scap_t* handle, uint16_t range_start, uint16_t range_end)
 {
 	//
@@ -2663,6 +3292,161 @@ int32_t scap_set_statsd_port(scap_t* const handle, const uint16_t port)
 #endif
 }
 
+static int32_t scap_set_tcp_stats_aggregation(scap_t *handle, bool enable)
+{
+	//
+	// Not supported on files
+	//
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "tcp stats aggregation not supported on this scap mode");
+		return SCAP_FAILURE;
+	}
+
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+	if(handle->m_bpf)
+	{
+		return scap_bpf_set_tcp_stats_aggregation(handle, enable);
+	}
+	else
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "tcp stats aggregation not supported on kernel module");
+		return SCAP_FAILURE;
+	}
+#endif
+}
+
+int32_t scap_enable_tcp_stats_aggregation(scap_t *handle)
+{
+	return scap_set_tcp_stats_aggregation(handle, true);
+}
+
+int32_t scap_disable_tcp_stats_aggregation(scap_t *handle)
+{
+	return scap_set_tcp_stats_aggregation(handle, false);
+}
+
+int32_t scap_read_tcp_stats(scap_t *handle, scap_tcp_stats *stats, uint32_t max, uint32_t *nstats)
+{
+	*nstats = 0;
+
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "tcp stats not supported on this scap mode");
+		return SCAP_FAILURE;
+	}
+
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+	if(handle->m_bpf)
+	{
+		return scap_bpf_read_tcp_stats(handle, stats, max, nstats);
+	}
+	else
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "tcp stats not supported on kernel module");
+		return SCAP_FAILURE;
+	}
+#endif
+}
+
+int32_t scap_set_kernel_prefilter(scap_t *handle, const scap_prefilter *prefilter)
+{
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "prefiltering not supported on this scap mode");
+		return SCAP_FAILURE;
+	}
+
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+	if(handle->m_bpf)
+	{
+		return scap_bpf_set_kernel_prefilter(handle, prefilter);
+	}
+	else
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "prefiltering not supported on kernel module");
+		return SCAP_FAILURE;
+	}
+#endif
+}
+
+static int32_t scap_set_detailed_stats(scap_t *handle, bool enable)
+{
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "detailed stats not supported on this scap mode");
+		return SCAP_FAILURE;
+	}
+
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+	if(handle->m_bpf)
+	{
+		return scap_bpf_set_detailed_stats(handle, enable);
+	}
+	else
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "detailed stats not supported on kernel module");
+		return SCAP_FAILURE;
+	}
+#endif
+}
+
+int32_t scap_enable_detailed_stats(scap_t *handle)
+{
+	return scap_set_detailed_stats(handle, true);
+}
+
+int32_t scap_disable_detailed_stats(scap_t *handle)
+{
+	return scap_set_detailed_stats(handle, false);
+}
+
+int32_t scap_get_detailed_stats(scap_t *handle, scap_evt_type_stats *stats, uint32_t ncpus)
+{
+	if(handle->m_mode != SCAP_MODE_LIVE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "detailed stats not supported on this scap mode");
+		return SCAP_FAILURE;
+	}
+
+#if !defined(HAS_CAPTURE) || defined(CYGWING_AGENT)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+	if(handle->m_bpf)
+	{
+		return scap_bpf_get_detailed_stats(handle, stats, ncpus);
+	}
+	else
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "detailed stats not supported on kernel module");
+		return SCAP_FAILURE;
+	}
+#endif
+}
+
+uint32_t scap_get_possible_cpus(scap_t *handle)
+{
+	if(handle->m_bpf && handle->m_bpf_possible_cpus > 0)
+	{
+		return handle->m_bpf_possible_cpus;
+	}
+
+	return handle->m_ndevs;
+}
+
 int32_t scap_enable_skb_capture(scap_t *handle)
 {
 	//
@@ -2722,82 +3506,56 @@ int32_t scap_disable_skb_capture(scap_t *handle)
 #endif
 }
 
-void delete_pid_vtid_map(scap_t *handle, uint64_t pid, uint64_t tid){
-	uint64_t vtid = get_tid_vtid_map(handle, tid);
-	if(vtid == 0){
-		return ;
-	}
-	uint64_t pid_vtid = pid<<32 | (vtid & 0xFFFFFFFF);
-	pid_vtid_info *pvi;
-	HASH_FIND_INT64(handle->m_pid_vtid_info, &pid_vtid, pvi);
-	if(pvi!=NULL){
-		HASH_DEL(handle->m_pid_vtid_info, pvi);
-		free(pvi);
+void delete_pid_vtid_map(scap_t *handle, uint64_t pid, uint64_t tid)
+{
+	uint64_t vtid = scap_id_map_get(&handle->m_tid_vtid_map, tid);
+
+	if(vtid == 0)
+	{
+		return;
 	}
-	delete_tid_vtid_map(handle, tid);
+
+	scap_id_map_delete(&handle->m_pid_vtid_map, pid << 32 | (vtid & 0xFFFFFFFF));
+	scap_id_map_delete(&handle->m_tid_vtid_map, tid);
 }
 
-uint64_t get_pid_vtid_map(scap_t *handle, uint64_t pid, uint64_t vtid){
-	uint64_t pid_vtid = pid<<32 | (vtid & 0xFFFFFFFF);
-	int32_t uth_status = SCAP_SUCCESS;
-	pid_vtid_info *pvi;
-	HASH_FIND_INT64(handle->m_pid_vtid_info, &pid_vtid, pvi);
-	if(pvi!=NULL){
-		return pvi->tid;
-	}else{
-		return 0;
-	}
+uint64_t get_pid_vtid_map(scap_t *handle, uint64_t pid, uint64_t vtid)
+{
+	return scap_id_map_get_concurrent(&handle->m_pid_vtid_map, pid << 32 | (vtid & 0xFFFFFFFF));
 }
 
-bool put_pid_vtid_map(scap_t *handle, uint64_t pid, uint64_t tid, uint64_t vtid){
-	int32_t uth_status = SCAP_SUCCESS;
-	pid_vtid_info *pvi;
-	uint64_t pid_vtid = pid<<32 | (vtid & 0xFFFFFFFF);
-	HASH_FIND_INT64(handle->m_pid_vtid_info, &pid_vtid, pvi);
-	if(pvi==NULL){
-		pvi = (struct pid_vtid_info*)malloc(sizeof(pid_vtid_info));
-		pvi->pid_vtid = pid_vtid;
-		pvi->tid = tid;
-		uth_status = SCAP_SUCCESS;
-		HASH_ADD_INT64(handle->m_pid_vtid_info, pid_vtid, pvi);
-	}else {
-		pvi->tid = tid;
+bool put_pid_vtid_map(scap_t *handle, uint64_t pid, uint64_t tid, uint64_t vtid)
+{
+	if(!scap_id_map_put(&handle->m_pid_vtid_map, pid << 32 | (vtid & 0xFFFFFFFF), tid))
+	{
+		return false;
 	}
-	put_tid_vtid_map(handle, tid, vtid);
-	return true;
+
+	return put_tid_vtid_map(handle, tid, vtid);
 }
 
-bool put_tid_vtid_map(scap_t *handle, uint64_t tid, uint64_t vtid){
-	int32_t uth_status = SCAP_SUCCESS;
-	tid_vtid_info *tvi;
-	HASH_FIND_INT64(handle->m_tid_vtid_info, &tid, tvi);
-	if(tvi==NULL){
-		tvi = (struct tid_vtid_info*)malloc(sizeof(tid_vtid_info));
-		tvi->vtid = vtid;
-		tvi->tid = tid;
-		uth_status = SCAP_SUCCESS;
-		HASH_ADD_INT64(handle->m_tid_vtid_info, tid, tvi);
-	}else {
-		tvi->vtid = vtid;
-	}
-	return true;
+bool put_tid_vtid_map(scap_t *handle, uint64_t tid, uint64_t vtid)
+{
+	return scap_id_map_put(&handle->m_tid_vtid_map, tid, vtid);
 }
 
-void delete_tid_vtid_map(scap_t *handle, uint64_t tid){
-	tid_vtid_info *tvi;
-	HASH_FIND_INT64(handle->m_tid_vtid_info, &tid, tvi);
-	if(tvi!=NULL){
-		HASH_DEL(handle->m_tid_vtid_info, tvi);
-		free(tvi);
+void scap_proc_put_vtid_map(scap_t* handle, scap_threadinfo* tinfo)
+{
+	//
+	// Only containerized threads have a different vtid
+	//
+	if(tinfo->vtid != 0 && (uint64_t)tinfo->vtid != tinfo->tid)
+	{
+		put_pid_vtid_map(handle, tinfo->pid, tinfo->tid, tinfo->vtid);
 	}
 }
 
-uint64_t get_tid_vtid_map(scap_t *handle,uint64_t tid){
-	tid_vtid_info *tvi;
-	HASH_FIND_INT64(handle->m_tid_vtid_info, &tid, tvi);
-	if(tvi!=NULL){
-		return tvi->vtid;
-	}else{
-		return 0;
-	}
-}
\ No newline at end of file
+void delete_tid_vtid_map(scap_t *handle, uint64_t tid)
+{
+	scap_id_map_delete(&handle->m_tid_vtid_map, tid);
+}
+
+uint64_t get_tid_vtid_map(scap_t *handle, uint64_t tid)
+{
+	return scap_id_map_get_concurrent(&handle->m_tid_vtid_map, tid);
+}
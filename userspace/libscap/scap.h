@@ -111,8 +111,59 @@ typedef struct scap_stats
 	uint64_t n_preemptions; ///< Number of preemptions.
 	uint64_t n_suppressed; ///< Number of events skipped due to the tid being in a set of suppressed tids
 	uint64_t n_tids_suppressed; ///< Number of threads currently being suppressed
+	uint64_t n_map_insert_failures; ///< Number of failed insertions in the eBPF probe's state maps, e.g. because they were full.
+	uint64_t n_map_evictions; ///< Number of entries the kernel evicted from the eBPF probe's per-thread LRU state maps because they were full.
 }scap_stats;
 
+#define SCAP_TCP_STATS_RTT_BUCKETS 32
+
+/*!
+  \brief Aggregated counters of a TCP connection, see scap_read_tcp_stats().
+  Addresses and ports are in network byte order.
+*/
+typedef struct scap_tcp_stats
+{
+	uint32_t saddr; ///< Local IPv4 address.
+	uint32_t daddr; ///< Remote IPv4 address.
+	uint16_t sport; ///< Local port.
+	uint16_t dport; ///< Remote port.
+	uint16_t family; ///< Address family of the socket.
+	uint64_t rtt_min; ///< Smallest smoothed RTT seen, in microseconds.
+	uint64_t rtt_max; ///< Largest smoothed RTT seen, in microseconds.
+	uint64_t rtt_sum; ///< Sum of the smoothed RTT samples, in microseconds.
+	uint64_t rtt_count; ///< Number of RTT samples.
+	uint64_t rtt_hist[SCAP_TCP_STATS_RTT_BUCKETS]; ///< Bucket n counts the RTT samples in [2^n, 2^(n+1)) microseconds.
+	uint64_t retransmits; ///< Number of retransmitted segments.
+	uint64_t drops; ///< Number of dropped packets.
+	bool closed; ///< The connection was closed.
+}scap_tcp_stats;
+
+/*!
+  \brief Events the eBPF probe drops before filling them, see
+  scap_set_kernel_prefilter(). An event is kept if its process is in tgids
+  or its thread in one of the cgroup_ids, when either is non empty, and
+  then sampled by the ratio of its type.
+*/
+typedef struct scap_prefilter
+{
+	const uint64_t* cgroup_ids; ///< cgroup v2 ids, i.e. the inode numbers of the cgroup directories.
+	uint32_t ncgroup_ids; ///< Number of cgroup ids, 0 to not filter by cgroup.
+	const uint32_t* tgids; ///< Process ids.
+	uint32_t ntgids; ///< Number of process ids, 0 to not filter by process.
+	const uint32_t* sampling_ratios; ///< PPM_EVENT_MAX ratios indexed by event type, 1 in every ratio events is kept (0 and 1 keep them all). NULL to not sample.
+}scap_prefilter;
+
+/*!
+  \brief Counters of an event type on a CPU, see scap_get_detailed_stats().
+*/
+typedef struct scap_evt_type_stats
+{
+	uint64_t n_evts; ///< Number of events of this type written to the buffer.
+	uint64_t n_bytes; ///< Total size of those events.
+	uint64_t n_drops_buffer; ///< Number of events of this type dropped because the buffer was full.
+	uint64_t filler_ns; ///< Time spent from the tracepoint to the end of the fillers for events of this type, written or not, in nanoseconds.
+}scap_evt_type_stats;
+
 /*!
   \brief Information about the parameter of an event
 */
@@ -224,20 +275,6 @@ typedef struct scap_fdinfo
 	UT_hash_handle hh; ///< makes this structure hashable
 }scap_fdinfo;
 
-typedef struct pid_vtid_info
-{
-	uint64_t pid_vtid; ///< The id of the process containing this thread. In single thread processes, this is equal to tid.
-	uint64_t tid;
-	UT_hash_handle hh; ///< makes this structure hashable
-}pid_vtid_info;
-
-typedef struct tid_vtid_info
-{
-	uint64_t tid;
-	uint64_t vtid;
-	UT_hash_handle hh; ///< makes this structure hashable
-}tid_vtid_info;
-
 /*!
   \brief Process information
 */
@@ -318,6 +355,23 @@ typedef enum {
 	SCAP_MODE_NODRIVER,
 } scap_mode_t;
 
+/*!
+  \brief How a live capture merges the per-CPU ring buffers into a single
+  timestamp-ordered stream
+*/
+typedef enum {
+	/*!
+	 * Scan the head of every ring on each scap_next() call. This is the
+	 * cheapest option when there are only a few CPUs.
+	 */
+	SCAP_MERGE_LINEAR = 0,
+	/*!
+	 * Keep the ring heads in a min-heap ordered by timestamp, so that each
+	 * event costs O(log ncpus) instead of O(ncpus).
+	 */
+	SCAP_MERGE_HEAP,
+} scap_merge_mode_t;
+
 typedef struct scap_open_args
 {
 	scap_mode_t mode;
@@ -336,6 +390,12 @@ typedef struct scap_open_args
 	void(*debug_log_fn)(const char* msg); // Function which SCAP may use to log a debug message
 	uint64_t proc_scan_timeout_ms; // Timeout in msec, after which so-far-successful scan of /proc should be cut short with success return
 	uint64_t proc_scan_log_interval_ms; // Interval for logging progress messages from /proc scan
+	scap_merge_mode_t merge_mode; ///< How the per-CPU buffers are merged in live mode. See scap_merge_mode_t.
+	uint32_t wakeup_watermark; ///< If non-zero, scap_next() blocks in poll() on the driver when the buffers are empty,
+	                           // and is woken up as soon as a buffer holds this many bytes. If zero, it sleeps
+	                           // with an exponential backoff instead. Ignored by udig.
+	uint32_t proc_scan_threads; ///< Number of threads scanning /proc when the capture is opened. 0 or 1 scan it
+	                            // on the calling thread. Ignored if there are suppressed comms.
 }scap_open_args;
 
 
@@ -523,7 +583,8 @@ typedef enum event_direction
 typedef enum compression_mode
 {
 	SCAP_COMPRESSION_NONE = 0,
-	SCAP_COMPRESSION_GZIP = 1
+	SCAP_COMPRESSION_GZIP = 1,
+	SCAP_COMPRESSION_CHUNKED = 2 ///< The events are compressed in independent chunks, and the file is indexed by timestamp. See scap_fseek_ts().
 }compression_mode;
 
 /*!
@@ -687,6 +748,61 @@ uint64_t scap_max_buf_used(scap_t* handle);
 */
 int32_t scap_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid);
 
+/*!
+  \brief Get a run of consecutive events from a single CPU buffer, without
+  ordering them against the other CPUs.
+
+  The events point straight into the ring buffer and remain valid until the next
+  call to scap_next_batch(). Successive calls rotate over the CPUs. Events are in
+  timestamp order within a batch, but not across batches. Don't mix this with
+  scap_next() on the same handle. Offline captures return one event per call.
+
+  \param handle Handle to the capture instance.
+  \param pevents User-provided array that will be filled with up to max_evts event pointers.
+  \param max_evts Size of the pevents array.
+  \param pnevts User-provided pointer that will be initialized with the number of events returned.
+  \param pcpuid User-provided pointer that will be initialized with the ID of the CPU
+    where all the returned events were captured.
+
+  \return SCAP_SUCCESS if the call is successful and at least one event was returned.
+   SCAP_TIMEOUT in case the read timeout expired and no event is available.
+   SCAP_EOF when the end of an offline capture is reached.
+   On Failure, SCAP_FAILURE is returned and scap_getlasterr() can be used to obtain the cause of the error.
+*/
+int32_t scap_next_batch(scap_t* handle, OUT scap_evt** pevents, uint32_t max_evts, OUT uint32_t* pnevts, OUT uint16_t* pcpuid);
+
+/*!
+  \brief Get the next event from a single CPU buffer of a live capture.
+
+  The event points straight into the ring buffer and remains valid until the
+  next call to scap_next_dev() for the same CPU. Calls for different CPUs only
+  touch their own buffer, so they can be issued concurrently from different
+  threads. Since no state shared across CPUs is touched, comm suppression and
+  the event counter are not applied here: the consumer must pass each event to
+  scap_check_suppressed_evt(), from a single thread.
+  Don't mix this with scap_next() or scap_next_batch() on the same handle.
+
+  \param handle Handle to the capture instance.
+  \param cpuid The CPU buffer to read from, lower than scap_get_ndevs().
+  \param pevent User-provided event pointer that will be initialized with address of the event.
+
+  \return SCAP_SUCCESS if the call is successful and pevent contains valid data.
+   SCAP_TIMEOUT if the buffer is empty. The call does not sleep.
+   SCAP_NOT_SUPPORTED if the handle is not a kernel module or BPF live capture.
+   On Failure, SCAP_FAILURE is returned and scap_dev_getlasterr() can be used to obtain the cause of the error.
+*/
+int32_t scap_next_dev(scap_t* handle, uint16_t cpuid, OUT scap_evt** pevent);
+
+/*!
+  \brief Return a string with the last error that scap_next_dev() hit on the
+  given CPU. Unlike scap_getlasterr(), it's not shared with the readers of the
+  other CPUs.
+
+  \param handle Handle to the capture instance.
+  \param cpuid The CPU that was passed to scap_next_dev().
+*/
+const char* scap_dev_getlasterr(scap_t* handle, uint16_t cpuid);
+
 /*!
   \brief Get the length of an event
 
@@ -799,6 +915,22 @@ int64_t scap_dump_ftell(scap_dumper_t *d);
 */
 void scap_dump_flush(scap_dumper_t *d);
 
+/*!
+  \brief Make the writes to a trace file asynchronous. From now on the
+  blocks are copied into staging buffers of buffer_size bytes, and a
+  background thread writes (and compresses) the full ones. The caller only
+  waits when all the buffers are queued, i.e. when the disk or zlib can't
+  keep up.
+
+  \param d The dump handle, returned by \ref scap_dump_open
+  \param buffer_size The size of the staging buffers, 0 for the default (1MB).
+
+  \return SCAP_SUCCESS if the call is successful, SCAP_NOT_SUPPORTED for
+   memory dumps and on Windows.
+  \note scap_dump_get_offset() only counts the buffers written so far.
+*/
+int32_t scap_dump_enable_async(scap_dumper_t *d, uint32_t buffer_size);
+
 /*!
   \brief Tell how many bytes would be written (a dry run of scap_dump)
 
@@ -822,11 +954,20 @@ int32_t scap_number_of_bytes_to_write(scap_evt *e, uint16_t cpuid, int32_t* byte
   \param flags The event flags. 0 means no flags.
 
   \return SCAP_SUCCESS if the call is successful.
-   On Failure, SCAP_FAILURE is returned and scap_getlasterr() can be used to obtain
-   the cause of the error.
+   On Failure, SCAP_FAILURE is returned and scap_dump_getlasterr() can be used to obtain
+   the cause of the error. The error is also copied to scap_getlasterr().
 */
 int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt* e, uint16_t cpuid, uint32_t flags);
 
+/*!
+  \brief Return a string with the last error that happened in scap_dump()
+  for this dump. Unlike scap_getlasterr(), it's not shared with the other
+  users of the handle.
+
+  \param d The dump handle, returned by \ref scap_dump_open
+*/
+const char* scap_dump_getlasterr(scap_dumper_t *d);
+
 /*!
   \brief Get the process list for the given capture instance
 
@@ -1036,6 +1177,15 @@ int32_t scap_suppress_events_comm(scap_t* handle, const char *comm);
 
 bool scap_check_suppressed_tid(scap_t *handle, int64_t tid);
 
+/*!
+  \brief Run an event returned by scap_next_dev() through the comm
+  suppression logic, and account for it like scap_next() would.
+
+  Clone and exit events update the set of suppressed tids, so events must
+  be passed in timestamp order from a single thread.
+*/
+int32_t scap_check_suppressed_evt(scap_t *handle, scap_evt *pevent, OUT bool *suppressed);
+
 /*@}*/
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1058,7 +1208,10 @@ uint32_t scap_event_get_sentinel_begin(scap_evt* e);
 
 // Get the information about a process.
 // The returned pointer must be freed via scap_proc_free by the caller.
-struct scap_threadinfo* scap_proc_get(scap_t* handle, int64_t tid, bool scan_sockets);
+// Errors are written to error, SCAP_LASTERR_SIZE bytes owned by the caller,
+// instead of the handle, so this can be called from any thread; the caller
+// records the vtid with scap_proc_put_vtid_map().
+struct scap_threadinfo* scap_proc_get(scap_t* handle, int64_t tid, bool scan_sockets, char *error);
 
 // Check if the given thread exists in ;proc
 bool scap_is_thread_alive(scap_t* handle, int64_t pid, int64_t tid, const char* comm);
@@ -1080,6 +1233,20 @@ void scap_refresh_proc_table(scap_t* handle);
 void scap_set_refresh_proc_table_when_saving(scap_t* handle, bool refresh);
 uint64_t scap_ftell(scap_t *handle);
 void scap_fseek(scap_t *handle, uint64_t off);
+/*!
+  \brief Move the read position of a capture file written with
+  SCAP_COMPRESSION_CHUNKED to the first event at or after ts.
+
+  \return SCAP_SUCCESS, or SCAP_NOT_SUPPORTED if the file has no chunk index
+  (e.g. because it's not chunked, or was truncated) or is compressed as a
+  whole.
+*/
+int32_t scap_fseek_ts(scap_t *handle, uint64_t ts);
+/*!
+  \brief Read the rest of an uncompressed capture file through zlib rather
+  than through its memory mapping, e.g. to compare the two.
+*/
+void scap_disable_file_map(scap_t *handle);
 int32_t scap_enable_tracers_capture(scap_t* handle);
 int32_t scap_enable_page_faults(scap_t *handle);
 int32_t scap_enable_skb_capture(scap_t *handle);
@@ -1126,12 +1293,75 @@ int32_t scap_set_fullcapture_port_range(scap_t* handle, uint16_t range_start, ui
  */
 int32_t scap_set_statsd_port(scap_t* handle, uint16_t port);
 
+/*!
+  \brief Have the eBPF probe aggregate the TCP RTT, retransmit, drop and
+  close kprobes into per-connection counters instead of emitting an event
+  for each of them. The counters are read with scap_read_tcp_stats().
+*/
+int32_t scap_enable_tcp_stats_aggregation(scap_t* handle);
+int32_t scap_disable_tcp_stats_aggregation(scap_t* handle);
+
+/*!
+  \brief Read the aggregated TCP counters of up to max connections into
+  stats, and their number into nstats. Reading removes the connections
+  from the probe's map, so the counters cover what happened since the
+  previous read, and a connection is only reported again if it sees more
+  activity. Connections the probe couldn't add because the map was full
+  are counted in scap_stats.n_map_insert_failures.
+*/
+int32_t scap_read_tcp_stats(scap_t* handle, scap_tcp_stats* stats, uint32_t max, uint32_t* nstats);
+
+/*!
+  \brief Have the eBPF probe drop the events that don't pass prefilter
+  before they reach the fillers and the ring buffers. Events that can't be
+  dropped, e.g. process exits, always pass. A NULL prefilter lets
+  everything through again.
+*/
+int32_t scap_set_kernel_prefilter(scap_t* handle, const scap_prefilter* prefilter);
+
+/*!
+  \brief Have the eBPF probe count the events, bytes, buffer full drops and
+  filler time of each event type on each CPU. The counters are read with
+  scap_get_detailed_stats().
+*/
+int32_t scap_enable_detailed_stats(scap_t* handle);
+int32_t scap_disable_detailed_stats(scap_t* handle);
+
+/*!
+  \brief Read the per event type counters into stats, which has
+  ncpus * PPM_EVENT_MAX entries, the ones of event type t on CPU c being
+  stats[c * PPM_EVENT_MAX + t], c counting the possible CPUs in order.
+  ncpus must be scap_get_possible_cpus(), which can be more than
+  scap_get_ndevs() when some CPUs are offline; a smaller ncpus drops the
+  counters of the CPUs past it. The counters are cumulative since they
+  were first enabled.
+*/
+int32_t scap_get_detailed_stats(scap_t* handle, scap_evt_type_stats* stats, uint32_t ncpus);
+
+/*!
+  \brief Return the number of possible CPUs, which the eBPF probe keeps
+  per-CPU counters for. Without the probe it's scap_get_ndevs().
+*/
+uint32_t scap_get_possible_cpus(scap_t* handle);
+
+/*!
+  \brief Maps between host and namespace thread ids for containerized
+  threads. The get functions can be called from any thread; put and delete
+  must only be called from the thread that reads the events.
+*/
 bool put_pid_vtid_map(scap_t *handle, uint64_t pid, uint64_t tid, uint64_t vtid);
 void delete_pid_vtid_map(scap_t *handle, uint64_t pid, uint64_t vtid);
 uint64_t get_pid_vtid_map(scap_t *handle, uint64_t pid, uint64_t vtid);
 bool put_tid_vtid_map(scap_t *handle, uint64_t tid, uint64_t vtid);
 uint64_t get_tid_vtid_map(scap_t *handle,uint64_t tid);
 void delete_tid_vtid_map(scap_t *handle, uint64_t tid);
+
+/*!
+  \brief Record the vtid of a thread returned by scap_proc_get() in the
+  maps above, if it's containerized. Like put, this must only be called
+  from the thread that reads the events.
+*/
+void scap_proc_put_vtid_map(scap_t* handle, scap_threadinfo* tinfo);
 #ifdef __cplusplus
 }
 #endif
@@ -61,6 +61,7 @@ struct bpf_map_data {
 	int fd;
 	size_t elf_offset;
 	struct bpf_map_def def;
+	char name[64];
 };
 
 static const int BUF_SIZE_PAGES = 2048;
@@ -75,6 +76,18 @@ static const char *g_filler_names[PPM_FILLER_MAX] = {
 };
 #undef FILLER_NAME_FN
 
+//
+// The names of the maps in enum sysdig_state_map, in order
+//
+static const char *g_state_map_names[SYSDIG_STATE_MAP_MAX] = {
+	"on_start_ts",
+	"off_start_ts",
+	"cpu_runq",
+	"type_map",
+	"cpu_focus_threads",
+	"cpu_records",
+};
+
 static int sys_bpf(enum bpf_cmd cmd, union bpf_attr *attr, unsigned int size)
 {
 	return syscall(__NR_bpf, cmd, attr, size);
@@ -129,9 +142,63 @@ static int bpf_map_lookup_elem(int fd, const void *key, void *value)
 	return sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr, sizeof(attr));
 }
 
+static int bpf_map_delete_elem(int fd, const void *key)
+{
+	union bpf_attr attr;
+
+	bzero(&attr, sizeof(attr));
+
+	attr.map_fd = fd;
+	attr.key = (unsigned long) key;
+
+	return sys_bpf(BPF_MAP_DELETE_ELEM, &attr, sizeof(attr));
+}
+
+static int bpf_map_get_next_key(int fd, const void *key, void *next_key)
+{
+	union bpf_attr attr;
+
+	bzero(&attr, sizeof(attr));
+
+	attr.map_fd = fd;
+	attr.key = (unsigned long) key;
+	attr.next_key = (unsigned long) next_key;
+
+	return sys_bpf(BPF_MAP_GET_NEXT_KEY, &attr, sizeof(attr));
+}
+
+static int bpf_map_batch(enum bpf_cmd cmd, int fd, void *in_batch, void *out_batch, void *keys, void *values, uint32_t *count)
+{
+	union bpf_attr attr;
+	int ret;
+
+	bzero(&attr, sizeof(attr));
+
+	attr.batch.map_fd = fd;
+	attr.batch.in_batch = (unsigned long) in_batch;
+	attr.batch.out_batch = (unsigned long) out_batch;
+	attr.batch.keys = (unsigned long) keys;
+	attr.batch.values = (unsigned long) values;
+	attr.batch.count = *count;
+
+	ret = sys_bpf(cmd, &attr, sizeof(attr));
+	*count = attr.batch.count;
+	return ret;
+}
+
+static int bpf_map_lookup_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values, uint32_t *count)
+{
+	return bpf_map_batch(BPF_MAP_LOOKUP_BATCH, fd, in_batch, out_batch, keys, values, count);
+}
+
+static int bpf_map_lookup_and_delete_batch(int fd, void *in_batch, void *out_batch, void *keys, void *values, uint32_t *count)
+{
+	return bpf_map_batch(BPF_MAP_LOOKUP_AND_DELETE_BATCH, fd, in_batch, out_batch, keys, values, count);
+}
+
 static int bpf_map_create(enum bpf_map_type map_type,
 			  int key_size, int value_size, int max_entries,
-			  uint32_t map_flags)
+			  uint32_t map_flags, int inner_map_fd)
 {
 	union bpf_attr attr;
 
@@ -142,9 +209,62 @@ static int bpf_map_create(enum bpf_map_type map_type,
 	attr.value_size = value_size;
 	attr.max_entries = max_entries;
 	attr.map_flags = map_flags;
+	attr.inner_map_fd = inner_map_fd;
 
 	return sys_bpf(BPF_MAP_CREATE, &attr, sizeof(attr));
 }
+
+static int ringbuf_create(uint32_t size)
+{
+	return bpf_map_create(BPF_MAP_TYPE_RINGBUF, 0, 0, size, 0, 0);
+}
+
+//
+// The probe outputs to the array of ring buffers if it was built for a
+// kernel that has them (5.8+), but it might still not be possible to
+// create them with the size we want, e.g. because of RLIMIT_MEMLOCK. In
+// that case, fall back to perf_map, with a dummy ring buffer that's only
+// needed to describe the array to the verifier.
+//
+static int32_t create_ringbuf_array(scap_t *handle, struct bpf_map_data *map)
+{
+	uint32_t size = getpagesize() * BUF_SIZE_PAGES;
+	int inner_fd;
+
+	inner_fd = ringbuf_create(size);
+	if(inner_fd >= 0)
+	{
+		handle->m_bpf_ringbuf = true;
+	}
+	else
+	{
+		handle->m_bpf_ringbuf = false;
+
+		inner_fd = ringbuf_create(getpagesize());
+		if(inner_fd < 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't create ring buffer: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+	}
+
+	map->def.max_entries = handle->m_ncpus;
+	map->fd = bpf_map_create(map->def.type,
+				 map->def.key_size,
+				 map->def.value_size,
+				 map->def.max_entries,
+				 map->def.map_flags,
+				 inner_fd);
+	close(inner_fd);
+
+	if(map->fd < 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't create ring buffer array: %s", scap_strerror(handle, errno));
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
 static uint32_t find_vdso_code()
 {
     char *vdso = (char *) getauxval(AT_SYSINFO_EHDR);
@@ -389,6 +509,7 @@ static int32_t load_elf_maps_section(scap_t *handle, struct bpf_map_data *maps,
 		def = (struct bpf_map_def *)(data_maps->d_buf + offset);
 		maps[i].elf_offset = offset;
 		memcpy(&maps[i].def, def, sizeof(struct bpf_map_def));
+		snprintf(maps[i].name, sizeof(maps[i].name), "%s", elf_strptr(elf, strtabidx, sym[i].st_name));
 	}
 
 	free(sym);
@@ -410,11 +531,24 @@ static int32_t load_maps(scap_t *handle, struct bpf_map_data *maps, int nr_maps)
 			maps[j].def.max_entries = handle->m_ncpus;
 		}
 
+		if(maps[j].def.type == BPF_MAP_TYPE_ARRAY_OF_MAPS)
+		{
+			if(create_ringbuf_array(handle, &maps[j]) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+
+			handle->m_bpf_map_fds[j] = maps[j].fd;
+			handle->m_bpf_ringbuf_map_idx = j;
+			continue;
+		}
+
 		handle->m_bpf_map_fds[j] = bpf_map_create(maps[j].def.type,
 							  maps[j].def.key_size,
 							  maps[j].def.value_size,
 							  maps[j].def.max_entries,
-							  maps[j].def.map_flags);
+							  maps[j].def.map_flags,
+							  0);
 
 		maps[j].fd = handle->m_bpf_map_fds[j];
 
@@ -428,6 +562,38 @@ static int32_t load_maps(scap_t *handle, struct bpf_map_data *maps, int nr_maps)
 		{
 			handle->m_bpf_prog_array_map_idx = j;
 		}
+		else if(strcmp(maps[j].name, "tcp_stats_map") == 0)
+		{
+			handle->m_bpf_tcp_stats_map_idx = j;
+		}
+		else if(strcmp(maps[j].name, "prefilter_tgids") == 0)
+		{
+			handle->m_bpf_prefilter_tgids_map_idx = j;
+		}
+		else if(strcmp(maps[j].name, "prefilter_cgroups") == 0)
+		{
+			handle->m_bpf_prefilter_cgroups_map_idx = j;
+		}
+		else if(strcmp(maps[j].name, "prefilter_sampling") == 0)
+		{
+			handle->m_bpf_prefilter_sampling_map_idx = j;
+		}
+		else if(strcmp(maps[j].name, "evt_type_stats_map") == 0)
+		{
+			handle->m_bpf_evt_type_stats_map_idx = j;
+		}
+		else
+		{
+			int k;
+
+			for(k = 0; k < SYSDIG_STATE_MAP_MAX; k++)
+			{
+				if(strcmp(maps[j].name, g_state_map_names[k]) == 0)
+				{
+					handle->m_bpf_state_map_max_entries[k] = maps[j].def.max_entries;
+				}
+			}
+		}
 	}
 
 	return SCAP_SUCCESS;
@@ -949,6 +1115,53 @@ static void *perf_event_mmap(scap_t *handle, int fd)
 	return tmp;
 }
 
+//
+// Create the ring buffer of a CPU and hook it to the probe. Only the
+// consumer position page can be mapped writable, the producer position and
+// the data pages are mapped read only, with the data mapped twice by the
+// kernel so that records crossing the end can be read linearly.
+//
+static int32_t ringbuf_open(scap_t *handle, int cpu, scap_device *dev)
+{
+	int page_size = getpagesize();
+	uint32_t ring_size = page_size * BUF_SIZE_PAGES;
+	int fd;
+
+	fd = ringbuf_create(ring_size);
+	if(fd < 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't create ring buffer: %s", scap_strerror(handle, errno));
+		return SCAP_FAILURE;
+	}
+
+	dev->m_fd = fd;
+
+	if(bpf_map_update_elem(handle->m_bpf_map_fds[handle->m_bpf_ringbuf_map_idx], &cpu, &fd, BPF_ANY) != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "SYSDIG_RINGBUF_MAPS bpf_map_update_elem < 0: %s", scap_strerror(handle, errno));
+		return SCAP_FAILURE;
+	}
+
+	dev->m_buffer = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(dev->m_buffer == MAP_FAILED)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "ring buffer mmap (1): %s", scap_strerror(handle, errno));
+		return SCAP_FAILURE;
+	}
+
+	void *p = mmap(NULL, page_size + 2 * ring_size, PROT_READ, MAP_SHARED, fd, page_size);
+	if(p == MAP_FAILED)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "ring buffer mmap (2): %s", scap_strerror(handle, errno));
+		return SCAP_FAILURE;
+	}
+
+	dev->m_ringbuf_producer = p;
+	dev->m_ringbuf_size = ring_size;
+
+	return SCAP_SUCCESS;
+}
+
 static int32_t populate_syscall_routing_table_map(scap_t *handle)
 {
 	int j;
@@ -1332,7 +1545,20 @@ int32_t scap_bpf_close(scap_t *handle)
 
 	for(j = 0; j < handle->m_ndevs; j++)
 	{
-		if(handle->m_devs[j].m_buffer != MAP_FAILED)
+		if(handle->m_bpf_ringbuf)
+		{
+			if(handle->m_devs[j].m_buffer != MAP_FAILED)
+			{
+				munmap(handle->m_devs[j].m_buffer, page_size);
+			}
+
+			if(handle->m_devs[j].m_ringbuf_producer != NULL)
+			{
+				munmap(handle->m_devs[j].m_ringbuf_producer, page_size + 2 * ring_size);
+				handle->m_devs[j].m_ringbuf_producer = NULL;
+			}
+		}
+		else if(handle->m_devs[j].m_buffer != MAP_FAILED)
 		{
 #ifdef _DEBUG
 			int ret;
@@ -1371,6 +1597,14 @@ int32_t scap_bpf_close(scap_t *handle)
 
 	handle->m_bpf_prog_cnt = 0;
 	handle->m_bpf_prog_array_map_idx = -1;
+	handle->m_bpf_ringbuf_map_idx = -1;
+	handle->m_bpf_ringbuf = false;
+	handle->m_bpf_tcp_stats_map_idx = -1;
+	handle->m_bpf_prefilter_tgids_map_idx = -1;
+	handle->m_bpf_prefilter_cgroups_map_idx = -1;
+	handle->m_bpf_prefilter_sampling_map_idx = -1;
+	handle->m_bpf_evt_type_stats_map_idx = -1;
+	memset(handle->m_bpf_state_map_max_entries, 0, sizeof(handle->m_bpf_state_map_max_entries));
 
 	return SCAP_SUCCESS;
 }
@@ -1562,6 +1796,64 @@ static int32_t set_runtime_params(scap_t *handle)
 	return SCAP_SUCCESS;
 }
 
+//
+// Per-CPU maps have a value for each possible CPU, which can be more than
+// the configured ones
+//
+static int get_possible_cpus(scap_t *handle)
+{
+	char buf[256];
+	char *p;
+	int ncpus = 0;
+	FILE *fp;
+
+	fp = fopen("/sys/devices/system/cpu/possible", "r");
+	if(fp == NULL)
+	{
+		return handle->m_ncpus;
+	}
+
+	if(fgets(buf, sizeof(buf), fp) == NULL)
+	{
+		fclose(fp);
+		return handle->m_ncpus;
+	}
+
+	fclose(fp);
+
+	//
+	// A list of ranges, e.g. "0-3,8-11" or "0"
+	//
+	p = buf;
+	while(*p != '\0' && *p != '\n')
+	{
+		char *end;
+		long first = strtol(p, &end, 10);
+		long last = first;
+
+		if(end == p)
+		{
+			break;
+		}
+
+		if(*end == '-')
+		{
+			p = end + 1;
+			last = strtol(p, &end, 10);
+		}
+
+		ncpus += last - first + 1;
+
+		p = end;
+		if(*p == ',')
+		{
+			p++;
+		}
+	}
+
+	return ncpus > 0? ncpus : handle->m_ncpus;
+}
+
 static int32_t set_default_settings(scap_t *handle)
 {
 	struct sysdig_bpf_settings settings;
@@ -1593,6 +1885,15 @@ static int32_t set_default_settings(scap_t *handle)
 		settings.switch_agg_num = 16;
 	}
 	memset(settings.if_name, 0, 16);
+
+	//
+	// With ring buffers the probe does the wakeup watermark itself
+	//
+	settings.ringbuf = handle->m_bpf_ringbuf;
+	settings.wakeup_watermark = handle->m_bpf_ringbuf? handle->m_wakeup_watermark : 0;
+	settings.tcp_stats_aggregation = false;
+	settings.prefilter = 0;
+	settings.detailed_stats = false;
 	int i = 0;
 	for (i = 0; i < PPM_EVENT_MAX; i++) {
 	    settings.events_mask[i] = true;
@@ -1623,6 +1924,15 @@ int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe)
 	}
 
 	handle->m_bpf_prog_array_map_idx = -1;
+	handle->m_bpf_ringbuf_map_idx = -1;
+	handle->m_bpf_ringbuf = false;
+	handle->m_bpf_tcp_stats_map_idx = -1;
+	handle->m_bpf_prefilter_tgids_map_idx = -1;
+	handle->m_bpf_prefilter_cgroups_map_idx = -1;
+	handle->m_bpf_prefilter_sampling_map_idx = -1;
+	handle->m_bpf_evt_type_stats_map_idx = -1;
+	memset(handle->m_bpf_state_map_max_entries, 0, sizeof(handle->m_bpf_state_map_max_entries));
+	handle->m_bpf_possible_cpus = get_possible_cpus(handle);
 
 	if(!bpf_probe)
 	{
@@ -1668,6 +1978,16 @@ int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe)
 		};
 		int pmu_fd;
 
+		//
+		// Have the kernel wake up poll() once this many bytes are
+		// available, see scap_open_args.wakeup_watermark
+		//
+		if(handle->m_wakeup_watermark != 0)
+		{
+			attr.watermark = 1;
+			attr.wakeup_watermark = handle->m_wakeup_watermark;
+		}
+
 		if(j > 0)
 		{
 			char filename[SCAP_MAX_PATH_SIZE];
@@ -1705,6 +2025,17 @@ int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe)
 			return SCAP_FAILURE;
 		}
 
+		if(handle->m_bpf_ringbuf)
+		{
+			if(ringbuf_open(handle, j, &handle->m_devs[online_cpu]) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+
+			++online_cpu;
+			continue;
+		}
+
 		pmu_fd = sys_perf_event_open(&attr, -1, j, -1, 0);
 		if(pmu_fd < 0)
 		{
@@ -1755,7 +2086,10 @@ int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe)
 
 int32_t scap_bpf_get_stats(scap_t* handle, OUT scap_stats* stats)
 {
+	uint64_t inserts[SYSDIG_STATE_MAP_MAX] = {0};
+	uint64_t deletes[SYSDIG_STATE_MAP_MAX] = {0};
 	int j;
+	int k;
 
 	for(j = 0; j < handle->m_ncpus; j++)
 	{
@@ -1770,10 +2104,31 @@ int32_t scap_bpf_get_stats(scap_t* handle, OUT scap_stats* stats)
 		stats->n_drops_buffer += handle->m_devs[j].m_evt_lost + v.n_drops_buffer;
 		stats->n_drops_pf += v.n_drops_pf;
 		stats->n_drops_bug += v.n_drops_bug;
+		stats->n_map_insert_failures += v.n_map_insert_failures;
 		stats->n_drops += handle->m_devs[j].m_evt_lost +
 				  v.n_drops_buffer +
 				  v.n_drops_pf +
 				  v.n_drops_bug;
+
+		for(k = 0; k < SYSDIG_STATE_MAP_MAX; k++)
+		{
+			inserts[k] += v.n_state_map_inserts[k];
+			deletes[k] += v.n_state_map_deletes[k];
+		}
+	}
+
+	//
+	// The kernel only evicts from a full LRU map, so whatever the probe
+	// inserted beyond the deletes and the size of the map was evicted
+	//
+	for(k = 0; k < SYSDIG_STATE_MAP_MAX; k++)
+	{
+		uint64_t max_entries = handle->m_bpf_state_map_max_entries[k];
+
+		if(max_entries != 0 && inserts[k] > deletes[k] + max_entries)
+		{
+			stats->n_map_evictions += inserts[k] - deletes[k] - max_entries;
+		}
 	}
 
 	return SCAP_SUCCESS;
@@ -1894,4 +2249,489 @@ int32_t scap_bpf_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event_id
 	}
 
 	return SCAP_SUCCESS;
-}
\ No newline at end of file
+}
+
+#if SCAP_TCP_STATS_RTT_BUCKETS != TCP_STATS_RTT_BUCKETS
+#error "scap_tcp_stats and the probe's tcp_stats have different histograms"
+#endif
+
+int32_t scap_bpf_set_tcp_stats_aggregation(scap_t *handle, bool enable)
+{
+	struct sysdig_bpf_settings settings;
+	int k = 0;
+
+	if(handle->m_bpf_tcp_stats_map_idx < 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the BPF probe doesn't support tcp stats aggregation");
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	if(bpf_map_lookup_elem(handle->m_bpf_map_fds[SYSDIG_SETTINGS_MAP], &k, &settings) != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "SYSDIG_SETTINGS_MAP bpf_map_lookup_elem < 0");
+		return SCAP_FAILURE;
+	}
+
+	settings.tcp_stats_aggregation = enable;
+	if(bpf_map_update_elem(handle->m_bpf_map_fds[SYSDIG_SETTINGS_MAP], &k, &settings, BPF_ANY) != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "SYSDIG_SETTINGS_MAP bpf_map_update_elem < 0");
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Fallback for kernels without BPF_MAP_LOOKUP_AND_DELETE_BATCH (< 5.6),
+// three syscalls per key. Every key read is deleted, so the next one is
+// always the first of the map.
+//
+static int32_t tcp_stats_lookup_iter(scap_t *handle, int fd, struct tuple *keys, struct tcp_stats *values,
+				     uint32_t max, uint32_t *nkeys)
+{
+	struct tuple next;
+
+	while(*nkeys < max && bpf_map_get_next_key(fd, NULL, &next) == 0)
+	{
+		if(bpf_map_lookup_elem(fd, &next, &values[(size_t) *nkeys * handle->m_bpf_possible_cpus]) == 0)
+		{
+			keys[*nkeys] = next;
+			(*nkeys)++;
+		}
+
+		if(bpf_map_delete_elem(fd, &next) != 0 && errno != ENOENT)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "tcp stats bpf_map_delete_elem: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Read and remove up to max entries, so that the map only holds the
+// connections active since the last read
+//
+static int32_t tcp_stats_lookup(scap_t *handle, int fd, struct tuple *keys, struct tcp_stats *values,
+				uint32_t max, uint32_t *nkeys)
+{
+	//
+	// For hash maps the batch token is a bucket index
+	//
+	uint32_t batch = 0;
+	bool first = true;
+
+	*nkeys = 0;
+
+	while(*nkeys < max)
+	{
+		uint32_t count = max - *nkeys;
+		int ret;
+
+		ret = bpf_map_lookup_and_delete_batch(fd, first? NULL : &batch, &batch,
+						      &keys[*nkeys],
+						      &values[(size_t) *nkeys * handle->m_bpf_possible_cpus],
+						      &count);
+		if(ret != 0 && errno == EINVAL && first)
+		{
+			return tcp_stats_lookup_iter(handle, fd, keys, values, max, nkeys);
+		}
+
+		*nkeys += count;
+
+		if(ret != 0)
+		{
+			//
+			// ENOENT means that we got to the end, ENOSPC that the
+			// next bucket doesn't fit in what's left of the buffer
+			//
+			if(errno == ENOENT || errno == ENOSPC)
+			{
+				break;
+			}
+
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "tcp stats bpf_map_lookup_and_delete_batch: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+
+		first = false;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_bpf_read_tcp_stats(scap_t *handle, scap_tcp_stats *stats, uint32_t max, uint32_t *nstats)
+{
+	uint32_t ncpus = handle->m_bpf_possible_cpus;
+	struct tuple *keys;
+	struct tcp_stats *values;
+	uint32_t nkeys;
+	uint32_t j;
+	uint32_t k;
+	int32_t res;
+	int fd;
+
+	*nstats = 0;
+
+	if(handle->m_bpf_tcp_stats_map_idx < 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the BPF probe doesn't support tcp stats aggregation");
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	if(max == 0)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	fd = handle->m_bpf_map_fds[handle->m_bpf_tcp_stats_map_idx];
+
+	keys = malloc(max * sizeof(struct tuple));
+	values = malloc((size_t) max * ncpus * sizeof(struct tcp_stats));
+	if(keys == NULL || values == NULL)
+	{
+		free(keys);
+		free(values);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't allocate the tcp stats buffers");
+		return SCAP_FAILURE;
+	}
+
+	res = tcp_stats_lookup(handle, fd, keys, values, max, &nkeys);
+	if(res != SCAP_SUCCESS)
+	{
+		free(keys);
+		free(values);
+		return res;
+	}
+
+	//
+	// Fold the per-CPU values
+	//
+	for(j = 0; j < nkeys; j++)
+	{
+		scap_tcp_stats *st = &stats[j];
+		uint64_t closes = 0;
+
+		memset(st, 0, sizeof(*st));
+		st->saddr = keys[j].saddr;
+		st->daddr = keys[j].daddr;
+		st->sport = keys[j].sport;
+		st->dport = keys[j].dport;
+		st->family = keys[j].family;
+
+		for(k = 0; k < ncpus; k++)
+		{
+			struct tcp_stats *v = &values[(size_t) j * ncpus + k];
+			uint32_t b;
+
+			if(v->rtt_count != 0)
+			{
+				if(st->rtt_count == 0 || v->rtt_min < st->rtt_min)
+				{
+					st->rtt_min = v->rtt_min;
+				}
+
+				if(v->rtt_max > st->rtt_max)
+				{
+					st->rtt_max = v->rtt_max;
+				}
+
+				st->rtt_sum += v->rtt_sum;
+				st->rtt_count += v->rtt_count;
+
+				for(b = 0; b < SCAP_TCP_STATS_RTT_BUCKETS; b++)
+				{
+					st->rtt_hist[b] += v->rtt_hist[b];
+				}
+			}
+
+			st->retransmits += v->retransmits;
+			st->drops += v->drops;
+			closes += v->closes;
+		}
+
+		st->closed = (closes != 0);
+	}
+
+	*nstats = nkeys;
+
+	free(keys);
+	free(values);
+	return SCAP_SUCCESS;
+}
+
+static int32_t set_prefilter_flags(scap_t *handle, uint8_t flags)
+{
+	struct sysdig_bpf_settings settings;
+	int k = 0;
+
+	if(bpf_map_lookup_elem(handle->m_bpf_map_fds[SYSDIG_SETTINGS_MAP], &k, &settings) != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "SYSDIG_SETTINGS_MAP bpf_map_lookup_elem < 0");
+		return SCAP_FAILURE;
+	}
+
+	settings.prefilter = flags;
+	if(bpf_map_update_elem(handle->m_bpf_map_fds[SYSDIG_SETTINGS_MAP], &k, &settings, BPF_ANY) != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "SYSDIG_SETTINGS_MAP bpf_map_update_elem < 0");
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Empty a prefilter hash and fill it with the given keys, of key_size bytes
+// each
+//
+static int32_t set_prefilter_keys(scap_t *handle, int fd, const void *keys, uint32_t nkeys, uint32_t key_size)
+{
+	uint64_t key;
+	uint8_t one = 1;
+	uint32_t j;
+
+	while(bpf_map_get_next_key(fd, NULL, &key) == 0)
+	{
+		if(bpf_map_delete_elem(fd, &key) != 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "prefilter bpf_map_delete_elem: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+	}
+
+	for(j = 0; j < nkeys; j++)
+	{
+		if(bpf_map_update_elem(fd, (const uint8_t *) keys + (size_t) j * key_size, &one, BPF_ANY) != 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "prefilter bpf_map_update_elem: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_bpf_set_kernel_prefilter(scap_t *handle, const scap_prefilter *prefilter)
+{
+	uint8_t flags = 0;
+	uint32_t j;
+	int fd;
+
+	if(handle->m_bpf_prefilter_tgids_map_idx < 0 ||
+	   handle->m_bpf_prefilter_cgroups_map_idx < 0 ||
+	   handle->m_bpf_prefilter_sampling_map_idx < 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the BPF probe doesn't support prefiltering");
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	if(prefilter != NULL &&
+	   (prefilter->ntgids > PREFILTER_MAX_ENTRIES || prefilter->ncgroup_ids > PREFILTER_MAX_ENTRIES))
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "too many prefilter entries, the maximum is %d", PREFILTER_MAX_ENTRIES);
+		return SCAP_FAILURE;
+	}
+
+	//
+	// The probe lets everything through while the maps are rewritten,
+	// rather than filtering with a half updated set
+	//
+	if(set_prefilter_flags(handle, 0) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	if(prefilter == NULL)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	fd = handle->m_bpf_map_fds[handle->m_bpf_prefilter_tgids_map_idx];
+	if(set_prefilter_keys(handle, fd, prefilter->tgids, prefilter->ntgids, sizeof(uint32_t)) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	fd = handle->m_bpf_map_fds[handle->m_bpf_prefilter_cgroups_map_idx];
+	if(set_prefilter_keys(handle, fd, prefilter->cgroup_ids, prefilter->ncgroup_ids, sizeof(uint64_t)) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	if(prefilter->sampling_ratios != NULL)
+	{
+		fd = handle->m_bpf_map_fds[handle->m_bpf_prefilter_sampling_map_idx];
+		for(j = 0; j < PPM_EVENT_MAX; j++)
+		{
+			if(bpf_map_update_elem(fd, &j, &prefilter->sampling_ratios[j], BPF_ANY) != 0)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "prefilter sampling bpf_map_update_elem: %s", scap_strerror(handle, errno));
+				return SCAP_FAILURE;
+			}
+		}
+
+		flags |= PREFILTER_SAMPLING;
+	}
+
+	if(prefilter->ntgids != 0)
+	{
+		flags |= PREFILTER_TGIDS;
+	}
+
+	if(prefilter->ncgroup_ids != 0)
+	{
+		flags |= PREFILTER_CGROUPS;
+	}
+
+	return set_prefilter_flags(handle, flags);
+}
+
+int32_t scap_bpf_set_detailed_stats(scap_t *handle, bool enable)
+{
+	struct sysdig_bpf_settings settings;
+	int k = 0;
+
+	if(handle->m_bpf_evt_type_stats_map_idx < 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the BPF probe doesn't support detailed stats");
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	if(bpf_map_lookup_elem(handle->m_bpf_map_fds[SYSDIG_SETTINGS_MAP], &k, &settings) != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "SYSDIG_SETTINGS_MAP bpf_map_lookup_elem < 0");
+		return SCAP_FAILURE;
+	}
+
+	settings.detailed_stats = enable;
+	if(bpf_map_update_elem(handle->m_bpf_map_fds[SYSDIG_SETTINGS_MAP], &k, &settings, BPF_ANY) != 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "SYSDIG_SETTINGS_MAP bpf_map_update_elem < 0");
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Read the per-CPU values of all the event types, with a single
+// BPF_MAP_LOOKUP_BATCH if the kernel has it, with one lookup per type
+// otherwise
+//
+static int32_t evt_type_stats_lookup(scap_t *handle, int fd, uint32_t *keys, struct evt_type_stats *values,
+				     uint32_t *nkeys)
+{
+	//
+	// For arrays the batch token is the next index
+	//
+	uint32_t batch = 0;
+	bool first = true;
+	uint32_t j;
+
+	*nkeys = 0;
+
+	while(*nkeys < PPM_EVENT_MAX)
+	{
+		uint32_t count = PPM_EVENT_MAX - *nkeys;
+		int ret;
+
+		ret = bpf_map_lookup_batch(fd, first? NULL : &batch, &batch,
+					   &keys[*nkeys],
+					   &values[(size_t) *nkeys * handle->m_bpf_possible_cpus],
+					   &count);
+		if(ret != 0 && errno == EINVAL && first)
+		{
+			break;
+		}
+
+		*nkeys += count;
+
+		if(ret != 0)
+		{
+			if(errno == ENOENT)
+			{
+				return SCAP_SUCCESS;
+			}
+
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "detailed stats bpf_map_lookup_batch: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+
+		first = false;
+	}
+
+	if(!first)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	for(j = 0; j < PPM_EVENT_MAX; j++)
+	{
+		keys[j] = j;
+		if(bpf_map_lookup_elem(fd, &j, &values[(size_t) j * handle->m_bpf_possible_cpus]) != 0)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "detailed stats bpf_map_lookup_elem: %s", scap_strerror(handle, errno));
+			return SCAP_FAILURE;
+		}
+	}
+
+	*nkeys = PPM_EVENT_MAX;
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_bpf_get_detailed_stats(scap_t *handle, scap_evt_type_stats *stats, uint32_t ncpus)
+{
+	uint32_t possible_cpus = handle->m_bpf_possible_cpus;
+	struct evt_type_stats *values;
+	uint32_t *keys;
+	uint32_t nkeys;
+	uint32_t j;
+	uint32_t k;
+	int32_t res;
+
+	memset(stats, 0, (size_t) ncpus * PPM_EVENT_MAX * sizeof(scap_evt_type_stats));
+
+	if(handle->m_bpf_evt_type_stats_map_idx < 0)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the BPF probe doesn't support detailed stats");
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	keys = malloc(PPM_EVENT_MAX * sizeof(uint32_t));
+	values = malloc((size_t) PPM_EVENT_MAX * possible_cpus * sizeof(struct evt_type_stats));
+	if(keys == NULL || values == NULL)
+	{
+		free(keys);
+		free(values);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't allocate the detailed stats buffers");
+		return SCAP_FAILURE;
+	}
+
+	res = evt_type_stats_lookup(handle, handle->m_bpf_map_fds[handle->m_bpf_evt_type_stats_map_idx], keys, values, &nkeys);
+	if(res == SCAP_SUCCESS)
+	{
+		//
+		// From [type][cpu] to [cpu][type]
+		//
+		for(j = 0; j < nkeys; j++)
+		{
+			for(k = 0; k < ncpus && k < possible_cpus; k++)
+			{
+				struct evt_type_stats *v = &values[(size_t) j * possible_cpus + k];
+				scap_evt_type_stats *st = &stats[(size_t) k * PPM_EVENT_MAX + keys[j]];
+
+				st->n_evts = v->n_evts;
+				st->n_bytes = v->n_bytes;
+				st->n_drops_buffer = v->n_drops_buffer;
+				st->filler_ns = v->filler_ns;
+			}
+		}
+	}
+
+	free(keys);
+	free(values);
+	return res;
+}
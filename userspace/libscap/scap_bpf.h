@@ -31,6 +31,21 @@ struct perf_lost_sample {
 	uint64_t lost;
 };
 
+//
+// A BPF_MAP_TYPE_RINGBUF record, see BPF_RINGBUF_* in linux/bpf.h.
+// Records are 8 byte aligned and never wrap, since the data pages are
+// mapped twice.
+//
+struct ringbuf_sample {
+	uint32_t len;
+	uint32_t pg_off;
+	char data[];
+};
+
+#define RINGBUF_BUSY_BIT (1U << 31)
+#define RINGBUF_DISCARD_BIT (1U << 30)
+#define RINGBUF_SAMPLE_SIZE(len) ((((len) & ~(RINGBUF_BUSY_BIT | RINGBUF_DISCARD_BIT)) + sizeof(struct ringbuf_sample) + 7) & ~7)
+
 int32_t scap_bpf_load(scap_t *handle, const char *bpf_probe);
 int32_t scap_bpf_start_capture(scap_t *handle);
 int32_t scap_bpf_stop_capture(scap_t *handle);
@@ -49,6 +64,11 @@ int32_t scap_bpf_get_n_tracepoint_hit(scap_t* handle, long* ret);
 int32_t scap_bpf_enable_skb_capture(scap_t *handle, const char *ifname);
 int32_t scap_bpf_disable_skb_capture(scap_t *handle);
 int32_t scap_bpf_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event_id);
+int32_t scap_bpf_set_tcp_stats_aggregation(scap_t* handle, bool enable);
+int32_t scap_bpf_read_tcp_stats(scap_t* handle, scap_tcp_stats* stats, uint32_t max, uint32_t* nstats);
+int32_t scap_bpf_set_kernel_prefilter(scap_t* handle, const scap_prefilter* prefilter);
+int32_t scap_bpf_set_detailed_stats(scap_t* handle, bool enable);
+int32_t scap_bpf_get_detailed_stats(scap_t* handle, scap_evt_type_stats* stats, uint32_t ncpus);
 int32_t scap_set_ktmask_bpf(scap_t* handle, uint32_t kt, bool enabled);
 
 static inline scap_evt *scap_bpf_evt_from_perf_sample(void *evt)
@@ -58,6 +78,16 @@ static inline scap_evt *scap_bpf_evt_from_perf_sample(void *evt)
 	return (scap_evt *) perf_evt->data;
 }
 
+static inline scap_evt *scap_bpf_evt_from_sample(scap_t *handle, void *evt)
+{
+	if(handle->m_bpf_ringbuf)
+	{
+		return (scap_evt *) ((struct ringbuf_sample *) evt)->data;
+	}
+
+	return scap_bpf_evt_from_perf_sample(evt);
+}
+
 static inline void scap_bpf_get_buf_pointers(char *buf, uint64_t *phead, uint64_t *ptail, uint64_t *pread_size)
 {
 	struct perf_event_mmap_page *header;
@@ -86,6 +116,87 @@ static inline void scap_bpf_get_buf_pointers(char *buf, uint64_t *phead, uint64_
 	}
 }
 
+//
+// Committed data in a ring buffer, up to the first record still being
+// written
+//
+static inline void scap_bpf_ringbuf_get_buf_pointers(struct scap_device *dev, uint64_t *phead, uint64_t *ptail, uint64_t *pread_size)
+{
+	char *data = dev->m_ringbuf_producer + getpagesize();
+	uint64_t mask = dev->m_ringbuf_size - 1;
+	uint64_t pos;
+
+	*ptail = *(volatile unsigned long *) dev->m_buffer;
+	*phead = __atomic_load_n((unsigned long *) dev->m_ringbuf_producer, __ATOMIC_ACQUIRE);
+
+	for(pos = *ptail; pos < *phead; )
+	{
+		uint32_t len = __atomic_load_n((uint32_t *) (data + (pos & mask)), __ATOMIC_ACQUIRE);
+
+		if(len & RINGBUF_BUSY_BIT)
+		{
+			break;
+		}
+
+		pos += RINGBUF_SAMPLE_SIZE(len);
+	}
+
+	*pread_size = pos - *ptail;
+}
+
+static inline uint64_t scap_bpf_buf_size_used(scap_t *handle, uint32_t cpuid)
+{
+	uint64_t head;
+	uint64_t tail;
+	uint64_t read_size;
+
+	if(handle->m_bpf_ringbuf)
+	{
+		scap_bpf_ringbuf_get_buf_pointers(&handle->m_devs[cpuid], &head, &tail, &read_size);
+	}
+	else
+	{
+		scap_bpf_get_buf_pointers(handle->m_devs[cpuid].m_buffer, &head, &tail, &read_size);
+	}
+
+	return read_size;
+}
+
+static inline int32_t scap_bpf_ringbuf_advance_to_evt(char *cur_evt, bool skip_current,
+						      char **next_evt, uint32_t *len)
+{
+	char *begin = cur_evt;
+
+	while(*len)
+	{
+		struct ringbuf_sample *s = (struct ringbuf_sample *) begin;
+		uint32_t size = RINGBUF_SAMPLE_SIZE(s->len);
+
+		ASSERT(*len >= size);
+		ASSERT((s->len & RINGBUF_BUSY_BIT) == 0);
+
+		if((s->len & RINGBUF_DISCARD_BIT) == 0)
+		{
+			ASSERT(((scap_evt *) s->data)->len <= s->len);
+
+			if(skip_current)
+			{
+				skip_current = false;
+			}
+			else
+			{
+				*next_evt = begin;
+				break;
+			}
+		}
+
+		begin += size;
+		*len -= size;
+	}
+
+	return SCAP_SUCCESS;
+}
+
 static inline int32_t scap_bpf_advance_to_evt(scap_t *handle, uint16_t cpuid, bool skip_current,
 					      char *cur_evt, char **next_evt, uint32_t *len)
 {
@@ -93,6 +204,11 @@ static inline int32_t scap_bpf_advance_to_evt(scap_t *handle, uint16_t cpuid, bo
 	void *base;
 	void *begin;
 
+	if(handle->m_bpf_ringbuf)
+	{
+		return scap_bpf_ringbuf_advance_to_evt(cur_evt, skip_current, next_evt, len);
+	}
+
 	dev = &handle->m_devs[cpuid];
 
 	struct perf_event_mmap_page *header = (struct perf_event_mmap_page *) dev->m_buffer;
@@ -164,13 +280,23 @@ static inline void scap_bpf_advance_tail(scap_t *handle, uint32_t cpuid)
 	struct scap_device *dev;
 
 	dev = &handle->m_devs[cpuid];
+	ASSERT(dev->m_lastreadsize > 0);
+
+	if(handle->m_bpf_ringbuf)
+	{
+		unsigned long *consumer = (unsigned long *) dev->m_buffer;
+
+		__atomic_store_n(consumer, *consumer + dev->m_lastreadsize, __ATOMIC_RELEASE);
+		dev->m_lastreadsize = 0;
+		return;
+	}
+
 	header = (struct perf_event_mmap_page *)dev->m_buffer;
 
 	// clang-format off
 	asm volatile("" ::: "memory");
 	// clang-format on
 
-	ASSERT(dev->m_lastreadsize > 0);
 	header->data_tail += dev->m_lastreadsize;
 	dev->m_lastreadsize = 0;
 }
@@ -185,9 +311,20 @@ static inline int32_t scap_bpf_readbuf(scap_t *handle, uint32_t cpuid, char **bu
 	char *p;
 
 	dev = &handle->m_devs[cpuid];
-	header = (struct perf_event_mmap_page *) dev->m_buffer;
-
 	ASSERT(dev->m_lastreadsize == 0);
+
+	if(handle->m_bpf_ringbuf)
+	{
+		scap_bpf_ringbuf_get_buf_pointers(dev, &head, &tail, &read_size);
+
+		dev->m_lastreadsize = read_size;
+		p = dev->m_ringbuf_producer + getpagesize() + (tail & (dev->m_ringbuf_size - 1));
+		*len = read_size;
+
+		return scap_bpf_ringbuf_advance_to_evt(p, false, buf, len);
+	}
+
+	header = (struct perf_event_mmap_page *) dev->m_buffer;
 	scap_bpf_get_buf_pointers((char *) header, &head, &tail, &read_size);
 
 	dev->m_lastreadsize = read_size;
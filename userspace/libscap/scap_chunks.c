@@ -0,0 +1,593 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Reading of chunked capture files (SCAP_COMPRESSION_CHUNKED). Their event
+// blocks are grouped in EVC_BLOCK_TYPE blocks of about SCAP_CHUNK_SIZE
+// bytes, each compressed on its own, and the file ends with an
+// EVCI_BLOCK_TYPE index of the chunks. scap_next_offline() hands the chunk
+// blocks to scap_chunk_load() and then reads the event blocks from the
+// decompressed chunk, as it would from the file.
+//
+// When the file is mapped and has an index, a pool of threads decompresses
+// the next SCAP_CHUNK_READAHEAD chunks while the current one is read.
+// Otherwise the chunks are decompressed when they are reached.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scap.h"
+#include "scap-int.h"
+#include "scap_savefile.h"
+
+#ifdef SCAP_HAS_FILE_MAP
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define SCAP_CHUNK_THREADS_MAX 4
+#define SCAP_CHUNK_READAHEAD 8
+
+typedef enum chunk_slot_state
+{
+	CHUNK_SLOT_FREE = 0,
+	CHUNK_SLOT_PENDING = 1,
+	CHUNK_SLOT_BUSY = 2,
+	CHUNK_SLOT_READY = 3,
+	CHUNK_SLOT_ERROR = 4,
+}chunk_slot_state;
+
+//
+// A chunk decompressed, or to be decompressed, by the pool. Chunk n goes in
+// slot n % SCAP_CHUNK_READAHEAD.
+//
+typedef struct chunk_slot
+{
+	uint32_t m_chunk;
+	chunk_slot_state m_state;
+	char* m_buf;
+	uint32_t m_buf_size;
+	uint32_t m_len;
+}chunk_slot;
+
+struct scap_chunk_reader
+{
+	// Chunks decompressed by the reading thread
+	char* m_buf;
+	uint32_t m_buf_size;
+	// Bodies of the chunk blocks of unmapped files
+	char* m_body;
+	uint32_t m_body_size;
+	// The index, in the mapping of the file. NULL if the file isn't
+	// mapped or has no index, e.g. because it was truncated.
+	const chunk_index_entry* m_index;
+	uint32_t m_nchunks;
+	uint64_t m_index_off;
+#ifdef SCAP_HAS_FILE_MAP
+	const char* m_map;
+	uint64_t m_map_size;
+	// Protects the slots
+	pthread_mutex_t m_mutex;
+	// Signaled when a slot becomes pending, or on shutdown
+	pthread_cond_t m_work_cond;
+	// Signaled when a slot is decompressed
+	pthread_cond_t m_done_cond;
+	pthread_t m_threads[SCAP_CHUNK_THREADS_MAX];
+	uint32_t m_nthreads;
+	bool m_stop;
+	chunk_slot m_slots[SCAP_CHUNK_READAHEAD];
+#endif
+};
+
+static bool chunk_buf_reserve(char** buf, uint32_t* size, uint32_t len)
+{
+	char* tbuf;
+
+	if(len <= *size)
+	{
+		return true;
+	}
+
+	tbuf = (char*)realloc(*buf, len);
+	if(tbuf == NULL)
+	{
+		return false;
+	}
+
+	*buf = tbuf;
+	*size = len;
+	return true;
+}
+
+//
+// Decompress the body of a chunk block (chunk header included) into buf
+//
+static int32_t chunk_decompress(const char* body, uint32_t body_len, char** buf, uint32_t* size, uint32_t* len)
+{
+#ifdef USE_ZLIB
+	chunk_header ch;
+	uLongf dlen;
+
+	if(body_len < sizeof(ch))
+	{
+		return SCAP_FAILURE;
+	}
+
+	memcpy(&ch, body, sizeof(ch));
+
+	if(ch.compressed_len > body_len - sizeof(ch) ||
+	   !chunk_buf_reserve(buf, size, ch.len))
+	{
+		return SCAP_FAILURE;
+	}
+
+	dlen = ch.len;
+	if(uncompress((Bytef*)*buf, &dlen, (const Bytef*)body + sizeof(ch), ch.compressed_len) != Z_OK ||
+	   dlen != ch.len)
+	{
+		return SCAP_FAILURE;
+	}
+
+	*len = ch.len;
+	return SCAP_SUCCESS;
+#else
+	return SCAP_FAILURE;
+#endif
+}
+
+//
+// The index is the last block of the file, found through the block length
+// at the end of it
+//
+static void chunk_load_index(scap_t* handle, struct scap_chunk_reader* r)
+{
+	const char* map = handle->m_file_map;
+	uint64_t size = handle->m_file_map_size;
+	block_header bh;
+	uint32_t len;
+
+	if(map == NULL || size < sizeof(bh) + sizeof(len))
+	{
+		return;
+	}
+
+	memcpy(&len, map + size - sizeof(len), sizeof(len));
+	if(len < sizeof(bh) + sizeof(len) || len > size)
+	{
+		return;
+	}
+
+	memcpy(&bh, map + size - len, sizeof(bh));
+	if(bh.block_type != EVCI_BLOCK_TYPE || bh.block_total_length != len)
+	{
+		return;
+	}
+
+	r->m_index = (const chunk_index_entry*)(map + size - len + sizeof(bh));
+	r->m_nchunks = (len - sizeof(bh) - sizeof(len)) / sizeof(chunk_index_entry);
+	r->m_index_off = size - len;
+}
+
+#ifdef SCAP_HAS_FILE_MAP
+//
+// Decompress chunk n of the index from the mapping
+//
+static int32_t chunk_decompress_mapped(struct scap_chunk_reader* r, uint32_t n, char** buf, uint32_t* size, uint32_t* len)
+{
+	uint64_t off = r->m_index[n].offset;
+	block_header bh;
+
+	if(off + sizeof(bh) > r->m_map_size)
+	{
+		return SCAP_FAILURE;
+	}
+
+	memcpy(&bh, r->m_map + off, sizeof(bh));
+	if(bh.block_type != EVC_BLOCK_TYPE ||
+	   bh.block_total_length < sizeof(bh) ||
+	   off + bh.block_total_length > r->m_map_size)
+	{
+		return SCAP_FAILURE;
+	}
+
+	return chunk_decompress(r->m_map + off + sizeof(bh), bh.block_total_length - sizeof(bh), buf, size, len);
+}
+
+static void* chunk_worker(void* arg)
+{
+	struct scap_chunk_reader* r = (struct scap_chunk_reader*)arg;
+	chunk_slot* slot;
+	int32_t res;
+	uint32_t j;
+
+	pthread_mutex_lock(&r->m_mutex);
+
+	while(!r->m_stop)
+	{
+		//
+		// The pending chunk that will be read first
+		//
+		slot = NULL;
+		for(j = 0; j < SCAP_CHUNK_READAHEAD; j++)
+		{
+			if(r->m_slots[j].m_state == CHUNK_SLOT_PENDING &&
+			   (slot == NULL || r->m_slots[j].m_chunk < slot->m_chunk))
+			{
+				slot = &r->m_slots[j];
+			}
+		}
+
+		if(slot == NULL)
+		{
+			pthread_cond_wait(&r->m_work_cond, &r->m_mutex);
+			continue;
+		}
+
+		//
+		// Busy slots are left alone by everybody else
+		//
+		slot->m_state = CHUNK_SLOT_BUSY;
+		pthread_mutex_unlock(&r->m_mutex);
+
+		res = chunk_decompress_mapped(r, slot->m_chunk, &slot->m_buf, &slot->m_buf_size, &slot->m_len);
+
+		pthread_mutex_lock(&r->m_mutex);
+		slot->m_state = (res == SCAP_SUCCESS)? CHUNK_SLOT_READY : CHUNK_SLOT_ERROR;
+		pthread_cond_broadcast(&r->m_done_cond);
+	}
+
+	pthread_mutex_unlock(&r->m_mutex);
+	return NULL;
+}
+
+static void chunk_pool_start(scap_t* handle, struct scap_chunk_reader* r)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t nthreads;
+	uint32_t j;
+
+	//
+	// Leave a CPU to the reading thread
+	//
+	if(ncpus <= 1 || r->m_nchunks <= 1)
+	{
+		return;
+	}
+	nthreads = MIN((uint32_t)ncpus - 1, SCAP_CHUNK_THREADS_MAX);
+
+	r->m_map = handle->m_file_map;
+	r->m_map_size = handle->m_file_map_size;
+	r->m_stop = false;
+	pthread_mutex_init(&r->m_mutex, NULL);
+	pthread_cond_init(&r->m_work_cond, NULL);
+	pthread_cond_init(&r->m_done_cond, NULL);
+
+	for(j = 0; j < nthreads; j++)
+	{
+		if(pthread_create(&r->m_threads[r->m_nthreads], NULL, chunk_worker, r) == 0)
+		{
+			r->m_nthreads++;
+		}
+	}
+
+	if(r->m_nthreads == 0)
+	{
+		pthread_mutex_destroy(&r->m_mutex);
+		pthread_cond_destroy(&r->m_work_cond);
+		pthread_cond_destroy(&r->m_done_cond);
+	}
+}
+
+static void chunk_pool_stop(struct scap_chunk_reader* r)
+{
+	uint32_t j;
+
+	if(r->m_nthreads == 0)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&r->m_mutex);
+	r->m_stop = true;
+	pthread_cond_broadcast(&r->m_work_cond);
+	pthread_mutex_unlock(&r->m_mutex);
+
+	for(j = 0; j < r->m_nthreads; j++)
+	{
+		pthread_join(r->m_threads[j], NULL);
+	}
+
+	pthread_mutex_destroy(&r->m_mutex);
+	pthread_cond_destroy(&r->m_work_cond);
+	pthread_cond_destroy(&r->m_done_cond);
+
+	for(j = 0; j < SCAP_CHUNK_READAHEAD; j++)
+	{
+		free(r->m_slots[j].m_buf);
+	}
+	memset(r->m_slots, 0, sizeof(r->m_slots));
+	r->m_nthreads = 0;
+}
+
+//
+// Schedule chunk n and the ones after it, and wait for n
+//
+static int32_t chunk_pool_get(struct scap_chunk_reader* r, uint32_t n, char** buf, uint32_t* len)
+{
+	chunk_slot* slot = &r->m_slots[n % SCAP_CHUNK_READAHEAD];
+	int32_t res = SCAP_SUCCESS;
+	uint32_t j;
+
+	pthread_mutex_lock(&r->m_mutex);
+
+	for(j = n; j < n + SCAP_CHUNK_READAHEAD && j < r->m_nchunks; j++)
+	{
+		chunk_slot* s = &r->m_slots[j % SCAP_CHUNK_READAHEAD];
+
+		if((s->m_chunk != j || s->m_state == CHUNK_SLOT_FREE) && s->m_state != CHUNK_SLOT_BUSY)
+		{
+			s->m_chunk = j;
+			s->m_state = CHUNK_SLOT_PENDING;
+		}
+	}
+	pthread_cond_broadcast(&r->m_work_cond);
+
+	while(true)
+	{
+		if(slot->m_chunk == n && slot->m_state == CHUNK_SLOT_READY)
+		{
+			*buf = slot->m_buf;
+			*len = slot->m_len;
+			break;
+		}
+		else if(slot->m_chunk == n && slot->m_state == CHUNK_SLOT_ERROR)
+		{
+			res = SCAP_FAILURE;
+			break;
+		}
+		else if(slot->m_chunk != n && slot->m_state != CHUNK_SLOT_BUSY)
+		{
+			//
+			// The slot was still busy with an older chunk above
+			//
+			slot->m_chunk = n;
+			slot->m_state = CHUNK_SLOT_PENDING;
+			pthread_cond_broadcast(&r->m_work_cond);
+		}
+
+		pthread_cond_wait(&r->m_done_cond, &r->m_mutex);
+	}
+
+	pthread_mutex_unlock(&r->m_mutex);
+	return res;
+}
+
+//
+// Number of the chunk at the given offset, or -1
+//
+static int64_t chunk_find(struct scap_chunk_reader* r, uint64_t off)
+{
+	uint32_t lo = 0;
+	uint32_t hi = r->m_nchunks;
+
+	while(lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if(r->m_index[mid].offset < off)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	if(lo < r->m_nchunks && r->m_index[lo].offset == off)
+	{
+		return lo;
+	}
+
+	return -1;
+}
+#endif // SCAP_HAS_FILE_MAP
+
+static struct scap_chunk_reader* chunk_get_reader(scap_t* handle)
+{
+	struct scap_chunk_reader* r = handle->m_chunk_reader;
+
+	if(r != NULL)
+	{
+		return r;
+	}
+
+	r = (struct scap_chunk_reader*)calloc(1, sizeof(struct scap_chunk_reader));
+	if(r == NULL)
+	{
+		return NULL;
+	}
+
+	chunk_load_index(handle, r);
+#ifdef SCAP_HAS_FILE_MAP
+	if(r->m_index != NULL)
+	{
+		chunk_pool_start(handle, r);
+	}
+#endif
+
+	handle->m_chunk_reader = r;
+	return r;
+}
+
+int32_t scap_chunk_load(scap_t* handle, uint64_t block_off, const char* body, uint32_t len)
+{
+	struct scap_chunk_reader* r = chunk_get_reader(handle);
+
+	if(r == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk reader");
+		return SCAP_FAILURE;
+	}
+
+	handle->m_chunk_block_off = block_off;
+	handle->m_chunk_off = 0;
+	handle->m_chunk_len = 0;
+
+#ifdef SCAP_HAS_FILE_MAP
+	if(r->m_nthreads != 0)
+	{
+		int64_t n = chunk_find(r, block_off);
+
+		if(n >= 0)
+		{
+			if(chunk_pool_get(r, (uint32_t)n, &handle->m_chunk_buf, &handle->m_chunk_len) != SCAP_SUCCESS)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error decompressing the chunk at offset %" PRIu64, block_off);
+				return SCAP_FAILURE;
+			}
+
+			return SCAP_SUCCESS;
+		}
+	}
+#endif
+
+	if(chunk_decompress(body, len, &r->m_buf, &r->m_buf_size, &handle->m_chunk_len) != SCAP_SUCCESS)
+	{
+		handle->m_chunk_len = 0;
+#ifdef USE_ZLIB
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error decompressing the chunk at offset %" PRIu64, block_off);
+#else
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "chunked captures are not supported without zlib");
+#endif
+		return SCAP_FAILURE;
+	}
+
+	handle->m_chunk_buf = r->m_buf;
+	return SCAP_SUCCESS;
+}
+
+char* scap_chunk_body_buf(scap_t* handle, uint32_t len)
+{
+	struct scap_chunk_reader* r = chunk_get_reader(handle);
+
+	if(r == NULL || !chunk_buf_reserve(&r->m_body, &r->m_body_size, len))
+	{
+		return NULL;
+	}
+
+	return r->m_body;
+}
+
+void scap_chunk_reader_unmap(scap_t* handle)
+{
+	struct scap_chunk_reader* r = handle->m_chunk_reader;
+
+	if(r == NULL)
+	{
+		return;
+	}
+
+#ifdef SCAP_HAS_FILE_MAP
+	//
+	// The rest of the current chunk may be in a slot
+	//
+	if(handle->m_chunk_off < handle->m_chunk_len && handle->m_chunk_buf != r->m_buf)
+	{
+		if(!chunk_buf_reserve(&r->m_buf, &r->m_buf_size, handle->m_chunk_len))
+		{
+			handle->m_chunk_len = 0;
+		}
+		else
+		{
+			memcpy(r->m_buf, handle->m_chunk_buf, handle->m_chunk_len);
+		}
+		handle->m_chunk_buf = r->m_buf;
+	}
+
+	chunk_pool_stop(r);
+#endif
+
+	r->m_index = NULL;
+	r->m_nchunks = 0;
+}
+
+void scap_chunk_reader_close(scap_t* handle)
+{
+	struct scap_chunk_reader* r = handle->m_chunk_reader;
+
+	if(r == NULL)
+	{
+		return;
+	}
+
+#ifdef SCAP_HAS_FILE_MAP
+	chunk_pool_stop(r);
+#endif
+	free(r->m_buf);
+	free(r->m_body);
+	free(r);
+
+	handle->m_chunk_reader = NULL;
+	handle->m_chunk_buf = NULL;
+	handle->m_chunk_off = 0;
+	handle->m_chunk_len = 0;
+}
+
+int32_t scap_fseek_ts(scap_t *handle, uint64_t ts)
+{
+	struct scap_chunk_reader* r;
+	uint32_t lo = 0;
+	uint32_t hi;
+
+	if(handle->m_mode != SCAP_MODE_CAPTURE || handle->m_file == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_fseek_ts only works on capture files");
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	r = chunk_get_reader(handle);
+	if(r == NULL || r->m_index == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the capture file has no chunk index");
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	//
+	// The first chunk that ends at or after ts
+	//
+	hi = r->m_nchunks;
+	while(lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if(r->m_index[mid].last_ts < ts)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	scap_fseek(handle, (lo < r->m_nchunks)? r->m_index[lo].offset : r->m_index_off);
+	handle->m_chunk_seek_ts = ts;
+	return SCAP_SUCCESS;
+}
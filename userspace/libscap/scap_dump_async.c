@@ -0,0 +1,327 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Asynchronous trace file dumps (scap_dump_enable_async()). The blocks are
+// serialized into the staging buffer being filled, which is queued once
+// full, and a background thread writes the queued buffers to the file with
+// one gzwrite() each. The dumper's gzFile belongs to that thread while
+// there are queued buffers; the other functions drain the queue before
+// touching it.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scap.h"
+#include "scap-int.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+
+#define SCAP_DUMP_ASYNC_NBUFS 4
+#define SCAP_DUMP_ASYNC_BUF_SIZE (1024 * 1024)
+
+typedef struct scap_dump_buf
+{
+	uint8_t* m_data;
+	uint32_t m_len;
+	uint32_t m_size;
+}scap_dump_buf;
+
+struct scap_dump_async
+{
+	pthread_t m_thread;
+	// Protects everything below but the buffer being filled
+	pthread_mutex_t m_mutex;
+	// Signaled when a buffer is queued, or on shutdown
+	pthread_cond_t m_queued_cond;
+	// Signaled when a buffer is written
+	pthread_cond_t m_written_cond;
+	// The queued buffers are m_head to m_head + m_nqueued - 1, the one
+	// being filled comes right after them
+	scap_dump_buf m_bufs[SCAP_DUMP_ASYNC_NBUFS];
+	uint32_t m_head;
+	uint32_t m_nqueued;
+	// The buffer being filled, only changed by the filling thread
+	uint32_t m_cur;
+	bool m_stop;
+	bool m_failed;
+	// gzoffset() after the last write
+	int64_t m_offset;
+	// Only used by the filling thread: gztell() when the dump became
+	// asynchronous, and the bytes staged since
+	int64_t m_tell_base;
+	uint64_t m_staged;
+};
+
+static inline scap_dump_buf* async_cur_buf(struct scap_dump_async* a)
+{
+	return &a->m_bufs[a->m_cur];
+}
+
+static void* async_writer(void* arg)
+{
+	scap_dumper_t* d = (scap_dumper_t*)arg;
+	struct scap_dump_async* a = d->m_async;
+	scap_dump_buf* buf;
+	bool failed;
+	bool ok;
+
+	pthread_mutex_lock(&a->m_mutex);
+
+	while(true)
+	{
+		if(a->m_nqueued == 0)
+		{
+			if(a->m_stop)
+			{
+				break;
+			}
+
+			pthread_cond_wait(&a->m_queued_cond, &a->m_mutex);
+			continue;
+		}
+
+		//
+		// The buffer stays queued, and untouched by the filling thread,
+		// until it's written
+		//
+		buf = &a->m_bufs[a->m_head];
+		failed = a->m_failed;
+		pthread_mutex_unlock(&a->m_mutex);
+
+		ok = !failed && gzwrite(d->m_f, buf->m_data, buf->m_len) == (int)buf->m_len;
+
+		pthread_mutex_lock(&a->m_mutex);
+		buf->m_len = 0;
+		a->m_head = (a->m_head + 1) % SCAP_DUMP_ASYNC_NBUFS;
+		a->m_nqueued--;
+		a->m_failed = !ok;
+		a->m_offset = gzoffset(d->m_f);
+		pthread_cond_broadcast(&a->m_written_cond);
+	}
+
+	pthread_mutex_unlock(&a->m_mutex);
+	return NULL;
+}
+
+//
+// Queue the buffer being filled, and wait for the next one to be free
+//
+static int32_t async_queue(struct scap_dump_async* a)
+{
+	int32_t res;
+
+	pthread_mutex_lock(&a->m_mutex);
+
+	a->m_nqueued++;
+	a->m_cur = (a->m_cur + 1) % SCAP_DUMP_ASYNC_NBUFS;
+	pthread_cond_signal(&a->m_queued_cond);
+
+	while(a->m_nqueued == SCAP_DUMP_ASYNC_NBUFS)
+	{
+		pthread_cond_wait(&a->m_written_cond, &a->m_mutex);
+	}
+
+	res = a->m_failed? SCAP_FAILURE : SCAP_SUCCESS;
+	pthread_mutex_unlock(&a->m_mutex);
+	return res;
+}
+
+//
+// Queue what was staged so far, and wait until everything is written
+//
+static int32_t async_drain(struct scap_dump_async* a)
+{
+	int32_t res;
+
+	if(async_cur_buf(a)->m_len != 0 && async_queue(a) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	pthread_mutex_lock(&a->m_mutex);
+
+	while(a->m_nqueued != 0)
+	{
+		pthread_cond_wait(&a->m_written_cond, &a->m_mutex);
+	}
+
+	res = a->m_failed? SCAP_FAILURE : SCAP_SUCCESS;
+	pthread_mutex_unlock(&a->m_mutex);
+	return res;
+}
+#endif // _WIN32
+
+int32_t scap_dump_enable_async(scap_dumper_t *d, uint32_t buffer_size)
+{
+#ifndef _WIN32
+	struct scap_dump_async* a;
+	uint32_t j;
+
+	if(d->m_type != DT_FILE)
+	{
+		return SCAP_NOT_SUPPORTED;
+	}
+
+	if(d->m_async != NULL)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	a = (struct scap_dump_async*)calloc(1, sizeof(struct scap_dump_async));
+	if(a == NULL)
+	{
+		return SCAP_FAILURE;
+	}
+
+	if(buffer_size == 0)
+	{
+		buffer_size = SCAP_DUMP_ASYNC_BUF_SIZE;
+	}
+
+	for(j = 0; j < SCAP_DUMP_ASYNC_NBUFS; j++)
+	{
+		a->m_bufs[j].m_data = (uint8_t*)malloc(buffer_size);
+		if(a->m_bufs[j].m_data == NULL)
+		{
+			goto error;
+		}
+		a->m_bufs[j].m_size = buffer_size;
+	}
+
+	a->m_offset = gzoffset(d->m_f);
+	a->m_tell_base = gztell(d->m_f);
+	pthread_mutex_init(&a->m_mutex, NULL);
+	pthread_cond_init(&a->m_queued_cond, NULL);
+	pthread_cond_init(&a->m_written_cond, NULL);
+
+	d->m_async = a;
+	if(pthread_create(&a->m_thread, NULL, async_writer, d) != 0)
+	{
+		d->m_async = NULL;
+		pthread_mutex_destroy(&a->m_mutex);
+		pthread_cond_destroy(&a->m_queued_cond);
+		pthread_cond_destroy(&a->m_written_cond);
+		goto error;
+	}
+
+	return SCAP_SUCCESS;
+
+error:
+	for(j = 0; j < SCAP_DUMP_ASYNC_NBUFS; j++)
+	{
+		free(a->m_bufs[j].m_data);
+	}
+	free(a);
+	return SCAP_FAILURE;
+#else
+	return SCAP_NOT_SUPPORTED;
+#endif
+}
+
+#ifndef _WIN32
+uint8_t* scap_dump_async_reserve(scap_dumper_t* d, uint32_t len)
+{
+	struct scap_dump_async* a = d->m_async;
+	scap_dump_buf* buf = async_cur_buf(a);
+
+	if(buf->m_len + len > buf->m_size)
+	{
+		if(buf->m_len != 0)
+		{
+			if(async_queue(a) != SCAP_SUCCESS)
+			{
+				return NULL;
+			}
+
+			buf = async_cur_buf(a);
+		}
+
+		//
+		// Blocks larger than the buffers get a buffer of their own
+		//
+		if(len > buf->m_size)
+		{
+			uint8_t* data = (uint8_t*)realloc(buf->m_data, len);
+			if(data == NULL)
+			{
+				return NULL;
+			}
+
+			buf->m_data = data;
+			buf->m_size = len;
+		}
+	}
+
+	return buf->m_data + buf->m_len;
+}
+
+void scap_dump_async_commit(scap_dumper_t* d, uint32_t len)
+{
+	async_cur_buf(d->m_async)->m_len += len;
+	d->m_async->m_staged += len;
+}
+
+int32_t scap_dump_async_flush(scap_dumper_t* d)
+{
+	return async_drain(d->m_async);
+}
+
+void scap_dump_async_close(scap_dumper_t* d)
+{
+	struct scap_dump_async* a = d->m_async;
+	uint32_t j;
+
+	async_drain(a);
+
+	pthread_mutex_lock(&a->m_mutex);
+	a->m_stop = true;
+	pthread_cond_signal(&a->m_queued_cond);
+	pthread_mutex_unlock(&a->m_mutex);
+	pthread_join(a->m_thread, NULL);
+
+	pthread_mutex_destroy(&a->m_mutex);
+	pthread_cond_destroy(&a->m_queued_cond);
+	pthread_cond_destroy(&a->m_written_cond);
+
+	for(j = 0; j < SCAP_DUMP_ASYNC_NBUFS; j++)
+	{
+		free(a->m_bufs[j].m_data);
+	}
+	free(a);
+	d->m_async = NULL;
+}
+
+int64_t scap_dump_async_get_offset(scap_dumper_t* d)
+{
+	struct scap_dump_async* a = d->m_async;
+	int64_t res;
+
+	pthread_mutex_lock(&a->m_mutex);
+	res = a->m_offset;
+	pthread_mutex_unlock(&a->m_mutex);
+	return res;
+}
+
+int64_t scap_dump_async_ftell(scap_dumper_t* d)
+{
+	return d->m_async->m_tell_base + d->m_async->m_staged;
+}
+#endif // _WIN32
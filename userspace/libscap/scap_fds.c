@@ -45,7 +45,9 @@ limitations under the License.
 #include <string.h>
 
 #include <errno.h>
+#include <pthread.h>
 #include <netinet/tcp.h>
+#include "procfs_helpers.h"
 #if defined(__linux__)
 #if HAVE_SYS_MKDEV_H
 #include <sys/mkdev.h>
@@ -60,7 +62,11 @@ limitations under the License.
 #endif
 #endif
 
-#define SOCKET_SCAN_BUFFER_SIZE 1024 * 1024
+//
+// The /proc/net socket tables are read through a buffer of this size, on the
+// stack, one line at a time
+//
+#define SOCKET_SCAN_BUFFER_SIZE (64 * 1024)
 
 int32_t scap_fd_print_ipv6_socket_info(scap_t *handle, scap_fdinfo *fdi, OUT char *str, uint32_t stlen)
 {
@@ -651,7 +657,7 @@ void scap_fd_remove(scap_t *handle, scap_threadinfo *tinfo, int64_t fd)
 // Add the file descriptor info pointed by fdi to the fd table for process tinfo.
 // Note: silently skips if fdi->type is SCAP_FD_UNKNOWN.
 //
-int32_t scap_add_fd_to_proc_table(scap_t *handle, scap_threadinfo *tinfo, scap_fdinfo *fdi, char *error)
+int32_t scap_add_fd_to_proc_table(scap_t *handle, scap_threadinfo *tinfo, scap_fdinfo *fdi, proc_entry_callback proc_callback, char *error)
 {
 	int32_t uth_status = SCAP_SUCCESS;
 	scap_fdinfo *tfdi;
@@ -677,7 +683,7 @@ int32_t scap_add_fd_to_proc_table(scap_t *handle, scap_threadinfo *tinfo, scap_f
 	//
 	// Add the fd to the table, or fire the notification callback
 	//
-	if(handle->m_proc_callback == NULL)
+	if(proc_callback == NULL)
 	{
 		HASH_ADD_INT64(tinfo->fdlist, fd, fdi);
 		if(uth_status != SCAP_SUCCESS)
@@ -688,7 +694,7 @@ int32_t scap_add_fd_to_proc_table(scap_t *handle, scap_threadinfo *tinfo, scap_f
 	}
 	else
 	{
-		handle->m_proc_callback(handle->m_proc_callback_context, handle, tinfo->tid, tinfo, fdi);
+		proc_callback(handle->m_proc_callback_context, handle, tinfo->tid, tinfo, fdi);
 	}
 
 	return SCAP_SUCCESS;
@@ -725,9 +731,10 @@ void scap_free_device_table(scap_t* handle)
 
 #if defined(HAS_CAPTURE) && !defined(_WIN32)
 
-int32_t scap_fd_handle_pipe(scap_t *handle, char *fname, scap_threadinfo *tinfo, scap_fdinfo *fdi, char *error)
+int32_t scap_fd_handle_pipe(scap_t *handle, char *fname, scap_threadinfo *tinfo, scap_fdinfo *fdi, proc_entry_callback proc_callback, char *error)
 {
 	char link_name[SCAP_MAX_PATH_SIZE];
+	char strerror_buf[SCAP_LASTERR_SIZE];
 	ssize_t r;
 	uint64_t ino;
 	struct stat sb;
@@ -736,7 +743,7 @@ int32_t scap_fd_handle_pipe(scap_t *handle, char *fname, scap_threadinfo *tinfo,
 	if (r <= 0)
 	{
 		snprintf(error, SCAP_LASTERR_SIZE, "Could not read link %s (%s)",
-			 fname, scap_strerror(handle, errno));
+			 fname, scap_strerror_r(strerror_buf, errno));
 		return SCAP_FAILURE;
 	}
 	link_name[r] = '\0';
@@ -753,7 +760,7 @@ int32_t scap_fd_handle_pipe(scap_t *handle, char *fname, scap_threadinfo *tinfo,
 	strncpy(fdi->info.fname, link_name, SCAP_MAX_PATH_SIZE);
 
 	fdi->ino = ino;
-	return scap_add_fd_to_proc_table(handle, tinfo, fdi, error);
+	return scap_add_fd_to_proc_table(handle, tinfo, fdi, proc_callback, error);
 }
 
 static inline uint32_t open_flags_to_scap(unsigned long flags)
@@ -821,6 +828,12 @@ static inline uint32_t open_flags_to_scap(unsigned long flags)
 	return res;
 }
 
+//
+// The multi-threaded /proc scan and the lookups run by sinsp away from the
+// capture thread share the device table
+//
+static pthread_mutex_t s_dev_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 uint32_t scap_get_device_by_mount_id(scap_t *handle, const char *procdir, unsigned long requested_mount_id)
 {
 	char fd_dir_name[SCAP_MAX_PATH_SIZE];
@@ -828,7 +841,9 @@ uint32_t scap_get_device_by_mount_id(scap_t *handle, const char *procdir, unsign
 	FILE *finfo;
 	scap_mountinfo *mountinfo;
 
+	pthread_mutex_lock(&s_dev_list_mutex);
 	HASH_FIND_INT64(handle->m_dev_list, &requested_mount_id, mountinfo);
+	pthread_mutex_unlock(&s_dev_list_mutex);
 	if(mountinfo != NULL)
 	{
 		return mountinfo->dev;
@@ -856,10 +871,18 @@ uint32_t scap_get_device_by_mount_id(scap_t *handle, const char *procdir, unsign
 			if(mountinfo)
 			{
 				int32_t uth_status = SCAP_SUCCESS;
+				scap_mountinfo *tmountinfo;
+
 				mountinfo->mount_id = mount_id;
 				mountinfo->dev = dev;
-				HASH_ADD_INT64(handle->m_dev_list, mount_id, mountinfo);
-				if(uth_status != SCAP_SUCCESS)
+				pthread_mutex_lock(&s_dev_list_mutex);
+				HASH_FIND_INT64(handle->m_dev_list, &requested_mount_id, tmountinfo);
+				if(tmountinfo == NULL)
+				{
+					HASH_ADD_INT64(handle->m_dev_list, mount_id, mountinfo);
+				}
+				pthread_mutex_unlock(&s_dev_list_mutex);
+				if(tmountinfo != NULL || uth_status != SCAP_SUCCESS)
 				{
 					free(mountinfo);
 				}
@@ -928,7 +951,7 @@ void scap_fd_flags_file(scap_t *handle, scap_fdinfo *fdi, const char *procdir)
 	fclose(finfo);
 }
 
-int32_t scap_fd_handle_regular_file(scap_t *handle, char *fname, scap_threadinfo *tinfo, scap_fdinfo *fdi, const char *procdir, char *error)
+int32_t scap_fd_handle_regular_file(scap_t *handle, char *fname, scap_threadinfo *tinfo, scap_fdinfo *fdi, const char *procdir, proc_entry_callback proc_callback, char *error)
 {
 	char link_name[SCAP_MAX_PATH_SIZE];
 	ssize_t r;
@@ -983,10 +1006,10 @@ int32_t scap_fd_handle_regular_file(scap_t *handle, char *fname, scap_threadinfo
 		strncpy(fdi->info.fname, link_name, SCAP_MAX_PATH_SIZE);
 	}
 
-	return scap_add_fd_to_proc_table(handle, tinfo, fdi, error);
+	return scap_add_fd_to_proc_table(handle, tinfo, fdi, proc_callback, error);
 }
 
-int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_threadinfo *tinfo, scap_fdinfo *fdi, char* procdir, uint64_t net_ns, struct scap_ns_socket_list **sockets_by_ns, char *error)
+int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_threadinfo *tinfo, scap_fdinfo *fdi, char* procdir, uint64_t net_ns, struct scap_ns_socket_list **sockets_by_ns, proc_entry_callback proc_callback, char *error)
 {
 	char link_name[SCAP_MAX_PATH_SIZE];
 	ssize_t r;
@@ -999,6 +1022,15 @@ int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_threadinfo *tinf
 	{
 		return SCAP_SUCCESS;
 	}
+#ifndef CYGWING_AGENT
+	else if(*sockets_by_ns == SCAP_NS_SOCKETS_SHARED)
+	{
+		if(scap_proc_scan_mt_get_sockets(handle, procdir, net_ns, &sockets, error) != SCAP_SUCCESS)
+		{
+			return SCAP_FAILURE;
+		}
+	}
+#endif
 	else
 	{
 		HASH_FIND_INT64(*sockets_by_ns, &net_ns, sockets);
@@ -1041,7 +1073,7 @@ int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_threadinfo *tinf
 	{
 		// it's a kind of socket, but we don't support it right now
 		fdi->type = SCAP_FD_UNSUPPORTED;
-		return scap_add_fd_to_proc_table(handle, tinfo, fdi, error);
+		return scap_add_fd_to_proc_table(handle, tinfo, fdi, proc_callback, error);
 	}
 
 	//
@@ -1053,7 +1085,7 @@ int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_threadinfo *tinf
 		memcpy(&(fdi->info), &(tfdi->info), sizeof(fdi->info));
 		fdi->ino = ino;
 		fdi->type = tfdi->type;
-		return scap_add_fd_to_proc_table(handle, tinfo, fdi, error);
+		return scap_add_fd_to_proc_table(handle, tinfo, fdi, proc_callback, error);
 	}
 	else
 	{
@@ -1061,27 +1093,29 @@ int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_threadinfo *tinf
 	}
 }
 
-int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filename, scap_fdinfo **sockets)
+int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filename, scap_fdinfo **sockets, char *error)
 {
-	FILE *f;
-	char line[SCAP_MAX_PATH_SIZE];
+	char buf[SOCKET_SCAN_BUFFER_SIZE];
+	char strerror_buf[SCAP_LASTERR_SIZE];
+	scap_procfs_reader r;
 	int first_line = false;
-	char *delimiters = " \t";
-	char *token;
 	int32_t uth_status = SCAP_SUCCESS;
+	const char* line;
+	const char* p;
+	size_t len;
+	uint32_t j;
 
-	f = fopen(filename, "r");
-	if(NULL == f)
+	if(!scap_procfs_reader_open(&r, AT_FDCWD, filename, buf, sizeof(buf)))
 	{
 		ASSERT(false);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Could not open sockets file %s (%s)",
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not open sockets file %s (%s)",
 			 filename,
-			 scap_strerror(handle, errno));
+			 scap_strerror_r(strerror_buf, errno));
 		return SCAP_FAILURE;
 	}
-	while(NULL != fgets(line, sizeof(line), f))
+	while((line = scap_procfs_reader_next_line(&r, &len)) != NULL)
 	{
-		char *scratch;
+		uint64_t source;
 
 		// skip the first line ... contains field names
 		if(!first_line)
@@ -1089,423 +1123,255 @@ int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filen
 			first_line = true;
 			continue;
 		}
-		scap_fdinfo *fdinfo = malloc(sizeof(scap_fdinfo));
-		fdinfo->type = SCAP_FD_UNIX_SOCK;
-
 
 		//
 		// parse the fields
 		//
 		// 1. Num
-		token = strtok_r(line, delimiters, &scratch);
-		if(token == NULL)
-		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
-		}
-
-		fdinfo->info.unix_socket_info.source = strtoul(token, NULL, 16);
-		fdinfo->info.unix_socket_info.destination = 0;
-
-		// 2. RefCount
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
+		p = scap_procfs_parse_hex(line, 16, &source);
+		if(p == NULL)
 		{
 			ASSERT(false);
-			free(fdinfo);
 			continue;
 		}
 
-		// 3. Protocol
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
+		// 2. RefCount, 3. Protocol, 4. Flags, 5. Type, 6. St
+		p = scap_procfs_skip_word(p);
+		for(j = 0; j < 5; j++)
 		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
+			p = scap_procfs_skip_word(p);
 		}
 
-		// 4. Flags
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
-		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
-		}
-
-		// 5. Type
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
-		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
-		}
-
-		// 6. St
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
-		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
-		}
+		scap_fdinfo *fdinfo = malloc(sizeof(scap_fdinfo));
+		fdinfo->type = SCAP_FD_UNIX_SOCK;
+		fdinfo->info.unix_socket_info.source = source;
+		fdinfo->info.unix_socket_info.destination = 0;
 
 		// 7. Inode
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
+		p = scap_procfs_parse_u64(p, &fdinfo->ino);
+		if(p == NULL)
 		{
 			ASSERT(false);
 			free(fdinfo);
 			continue;
 		}
 
-		sscanf(token, "%"PRIu64, &(fdinfo->ino));
-
 		// 8. Path
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(NULL != token)
-		{
-			strncpy(fdinfo->info.unix_socket_info.fname, token, SCAP_MAX_PATH_SIZE);
-		}
-		else
-		{
-			fdinfo->info.unix_socket_info.fname[0] = '\0';
-		}
+		p = scap_procfs_skip_blanks(p);
+		snprintf(fdinfo->info.unix_socket_info.fname, SCAP_MAX_PATH_SIZE, "%s", p);
 
 		HASH_ADD_INT64((*sockets), ino, fdinfo);
 		if(uth_status != SCAP_SUCCESS)
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unix socket allocation error");
-			fclose(f);
+			snprintf(error, SCAP_LASTERR_SIZE, "unix socket allocation error");
+			scap_procfs_reader_close(&r);
 			free(fdinfo);
 			return SCAP_FAILURE;
 		}
 	}
-	fclose(f);
+	scap_procfs_reader_close(&r);
 	return uth_status;
 }
 
 //sk       Eth Pid    Groups   Rmem     Wmem     Dump     Locks     Drops     Inode
 //ffff88011abfb000 0   0      00000000 0        0        0 2        0        13
 
-int32_t scap_fd_read_netlink_sockets_from_proc_fs(scap_t *handle, const char* filename, scap_fdinfo **sockets)
+int32_t scap_fd_read_netlink_sockets_from_proc_fs(scap_t *handle, const char* filename, scap_fdinfo **sockets, char *error)
 {
-	FILE *f;
-	char line[SCAP_MAX_PATH_SIZE];
+	char buf[SOCKET_SCAN_BUFFER_SIZE];
+	char strerror_buf[SCAP_LASTERR_SIZE];
+	scap_procfs_reader r;
 	int first_line = false;
-	char *delimiters = " \t";
-	char *token;
 	int32_t uth_status = SCAP_SUCCESS;
+	const char* line;
+	const char* p;
+	size_t len;
+	uint64_t ino;
+	uint32_t j;
 
-	f = fopen(filename, "r");
-	if(NULL == f)
+	if(!scap_procfs_reader_open(&r, AT_FDCWD, filename, buf, sizeof(buf)))
 	{
 		ASSERT(false);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Could not open netlink sockets file %s (%s)",
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not open netlink sockets file %s (%s)",
 			 filename,
-			 scap_strerror(handle, errno));
+			 scap_strerror_r(strerror_buf, errno));
 
 		return SCAP_FAILURE;
 	}
-	while(NULL != fgets(line, sizeof(line), f))
+	while((line = scap_procfs_reader_next_line(&r, &len)) != NULL)
 	{
-		char *scratch;
-
 		// skip the first line ... contains field names
 		if(!first_line)
 		{
 			first_line = true;
 			continue;
 		}
-		scap_fdinfo *fdinfo = malloc(sizeof(scap_fdinfo));
-		memset(fdinfo, 0, sizeof(scap_fdinfo));
-		fdinfo->type = SCAP_FD_UNIX_SOCK;
-
 
 		//
-		// parse the fields
+		// parse the fields: skip sk, Eth, Pid, Groups, Rmem, Wmem,
+		// Dump, Locks and Drops, then read Inode
 		//
-		// 1. Num
-		token = strtok_r(line, delimiters, &scratch);
-		if(token == NULL)
-		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
-		}
-
-		// 2. Eth
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
+		p = line;
+		for(j = 0; j < 9; j++)
 		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
+			p = scap_procfs_skip_word(p);
 		}
 
-		// 3. Pid
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
+		if(scap_procfs_parse_u64(p, &ino) == NULL)
 		{
 			ASSERT(false);
-			free(fdinfo);
 			continue;
 		}
 
-		// 4. Groups
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
-		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
-		}
+		scap_fdinfo *fdinfo = malloc(sizeof(scap_fdinfo));
+		memset(fdinfo, 0, sizeof(scap_fdinfo));
+		fdinfo->type = SCAP_FD_UNIX_SOCK;
+		fdinfo->ino = ino;
 
-		// 5. Rmem
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
+		HASH_ADD_INT64((*sockets), ino, fdinfo);
+		if(uth_status != SCAP_SUCCESS)
 		{
-			ASSERT(false);
+			snprintf(error, SCAP_LASTERR_SIZE, "netlink socket allocation error");
+			scap_procfs_reader_close(&r);
 			free(fdinfo);
-			continue;
+			return SCAP_FAILURE;
 		}
+	}
+	scap_procfs_reader_close(&r);
+	return uth_status;
+}
 
-		// 6. Wmem
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
-		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
-		}
+//
+// Parse the fields common to the lines of /proc/net/{tcp,udp,raw}{,6}
+// after the addresses:
+//
+//   st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode
+//   0A 00000000:00000000 00:00000000 00000000     0        0 12345 ...
+//
+static bool scap_fd_parse_inet_socket_inode(const char* p, uint64_t* ino)
+{
+	uint32_t j;
 
-		// 7. Dump
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
-		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
-		}
+	for(j = 0; j < 6; j++)
+	{
+		p = scap_procfs_skip_word(p);
+	}
 
-		// 8. Locks
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
-		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
-		}
+	return scap_procfs_parse_u64(p, ino) != NULL;
+}
 
-		// 9. Drops
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
-		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
-		}
+//
+// Parse an address:port pair of /proc/net/{tcp,udp,raw}{,6}, whose address
+// is naddr 32 bit words in hex, into addr and port
+//
+static const char* scap_fd_parse_inet_address(const char* p, uint32_t naddr, uint32_t* addr, uint16_t* port)
+{
+	uint64_t v;
+	uint32_t j;
 
-		// 10. Inode
-		token = strtok_r(NULL, delimiters, &scratch);
-		if(token == NULL)
+	p = scap_procfs_skip_blanks(p);
+	for(j = 0; j < naddr; j++)
+	{
+		p = scap_procfs_parse_hex(p, 8, &v);
+		if(p == NULL)
 		{
-			ASSERT(false);
-			free(fdinfo);
-			continue;
+			return NULL;
 		}
+		addr[j] = (uint32_t)v;
+	}
 
-		sscanf(token, "%"PRIu64, &(fdinfo->ino));
-
-		HASH_ADD_INT64((*sockets), ino, fdinfo);
-		if(uth_status != SCAP_SUCCESS)
-		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "netlink socket allocation error");
-			fclose(f);
-			free(fdinfo);
-			return SCAP_FAILURE;
-		}
+	if(*p != ':' || (p = scap_procfs_parse_hex(p + 1, 4, &v)) == NULL)
+	{
+		return NULL;
 	}
-	fclose(f);
-	return uth_status;
+
+	*port = (uint16_t)v;
+	return p;
 }
 
-int32_t scap_fd_read_ipv4_sockets_from_proc_fs(scap_t *handle, const char *dir, int l4proto, scap_fdinfo **sockets)
+int32_t scap_fd_read_ipv4_sockets_from_proc_fs(scap_t *handle, const char *dir, int l4proto, scap_fdinfo **sockets, char *error)
 {
-	FILE *f;
+	char buf[SOCKET_SCAN_BUFFER_SIZE];
+	char strerror_buf[SCAP_LASTERR_SIZE];
+	scap_procfs_reader r;
+	int first_line = false;
 	int32_t uth_status = SCAP_SUCCESS;
-	char* scan_buf;
-	char* scan_pos;
-	char* tmp_pos;
-	uint32_t rsize;
-	char* end;
-	char tc;
-	uint32_t j;
-
-	scan_buf = (char*)malloc(SOCKET_SCAN_BUFFER_SIZE);
-	if(scan_buf == NULL)
-	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scan_buf allocation error");
-		return SCAP_FAILURE;
-	}
+	const char* line;
+	const char* p;
+	size_t len;
 
-	f = fopen(dir, "r");
-	if(NULL == f)
+	if(!scap_procfs_reader_open(&r, AT_FDCWD, dir, buf, sizeof(buf)))
 	{
 		ASSERT(false);
-		free(scan_buf);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Could not open ipv4 sockets dir %s (%s)",
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not open ipv4 sockets dir %s (%s)",
 			 dir,
-			 scap_strerror(handle, errno));
+			 scap_strerror_r(strerror_buf, errno));
 		return SCAP_FAILURE;
 	}
 
-	while((rsize = fread(scan_buf, 1, SOCKET_SCAN_BUFFER_SIZE, f))  != 0)
+	while((line = scap_procfs_reader_next_line(&r, &len)) != NULL)
 	{
-		char* scan_end = scan_buf + rsize;
-		scan_pos = scan_buf;
+		uint32_t sip;
+		uint32_t dip;
+		uint16_t sport;
+		uint16_t dport;
+		uint64_t ino;
 
-		while(scan_pos <= scan_end)
+		// skip the first line ... contains field names
+		if(!first_line)
 		{
-			scan_pos = memchr(scan_pos, '\n', scan_end - scan_pos);
-
-			if(scan_pos == NULL)
-			{
-				break;
-			}
-
-			scap_fdinfo *fdinfo = malloc(sizeof(scap_fdinfo));
-
-			//
-			// Skip the sl field
-			//
-			scan_pos = memchr(scan_pos, ':', scan_end - scan_pos);
-			if(scan_pos == NULL)
-			{
-				free(fdinfo);
-				break;
-			}
-
-			scan_pos += 2;
-			if(scan_pos + 80 >= scan_end)
-			{
-				free(fdinfo);
-				break;
-			}
-
-			//
-			// Scan the local address
-			//
-			tc = *(scan_pos + 8);
-			*(scan_pos + 8) = 0;
-			fdinfo->info.ipv4info.sip = strtoul(scan_pos, &end, 16);
-			*(scan_pos + 8) = tc;
-
-			scan_pos += 9;
-			tc = *(scan_pos + 4);
-			ASSERT(tc == ' ');
-			*(scan_pos + 4) = 0;
-			fdinfo->info.ipv4info.sport = (uint16_t)strtoul(scan_pos, &end, 16);
-			*(scan_pos + 4) = tc;
-
-			//
-			// Scan the remote address
-			//
-			scan_pos += 5;
-
-			tc = *(scan_pos + 8);
-			*(scan_pos + 8) = 0;
-			fdinfo->info.ipv4info.dip = strtoul(scan_pos, &end, 16);
-			*(scan_pos + 8) = tc;
-
-			scan_pos += 9;
-			tc = *(scan_pos + 4);
-			ASSERT(tc == ' ');
-			*(scan_pos + 4) = 0;
-			fdinfo->info.ipv4info.dport = (uint16_t)strtoul(scan_pos, &end, 16);
-			*(scan_pos + 4) = tc;
-
-			//
-			// Skip to parsing the inode
-			//
-			scan_pos += 4;
-
-			for(j = 0; j < 6; j++)
-			{
-				scan_pos++;
-
-				scan_pos = memchr(scan_pos, ' ', scan_end - scan_pos);
-				if(scan_pos == NULL)
-				{
-					break;
-				}
-
-				while(*scan_pos == ' ' && scan_pos < scan_end)
-				{
-					scan_pos++;
-				}
-
-				if(scan_pos >= scan_end)
-				{
-					break;
-				}
-			}
-
-			if(j < 6)
-			{
-				free(fdinfo);
-				break;
-			}
-
-			tmp_pos = scan_pos;
-			scan_pos = memchr(scan_pos, ' ', scan_end - scan_pos);
-			if(scan_pos == NULL || scan_pos >= scan_end)
-			{
-				free(fdinfo);
-				break;
-			}
-
-			tc = *(scan_pos);
-
-			fdinfo->ino = (uint64_t)strtoull(tmp_pos, &end, 10);
+			first_line = true;
+			continue;
+		}
 
-			*(scan_pos) = tc;
+		//
+		// Skip the sl field, then scan the local and remote addresses
+		// and the inode
+		//
+		p = strchr(line, ':');
+		if(p == NULL ||
+		   (p = scap_fd_parse_inet_address(p + 1, 1, &sip, &sport)) == NULL ||
+		   (p = scap_fd_parse_inet_address(p, 1, &dip, &dport)) == NULL ||
+		   !scap_fd_parse_inet_socket_inode(p, &ino))
+		{
+			continue;
+		}
 
-			//
-			// Add to the table
-			//
-			if(fdinfo->info.ipv4info.dip == 0)
-			{
-				fdinfo->type = SCAP_FD_IPV4_SERVSOCK;
-				fdinfo->info.ipv4serverinfo.l4proto = l4proto;
-				fdinfo->info.ipv4serverinfo.port = fdinfo->info.ipv4info.sport;
-				fdinfo->info.ipv4serverinfo.ip = fdinfo->info.ipv4info.sip;
-			}
-			else
-			{
-				fdinfo->type = SCAP_FD_IPV4_SOCK;
-				fdinfo->info.ipv4info.l4proto = l4proto;
-			}
+		scap_fdinfo *fdinfo = malloc(sizeof(scap_fdinfo));
+		fdinfo->ino = ino;
 
-			HASH_ADD_INT64((*sockets), ino, fdinfo);
+		//
+		// Add to the table
+		//
+		if(dip == 0)
+		{
+			fdinfo->type = SCAP_FD_IPV4_SERVSOCK;
+			fdinfo->info.ipv4serverinfo.l4proto = l4proto;
+			fdinfo->info.ipv4serverinfo.port = sport;
+			fdinfo->info.ipv4serverinfo.ip = sip;
+		}
+		else
+		{
+			fdinfo->type = SCAP_FD_IPV4_SOCK;
+			fdinfo->info.ipv4info.sip = sip;
+			fdinfo->info.ipv4info.sport = sport;
+			fdinfo->info.ipv4info.dip = dip;
+			fdinfo->info.ipv4info.dport = dport;
+			fdinfo->info.ipv4info.l4proto = l4proto;
+		}
 
-			if(uth_status != SCAP_SUCCESS)
-			{
-				uth_status = SCAP_FAILURE;
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "ipv4 socket allocation error");
-				free(fdinfo);
-				break;
-			}
+		HASH_ADD_INT64((*sockets), ino, fdinfo);
 
-			scan_pos++;
+		if(uth_status != SCAP_SUCCESS)
+		{
+			uth_status = SCAP_FAILURE;
+			snprintf(error, SCAP_LASTERR_SIZE, "ipv4 socket allocation error");
+			free(fdinfo);
+			break;
 		}
 	}
 
-	fclose(f);
-	free(scan_buf);
+	scap_procfs_reader_close(&r);
 	return uth_status;
 }
 
@@ -1514,221 +1380,89 @@ int32_t scap_fd_is_ipv6_server_socket(uint32_t ip6_addr[4])
 	return 0 == ip6_addr[0] && 0 == ip6_addr[1] && 0 == ip6_addr[2] && 0 == ip6_addr[3];
 }
 
-int32_t scap_fd_read_ipv6_sockets_from_proc_fs(scap_t *handle, char *dir, int l4proto, scap_fdinfo **sockets)
+int32_t scap_fd_read_ipv6_sockets_from_proc_fs(scap_t *handle, char *dir, int l4proto, scap_fdinfo **sockets, char *error)
 {
-	FILE *f;
+	char buf[SOCKET_SCAN_BUFFER_SIZE];
+	char strerror_buf[SCAP_LASTERR_SIZE];
+	scap_procfs_reader r;
+	int first_line = false;
 	int32_t uth_status = SCAP_SUCCESS;
-	char* scan_buf;
-	char* scan_pos;
-	char* tmp_pos;
-	uint32_t rsize;
-	char* end;
-	char tc;
-	uint32_t j;
-
-	scan_buf = (char*)malloc(SOCKET_SCAN_BUFFER_SIZE);
-	if(scan_buf == NULL)
-	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scan_buf allocation error");
-		return SCAP_FAILURE;
-	}
+	const char* line;
+	const char* p;
+	size_t len;
 
-	f = fopen(dir, "r");
-
-	if(NULL == f)
+	if(!scap_procfs_reader_open(&r, AT_FDCWD, dir, buf, sizeof(buf)))
 	{
 		ASSERT(false);
-		free(scan_buf);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Could not open ipv6 sockets dir %s (%s)",
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not open ipv6 sockets dir %s (%s)",
 			 dir,
-			 scap_strerror(handle, errno));
+			 scap_strerror_r(strerror_buf, errno));
 		return SCAP_FAILURE;
 	}
 
-	while((rsize = fread(scan_buf, 1, SOCKET_SCAN_BUFFER_SIZE, f))  != 0)
+	while((line = scap_procfs_reader_next_line(&r, &len)) != NULL)
 	{
-		char* scan_end = scan_buf + rsize;
-		scan_pos = scan_buf;
+		uint32_t sip[4];
+		uint32_t dip[4];
+		uint16_t sport;
+		uint16_t dport;
+		uint64_t ino;
 
-		while(scan_pos <= scan_end)
+		// skip the first line ... contains field names
+		if(!first_line)
 		{
-			scan_pos = memchr(scan_pos, '\n', scan_end - scan_pos);
-
-			if(scan_pos == NULL)
-			{
-				break;
-			}
-
-			scap_fdinfo *fdinfo = malloc(sizeof(scap_fdinfo));
-
-			//
-			// Skip the sl field
-			//
-			scan_pos = memchr(scan_pos, ':', scan_end - scan_pos);
-			if(scan_pos == NULL)
-			{
-				free(fdinfo);
-				break;
-			}
-
-			scan_pos += 2;
-			if(scan_pos + 80 >= scan_end)
-			{
-				free(fdinfo);
-				break;
-			}
-
-			//
-			// Scan the first address
-			//
-			tc = *(scan_pos + 8);
-			*(scan_pos + 8) = 0;
-			fdinfo->info.ipv6info.sip[0] = strtoul(scan_pos, &end, 16);
-			*(scan_pos + 8) = tc;
-
-			scan_pos += 8;
-			tc = *(scan_pos + 8);
-			*(scan_pos + 8) = 0;
-			fdinfo->info.ipv6info.sip[1] = strtoul(scan_pos, &end, 16);
-			*(scan_pos + 8) = tc;
-
-			scan_pos += 8;
-			tc = *(scan_pos + 8);
-			*(scan_pos + 8) = 0;
-			fdinfo->info.ipv6info.sip[2] = strtoul(scan_pos, &end, 16);
-			*(scan_pos + 8) = tc;
-
-			scan_pos += 8;
-			tc = *(scan_pos + 8);
-			ASSERT(tc == ':');
-			*(scan_pos + 8) = 0;
-			fdinfo->info.ipv6info.sip[3] = strtoul(scan_pos, &end, 16);
-			*(scan_pos + 8) = tc;
-
-			scan_pos += 9;
-			tc = *(scan_pos + 4);
-			ASSERT(tc == ' ');
-			*(scan_pos + 4) = 0;
-			fdinfo->info.ipv6info.sport = (uint16_t)strtoul(scan_pos, &end, 16);
-			*(scan_pos + 4) = tc;
-
-			//
-			// Scan the second address
-			//
-			scan_pos += 5;
-
-			tc = *(scan_pos + 8);
-			*(scan_pos + 8) = 0;
-			fdinfo->info.ipv6info.dip[0] = strtoul(scan_pos, &end, 16);
-			*(scan_pos + 8) = tc;
-
-			scan_pos += 8;
-			tc = *(scan_pos + 8);
-			*(scan_pos + 8) = 0;
-			fdinfo->info.ipv6info.dip[1] = strtoul(scan_pos, &end, 16);
-			*(scan_pos + 8) = tc;
-
-			scan_pos += 8;
-			tc = *(scan_pos + 8);
-			*(scan_pos + 8) = 0;
-			fdinfo->info.ipv6info.dip[2] = strtoul(scan_pos, &end, 16);
-			*(scan_pos + 8) = tc;
-
-			scan_pos += 8;
-			tc = *(scan_pos + 8);
-			ASSERT(tc == ':');
-			*(scan_pos + 8) = 0;
-			fdinfo->info.ipv6info.dip[3] = strtoul(scan_pos, &end, 16);
-			*(scan_pos + 8) = tc;
-
-			scan_pos += 9;
-			tc = *(scan_pos + 4);
-			ASSERT(tc == ' ');
-			*(scan_pos + 4) = 0;
-			fdinfo->info.ipv6info.dport = (uint16_t)strtoul(scan_pos, &end, 16);
-			*(scan_pos + 4) = tc;
-
-			//
-			// Skip to parsing the inode
-			//
-			scan_pos += 4;
-
-			for(j = 0; j < 6; j++)
-			{
-				scan_pos++;
-
-				scan_pos = memchr(scan_pos, ' ', scan_end - scan_pos);
-				if(scan_pos == NULL)
-				{
-					break;
-				}
-
-				while(*scan_pos == ' ' && scan_pos < scan_end)
-				{
-					scan_pos++;
-				}
-
-				if(scan_pos >= scan_end)
-				{
-					break;
-				}
-			}
-
-			if(j < 6)
-			{
-				free(fdinfo);
-				break;
-			}
-
-			tmp_pos = scan_pos;
-			scan_pos = memchr(scan_pos, ' ', scan_end - scan_pos);
-			if(scan_pos == NULL || scan_pos >= scan_end)
-			{
-				free(fdinfo);
-				break;
-			}
-
-			tc = *(scan_pos);
-
-			fdinfo->ino = (uint64_t)strtoull(tmp_pos, &end, 10);
+			first_line = true;
+			continue;
+		}
 
-			*(scan_pos) = tc;
+		//
+		// Skip the sl field, then scan the local and remote addresses
+		// and the inode
+		//
+		p = strchr(line, ':');
+		if(p == NULL ||
+		   (p = scap_fd_parse_inet_address(p + 1, 4, sip, &sport)) == NULL ||
+		   (p = scap_fd_parse_inet_address(p, 4, dip, &dport)) == NULL ||
+		   !scap_fd_parse_inet_socket_inode(p, &ino))
+		{
+			continue;
+		}
 
-			//
-			// Add to the table
-			//
-			if(scap_fd_is_ipv6_server_socket(fdinfo->info.ipv6info.dip))
-			{
-				fdinfo->type = SCAP_FD_IPV6_SERVSOCK;
-				fdinfo->info.ipv6serverinfo.l4proto = l4proto;
-				fdinfo->info.ipv6serverinfo.port = fdinfo->info.ipv6info.sport;
-				fdinfo->info.ipv6serverinfo.ip[0] = fdinfo->info.ipv6info.sip[0];
-				fdinfo->info.ipv6serverinfo.ip[1] = fdinfo->info.ipv6info.sip[1];
-				fdinfo->info.ipv6serverinfo.ip[2] = fdinfo->info.ipv6info.sip[2];
-				fdinfo->info.ipv6serverinfo.ip[3] = fdinfo->info.ipv6info.sip[3];
-			}
-			else
-			{
-				fdinfo->type = SCAP_FD_IPV6_SOCK;
-				fdinfo->info.ipv6info.l4proto = l4proto;
-			}
+		scap_fdinfo *fdinfo = malloc(sizeof(scap_fdinfo));
+		fdinfo->ino = ino;
 
-			HASH_ADD_INT64((*sockets), ino, fdinfo);
+		//
+		// Add to the table
+		//
+		if(scap_fd_is_ipv6_server_socket(dip))
+		{
+			fdinfo->type = SCAP_FD_IPV6_SERVSOCK;
+			fdinfo->info.ipv6serverinfo.l4proto = l4proto;
+			fdinfo->info.ipv6serverinfo.port = sport;
+			memcpy(fdinfo->info.ipv6serverinfo.ip, sip, sizeof(sip));
+		}
+		else
+		{
+			fdinfo->type = SCAP_FD_IPV6_SOCK;
+			memcpy(fdinfo->info.ipv6info.sip, sip, sizeof(sip));
+			fdinfo->info.ipv6info.sport = sport;
+			memcpy(fdinfo->info.ipv6info.dip, dip, sizeof(dip));
+			fdinfo->info.ipv6info.dport = dport;
+			fdinfo->info.ipv6info.l4proto = l4proto;
+		}
 
-			if(uth_status != SCAP_SUCCESS)
-			{
-				uth_status = SCAP_FAILURE;
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "ipv6 socket allocation error");
-				break;
-			}
+		HASH_ADD_INT64((*sockets), ino, fdinfo);
 
-			scan_pos++;
+		if(uth_status != SCAP_SUCCESS)
+		{
+			uth_status = SCAP_FAILURE;
+			snprintf(error, SCAP_LASTERR_SIZE, "ipv6 socket allocation error");
+			free(fdinfo);
+			break;
 		}
 	}
 
-	fclose(f);
-	free(scan_buf);
-
+	scap_procfs_reader_close(&r);
 	return uth_status;
 }
 
@@ -1736,6 +1470,7 @@ int32_t scap_fd_read_sockets(scap_t *handle, char* procdir, struct scap_ns_socke
 {
 	char filename[SCAP_MAX_PATH_SIZE];
 	char netroot[SCAP_MAX_PATH_SIZE];
+	char read_error[SCAP_LASTERR_SIZE];
 
 	if(sockets->net_ns)
 	{
@@ -1753,42 +1488,42 @@ int32_t scap_fd_read_sockets(scap_t *handle, char* procdir, struct scap_ns_socke
 	}
 
 	snprintf(filename, sizeof(filename), "%stcp", netroot);
-	if(scap_fd_read_ipv4_sockets_from_proc_fs(handle, filename, SCAP_L4_TCP, &sockets->sockets) == SCAP_FAILURE)
+	if(scap_fd_read_ipv4_sockets_from_proc_fs(handle, filename, SCAP_L4_TCP, &sockets->sockets, read_error) == SCAP_FAILURE)
 	{
 		scap_fd_free_table(handle, &sockets->sockets);
-		snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv4 tcp sockets (%s)", handle->m_lasterr);
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv4 tcp sockets (%s)", read_error);
 		return SCAP_FAILURE;
 	}
 
 	snprintf(filename, sizeof(filename), "%sudp", netroot);
-	if(scap_fd_read_ipv4_sockets_from_proc_fs(handle, filename, SCAP_L4_UDP, &sockets->sockets) == SCAP_FAILURE)
+	if(scap_fd_read_ipv4_sockets_from_proc_fs(handle, filename, SCAP_L4_UDP, &sockets->sockets, read_error) == SCAP_FAILURE)
 	{
 		scap_fd_free_table(handle, &sockets->sockets);
-		snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv4 udp sockets (%s)", handle->m_lasterr);
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv4 udp sockets (%s)", read_error);
 		return SCAP_FAILURE;
 	}
 
 	snprintf(filename, sizeof(filename), "%sraw", netroot);
-	if(scap_fd_read_ipv4_sockets_from_proc_fs(handle, filename, SCAP_L4_RAW, &sockets->sockets) == SCAP_FAILURE)
+	if(scap_fd_read_ipv4_sockets_from_proc_fs(handle, filename, SCAP_L4_RAW, &sockets->sockets, read_error) == SCAP_FAILURE)
 	{
 		scap_fd_free_table(handle, &sockets->sockets);
-		snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv4 raw sockets (%s)", handle->m_lasterr);
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv4 raw sockets (%s)", read_error);
 		return SCAP_FAILURE;
 	}
 
 	snprintf(filename, sizeof(filename), "%sunix", netroot);
-	if(scap_fd_read_unix_sockets_from_proc_fs(handle, filename, &sockets->sockets) == SCAP_FAILURE)
+	if(scap_fd_read_unix_sockets_from_proc_fs(handle, filename, &sockets->sockets, read_error) == SCAP_FAILURE)
 	{
 		scap_fd_free_table(handle, &sockets->sockets);
-		snprintf(error, SCAP_LASTERR_SIZE, "Could not read unix sockets (%s)", handle->m_lasterr);
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not read unix sockets (%s)", read_error);
 		return SCAP_FAILURE;
 	}
 
 	snprintf(filename, sizeof(filename), "%snetlink", netroot);
-	if(scap_fd_read_netlink_sockets_from_proc_fs(handle, filename, &sockets->sockets) == SCAP_FAILURE)
+	if(scap_fd_read_netlink_sockets_from_proc_fs(handle, filename, &sockets->sockets, read_error) == SCAP_FAILURE)
 	{
 		scap_fd_free_table(handle, &sockets->sockets);
-		snprintf(error, SCAP_LASTERR_SIZE, "Could not read netlink sockets (%s)", handle->m_lasterr);
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not read netlink sockets (%s)", read_error);
 		return SCAP_FAILURE;
 	}
 
@@ -1796,26 +1531,26 @@ int32_t scap_fd_read_sockets(scap_t *handle, char* procdir, struct scap_ns_socke
     /* We assume if there is /proc/net/tcp6 that ipv6 is available */
     if(access(filename, R_OK) == 0)
     {
-		if(scap_fd_read_ipv6_sockets_from_proc_fs(handle, filename, SCAP_L4_TCP, &sockets->sockets) == SCAP_FAILURE)
+		if(scap_fd_read_ipv6_sockets_from_proc_fs(handle, filename, SCAP_L4_TCP, &sockets->sockets, read_error) == SCAP_FAILURE)
 		{
 			scap_fd_free_table(handle, &sockets->sockets);
-			snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv6 tcp sockets (%s)", handle->m_lasterr);
+			snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv6 tcp sockets (%s)", read_error);
 			return SCAP_FAILURE;
 		}
 
 		snprintf(filename, sizeof(filename), "%sudp6", netroot);
-		if(scap_fd_read_ipv6_sockets_from_proc_fs(handle, filename, SCAP_L4_UDP, &sockets->sockets) == SCAP_FAILURE)
+		if(scap_fd_read_ipv6_sockets_from_proc_fs(handle, filename, SCAP_L4_UDP, &sockets->sockets, read_error) == SCAP_FAILURE)
 		{
 			scap_fd_free_table(handle, &sockets->sockets);
-			snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv6 udp sockets (%s)", handle->m_lasterr);
+			snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv6 udp sockets (%s)", read_error);
 			return SCAP_FAILURE;
 		}
 
 		snprintf(filename, sizeof(filename), "%sraw6", netroot);
-		if(scap_fd_read_ipv6_sockets_from_proc_fs(handle, filename, SCAP_L4_RAW, &sockets->sockets) == SCAP_FAILURE)
+		if(scap_fd_read_ipv6_sockets_from_proc_fs(handle, filename, SCAP_L4_RAW, &sockets->sockets, read_error) == SCAP_FAILURE)
 		{
 			scap_fd_free_table(handle, &sockets->sockets);
-			snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv6 raw sockets (%s)", handle->m_lasterr);
+			snprintf(error, SCAP_LASTERR_SIZE, "Could not read ipv6 raw sockets (%s)", read_error);
 			return SCAP_FAILURE;
 		}
     }
@@ -1831,7 +1566,6 @@ int32_t scap_fd_allocate_fdinfo(scap_t *handle, scap_fdinfo **fdi, int64_t fd, s
 	*fdi = (scap_fdinfo *)malloc(sizeof(scap_fdinfo));
 	if(*fdi == NULL)
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "fd table allocation error (2)");
 		return SCAP_FAILURE;
 	}
 	(*fdi)->type = type;
@@ -1881,7 +1615,7 @@ char * decode_st_mode(struct stat* sb)
 //
 // Scan the directory containing the fd's of a proc /proc/x/fd
 //
-int32_t scap_fd_scan_fd_dir(scap_t *handle, char *procdir, scap_threadinfo *tinfo, struct scap_ns_socket_list **sockets_by_ns, uint64_t* num_fds_ret, char *error)
+int32_t scap_fd_scan_fd_dir(scap_t *handle, char *procdir, scap_threadinfo *tinfo, struct scap_ns_socket_list **sockets_by_ns, proc_entry_callback proc_callback, uint64_t* num_fds_ret, char *error)
 {
 	DIR *dir_p;
 	struct dirent *dir_entry_p;
@@ -1954,7 +1688,7 @@ int32_t scap_fd_scan_fd_dir(scap_t *handle, char *procdir, scap_threadinfo *tinf
 				snprintf(error, SCAP_LASTERR_SIZE, "can't allocate scap fd handle for fifo fd %" PRIu64, fd);
 				break;
 			}
-			res = scap_fd_handle_pipe(handle, f_name, tinfo, fdi, error);
+			res = scap_fd_handle_pipe(handle, f_name, tinfo, fdi, proc_callback, error);
 			break;
 		case S_IFREG:
 		case S_IFBLK:
@@ -1967,7 +1701,7 @@ int32_t scap_fd_scan_fd_dir(scap_t *handle, char *procdir, scap_threadinfo *tinf
 				break;
 			}
 			fdi->ino = sb.st_ino;
-			res = scap_fd_handle_regular_file(handle, f_name, tinfo, fdi, procdir, error);
+			res = scap_fd_handle_regular_file(handle, f_name, tinfo, fdi, procdir, proc_callback, error);
 			break;
 		case S_IFDIR:
 			res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_DIRECTORY);
@@ -1977,7 +1711,7 @@ int32_t scap_fd_scan_fd_dir(scap_t *handle, char *procdir, scap_threadinfo *tinf
 				break;
 			}
 			fdi->ino = sb.st_ino;
-			res = scap_fd_handle_regular_file(handle, f_name, tinfo, fdi, procdir, error);
+			res = scap_fd_handle_regular_file(handle, f_name, tinfo, fdi, procdir, proc_callback, error);
 			break;
 		case S_IFSOCK:
 			res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_UNKNOWN);
@@ -1986,8 +1720,8 @@ int32_t scap_fd_scan_fd_dir(scap_t *handle, char *procdir, scap_threadinfo *tinf
 				snprintf(error, SCAP_LASTERR_SIZE, "can't allocate scap fd handle for sock fd %" PRIu64, fd);
 				break;
 			}
-			res = scap_fd_handle_socket(handle, f_name, tinfo, fdi, procdir, net_ns, sockets_by_ns, error);
-			if(handle->m_proc_callback == NULL)
+			res = scap_fd_handle_socket(handle, f_name, tinfo, fdi, procdir, net_ns, sockets_by_ns, proc_callback, error);
+			if(proc_callback == NULL)
 			{
 				// we can land here if we've got a netlink socket
 				if(fdi->type == SCAP_FD_UNKNOWN)
@@ -2004,11 +1738,11 @@ int32_t scap_fd_scan_fd_dir(scap_t *handle, char *procdir, scap_threadinfo *tinf
 				break;
 			}
 			fdi->ino = sb.st_ino;
-			res = scap_fd_handle_regular_file(handle, f_name, tinfo, fdi, procdir, error);
+			res = scap_fd_handle_regular_file(handle, f_name, tinfo, fdi, procdir, proc_callback, error);
 			break;
 		}
 
-		if(handle->m_proc_callback != NULL)
+		if(proc_callback != NULL)
 		{
 			if(fdi)
 			{
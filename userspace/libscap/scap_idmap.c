@@ -0,0 +1,352 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include "scap.h"
+#include "scap-int.h"
+
+//
+// Barriers for the per-shard sequence counter
+//
+#ifdef _WIN32
+#define ID_MAP_RMB() MemoryBarrier()
+#define ID_MAP_WMB() MemoryBarrier()
+#else
+#define ID_MAP_RMB() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define ID_MAP_WMB() __atomic_thread_fence(__ATOMIC_RELEASE)
+#endif
+
+static inline uint64_t id_map_hash(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+//
+// The top bits of the hash pick the shard and the low bits the slot, so
+// that the two don't correlate
+//
+static inline scap_id_map_shard* id_map_shard(scap_id_map* map, uint64_t hash)
+{
+	return &map->shards[hash >> 60];
+}
+
+static inline void id_map_write_begin(scap_id_map_shard* shard)
+{
+	shard->seq++;
+	ID_MAP_WMB();
+}
+
+static inline void id_map_write_end(scap_id_map_shard* shard)
+{
+	ID_MAP_WMB();
+	shard->seq++;
+}
+
+static scap_id_map_slot* id_map_alloc_slots(uint32_t size)
+{
+	uint32_t j;
+	scap_id_map_slot* slots = (scap_id_map_slot*)malloc(size * sizeof(scap_id_map_slot));
+
+	if(slots == NULL)
+	{
+		return NULL;
+	}
+
+	for(j = 0; j < size; j++)
+	{
+		slots[j].key = SCAP_ID_MAP_EMPTY_KEY;
+	}
+
+	return slots;
+}
+
+//
+// Double the shard once it's 3/4 full. The new array is filled before
+// it's published, and the old one is kept around for the readers that
+// might still be probing it.
+//
+static bool id_map_grow(scap_id_map_shard* shard)
+{
+	uint32_t size = (shard->slots == NULL)? SCAP_ID_MAP_SHARD_INITIAL_SIZE : (shard->mask + 1) * 2;
+	scap_id_map_slot* slots = id_map_alloc_slots(size);
+	scap_id_map_slot** retired;
+	uint32_t j;
+
+	if(slots == NULL)
+	{
+		return false;
+	}
+
+	if(shard->slots != NULL)
+	{
+		retired = (scap_id_map_slot**)realloc(shard->retired, (shard->nretired + 1) * sizeof(scap_id_map_slot*));
+		if(retired == NULL)
+		{
+			free(slots);
+			return false;
+		}
+		shard->retired = retired;
+
+		for(j = 0; j <= shard->mask; j++)
+		{
+			uint64_t key = shard->slots[j].key;
+			uint32_t idx;
+
+			if(key == SCAP_ID_MAP_EMPTY_KEY)
+			{
+				continue;
+			}
+
+			idx = (uint32_t)(id_map_hash(key) & (size - 1));
+			while(slots[idx].key != SCAP_ID_MAP_EMPTY_KEY)
+			{
+				idx = (idx + 1) & (size - 1);
+			}
+
+			slots[idx] = shard->slots[j];
+		}
+
+		shard->retired[shard->nretired++] = shard->slots;
+	}
+
+	id_map_write_begin(shard);
+	shard->slots = slots;
+	shard->mask = size - 1;
+	id_map_write_end(shard);
+
+	return true;
+}
+
+bool scap_id_map_put(scap_id_map* map, uint64_t key, uint64_t value)
+{
+	uint64_t hash = id_map_hash(key);
+	scap_id_map_shard* shard = id_map_shard(map, hash);
+	scap_id_map_slot* slots;
+	uint32_t idx;
+
+	if(key == SCAP_ID_MAP_EMPTY_KEY)
+	{
+		return false;
+	}
+
+	if(shard->slots == NULL || (shard->count + 1) * 4 > (shard->mask + 1) * 3)
+	{
+		if(!id_map_grow(shard))
+		{
+			return false;
+		}
+	}
+
+	slots = shard->slots;
+	idx = (uint32_t)(hash & shard->mask);
+	while(slots[idx].key != SCAP_ID_MAP_EMPTY_KEY && slots[idx].key != key)
+	{
+		idx = (idx + 1) & shard->mask;
+	}
+
+	id_map_write_begin(shard);
+	if(slots[idx].key == SCAP_ID_MAP_EMPTY_KEY)
+	{
+		slots[idx].key = key;
+		shard->count++;
+	}
+	slots[idx].value = value;
+	id_map_write_end(shard);
+
+	return true;
+}
+
+uint64_t scap_id_map_get(scap_id_map* map, uint64_t key)
+{
+	uint64_t hash = id_map_hash(key);
+	scap_id_map_shard* shard = id_map_shard(map, hash);
+	uint32_t idx;
+
+	if(shard->slots == NULL)
+	{
+		return 0;
+	}
+
+	idx = (uint32_t)(hash & shard->mask);
+	while(shard->slots[idx].key != SCAP_ID_MAP_EMPTY_KEY)
+	{
+		if(shard->slots[idx].key == key)
+		{
+			return shard->slots[idx].value;
+		}
+
+		idx = (idx + 1) & shard->mask;
+	}
+
+	return 0;
+}
+
+uint64_t scap_id_map_get_concurrent(scap_id_map* map, uint64_t key)
+{
+	uint64_t hash = id_map_hash(key);
+	scap_id_map_shard* shard = id_map_shard(map, hash);
+
+	while(true)
+	{
+		uint32_t seq = shard->seq;
+		scap_id_map_slot* slots;
+		uint64_t value = 0;
+		uint32_t mask;
+		uint32_t idx;
+		uint32_t j;
+
+		ID_MAP_RMB();
+
+		if(seq & 1)
+		{
+			continue;
+		}
+
+		slots = shard->slots;
+		mask = shard->mask;
+
+		if(slots == NULL)
+		{
+			return 0;
+		}
+
+		//
+		// A torn view of the shard can have no empty slot on the probe
+		// path, so bound the walk and let the sequence check retry
+		//
+		idx = (uint32_t)(hash & mask);
+		for(j = 0; j <= mask; j++)
+		{
+			uint64_t k = ((volatile scap_id_map_slot*)slots)[idx].key;
+
+			if(k == SCAP_ID_MAP_EMPTY_KEY)
+			{
+				break;
+			}
+
+			if(k == key)
+			{
+				value = ((volatile scap_id_map_slot*)slots)[idx].value;
+				break;
+			}
+
+			idx = (idx + 1) & mask;
+		}
+
+		ID_MAP_RMB();
+
+		if(shard->seq == seq)
+		{
+			return value;
+		}
+	}
+}
+
+bool scap_id_map_delete(scap_id_map* map, uint64_t key)
+{
+	uint64_t hash = id_map_hash(key);
+	scap_id_map_shard* shard = id_map_shard(map, hash);
+	scap_id_map_slot* slots = shard->slots;
+	uint32_t mask = shard->mask;
+	uint32_t i;
+	uint32_t j;
+
+	if(slots == NULL)
+	{
+		return false;
+	}
+
+	i = (uint32_t)(hash & mask);
+	while(slots[i].key != key)
+	{
+		if(slots[i].key == SCAP_ID_MAP_EMPTY_KEY)
+		{
+			return false;
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	id_map_write_begin(shard);
+
+	//
+	// Backward-shift deletion: move back every entry of the cluster
+	// whose home slot is not between the hole and its current position,
+	// so that lookups never need tombstones
+	//
+	j = i;
+	while(true)
+	{
+		uint32_t home;
+
+		j = (j + 1) & mask;
+		if(slots[j].key == SCAP_ID_MAP_EMPTY_KEY)
+		{
+			break;
+		}
+
+		home = (uint32_t)(id_map_hash(slots[j].key) & mask);
+		if((i <= j)? (i < home && home <= j) : (i < home || home <= j))
+		{
+			continue;
+		}
+
+		slots[i] = slots[j];
+		i = j;
+	}
+
+	slots[i].key = SCAP_ID_MAP_EMPTY_KEY;
+	shard->count--;
+
+	id_map_write_end(shard);
+
+	return true;
+}
+
+void scap_id_map_free(scap_id_map* map)
+{
+	uint32_t j;
+	uint32_t k;
+
+	for(j = 0; j < SCAP_ID_MAP_SHARDS; j++)
+	{
+		scap_id_map_shard* shard = &map->shards[j];
+
+		for(k = 0; k < shard->nretired; k++)
+		{
+			free(shard->retired[k]);
+		}
+
+		free(shard->retired);
+		free(shard->slots);
+
+		shard->retired = NULL;
+		shard->nretired = 0;
+		shard->slots = NULL;
+		shard->mask = 0;
+		shard->count = 0;
+	}
+}
@@ -36,6 +36,9 @@ limitations under the License.
 #include "scap-int.h"
 #include "clock_helpers.h"
 #include "debug_log_helpers.h"
+#if defined(HAS_CAPTURE) && !defined(CYGWING_AGENT) && !defined(_WIN32)
+#include "procfs_helpers.h"
+#endif
 
 #if defined(CYGWING_AGENT) || defined(_WIN32)
 #include <io.h>
@@ -50,18 +53,16 @@ limitations under the License.
 
 #if defined(HAS_CAPTURE)
 #if !defined(CYGWING_AGENT) && !defined(_WIN32)
-int32_t scap_proc_fill_cwd(scap_t *handle, char* procdirname, struct scap_threadinfo* tinfo)
+int32_t scap_proc_fill_cwd(scap_t *handle, int procdirfd, char* procdirname, struct scap_threadinfo* tinfo, char *error)
 {
 	int target_res;
-	char filename[SCAP_MAX_PATH_SIZE];
-
-	snprintf(filename, sizeof(filename), "%scwd", procdirname);
+	char strerror_buf[SCAP_LASTERR_SIZE];
 
-	target_res = readlink(filename, tinfo->cwd, sizeof(tinfo->cwd) - 1);
+	target_res = readlinkat(procdirfd, "cwd", tinfo->cwd, sizeof(tinfo->cwd) - 1);
 	if(target_res <= 0)
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "readlink %s failed (%s)",
-			 filename, scap_strerror(handle, errno));
+		snprintf(error, SCAP_LASTERR_SIZE, "readlink %scwd failed (%s)",
+			 procdirname, scap_strerror_r(strerror_buf, errno));
 		return SCAP_FAILURE;
 	}
 
@@ -69,28 +70,32 @@ int32_t scap_proc_fill_cwd(scap_t *handle, char* procdirname, struct scap_thread
 	return SCAP_SUCCESS;
 }
 
-int32_t scap_proc_fill_info_from_stats(scap_t *handle, char* procdirname, struct scap_threadinfo* tinfo)
+int32_t scap_proc_fill_info_from_stats(scap_t *handle, int procdirfd, char* procdirname, struct scap_threadinfo* tinfo, char *error)
 {
-	char filename[SCAP_MAX_PATH_SIZE];
 	uint32_t nfound = 0;
-	int64_t tmp;
-	uint32_t uid;
+	uint64_t tmp;
+	uint64_t uid;
 	uint64_t tgid;
 	uint64_t ppid;
 	uint64_t vpid;
 	uint64_t vtid;
 	int64_t sid;
 	int64_t pgid;
-	int64_t vpgid;
-	uint32_t vmsize_kb;
-	uint32_t vmrss_kb;
-	uint32_t vmswap_kb;
-	uint64_t pfmajor;
-	uint64_t pfminor;
-	int32_t tty;
-	char line[512];
-	char tmpc;
-	char* s;
+	uint64_t vpgid;
+	uint64_t vmsize_kb;
+	uint64_t vmrss_kb;
+	uint64_t vmswap_kb;
+	int64_t pfmajor;
+	int64_t pfminor;
+	int64_t tty;
+	int64_t itmp;
+	char buf[4096];
+	char strerror_buf[SCAP_LASTERR_SIZE];
+	scap_procfs_reader r;
+	const char* line;
+	const char* p;
+	size_t len;
+	ssize_t ssres;
 
 	tinfo->uid = (uint32_t)-1;
 	tinfo->ptid = (uint32_t)-1LL;
@@ -104,24 +109,21 @@ int32_t scap_proc_fill_info_from_stats(scap_t *handle, char* procdirname, struct
 	tinfo->filtered_out = 0;
 	tinfo->tty = 0;
 
-	snprintf(filename, sizeof(filename), "%sstatus", procdirname);
-
-	FILE* f = fopen(filename, "r");
-	if(f == NULL)
+	if(!scap_procfs_reader_open(&r, procdirfd, "status", buf, sizeof(buf)))
 	{
 		ASSERT(false);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "open status file %s failed (%s)",
-			 filename, scap_strerror(handle, errno));
+		snprintf(error, SCAP_LASTERR_SIZE, "open status file %sstatus failed (%s)",
+			 procdirname, scap_strerror_r(strerror_buf, errno));
 		return SCAP_FAILURE;
 	}
 
-	while(fgets(line, sizeof(line), f) != NULL)
+	while((line = scap_procfs_reader_next_line(&r, &len)) != NULL)
 	{
-		if(strstr(line, "Tgid") == line)
+		if((p = scap_procfs_field(line, "Tgid:")) != NULL)
 		{
 			nfound++;
 
-			if(sscanf(line, "Tgid: %" PRIu64, &tgid) == 1)
+			if(scap_procfs_parse_u64(p, &tgid) != NULL)
 			{
 				tinfo->pid = tgid;
 			}
@@ -130,37 +132,42 @@ int32_t scap_proc_fill_info_from_stats(scap_t *handle, char* procdirname, struct
 				ASSERT(false);
 			}
 		}
-		if(strstr(line, "Uid") == line)
+		else if((p = scap_procfs_field(line, "Uid:")) != NULL)
 		{
 			nfound++;
 
-			if(sscanf(line, "Uid: %" PRIu64 " %" PRIu32, &tmp, &uid) == 2)
+			//
+			// The effective uid, after the real one
+			//
+			if((p = scap_procfs_parse_u64(p, &tmp)) != NULL &&
+			   scap_procfs_parse_u64(p, &uid) != NULL)
 			{
-				tinfo->uid = uid;
+				tinfo->uid = (uint32_t)uid;
 			}
 			else
 			{
 				ASSERT(false);
 			}
 		}
-		else if(strstr(line, "Gid") == line)
+		else if((p = scap_procfs_field(line, "Gid:")) != NULL)
 		{
 			nfound++;
 
-			if(sscanf(line, "Gid: %" PRIu64 " %" PRIu32, &tmp, &uid) == 2)
+			if((p = scap_procfs_parse_u64(p, &tmp)) != NULL &&
+			   scap_procfs_parse_u64(p, &uid) != NULL)
 			{
-				tinfo->gid = uid;
+				tinfo->gid = (uint32_t)uid;
 			}
 			else
 			{
 				ASSERT(false);
 			}
 		}
-		else if(strstr(line, "PPid") == line)
+		else if((p = scap_procfs_field(line, "PPid:")) != NULL)
 		{
 			nfound++;
 
-			if(sscanf(line, "PPid: %" PRIu64, &ppid) == 1)
+			if(scap_procfs_parse_u64(p, &ppid) != NULL)
 			{
 				tinfo->ptid = ppid;
 			}
@@ -169,70 +176,78 @@ int32_t scap_proc_fill_info_from_stats(scap_t *handle, char* procdirname, struct
 				ASSERT(false);
 			}
 		}
-		else if(strstr(line, "VmSize:") == line)
+		else if((p = scap_procfs_field(line, "VmSize:")) != NULL)
 		{
 			nfound++;
 
-			if(sscanf(line, "VmSize: %" PRIu32, &vmsize_kb) == 1)
+			if(scap_procfs_parse_u64(p, &vmsize_kb) != NULL)
 			{
-				tinfo->vmsize_kb = vmsize_kb;
+				tinfo->vmsize_kb = (uint32_t)vmsize_kb;
 			}
 			else
 			{
 				ASSERT(false);
 			}
 		}
-		else if(strstr(line, "VmRSS:") == line)
+		else if((p = scap_procfs_field(line, "VmRSS:")) != NULL)
 		{
 			nfound++;
 
-			if(sscanf(line, "VmRSS: %" PRIu32, &vmrss_kb) == 1)
+			if(scap_procfs_parse_u64(p, &vmrss_kb) != NULL)
 			{
-				tinfo->vmrss_kb = vmrss_kb;
+				tinfo->vmrss_kb = (uint32_t)vmrss_kb;
 			}
 			else
 			{
 				ASSERT(false);
 			}
 		}
-		else if(strstr(line, "VmSwap:") == line)
+		else if((p = scap_procfs_field(line, "VmSwap:")) != NULL)
 		{
 			nfound++;
 
-			if(sscanf(line, "VmSwap: %" PRIu32, &vmswap_kb) == 1)
+			if(scap_procfs_parse_u64(p, &vmswap_kb) != NULL)
 			{
-				tinfo->vmswap_kb = vmswap_kb;
+				tinfo->vmswap_kb = (uint32_t)vmswap_kb;
 			}
 			else
 			{
 				ASSERT(false);
 			}
 		}
-		else if(strstr(line, "NSpid:") == line)
+		else if((p = scap_procfs_field(line, "NSpid:")) != NULL)
 		{
 			nfound++;
-			if(sscanf(line, "NSpid: %*u %" PRIu64, &vtid) == 1)
+
+			//
+			// The id in the innermost namespace, if there's more than one
+			//
+			if((p = scap_procfs_parse_u64(p, &tmp)) != NULL &&
+			   scap_procfs_parse_u64(p, &vtid) != NULL)
 			{
 				tinfo->vtid = vtid;
-				put_pid_vtid_map(handle, tinfo->pid, tinfo->tid, tinfo->vtid);
 			}
 			else
 			{
 				tinfo->vtid = tinfo->tid;
 			}
 		}
-		else if(strstr(line, "NSpgid:") == line)
+		else if((p = scap_procfs_field(line, "NSpgid:")) != NULL)
 		{
 			nfound++;
-			if(sscanf(line, "NSpgid: %*u %" PRIu64, &vpgid) == 1)
+
+			if((p = scap_procfs_parse_u64(p, &tmp)) != NULL &&
+			   scap_procfs_parse_u64(p, &vpgid) != NULL)
 			{
 				tinfo->vpgid = vpgid;
 			}
 		}
-		else if(strstr(line, "NStgid:") == line)
+		else if((p = scap_procfs_field(line, "NStgid:")) != NULL)
 		{
 			nfound++;
-			if(sscanf(line, "NStgid: %*u %" PRIu64, &vpid) == 1)
+
+			if((p = scap_procfs_parse_u64(p, &tmp)) != NULL &&
+			   scap_procfs_parse_u64(p, &vpid) != NULL)
 			{
 				tinfo->vpid = vpid;
 			}
@@ -250,59 +265,55 @@ int32_t scap_proc_fill_info_from_stats(scap_t *handle, char* procdirname, struct
 
 	ASSERT(nfound == 10 || nfound == 7 || nfound == 6);
 
-	fclose(f);
+	scap_procfs_reader_close(&r);
 
-	snprintf(filename, sizeof(filename), "%sstat", procdirname);
-
-	f = fopen(filename, "r");
-	if(f == NULL)
+	ssres = scap_procfs_read_str(procdirfd, "stat", buf, 512);
+	if(ssres < 0)
 	{
 		ASSERT(false);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "read stat file %s failed (%s)",
-			 filename, scap_strerror(handle, errno));
+		snprintf(error, SCAP_LASTERR_SIZE, "read stat file %sstat failed (%s)",
+			 procdirname, scap_strerror_r(strerror_buf, errno));
 		return SCAP_FAILURE;
 	}
-
-	size_t ssres = fread(line, 1, sizeof(line) - 1, f);
-	if(ssres == 0)
+	else if(ssres == 0)
 	{
 		ASSERT(false);
-		fclose(f);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Could not read from stat file %s (%s)",
-			 filename, scap_strerror(handle, errno));
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not read from stat file %sstat (%s)",
+			 procdirname, scap_strerror_r(strerror_buf, errno));
 		return SCAP_FAILURE;
 	}
-	line[ssres] = 0;
 
-	s = strrchr(line, ')');
-	if(s == NULL)
+	//
+	// The command name can contain parentheses, look for the last one
+	//
+	p = strrchr(buf, ')');
+	if(p == NULL)
 	{
 		ASSERT(false);
-		fclose(f);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Could not find closing bracket in stat file %s",
-			 filename);
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not find closing bracket in stat file %sstat",
+			 procdirname);
 		return SCAP_FAILURE;
 	}
 
 	//
-	// Extract the line content
+	// Extract the fields after the state: ppid, pgrp, session, tty_nr,
+	// tpgid, flags, minflt, cminflt, majflt
 	//
-	if(sscanf(s + 2, "%c %" PRId64 " %" PRId64 " %" PRId64 " %" PRId32 " %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64,
-		&tmpc,
-		&tmp,
-		&pgid,
-		&sid,
-		&tty,
-		&tmp,
-		&tmp,
-		&pfminor,
-		&tmp,
-		&pfmajor) != 10)
+	p = scap_procfs_skip_blanks(p + 1);
+	if(*p == 0 ||
+	   (p = scap_procfs_parse_i64(p + 1, &itmp)) == NULL ||
+	   (p = scap_procfs_parse_i64(p, &pgid)) == NULL ||
+	   (p = scap_procfs_parse_i64(p, &sid)) == NULL ||
+	   (p = scap_procfs_parse_i64(p, &tty)) == NULL ||
+	   (p = scap_procfs_parse_i64(p, &itmp)) == NULL ||
+	   (p = scap_procfs_parse_i64(p, &itmp)) == NULL ||
+	   (p = scap_procfs_parse_i64(p, &pfminor)) == NULL ||
+	   (p = scap_procfs_parse_i64(p, &itmp)) == NULL ||
+	   (p = scap_procfs_parse_i64(p, &pfmajor)) == NULL)
 	{
 		ASSERT(false);
-		fclose(f);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Could not read expected fields from stat file %s",
-			 filename);
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not read expected fields from stat file %sstat",
+			 procdirname);
 		return SCAP_FAILURE;
 	}
 
@@ -317,9 +328,8 @@ int32_t scap_proc_fill_info_from_stats(scap_t *handle, char* procdirname, struct
 		tinfo->vpgid = pgid;
 	}
 
-	tinfo->tty = tty;
+	tinfo->tty = (int32_t)tty;
 
-	fclose(f);
 	return SCAP_SUCCESS;
 }
 
@@ -350,102 +360,111 @@ static int32_t scap_proc_fill_flimit(scap_t *handle, uint64_t tid, struct scap_t
 }
 #endif
 
-int32_t scap_proc_fill_cgroups(scap_t *handle, struct scap_threadinfo* tinfo, const char* procdirname)
+int32_t scap_proc_fill_cgroups(scap_t *handle, struct scap_threadinfo* tinfo, int procdirfd, const char* procdirname, char *error)
 {
-	char filename[SCAP_MAX_PATH_SIZE];
-	char line[SCAP_MAX_CGROUPS_SIZE];
+	char buf[SCAP_MAX_CGROUPS_SIZE];
+	char strerror_buf[SCAP_LASTERR_SIZE];
+	scap_procfs_reader r;
+	char* line;
+	size_t len;
 
 	tinfo->cgroups_len = 0;
-	snprintf(filename, sizeof(filename), "%scgroup", procdirname);
 
-	if(access(filename, R_OK) == -1)
+	if(!scap_procfs_reader_open(&r, procdirfd, "cgroup", buf, sizeof(buf)))
 	{
-		return SCAP_SUCCESS;
-	}
+		if(errno == ENOENT || errno == EACCES)
+		{
+			return SCAP_SUCCESS;
+		}
 
-	FILE* f = fopen(filename, "r");
-	if(f == NULL)
-	{
 		ASSERT(false);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "open cgroup file %s failed (%s)",
-			 filename, scap_strerror(handle, errno));
+		snprintf(error, SCAP_LASTERR_SIZE, "open cgroup file %scgroup failed (%s)",
+			 procdirname, scap_strerror_r(strerror_buf, errno));
 		return SCAP_FAILURE;
 	}
 
-	while(fgets(line, sizeof(line), f) != NULL)
+	//
+	// The lines are id:subsys_list:cgroup
+	//
+	while((line = scap_procfs_reader_next_line(&r, &len)) != NULL)
 	{
-		char* token;
 		char* subsys_list;
+		char* subsys_end;
 		char* cgroup;
-		char* scratch;
+		char* token;
+		size_t cgroup_len;
 
-		// id
-		token = strtok_r(line, ":", &scratch);
-		if(token == NULL)
+		subsys_list = strchr(line, ':');
+		if(subsys_list == NULL)
 		{
 			ASSERT(false);
-			fclose(f);
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Did not find id in cgroup file %s",
-				 filename);
+			scap_procfs_reader_close(&r);
+			snprintf(error, SCAP_LASTERR_SIZE, "Did not find subsys in cgroup file %scgroup",
+				 procdirname);
 			return SCAP_FAILURE;
 		}
+		subsys_list++;
 
-		// subsys
-		subsys_list = strtok_r(NULL, ":", &scratch);
-		if(subsys_list == NULL)
+		subsys_end = strchr(subsys_list, ':');
+		if(subsys_end == NULL || subsys_end[1] == 0)
 		{
 			ASSERT(false);
-			fclose(f);
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Did not find subsys in cgroup file %s",
-				 filename);
+			scap_procfs_reader_close(&r);
+			snprintf(error, SCAP_LASTERR_SIZE, "Did not find cgroup in cgroup file %scgroup",
+				 procdirname);
 			return SCAP_FAILURE;
 		}
 
-		// Hack to detect empty fields, because strtok does not support it
-		// strsep() should be used to fix this but it's not available
-		// on CentOS 6 (has been added from Glibc 2.19)
-		if(subsys_list-token-strlen(token) > 1)
+		if(subsys_end == subsys_list)
 		{
 			// skip cgroups like this:
 			// 0::/init.scope
 			continue;
 		}
 
-		// cgroup should be the only thing remaining so use newline as the delimiter.
-		cgroup = strtok_r(NULL, "\n", &scratch);
-		if(cgroup == NULL)
-		{
-			ASSERT(false);
-			fclose(f);
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Did not find cgroup in cgroup file %s",
-				 filename);
-			return SCAP_FAILURE;
-		}
+		*subsys_end = 0;
+		cgroup = subsys_end + 1;
+		cgroup_len = line + len - cgroup;
 
-		while((token = strtok_r(subsys_list, ",", &scratch)) != NULL)
+		while((token = subsys_list) != NULL)
 		{
-			subsys_list = NULL;
-			if(strlen(cgroup) + 1 + strlen(token) + 1 > SCAP_MAX_CGROUPS_SIZE - tinfo->cgroups_len)
+			size_t token_len;
+
+			subsys_list = strchr(token, ',');
+			if(subsys_list != NULL)
+			{
+				*subsys_list++ = 0;
+			}
+
+			token_len = strlen(token);
+			if(token_len == 0)
+			{
+				continue;
+			}
+
+			if(cgroup_len + 1 + token_len + 1 > SCAP_MAX_CGROUPS_SIZE - tinfo->cgroups_len)
 			{
 				ASSERT(false);
-				fclose(f);
+				scap_procfs_reader_close(&r);
 				return SCAP_SUCCESS;
 			}
 
-			snprintf(tinfo->cgroups + tinfo->cgroups_len, SCAP_MAX_CGROUPS_SIZE - tinfo->cgroups_len, "%s=%s", token, cgroup);
-			tinfo->cgroups_len += strlen(cgroup) + 1 + strlen(token) + 1;
+			memcpy(tinfo->cgroups + tinfo->cgroups_len, token, token_len);
+			tinfo->cgroups[tinfo->cgroups_len + token_len] = '=';
+			memcpy(tinfo->cgroups + tinfo->cgroups_len + token_len + 1, cgroup, cgroup_len + 1);
+			tinfo->cgroups_len += cgroup_len + 1 + token_len + 1;
 		}
 	}
 
-	fclose(f);
+	scap_procfs_reader_close(&r);
 	return SCAP_SUCCESS;
 }
 
-static int32_t scap_get_vtid(scap_t* handle, int64_t tid, int64_t *vtid)
+static int32_t scap_get_vtid(scap_t* handle, int64_t tid, int64_t *vtid, char *error)
 {
 	if(handle->m_mode != SCAP_MODE_LIVE)
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Cannot get vtid (not in live mode)");
+		snprintf(error, SCAP_LASTERR_SIZE, "Cannot get vtid (not in live mode)");
 		return SCAP_FAILURE;
 	}
 
@@ -464,9 +483,11 @@ static int32_t scap_get_vtid(scap_t* handle, int64_t tid, int64_t *vtid)
 
 		if(*vtid == -1)
 		{
+			char strerror_buf[SCAP_LASTERR_SIZE];
+
 			ASSERT(false);
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "ioctl to get vtid failed (%s)",
-				 scap_strerror(handle, errno));
+			snprintf(error, SCAP_LASTERR_SIZE, "ioctl to get vtid failed (%s)",
+				 scap_strerror_r(strerror_buf, errno));
 			return SCAP_FAILURE;
 		}
 	}
@@ -475,11 +496,11 @@ static int32_t scap_get_vtid(scap_t* handle, int64_t tid, int64_t *vtid)
 #endif
 }
 
-static int32_t scap_get_vpid(scap_t* handle, int64_t tid, int64_t *vpid)
+static int32_t scap_get_vpid(scap_t* handle, int64_t tid, int64_t *vpid, char *error)
 {
 	if(handle->m_mode != SCAP_MODE_LIVE)
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Cannot get vtid (not in live mode)");
+		snprintf(error, SCAP_LASTERR_SIZE, "Cannot get vtid (not in live mode)");
 		return SCAP_FAILURE;
 	}
 
@@ -498,9 +519,11 @@ static int32_t scap_get_vpid(scap_t* handle, int64_t tid, int64_t *vpid)
 
 		if(*vpid == -1)
 		{
+			char strerror_buf[SCAP_LASTERR_SIZE];
+
 			ASSERT(false);
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "ioctl to get vpid failed (%s)",
-				 scap_strerror(handle, errno));
+			snprintf(error, SCAP_LASTERR_SIZE, "ioctl to get vpid failed (%s)",
+				 scap_strerror_r(strerror_buf, errno));
 			return SCAP_FAILURE;
 		}
 	}
@@ -509,30 +532,30 @@ static int32_t scap_get_vpid(scap_t* handle, int64_t tid, int64_t *vpid)
 #endif
 }
 
-int32_t scap_proc_fill_root(scap_t *handle, struct scap_threadinfo* tinfo, const char* procdirname)
+int32_t scap_proc_fill_root(scap_t *handle, struct scap_threadinfo* tinfo, int procdirfd, const char* procdirname, char *error)
 {
-	char root_path[SCAP_MAX_PATH_SIZE];
-	snprintf(root_path, sizeof(root_path), "%sroot", procdirname);
-	if ( readlink(root_path, tinfo->root, sizeof(tinfo->root)) > 0)
+	char strerror_buf[SCAP_LASTERR_SIZE];
+
+	if ( readlinkat(procdirfd, "root", tinfo->root, sizeof(tinfo->root)) > 0)
 	{
 		return SCAP_SUCCESS;
 	}
 	else
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "readlink %s failed (%s)",
-			 root_path, scap_strerror(handle, errno));
+		snprintf(error, SCAP_LASTERR_SIZE, "readlink %sroot failed (%s)",
+			 procdirname, scap_strerror_r(strerror_buf, errno));
 		return SCAP_FAILURE;
 	}
 }
 
-int32_t scap_proc_fill_loginuid(scap_t *handle, struct scap_threadinfo* tinfo, const char* procdirname)
+int32_t scap_proc_fill_loginuid(scap_t *handle, struct scap_threadinfo* tinfo, int procdirfd, const char* procdirname, char *error)
 {
-	uint32_t loginuid;
-	char loginuid_path[SCAP_MAX_PATH_SIZE];
-	char line[512];
-	snprintf(loginuid_path, sizeof(loginuid_path), "%sloginuid", procdirname);
-	FILE* f = fopen(loginuid_path, "r");
-	if(f == NULL)
+	uint64_t loginuid;
+	char line[64];
+	ssize_t len;
+
+	len = scap_procfs_read_str(procdirfd, "loginuid", line, sizeof(line));
+	if(len < 0)
 	{
 		// If Linux kernel is built with CONFIG_AUDIT=n, loginuid management
 		// (and associated /proc file) is not implemented.
@@ -540,57 +563,51 @@ int32_t scap_proc_fill_loginuid(scap_t *handle, struct scap_threadinfo* tinfo, c
 		tinfo->loginuid = (uint32_t)-1;
 		return SCAP_SUCCESS;
 	}
-	if (fgets(line, sizeof(line), f) == NULL)
+	if(len == 0)
 	{
 		ASSERT(false);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Could not read loginuid from %s (%s)",
-			 loginuid_path, scap_strerror(handle, errno));
-		fclose(f);
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not read loginuid from %sloginuid",
+			 procdirname);
 		return SCAP_FAILURE;
 	}
 
-	fclose(f);
-
-	if(sscanf(line, "%" PRId32, &loginuid) == 1)
+	if(scap_procfs_parse_u64(line, &loginuid) != NULL)
 	{
-		tinfo->loginuid = loginuid;
+		tinfo->loginuid = (uint32_t)loginuid;
 		return SCAP_SUCCESS;
 	}
 	else
 	{
 		ASSERT(false);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "Could not read loginuid from %s",
-			 loginuid_path);
+		snprintf(error, SCAP_LASTERR_SIZE, "Could not read loginuid from %sloginuid",
+			 procdirname);
 		return SCAP_FAILURE;
 	}
 }
 
 //
-// Add a process to the list by parsing its entry under /proc
+// Add a process to the list by parsing its entry under /proc, dir_name,
+// whose files are read relative to procdirfd
 //
-static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procdirname, struct scap_ns_socket_list** sockets_by_ns, scap_threadinfo** procinfo, uint64_t* num_fds_ret, char *error)
+static int32_t scap_proc_add_from_procdir(scap_t* handle, uint32_t tid, int procdirfd, char* dir_name, struct scap_ns_socket_list** sockets_by_ns, scap_threadinfo** procinfo, uint64_t* num_fds_ret, char *error)
 {
-	char dir_name[256];
 	char target_name[SCAP_MAX_PATH_SIZE];
 	int target_res;
-	char filename[252];
 	char line[SCAP_MAX_ENV_SIZE];
+	char strerror_buf[SCAP_LASTERR_SIZE];
+	char fill_error[SCAP_LASTERR_SIZE];
 	struct scap_threadinfo* tinfo;
 	int32_t uth_status = SCAP_SUCCESS;
-	FILE* f;
-	size_t filesize;
+	ssize_t filesize;
 	size_t exe_len;
 	bool free_tinfo = false;
 	int32_t res = SCAP_SUCCESS;
 	struct stat dirstat;
 
-	snprintf(dir_name, sizeof(dir_name), "%s/%u/", procdirname, tid);
-	snprintf(filename, sizeof(filename), "%sexe", dir_name);
-
 	//
 	// Gather the executable full name
 	//
-	target_res = readlink(filename, target_name, sizeof(target_name) - 1);			// Getting the target of the exe, i.e. to which binary it points to
+	target_res = readlinkat(procdirfd, "exe", target_name, sizeof(target_name) - 1);			// Getting the target of the exe, i.e. to which binary it points to
 
 	if(target_res <= 0)
 	{
@@ -600,24 +617,12 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procd
 		//  - a process that has been containerized or has some weird thing going on. In that case
 		//    we accept it.
 		//
-		snprintf(filename, sizeof(filename), "%scmdline", dir_name);
-		f = fopen(filename, "r");
-		if(f == NULL)
-		{
-			return SCAP_SUCCESS;
-		}
-
 		ASSERT(sizeof(line) >= SCAP_MAX_PATH_SIZE);
 
-		if(fgets(line, SCAP_MAX_PATH_SIZE, f) == NULL)
+		if(scap_procfs_read(procdirfd, "cmdline", line, SCAP_MAX_PATH_SIZE - 1) <= 0)
 		{
-			fclose(f);
 			return SCAP_SUCCESS;
 		}
-		else
-		{
-			fclose(f);
-		}
 
 		target_name[0] = 0;
 	}
@@ -630,10 +635,9 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procd
 	//
 	// This is a real user level process. Allocate the procinfo structure.
 	//
-	if((tinfo = scap_proc_alloc(handle)) == NULL)
+	if((tinfo = (struct scap_threadinfo*) calloc(1, sizeof(scap_threadinfo))) == NULL)
 	{
-		// Error message saved in handle->m_lasterr
-		snprintf(error, SCAP_LASTERR_SIZE, "can't allocate procinfo struct: %s", handle->m_lasterr);
+		snprintf(error, SCAP_LASTERR_SIZE, "can't allocate procinfo struct");
 		return SCAP_FAILURE;
 	}
 
@@ -649,33 +653,27 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procd
 	//
 	// Gather the command name
 	//
-	snprintf(filename, sizeof(filename), "%sstatus", dir_name);
+	ASSERT(sizeof(line) >= SCAP_MAX_PATH_SIZE);
 
-	f = fopen(filename, "r");
-	if(f == NULL)
+	filesize = scap_procfs_read_str(procdirfd, "status", line, SCAP_MAX_PATH_SIZE);
+	if(filesize < 0)
 	{
-		snprintf(error, SCAP_LASTERR_SIZE, "can't open %s (error %s)", filename, scap_strerror(handle, errno));
+		snprintf(error, SCAP_LASTERR_SIZE, "can't open %sstatus (error %s)", dir_name, scap_strerror_r(strerror_buf, errno));
 		free(tinfo);
 		return SCAP_FAILURE;
 	}
-	else
+	else if(filesize == 0)
 	{
-		ASSERT(sizeof(line) >= SCAP_MAX_PATH_SIZE);
-
-		if(fgets(line, SCAP_MAX_PATH_SIZE, f) == NULL)
-		{
-			snprintf(error, SCAP_LASTERR_SIZE, "can't read from %s (%s)",
-				 filename, scap_strerror(handle, errno));
-			fclose(f);
-			free(tinfo);
-			return SCAP_FAILURE;
-		}
-
-		line[SCAP_MAX_PATH_SIZE - 1] = 0;
-		sscanf(line, "Name:%1024s", tinfo->comm);
-		fclose(f);
+		snprintf(error, SCAP_LASTERR_SIZE, "can't read from %sstatus", dir_name);
+		free(tinfo);
+		return SCAP_FAILURE;
 	}
 
+	//
+	// Name is the first line
+	//
+	sscanf(line, "Name:%1024s", tinfo->comm);
+
 	bool suppressed;
 	if ((res = scap_update_suppressed(handle, tinfo->comm, tid, 0, &suppressed)) != SCAP_SUCCESS)
 	{
@@ -693,90 +691,73 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procd
 	//
 	// Gather the command line
 	//
-	snprintf(filename, sizeof(filename), "%scmdline", dir_name);
+	ASSERT(sizeof(line) >= SCAP_MAX_ARGS_SIZE);
 
-	f = fopen(filename, "r");
-	if(f == NULL)
+	filesize = scap_procfs_read(procdirfd, "cmdline", line, SCAP_MAX_ARGS_SIZE - 1);
+	if(filesize < 0)
 	{
-		snprintf(error, SCAP_LASTERR_SIZE, "can't open cmdline file %s (%s)",
-			 filename, scap_strerror(handle, errno));
+		snprintf(error, SCAP_LASTERR_SIZE, "can't open cmdline file %scmdline (%s)",
+			 dir_name, scap_strerror_r(strerror_buf, errno));
 		free(tinfo);
 		return SCAP_FAILURE;
 	}
-	else
+	else if(filesize > 0)
 	{
-		ASSERT(sizeof(line) >= SCAP_MAX_ARGS_SIZE);
+		line[filesize] = 0;
 
-		filesize = fread(line, 1, SCAP_MAX_ARGS_SIZE - 1, f);
-		if(filesize > 0)
+		exe_len = strlen(line);
+		if(exe_len < (size_t)filesize)
 		{
-			line[filesize] = 0;
-
-			exe_len = strlen(line);
-			if(exe_len < filesize)
-			{
-				++exe_len;
-			}
+			++exe_len;
+		}
 
-			snprintf(tinfo->exe, SCAP_MAX_PATH_SIZE, "%s", line);
+		snprintf(tinfo->exe, SCAP_MAX_PATH_SIZE, "%s", line);
 
-			tinfo->args_len = filesize - exe_len;
+		tinfo->args_len = filesize - exe_len;
 
-			memcpy(tinfo->args, line + exe_len, tinfo->args_len);
-			tinfo->args[SCAP_MAX_ARGS_SIZE - 1] = 0;
-		}
-		else
-		{
-			tinfo->args[0] = 0;
-			tinfo->exe[0] = 0;
-		}
-
-		fclose(f);
+		memcpy(tinfo->args, line + exe_len, tinfo->args_len);
+		tinfo->args[SCAP_MAX_ARGS_SIZE - 1] = 0;
+	}
+	else
+	{
+		tinfo->args[0] = 0;
+		tinfo->exe[0] = 0;
 	}
 
 	//
 	// Gather the environment
 	//
-	snprintf(filename, sizeof(filename), "%senviron", dir_name);
+	ASSERT(sizeof(line) >= SCAP_MAX_ENV_SIZE);
 
-	f = fopen(filename, "r");
-	if(f == NULL)
+	filesize = scap_procfs_read(procdirfd, "environ", line, SCAP_MAX_ENV_SIZE);
+	if(filesize < 0)
 	{
-		snprintf(error, SCAP_LASTERR_SIZE, "can't open environ file %s (%s)",
-			 filename, scap_strerror(handle, errno));
+		snprintf(error, SCAP_LASTERR_SIZE, "can't open environ file %senviron (%s)",
+			 dir_name, scap_strerror_r(strerror_buf, errno));
 		free(tinfo);
 		return SCAP_FAILURE;
 	}
-	else
+	else if(filesize > 0)
 	{
-		ASSERT(sizeof(line) >= SCAP_MAX_ENV_SIZE);
-
-		filesize = fread(line, 1, SCAP_MAX_ENV_SIZE, f);
-
-		if(filesize > 0)
-		{
-			line[filesize - 1] = 0;
-
-			tinfo->env_len = filesize;
+		line[filesize - 1] = 0;
 
-			memcpy(tinfo->env, line, tinfo->env_len);
-			tinfo->env[SCAP_MAX_ENV_SIZE - 1] = 0;
-		}
-		else
-		{
-			tinfo->env[0] = 0;
-		}
+		tinfo->env_len = filesize;
 
-		fclose(f);
+		memcpy(tinfo->env, line, tinfo->env_len);
+		tinfo->env[SCAP_MAX_ENV_SIZE - 1] = 0;
+	}
+	else
+	{
+		tinfo->env[0] = 0;
 	}
 
 	//
 	// set the current working directory of the process
 	//
-	if(SCAP_FAILURE == scap_proc_fill_cwd(handle, dir_name, tinfo))
+	if(SCAP_FAILURE == scap_proc_fill_cwd(handle, procdirfd, dir_name, tinfo, fill_error))
 	{
 		snprintf(error, SCAP_LASTERR_SIZE, "can't fill cwd for %s (%s)",
-			 dir_name, handle->m_lasterr);
+			 dir_name, fill_error);
 		free(tinfo);
 		return SCAP_FAILURE;
 	}
@@ -784,10 +765,10 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procd
 	//
 	// extract the user id and ppid from /proc/pid/status
 	//
-	if(SCAP_FAILURE == scap_proc_fill_info_from_stats(handle, dir_name, tinfo))
+	if(SCAP_FAILURE == scap_proc_fill_info_from_stats(handle, procdirfd, dir_name, tinfo, fill_error))
 	{
 		snprintf(error, SCAP_LASTERR_SIZE, "can't fill uid and pid for %s (%s)",
-			 dir_name, handle->m_lasterr);
+			 dir_name, fill_error);
 		free(tinfo);
 		return SCAP_FAILURE;
 	}
@@ -797,28 +778,27 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procd
 	//
 	if(SCAP_FAILURE == scap_proc_fill_flimit(handle, tinfo->tid, tinfo))
 	{
-		snprintf(error, SCAP_LASTERR_SIZE, "can't fill flimit for %s (%s)",
-			 dir_name, handle->m_lasterr);
+		snprintf(error, SCAP_LASTERR_SIZE, "can't fill flimit for %s", dir_name);
 		free(tinfo);
 		return SCAP_FAILURE;
 	}
 
-	if(scap_proc_fill_cgroups(handle, tinfo, dir_name) == SCAP_FAILURE)
+	if(scap_proc_fill_cgroups(handle, tinfo, procdirfd, dir_name, fill_error) == SCAP_FAILURE)
 	{
 		snprintf(error, SCAP_LASTERR_SIZE, "can't fill cgroups for %s (%s)",
-			 dir_name, handle->m_lasterr);
+			 dir_name, fill_error);
 		free(tinfo);
 		return SCAP_FAILURE;
 	}
 
 	// These values should be read already from /status file, leave these
 	// fallback functions for older kernels < 4.1
-	if(tinfo->vtid == 0 && scap_get_vtid(handle, tinfo->tid, &tinfo->vtid) == SCAP_FAILURE)
+	if(tinfo->vtid == 0 && scap_get_vtid(handle, tinfo->tid, &tinfo->vtid, fill_error) == SCAP_FAILURE)
 	{
 		tinfo->vtid = tinfo->tid;
 	}
 
-	if(tinfo->vpid == 0 && scap_get_vpid(handle, tinfo->tid, &tinfo->vpid) == SCAP_FAILURE)
+	if(tinfo->vpid == 0 && scap_get_vpid(handle, tinfo->tid, &tinfo->vpid, fill_error) == SCAP_FAILURE)
 	{
 		tinfo->vpid = tinfo->pid;
 	}
@@ -826,10 +806,10 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procd
 	//
 	// set the current root of the process
 	//
-	if(SCAP_FAILURE == scap_proc_fill_root(handle, tinfo, dir_name))
+	if(SCAP_FAILURE == scap_proc_fill_root(handle, tinfo, procdirfd, dir_name, fill_error))
 	{
 		snprintf(error, SCAP_LASTERR_SIZE, "can't fill root for %s (%s)",
-			 dir_name, handle->m_lasterr);
+			 dir_name, fill_error);
 		free(tinfo);
 		return SCAP_FAILURE;
 	}
@@ -837,15 +817,15 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procd
 	//
 	// set the loginuid
 	//
-	if(SCAP_FAILURE == scap_proc_fill_loginuid(handle, tinfo, dir_name))
+	if(SCAP_FAILURE == scap_proc_fill_loginuid(handle, tinfo, procdirfd, dir_name, fill_error))
 	{
 		snprintf(error, SCAP_LASTERR_SIZE, "can't fill loginuid for %s (%s)",
-			 dir_name, handle->m_lasterr);
+			 dir_name, fill_error);
 		free(tinfo);
 		return SCAP_FAILURE;
 	}
 
-	if(stat(dir_name, &dirstat) == 0)
+	if(fstat(procdirfd, &dirstat) == 0)
 	{
 		tinfo->clone_ts = dirstat.st_ctim.tv_sec*1000000000 + dirstat.st_ctim.tv_nsec;
 	}
@@ -870,6 +850,8 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procd
 	//
 	if(!procinfo)
 	{
+		scap_proc_put_vtid_map(handle, tinfo);
+
 		//
 		// Done. Add the entry to the process table, or fire the notification callback
 		//
@@ -899,7 +881,12 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procd
 	//
 	if(tinfo->pid == tinfo->tid)
 	{
-		res = scap_fd_scan_fd_dir(handle, dir_name, tinfo, sockets_by_ns, num_fds_ret, error);
+		//
+		// Lookups get the fds in the fd table of the thread they return
+		//
+		res = scap_fd_scan_fd_dir(handle, dir_name, tinfo, sockets_by_ns,
+					  procinfo? NULL : handle->m_proc_callback,
+					  num_fds_ret, error);
 	}
 
 	if(free_tinfo)
@@ -910,6 +897,29 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procd
 	return res;
 }
 
+int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, char* procdirname, struct scap_ns_socket_list** sockets_by_ns, scap_threadinfo** procinfo, uint64_t* num_fds_ret, char *error)
+{
+	char dir_name[256];
+	int procdirfd;
+	int32_t res;
+
+	snprintf(dir_name, sizeof(dir_name), "%s/%u/", procdirname, tid);
+
+	procdirfd = open(dir_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(procdirfd < 0)
+	{
+		//
+		// The thread is gone
+		//
+		return SCAP_SUCCESS;
+	}
+
+	res = scap_proc_add_from_procdir(handle, tid, procdirfd, dir_name, sockets_by_ns, procinfo, num_fds_ret, error);
+
+	close(procdirfd);
+	return res;
+}
+
 //
 // Read a single thread info from /proc
 //
@@ -1164,6 +1174,15 @@ static int32_t _scap_proc_scan_proc_dir_impl(scap_t* handle, char* procdirname,
 
 int32_t scap_proc_scan_proc_dir(scap_t* handle, char* procdirname, char *error)
 {
+	//
+	// The workers can't share the set of suppressed tids, which
+	// suppressed comms make them update
+	//
+	if(handle->m_proc_scan_threads > 1 && handle->m_num_suppressed_comms == 0)
+	{
+		return scap_proc_scan_proc_dir_mt(handle, procdirname, error);
+	}
+
 	return _scap_proc_scan_proc_dir_impl(handle, procdirname, -1, error);
 }
 
@@ -1279,7 +1298,7 @@ void scap_proc_free_table(scap_t* handle)
 	}
 }
 
-struct scap_threadinfo* scap_proc_get(scap_t* handle, int64_t tid, bool scan_sockets)
+struct scap_threadinfo* scap_proc_get(scap_t* handle, int64_t tid, bool scan_sockets, char *error)
 {
 #if !defined(HAS_CAPTURE) || defined(_WIN32)
 	return NULL;
@@ -1296,7 +1315,7 @@ struct scap_threadinfo* scap_proc_get(scap_t* handle, int64_t tid, bool scan_soc
 	struct scap_threadinfo* tinfo = NULL;
 	char filename[SCAP_MAX_PATH_SIZE];
 	snprintf(filename, sizeof(filename), "%s/proc", scap_get_host_root());
-	if(scap_proc_read_thread(handle, filename, tid, &tinfo, handle->m_lasterr, scan_sockets) != SCAP_SUCCESS)
+	if(scap_proc_read_thread(handle, filename, tid, &tinfo, error, scan_sockets) != SCAP_SUCCESS)
 	{
 		free(tinfo);
 		return NULL;
@@ -1478,17 +1497,22 @@ void scap_proc_print_table(scap_t* handle)
 }
 
 const char *scap_strerror(scap_t *handle, int errnum)
+{
+	return scap_strerror_r(handle->m_strerror_buf, errnum);
+}
+
+const char *scap_strerror_r(char *buf, int errnum)
 {
 	int rc;
-	if((rc = strerror_r(errnum, handle->m_strerror_buf, SCAP_LASTERR_SIZE) != 0))
+	if((rc = strerror_r(errnum, buf, SCAP_LASTERR_SIZE) != 0))
 	{
 		if(rc != ERANGE)
 		{
-			snprintf(handle->m_strerror_buf, SCAP_LASTERR_SIZE, "Errno %d", errnum);
+			snprintf(buf, SCAP_LASTERR_SIZE, "Errno %d", errnum);
 		}
 	}
 
-	return handle->m_strerror_buf;
+	return buf;
 }
 
 int32_t scap_update_suppressed(scap_t *handle,
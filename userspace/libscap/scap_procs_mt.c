@@ -0,0 +1,637 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Multi-threaded initial /proc scan, used when scap_open_args.proc_scan_threads
+// is greater than 1. The pids found in the /proc directory are handed out in
+// directory order to a pool of workers, which read each process, its fds and
+// its tasks into a private table with scap_proc_add_from_proc(). The calling
+// thread merges the tables into m_proclist (or fires the proc callback) in the
+// same order, so the result is the same as the sequential scan's. Workers
+// stay at most SCAP_PROC_SCAN_WINDOW pids ahead of the merge each, which
+// bounds the memory of the tables waiting to be merged.
+//
+// The socket tables of each network namespace are read once, by the first
+// worker that needs them, and shared by all the workers.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scap.h"
+#include "scap-int.h"
+#include "clock_helpers.h"
+#include "debug_log_helpers.h"
+
+#if defined(HAS_CAPTURE) && !defined(CYGWING_AGENT) && !defined(_WIN32)
+
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include "uthash.h"
+
+#define SCAP_PROC_SCAN_THREADS_MAX 32
+#define SCAP_PROC_SCAN_WINDOW 64
+
+//
+// The threads of a process, in the order the sequential scan would add them
+//
+typedef struct proc_scan_result
+{
+	scap_threadinfo* m_procs;
+	uint64_t m_num_fds;
+	bool m_done;
+}proc_scan_result;
+
+//
+// The sockets of a network namespace. m_ready is set once they have been
+// read, until then the other workers wait for them on m_ns_cond.
+//
+typedef struct proc_scan_ns
+{
+	struct scap_ns_socket_list m_list;
+	int64_t net_ns;
+	bool m_ready;
+	UT_hash_handle hh;
+}proc_scan_ns;
+
+struct scap_proc_scan_mt
+{
+	scap_t* m_handle;
+	char* m_procdirname;
+	uint64_t* m_tids;
+	uint32_t m_ntids;
+	proc_scan_result* m_results;
+	// Protects m_next, m_consumed, m_stop and the m_done flags
+	pthread_mutex_t m_mutex;
+	// Signaled when m_consumed moves forward, or on shutdown
+	pthread_cond_t m_work_cond;
+	// Signaled when a result is done
+	pthread_cond_t m_done_cond;
+	// The next pid to be scanned
+	uint32_t m_next;
+	// The pids merged so far
+	uint32_t m_consumed;
+	uint32_t m_window;
+	bool m_stop;
+	// Protects m_ns and the m_ready flags
+	pthread_mutex_t m_ns_mutex;
+	pthread_cond_t m_ns_cond;
+	proc_scan_ns* m_ns;
+	pthread_t m_threads[SCAP_PROC_SCAN_THREADS_MAX];
+	uint32_t m_nthreads;
+};
+
+static void proc_scan_free_result(scap_t* handle, proc_scan_result* r)
+{
+	scap_threadinfo* tinfo;
+	scap_threadinfo* ttinfo;
+
+	HASH_ITER(hh, r->m_procs, tinfo, ttinfo)
+	{
+		HASH_DEL(r->m_procs, tinfo);
+		scap_proc_free(handle, tinfo);
+	}
+}
+
+//
+// Read the tasks of pid, other than its main thread, into r
+//
+static void proc_scan_tasks(scap_t* handle, struct scap_proc_scan_mt* s, uint64_t pid, proc_scan_result* r)
+{
+	char childdir[SCAP_MAX_PATH_SIZE];
+	char add_error[SCAP_LASTERR_SIZE];
+	struct scap_ns_socket_list* sockets_by_ns = SCAP_NS_SOCKETS_SHARED;
+	struct dirent *dir_entry_p;
+	scap_threadinfo* tinfo;
+	scap_threadinfo* dup;
+	DIR *dir_p;
+	uint64_t tid;
+
+	snprintf(childdir, sizeof(childdir), "%s/%u/task", s->m_procdirname, (int)pid);
+	dir_p = opendir(childdir);
+	if(dir_p == NULL)
+	{
+		return;
+	}
+
+	while((dir_entry_p = readdir(dir_p)) != NULL)
+	{
+		int32_t uth_status = SCAP_SUCCESS;
+
+		if(strspn(dir_entry_p->d_name, "0123456789") != strlen(dir_entry_p->d_name))
+		{
+			continue;
+		}
+
+		tid = atoi(dir_entry_p->d_name);
+		if(tid == pid)
+		{
+			continue;
+		}
+
+		tinfo = NULL;
+		scap_proc_add_from_proc(handle, tid, childdir, &sockets_by_ns, &tinfo, NULL, add_error);
+		if(tinfo == NULL)
+		{
+			continue;
+		}
+
+		//
+		// Duplicates across pids are caught by the merge
+		//
+		HASH_FIND_INT64(r->m_procs, &tinfo->tid, dup);
+		if(dup != NULL)
+		{
+			scap_proc_free(handle, tinfo);
+			continue;
+		}
+
+		HASH_ADD_INT64(r->m_procs, tid, tinfo);
+		if(uth_status != SCAP_SUCCESS)
+		{
+			scap_proc_free(handle, tinfo);
+		}
+	}
+
+	closedir(dir_p);
+}
+
+//
+// Read the process with the j-th pid, its fds and its tasks
+//
+static void proc_scan_one(scap_t* handle, struct scap_proc_scan_mt* s, uint32_t j)
+{
+	char add_error[SCAP_LASTERR_SIZE];
+	struct scap_ns_socket_list* sockets_by_ns = SCAP_NS_SOCKETS_SHARED;
+	proc_scan_result* r = &s->m_results[j];
+	scap_threadinfo* tinfo = NULL;
+	uint64_t pid = s->m_tids[j];
+	int32_t uth_status = SCAP_SUCCESS;
+	int32_t res;
+
+	res = scap_proc_add_from_proc(handle, pid, s->m_procdirname, &sockets_by_ns, &tinfo, &r->m_num_fds, add_error);
+	if(tinfo == NULL)
+	{
+		//
+		// As in the sequential scan, processes that can't be read
+		// are dropped and filled in by their first event
+		//
+		return;
+	}
+
+	HASH_ADD_INT64(r->m_procs, tid, tinfo);
+	if(uth_status != SCAP_SUCCESS)
+	{
+		scap_proc_free(handle, tinfo);
+		return;
+	}
+
+	if(res == SCAP_SUCCESS && handle->m_mode != SCAP_MODE_NODRIVER)
+	{
+		proc_scan_tasks(handle, s, pid, r);
+	}
+}
+
+static void* proc_scan_worker(void* arg)
+{
+	struct scap_proc_scan_mt* s = (struct scap_proc_scan_mt*)arg;
+	uint32_t j;
+
+	pthread_mutex_lock(&s->m_mutex);
+
+	while(!s->m_stop && s->m_next < s->m_ntids)
+	{
+		if(s->m_next >= s->m_consumed + s->m_window)
+		{
+			pthread_cond_wait(&s->m_work_cond, &s->m_mutex);
+			continue;
+		}
+
+		j = s->m_next++;
+		pthread_mutex_unlock(&s->m_mutex);
+
+		proc_scan_one(s->m_handle, s, j);
+
+		pthread_mutex_lock(&s->m_mutex);
+		s->m_results[j].m_done = true;
+		pthread_cond_broadcast(&s->m_done_cond);
+	}
+
+	pthread_mutex_unlock(&s->m_mutex);
+	return NULL;
+}
+
+int32_t scap_proc_scan_mt_get_sockets(scap_t* handle, char* procdir, uint64_t net_ns, struct scap_ns_socket_list** sockets, char *error)
+{
+	struct scap_proc_scan_mt* s = handle->m_proc_scan_mt;
+	char fd_error[SCAP_LASTERR_SIZE];
+	int32_t uth_status = SCAP_SUCCESS;
+	proc_scan_ns* ns;
+	int32_t res;
+
+	ASSERT(s != NULL);
+
+	pthread_mutex_lock(&s->m_ns_mutex);
+
+	HASH_FIND_INT64(s->m_ns, &net_ns, ns);
+	if(ns != NULL)
+	{
+		while(!ns->m_ready)
+		{
+			pthread_cond_wait(&s->m_ns_cond, &s->m_ns_mutex);
+		}
+
+		pthread_mutex_unlock(&s->m_ns_mutex);
+		*sockets = &ns->m_list;
+		return SCAP_SUCCESS;
+	}
+
+	ns = (proc_scan_ns*)calloc(1, sizeof(proc_scan_ns));
+	if(ns == NULL)
+	{
+		pthread_mutex_unlock(&s->m_ns_mutex);
+		snprintf(error, SCAP_LASTERR_SIZE, "socket list allocation error");
+		return SCAP_FAILURE;
+	}
+
+	ns->net_ns = net_ns;
+	ns->m_list.net_ns = net_ns;
+	HASH_ADD_INT64(s->m_ns, net_ns, ns);
+	if(uth_status != SCAP_SUCCESS)
+	{
+		pthread_mutex_unlock(&s->m_ns_mutex);
+		snprintf(error, SCAP_LASTERR_SIZE, "socket list allocation error");
+		free(ns);
+		return SCAP_FAILURE;
+	}
+
+	pthread_mutex_unlock(&s->m_ns_mutex);
+
+	//
+	// Read the tables outside of the lock, so that workers in other
+	// namespaces don't wait for them
+	//
+	res = scap_fd_read_sockets(handle, procdir, &ns->m_list, fd_error);
+	if(res == SCAP_FAILURE)
+	{
+		ns->m_list.sockets = NULL;
+	}
+
+	pthread_mutex_lock(&s->m_ns_mutex);
+	ns->m_ready = true;
+	pthread_cond_broadcast(&s->m_ns_cond);
+	pthread_mutex_unlock(&s->m_ns_mutex);
+
+	if(res == SCAP_FAILURE)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "Cannot read sockets (%.*s)",
+			 (int)(SCAP_LASTERR_SIZE - sizeof("Cannot read sockets ()")), fd_error);
+		return SCAP_FAILURE;
+	}
+
+	*sockets = &ns->m_list;
+	return SCAP_SUCCESS;
+}
+
+//
+// Add the threads of r to the process table, or hand them and their fds to
+// the proc callback
+//
+static int32_t proc_scan_merge(scap_t* handle, proc_scan_result* r, char *error)
+{
+	scap_threadinfo* tinfo;
+	scap_threadinfo* ttinfo;
+	scap_threadinfo* dup;
+	scap_fdinfo* fdi;
+	scap_fdinfo* tfdi;
+
+	HASH_ITER(hh, r->m_procs, tinfo, ttinfo)
+	{
+		int32_t uth_status = SCAP_SUCCESS;
+
+		HASH_DEL(r->m_procs, tinfo);
+
+		//
+		// This is the initial /proc scan so duplicate threads
+		// are an error, or at least unexpected
+		//
+		HASH_FIND_INT64(handle->m_proclist, &tinfo->tid, dup);
+		if(dup != NULL)
+		{
+			ASSERT(false);
+			snprintf(error, SCAP_LASTERR_SIZE, "duplicate process %"PRIu64, tinfo->tid);
+			scap_proc_free(handle, tinfo);
+			return SCAP_FAILURE;
+		}
+
+		//
+		// The workers leave the vtid in tinfo, the maps are only
+		// written from this thread
+		//
+		scap_proc_put_vtid_map(handle, tinfo);
+
+		if(handle->m_proc_callback == NULL)
+		{
+			HASH_ADD_INT64(handle->m_proclist, tid, tinfo);
+			if(uth_status != SCAP_SUCCESS)
+			{
+				snprintf(error, SCAP_LASTERR_SIZE, "process table allocation error (2)");
+				scap_proc_free(handle, tinfo);
+				return SCAP_FAILURE;
+			}
+		}
+		else
+		{
+			handle->m_proc_callback(handle->m_proc_callback_context, handle, tinfo->tid, tinfo, NULL);
+
+			HASH_ITER(hh, tinfo->fdlist, fdi, tfdi)
+			{
+				HASH_DEL(tinfo->fdlist, fdi);
+				handle->m_proc_callback(handle->m_proc_callback_context, handle, tinfo->tid, tinfo, fdi);
+				free(fdi);
+			}
+
+			free(tinfo);
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
+static void proc_scan_stop(struct scap_proc_scan_mt* s)
+{
+	proc_scan_ns* ns;
+	proc_scan_ns* tns;
+	uint32_t j;
+
+	pthread_mutex_lock(&s->m_mutex);
+	s->m_stop = true;
+	pthread_cond_broadcast(&s->m_work_cond);
+	pthread_mutex_unlock(&s->m_mutex);
+
+	for(j = 0; j < s->m_nthreads; j++)
+	{
+		pthread_join(s->m_threads[j], NULL);
+	}
+
+	for(j = s->m_consumed; j < s->m_ntids; j++)
+	{
+		proc_scan_free_result(s->m_handle, &s->m_results[j]);
+	}
+
+	HASH_ITER(hh, s->m_ns, ns, tns)
+	{
+		HASH_DEL(s->m_ns, ns);
+		scap_fd_free_table(s->m_handle, &ns->m_list.sockets);
+		free(ns);
+	}
+
+	pthread_mutex_destroy(&s->m_mutex);
+	pthread_cond_destroy(&s->m_work_cond);
+	pthread_cond_destroy(&s->m_done_cond);
+	pthread_mutex_destroy(&s->m_ns_mutex);
+	pthread_cond_destroy(&s->m_ns_cond);
+}
+
+//
+// The pids in procdirname, in directory order
+//
+static int32_t proc_scan_list_pids(scap_t* handle, struct scap_proc_scan_mt* s, char *error)
+{
+	struct dirent *dir_entry_p;
+	uint32_t size = 0;
+	DIR *dir_p;
+
+	dir_p = opendir(s->m_procdirname);
+	if(dir_p == NULL)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "error opening the %s directory (%s)",
+			 s->m_procdirname, scap_strerror(handle, errno));
+		return SCAP_NOTFOUND;
+	}
+
+	while((dir_entry_p = readdir(dir_p)) != NULL)
+	{
+		if(strspn(dir_entry_p->d_name, "0123456789") != strlen(dir_entry_p->d_name))
+		{
+			continue;
+		}
+
+		if(s->m_ntids == size)
+		{
+			uint64_t* tids;
+
+			size = size? size * 2 : 1024;
+			tids = (uint64_t*)realloc(s->m_tids, size * sizeof(uint64_t));
+			if(tids == NULL)
+			{
+				snprintf(error, SCAP_LASTERR_SIZE, "process list allocation error");
+				closedir(dir_p);
+				return SCAP_FAILURE;
+			}
+			s->m_tids = tids;
+		}
+
+		s->m_tids[s->m_ntids++] = atoi(dir_entry_p->d_name);
+	}
+
+	closedir(dir_p);
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_proc_scan_proc_dir_mt(scap_t* handle, char* procdirname, char *error)
+{
+	struct scap_proc_scan_mt s;
+	int32_t res = SCAP_SUCCESS;
+	uint32_t nthreads;
+	uint32_t j;
+
+	uint64_t num_procs_processed = 0;
+	uint64_t total_num_fds = 0;
+	uint64_t last_tid_processed = 0;
+
+	memset(&s, 0, sizeof(s));
+	s.m_handle = handle;
+	s.m_procdirname = procdirname;
+
+	res = proc_scan_list_pids(handle, &s, error);
+	if(res != SCAP_SUCCESS)
+	{
+		free(s.m_tids);
+		return res;
+	}
+
+	s.m_results = (proc_scan_result*)calloc(s.m_ntids + 1, sizeof(proc_scan_result));
+	if(s.m_results == NULL)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "process list allocation error");
+		free(s.m_tids);
+		return SCAP_FAILURE;
+	}
+
+	bool do_timing = (handle->m_proc_scan_timeout_ms != SCAP_PROC_SCAN_TIMEOUT_NONE) ||
+	                 (handle->m_proc_scan_log_interval_ms != SCAP_PROC_SCAN_LOG_NONE);
+	uint64_t monotonic_ts_context = SCAP_GET_CUR_TS_MS_CONTEXT_INIT;
+	uint64_t start_ts_ms = 0;
+	uint64_t last_log_ts_ms = 0;
+	uint64_t cur_ts_ms = 0;
+	uint64_t total_elapsed_time_ms = 0;
+
+	if(do_timing)
+	{
+		start_ts_ms = scap_get_monotonic_ts_ms(&monotonic_ts_context);
+		last_log_ts_ms = start_ts_ms;
+	}
+
+	nthreads = MIN(handle->m_proc_scan_threads, SCAP_PROC_SCAN_THREADS_MAX);
+	nthreads = MIN(nthreads, s.m_ntids);
+	s.m_window = SCAP_PROC_SCAN_WINDOW * (nthreads? nthreads : 1);
+
+	pthread_mutex_init(&s.m_mutex, NULL);
+	pthread_cond_init(&s.m_work_cond, NULL);
+	pthread_cond_init(&s.m_done_cond, NULL);
+	pthread_mutex_init(&s.m_ns_mutex, NULL);
+	pthread_cond_init(&s.m_ns_cond, NULL);
+	handle->m_proc_scan_mt = &s;
+
+	for(j = 0; j < nthreads; j++)
+	{
+		if(pthread_create(&s.m_threads[s.m_nthreads], NULL, proc_scan_worker, &s) == 0)
+		{
+			s.m_nthreads++;
+		}
+	}
+
+	bool timeout_expired = false;
+	for(j = 0; j < s.m_ntids && !timeout_expired; j++)
+	{
+		pthread_mutex_lock(&s.m_mutex);
+		while(!s.m_results[j].m_done)
+		{
+			//
+			// Scan the pid here if no worker took it yet, e.g.
+			// because none could be started
+			//
+			if(s.m_next == j)
+			{
+				s.m_next++;
+				pthread_mutex_unlock(&s.m_mutex);
+				proc_scan_one(handle, &s, j);
+				pthread_mutex_lock(&s.m_mutex);
+				s.m_results[j].m_done = true;
+				break;
+			}
+
+			pthread_cond_wait(&s.m_done_cond, &s.m_mutex);
+		}
+		pthread_mutex_unlock(&s.m_mutex);
+
+		bool scanned = (s.m_results[j].m_procs != NULL);
+		res = proc_scan_merge(handle, &s.m_results[j], error);
+		proc_scan_free_result(handle, &s.m_results[j]);
+
+		pthread_mutex_lock(&s.m_mutex);
+		s.m_consumed = j + 1;
+		pthread_cond_broadcast(&s.m_work_cond);
+		pthread_mutex_unlock(&s.m_mutex);
+
+		if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+
+		if(!scanned)
+		{
+			continue;
+		}
+
+		last_tid_processed = s.m_tids[j];
+		num_procs_processed++;
+		total_num_fds += s.m_results[j].m_num_fds;
+
+		if(do_timing)
+		{
+			cur_ts_ms = scap_get_monotonic_ts_ms(&monotonic_ts_context);
+			total_elapsed_time_ms = cur_ts_ms - start_ts_ms;
+
+			if(handle->m_proc_scan_log_interval_ms != SCAP_PROC_SCAN_LOG_NONE &&
+			   cur_ts_ms - last_log_ts_ms >= handle->m_proc_scan_log_interval_ms)
+			{
+				scap_debug_log(handle,
+				               "scap_proc_scan: %ld proc in %ld ms, avg=%ld, last pid %ld, num_fds %ld, %u threads",
+				               num_procs_processed,
+				               total_elapsed_time_ms,
+				               (total_elapsed_time_ms / (uint64_t)num_procs_processed),
+				               last_tid_processed,
+				               total_num_fds,
+				               s.m_nthreads);
+				last_log_ts_ms = cur_ts_ms;
+			}
+
+			if(handle->m_proc_scan_timeout_ms != SCAP_PROC_SCAN_TIMEOUT_NONE &&
+			   total_elapsed_time_ms >= handle->m_proc_scan_timeout_ms)
+			{
+				timeout_expired = true;
+			}
+		}
+	}
+
+	proc_scan_stop(&s);
+	handle->m_proc_scan_mt = NULL;
+
+	if(do_timing)
+	{
+		cur_ts_ms = scap_get_monotonic_ts_ms(&monotonic_ts_context);
+		total_elapsed_time_ms = cur_ts_ms - start_ts_ms;
+		uint64_t avg_proc_time_ms = (num_procs_processed != 0) ?
+		                               (total_elapsed_time_ms / num_procs_processed) : 0;
+
+		if(timeout_expired)
+		{
+			scap_debug_log(handle,
+			               "scap_proc_scan TIMEOUT (%ld ms): %ld proc in %ld ms, avg=%ld, last pid %ld, num_fds %ld, %u threads",
+			               handle->m_proc_scan_timeout_ms,
+			               num_procs_processed,
+			               total_elapsed_time_ms,
+			               avg_proc_time_ms,
+			               last_tid_processed,
+			               total_num_fds,
+			               s.m_nthreads);
+		}
+		else if((handle->m_proc_scan_log_interval_ms != SCAP_PROC_SCAN_LOG_NONE) &&
+		        (num_procs_processed != 0))
+		{
+			scap_debug_log(handle,
+			               "scap_proc_scan DONE: %ld proc in %ld ms, avg=%ld, last pid %ld, num_fds %ld, %u threads",
+			               num_procs_processed,
+			               total_elapsed_time_ms,
+			               avg_proc_time_ms,
+			               last_tid_processed,
+			               total_num_fds,
+			               s.m_nthreads);
+		}
+	}
+
+	free(s.m_results);
+	free(s.m_tids);
+	return res;
+}
+
+#endif // HAS_CAPTURE && !CYGWING_AGENT && !_WIN32
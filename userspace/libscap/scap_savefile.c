@@ -33,12 +33,20 @@ struct iovec {
 #include "scap-int.h"
 #include "scap_savefile.h"
 
+#ifdef SCAP_HAS_FILE_MAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // WRITE FUNCTIONS
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
+static int32_t scap_dump_chunk_flush(scap_dumper_t *d);
+
 //
 // Write data into a dump file
 //
@@ -46,6 +54,30 @@ int scap_dump_write(scap_dumper_t *d, void* buf, unsigned len)
 {
 	if(d->m_type == DT_FILE)
 	{
+		//
+		// Keep the blocks in order, the pending events of a chunked dump
+		// go first
+		//
+		if(d->m_chunk_len != 0 && scap_dump_chunk_flush(d) != SCAP_SUCCESS)
+		{
+			return -1;
+		}
+
+#ifndef _WIN32
+		if(d->m_async != NULL)
+		{
+			uint8_t* staged = scap_dump_async_reserve(d, len);
+			if(staged == NULL)
+			{
+				return -1;
+			}
+
+			memcpy(staged, buf, len);
+			scap_dump_async_commit(d, len);
+			return len;
+		}
+#endif
+
 		return gzwrite(d->m_f, buf, len);
 	}
 	else
@@ -134,6 +166,121 @@ static int32_t scap_write_padding(scap_dumper_t *d, uint32_t blocklen)
 	}
 }
 
+//
+// Compress the pending events of a chunked dump into a chunk block, and
+// add it to the index
+//
+static int32_t scap_dump_chunk_flush(scap_dumper_t *d)
+{
+#ifdef USE_ZLIB
+	block_header bh;
+	chunk_header ch;
+	chunk_index_entry *entry;
+	uint64_t zlen;
+	uint32_t bt;
+
+	if(d->m_chunk_len == 0)
+	{
+		return SCAP_SUCCESS;
+	}
+
+	zlen = compressBound(d->m_chunk_len) + 1;
+	if(zlen > d->m_zchunk_size)
+	{
+		uint8_t *zchunk = (uint8_t *)realloc(d->m_zchunk, zlen);
+		if(zchunk == NULL)
+		{
+			return SCAP_FAILURE;
+		}
+
+		d->m_zchunk = zchunk;
+		d->m_zchunk_size = zlen;
+	}
+
+	if(compr(d->m_zchunk, &zlen, d->m_chunk, d->m_chunk_len, Z_DEFAULT_COMPRESSION) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
+	if(d->m_chunk_index_len == d->m_chunk_index_size)
+	{
+		uint32_t size = d->m_chunk_index_size? d->m_chunk_index_size * 2 : 256;
+		chunk_index_entry *index = (chunk_index_entry *)realloc(d->m_chunk_index, size * sizeof(chunk_index_entry));
+		if(index == NULL)
+		{
+			return SCAP_FAILURE;
+		}
+
+		d->m_chunk_index = index;
+		d->m_chunk_index_size = size;
+	}
+
+	entry = &d->m_chunk_index[d->m_chunk_index_len++];
+	//
+	// Not gztell(), which races with the writer thread of an async dump
+	//
+	entry->offset = scap_dump_ftell(d);
+	entry->first_ts = d->m_chunk_first_ts;
+	entry->last_ts = d->m_chunk_last_ts;
+	entry->nevts = d->m_chunk_nevts;
+	entry->reserved = 0;
+
+	ch.first_ts = d->m_chunk_first_ts;
+	ch.last_ts = d->m_chunk_last_ts;
+	ch.nevts = d->m_chunk_nevts;
+	ch.len = d->m_chunk_len;
+	ch.compressed_len = (uint32_t)zlen;
+
+	bh.block_type = EVC_BLOCK_TYPE;
+	bh.block_total_length = scap_normalize_block_len(sizeof(bh) + sizeof(ch) + ch.compressed_len + 4);
+	bt = bh.block_total_length;
+
+	//
+	// The chunk is empty again before the writes below, which would
+	// otherwise come back here
+	//
+	d->m_chunk_len = 0;
+	d->m_chunk_nevts = 0;
+
+	if(scap_dump_write(d, &bh, sizeof(bh)) != sizeof(bh) ||
+		scap_dump_write(d, &ch, sizeof(ch)) != sizeof(ch) ||
+		scap_dump_write(d, d->m_zchunk, ch.compressed_len) != ch.compressed_len ||
+		scap_write_padding(d, sizeof(ch) + ch.compressed_len) != SCAP_SUCCESS ||
+		scap_dump_write(d, &bt, sizeof(bt)) != sizeof(bt))
+	{
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+#else
+	return SCAP_FAILURE;
+#endif
+}
+
+//
+// Write the index of the chunks, as the last block of a chunked dump
+//
+static int32_t scap_dump_chunk_write_index(scap_dumper_t *d)
+{
+	block_header bh;
+	uint32_t len = d->m_chunk_index_len * sizeof(chunk_index_entry);
+	uint32_t bt;
+
+	bh.block_type = EVCI_BLOCK_TYPE;
+	bh.block_total_length = scap_normalize_block_len(sizeof(bh) + len + 4);
+	bt = bh.block_total_length;
+
+	if(scap_dump_write(d, &bh, sizeof(bh)) != sizeof(bh) ||
+		scap_dump_write(d, d->m_chunk_index, len) != len ||
+		scap_write_padding(d, len) != SCAP_SUCCESS ||
+		scap_dump_write(d, &bt, sizeof(bt)) != sizeof(bt))
+	{
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
 int32_t scap_write_proc_fds(scap_t *handle, struct scap_threadinfo *tinfo, scap_dumper_t *d)
 {
 	block_header bh;
@@ -890,7 +1037,7 @@ int32_t scap_setup_dump(scap_t *handle, scap_dumper_t* d, const char *fname)
 }
 
 // fname is only used for log messages in scap_setup_dump
-static scap_dumper_t *scap_dump_open_gzfile(scap_t *handle, gzFile gzfile, const char *fname, bool skip_proc_scan)
+static scap_dumper_t *scap_dump_open_gzfile(scap_t *handle, gzFile gzfile, const char *fname, compression_mode compress, bool skip_proc_scan)
 {
 	scap_dumper_t* res = (scap_dumper_t*)malloc(sizeof(scap_dumper_t));
 	res->m_f = gzfile;
@@ -898,6 +1045,16 @@ static scap_dumper_t *scap_dump_open_gzfile(scap_t *handle, gzFile gzfile, const
 	res->m_targetbuf = NULL;
 	res->m_targetbufcurpos = NULL;
 	res->m_targetbufend = NULL;
+	res->m_chunk = NULL;
+	res->m_chunk_len = 0;
+	res->m_chunk_nevts = 0;
+	res->m_zchunk = NULL;
+	res->m_zchunk_size = 0;
+	res->m_chunk_index = NULL;
+	res->m_chunk_index_len = 0;
+	res->m_chunk_index_size = 0;
+	res->m_async = NULL;
+	res->m_lasterr[0] = 0;
 
 	bool tmp_refresh_proc_table_when_saving = handle->refresh_proc_table_when_saving;
 	if(skip_proc_scan)
@@ -915,6 +1072,21 @@ static scap_dumper_t *scap_dump_open_gzfile(scap_t *handle, gzFile gzfile, const
 		handle->refresh_proc_table_when_saving = tmp_refresh_proc_table_when_saving;
 	}
 
+	//
+	// From here on the events of chunked dumps are collected in m_chunk
+	//
+	if(res != NULL && compress == SCAP_COMPRESSION_CHUNKED)
+	{
+		res->m_chunk_size = SCAP_CHUNK_SIZE + FILE_READ_BUF_SIZE;
+		res->m_chunk = (uint8_t*)malloc(res->m_chunk_size);
+		if(res->m_chunk == NULL)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk buffer");
+			scap_dump_close(res);
+			res = NULL;
+		}
+	}
+
 	return res;
 }
 
@@ -935,6 +1107,17 @@ scap_dumper_t *scap_dump_open(scap_t *handle, const char *fname, compression_mod
 	case SCAP_COMPRESSION_NONE:
 		mode = "wbT";
 		break;
+	case SCAP_COMPRESSION_CHUNKED:
+#ifdef USE_ZLIB
+		//
+		// The chunks are compressed by us, the file itself is not
+		//
+		mode = "wbT";
+		break;
+#else
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "chunked compression is not supported without zlib");
+		return NULL;
+#endif
 	default:
 		ASSERT(false);
 		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid compression mode");
@@ -972,7 +1155,7 @@ scap_dumper_t *scap_dump_open(scap_t *handle, const char *fname, compression_mod
 		return NULL;
 	}
 
-	return scap_dump_open_gzfile(handle, f, fname, skip_proc_scan);
+	return scap_dump_open_gzfile(handle, f, fname, compress, skip_proc_scan);
 }
 
 //
@@ -990,6 +1173,17 @@ scap_dumper_t* scap_dump_open_fd(scap_t *handle, int fd, compression_mode compre
 	case SCAP_COMPRESSION_NONE:
 		mode = "wbT";
 		break;
+	case SCAP_COMPRESSION_CHUNKED:
+#ifdef USE_ZLIB
+		//
+		// The chunks are compressed by us, the file itself is not
+		//
+		mode = "wbT";
+		break;
+#else
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "chunked compression is not supported without zlib");
+		return NULL;
+#endif
 	default:
 		ASSERT(false);
 		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid compression mode");
@@ -1004,7 +1198,7 @@ scap_dumper_t* scap_dump_open_fd(scap_t *handle, int fd, compression_mode compre
 		return NULL;
 	}
 
-	return scap_dump_open_gzfile(handle, f, "", skip_proc_scan);
+	return scap_dump_open_gzfile(handle, f, "", compress, skip_proc_scan);
 }
 
 //
@@ -1024,6 +1218,10 @@ scap_dumper_t *scap_memory_dump_open(scap_t *handle, uint8_t* targetbuf, uint64_
 	res->m_targetbuf = targetbuf;
 	res->m_targetbufcurpos = targetbuf;
 	res->m_targetbufend = targetbuf + targetbufsize;
+	res->m_chunk = NULL;
+	res->m_chunk_len = 0;
+	res->m_async = NULL;
+	res->m_lasterr[0] = 0;
 
 	//
 	// Disable proc parsing since it would be too heavy when saving to memory.
@@ -1051,12 +1249,33 @@ void scap_dump_close(scap_dumper_t *d)
 {
 	if(d->m_type == DT_FILE)
 	{
+		if(d->m_chunk != NULL)
+		{
+			scap_dump_chunk_flush(d);
+			scap_dump_chunk_write_index(d);
+			free(d->m_chunk);
+			free(d->m_zchunk);
+			free(d->m_chunk_index);
+		}
+
+#ifndef _WIN32
+		if(d->m_async != NULL)
+		{
+			scap_dump_async_close(d);
+		}
+#endif
+
 		gzclose(d->m_f);
 	}
 
 	free(d);
 }
 
+const char* scap_dump_getlasterr(scap_dumper_t *d)
+{
+	return d->m_lasterr;
+}
+
 //
 // Return the current size of a tracefile
 //
@@ -1064,6 +1283,13 @@ int64_t scap_dump_get_offset(scap_dumper_t *d)
 {
 	if(d->m_type == DT_FILE)
 	{
+#ifndef _WIN32
+		if(d->m_async != NULL)
+		{
+			return scap_dump_async_get_offset(d);
+		}
+#endif
+
 		return gzoffset(d->m_f);
 	}
 	else
@@ -1076,6 +1302,13 @@ int64_t scap_dump_ftell(scap_dumper_t *d)
 {
 	if(d->m_type == DT_FILE)
 	{
+#ifndef _WIN32
+		if(d->m_async != NULL)
+		{
+			return scap_dump_async_ftell(d);
+		}
+#endif
+
 		return gztell(d->m_f);
 	}
 	else
@@ -1088,6 +1321,13 @@ void scap_dump_flush(scap_dumper_t *d)
 {
 	if(d->m_type == DT_FILE)
 	{
+		scap_dump_chunk_flush(d);
+#ifndef _WIN32
+		if(d->m_async != NULL)
+		{
+			scap_dump_async_flush(d);
+		}
+#endif
 		gzflush(d->m_f, Z_FULL_FLUSH);
 	}
 }
@@ -1102,6 +1342,92 @@ int32_t scap_number_of_bytes_to_write(scap_evt *e, uint16_t cpuid, int32_t *byte
 	return SCAP_SUCCESS;
 }
 
+//
+// Lay out an event block in memory as scap_dump() writes it, block_len
+// bytes long
+//
+static void scap_dump_fill_event_block(uint8_t *block, uint32_t block_len, scap_evt *e, uint16_t cpuid, uint32_t flags)
+{
+	block_header bh;
+	uint8_t *p = block;
+
+	bh.block_type = flags? EVF_BLOCK_TYPE_V2 : EV_BLOCK_TYPE_V2;
+	bh.block_total_length = block_len;
+
+	memcpy(p, &bh, sizeof(bh));
+	p += sizeof(bh);
+	memcpy(p, &cpuid, sizeof(cpuid));
+	p += sizeof(cpuid);
+	if(flags)
+	{
+		memcpy(p, &flags, sizeof(flags));
+		p += sizeof(flags);
+	}
+	memcpy(p, e, e->len);
+	p += e->len;
+	memset(p, 0, block + block_len - sizeof(uint32_t) - p);
+	memcpy(block + block_len - sizeof(uint32_t), &block_len, sizeof(uint32_t));
+}
+
+static inline uint32_t scap_dump_event_block_len(scap_evt *e, uint32_t flags)
+{
+	return scap_normalize_block_len(sizeof(block_header) + sizeof(uint16_t) + (flags? sizeof(flags) : 0) + e->len + 4);
+}
+
+//
+// Record a scap_dump() failure in the dumper, and in the handle for the
+// callers that predate scap_dump_getlasterr()
+//
+static int32_t scap_dump_error(scap_t *handle, scap_dumper_t *d, const char *error)
+{
+	snprintf(d->m_lasterr, SCAP_LASTERR_SIZE, "%s", error);
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "%s", error);
+	return SCAP_FAILURE;
+}
+
+//
+// Append an event block to the pending chunk of a chunked dump
+//
+static int32_t scap_dump_chunk_event(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid, uint32_t flags)
+{
+	uint32_t block_len = scap_dump_event_block_len(e, flags);
+
+	if(d->m_chunk_len + block_len > d->m_chunk_size)
+	{
+		uint32_t size = d->m_chunk_len + block_len;
+		uint8_t *chunk = (uint8_t *)realloc(d->m_chunk, size);
+		if(chunk == NULL)
+		{
+			return scap_dump_error(handle, d, "error allocating the chunk buffer");
+		}
+
+		d->m_chunk = chunk;
+		d->m_chunk_size = size;
+	}
+
+	scap_dump_fill_event_block(d->m_chunk + d->m_chunk_len, block_len, e, cpuid, flags);
+
+	//
+	// The events are not strictly sorted across CPUs
+	//
+	if(d->m_chunk_nevts == 0)
+	{
+		d->m_chunk_first_ts = e->ts;
+		d->m_chunk_last_ts = e->ts;
+	}
+	d->m_chunk_first_ts = MIN(d->m_chunk_first_ts, e->ts);
+	d->m_chunk_last_ts = MAX(d->m_chunk_last_ts, e->ts);
+	d->m_chunk_nevts++;
+	d->m_chunk_len += block_len;
+
+	if(d->m_chunk_len >= SCAP_CHUNK_SIZE && scap_dump_chunk_flush(d) != SCAP_SUCCESS)
+	{
+		return scap_dump_error(handle, d, "error writing to file (8)");
+	}
+
+	return SCAP_SUCCESS;
+}
+
 //
 // Write an event to a dump file
 //
@@ -1110,6 +1436,31 @@ int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid,
 	block_header bh;
 	uint32_t bt;
 
+	if(d->m_chunk != NULL)
+	{
+		return scap_dump_chunk_event(handle, d, e, cpuid, flags);
+	}
+
+#ifndef _WIN32
+	//
+	// One copy into the staging buffer rather than a write per field
+	//
+	if(d->m_async != NULL)
+	{
+		uint32_t block_len = scap_dump_event_block_len(e, flags);
+		uint8_t *block = scap_dump_async_reserve(d, block_len);
+
+		if(block == NULL)
+		{
+			return scap_dump_error(handle, d, "error writing to file (9)");
+		}
+
+		scap_dump_fill_event_block(block, block_len, e, cpuid, flags);
+		scap_dump_async_commit(d, block_len);
+		return SCAP_SUCCESS;
+	}
+#endif
+
 	if(flags == 0)
 	{
 		//
@@ -1125,8 +1476,7 @@ int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid,
 				scap_write_padding(d, sizeof(cpuid) + e->len) != SCAP_SUCCESS ||
 				scap_dump_write(d, &bt, sizeof(bt)) != sizeof(bt))
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (6)");
-			return SCAP_FAILURE;
+			return scap_dump_error(handle, d, "error writing to file (6)");
 		}
 	}
 	else
@@ -1145,8 +1495,7 @@ int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid,
 				scap_write_padding(d, sizeof(cpuid) + e->len) != SCAP_SUCCESS ||
 				scap_dump_write(d, &bt, sizeof(bt)) != sizeof(bt))
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (7)");
-			return SCAP_FAILURE;
+			return scap_dump_error(handle, d, "error writing to file (7)");
 		}
 	}
 
@@ -2595,6 +2944,8 @@ int32_t scap_read_init(scap_t *handle, gzFile f)
 		case EV_BLOCK_TYPE_V2:
 		case EVF_BLOCK_TYPE:
 		case EVF_BLOCK_TYPE_V2:
+		case EVC_BLOCK_TYPE:
+		case EVCI_BLOCK_TYPE:
 			found_ev = 1;
 
 			//
@@ -2687,6 +3038,196 @@ int32_t scap_read_init(scap_t *handle, gzFile f)
 	return SCAP_SUCCESS;
 }
 
+//
+// How far ahead of the read offset the pages of a mapped capture file are
+// requested
+//
+#define FILE_MAP_READAHEAD (16 * 1024 * 1024)
+
+void scap_map_offline_file(scap_t *handle, const char *fname, int fd)
+{
+#ifdef SCAP_HAS_FILE_MAP
+	struct stat st;
+	void *map = MAP_FAILED;
+	int map_fd = fd;
+
+	//
+	// Compressed files go through zlib, and so do pipes and the like,
+	// which can't be mapped
+	//
+	if(gzdirect(handle->m_file) != 1)
+	{
+		return;
+	}
+
+	if(fd == 0)
+	{
+		if(fname == NULL)
+		{
+			return;
+		}
+
+		map_fd = open(fname, O_RDONLY);
+		if(map_fd < 0)
+		{
+			return;
+		}
+	}
+
+	//
+	// Private and writable, like m_file_evt_buf, as the consumers are
+	// free to patch the events they are handed
+	//
+	if(fstat(map_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+	   (uint64_t)st.st_size <= SIZE_MAX)
+	{
+		map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, map_fd, 0);
+	}
+
+	if(fd == 0)
+	{
+		close(map_fd);
+	}
+
+	if(map == MAP_FAILED)
+	{
+		return;
+	}
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	handle->m_file_map = map;
+	handle->m_file_map_size = st.st_size;
+	handle->m_file_map_off = gztell(handle->m_file);
+	handle->m_file_map_readahead = handle->m_file_map_off;
+#endif
+}
+
+void scap_disable_file_map(scap_t *handle)
+{
+#ifdef SCAP_HAS_FILE_MAP
+	if(handle->m_file_map == NULL)
+	{
+		return;
+	}
+
+	scap_chunk_reader_unmap(handle);
+	gzseek(handle->m_file, handle->m_file_map_off, SEEK_SET);
+	munmap(handle->m_file_map, handle->m_file_map_size);
+	handle->m_file_map = NULL;
+#endif
+}
+
+//
+// Keep FILE_MAP_READAHEAD bytes of the mapping ahead of the read offset
+// on their way in, in large requests rather than one fault per page
+//
+static inline void file_map_readahead(scap_t *handle)
+{
+#ifdef SCAP_HAS_FILE_MAP
+	uint64_t start;
+	uint64_t len;
+
+	if(handle->m_file_map_off + FILE_MAP_READAHEAD / 2 < handle->m_file_map_readahead ||
+	   handle->m_file_map_readahead >= handle->m_file_map_size)
+	{
+		return;
+	}
+
+	start = MAX(handle->m_file_map_readahead, handle->m_file_map_off);
+	start &= ~((uint64_t)getpagesize() - 1);
+	len = MIN(FILE_MAP_READAHEAD, handle->m_file_map_size - start);
+
+	madvise(handle->m_file_map + start, len, MADV_WILLNEED);
+	handle->m_file_map_readahead = start + len;
+#endif
+}
+
+//
+// Read from the mapping of the file instead of m_file. Returns the number
+// of bytes available, up to len, and moves the read offset past them.
+//
+static inline size_t file_map_read(scap_t *handle, char **buf, size_t len)
+{
+	uint64_t avail = handle->m_file_map_size - handle->m_file_map_off;
+
+	if(len > avail)
+	{
+		len = avail;
+	}
+
+	*buf = handle->m_file_map + handle->m_file_map_off;
+	handle->m_file_map_off += len;
+	return len;
+}
+
+//
+// Read from the current chunk of a chunked capture, like file_map_read()
+//
+static inline size_t chunk_read(scap_t *handle, char **buf, size_t len)
+{
+	uint32_t avail = handle->m_chunk_len - handle->m_chunk_off;
+
+	if(len > avail)
+	{
+		len = avail;
+	}
+
+	*buf = handle->m_chunk_buf + handle->m_chunk_off;
+	handle->m_chunk_off += len;
+	return len;
+}
+
+//
+// Load the chunk of the chunk block whose header was just read, its event
+// blocks are read next. The index block follows the last chunk and ends
+// the events.
+//
+static int32_t next_chunk(scap_t *handle, block_header *bh)
+{
+	uint64_t block_off = scap_ftell(handle) - sizeof(*bh);
+	uint32_t readlen;
+	size_t readsize;
+	char *buf;
+
+	if(bh->block_type == EVCI_BLOCK_TYPE)
+	{
+		//
+		// Stay at the index block, so that reading again is still EOF
+		//
+		scap_fseek(handle, block_off);
+		return SCAP_EOF;
+	}
+
+	if(bh->block_total_length < sizeof(*bh) + sizeof(chunk_header) + 4)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "chunk block length too short %u", (uint32_t)bh->block_total_length);
+		return SCAP_FAILURE;
+	}
+
+	readlen = bh->block_total_length - sizeof(*bh);
+
+	if(handle->m_file_map != NULL)
+	{
+		readsize = file_map_read(handle, &buf, readlen);
+		file_map_readahead(handle);
+	}
+	else
+	{
+		buf = scap_chunk_body_buf(handle, readlen);
+		if(buf == NULL)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk buffer");
+			return SCAP_FAILURE;
+		}
+
+		readsize = gzread(handle->m_file, buf, readlen);
+	}
+	CHECK_READ_SIZE(readsize, readlen);
+
+	return scap_chunk_load(handle, block_off, buf, readlen);
+}
+
 //
 // Read an event from disk
 //
@@ -2696,6 +3237,9 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 	size_t readsize;
 	uint32_t readlen;
 	size_t hdr_len;
+	char *buf;
+	bool in_chunk;
+	int32_t res;
 	gzFile f = handle->m_file;
 
 	ASSERT(f != NULL);
@@ -2707,9 +3251,23 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 	while(true)
 	{
 		//
-		// Read the block header
+		// Read the block header, from the current chunk if there's one
 		//
-		readsize = gzread(f, &bh, sizeof(bh));
+		in_chunk = handle->m_chunk_off < handle->m_chunk_len;
+		if(in_chunk)
+		{
+			readsize = chunk_read(handle, &buf, sizeof(bh));
+			memcpy(&bh, buf, readsize);
+		}
+		else if(handle->m_file_map != NULL)
+		{
+			readsize = file_map_read(handle, &buf, sizeof(bh));
+			memcpy(&bh, buf, readsize);
+		}
+		else
+		{
+			readsize = gzread(f, &bh, sizeof(bh));
+		}
 
 		if(readsize != sizeof(bh))
 		{
@@ -2738,6 +3296,22 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 			}
 		}
 
+		if(!in_chunk && (bh.block_type == EVC_BLOCK_TYPE || bh.block_type == EVCI_BLOCK_TYPE))
+		{
+			if((res = next_chunk(handle, &bh)) != SCAP_SUCCESS)
+			{
+				return res;
+			}
+
+			continue;
+		}
+
+		if(in_chunk && bh.block_type != EV_BLOCK_TYPE_V2 && bh.block_type != EVF_BLOCK_TYPE_V2)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unexpected block type %u in chunk", (uint32_t)bh.block_type);
+			return SCAP_FAILURE;
+		}
+
 		if(bh.block_type != EV_BLOCK_TYPE &&
 		   bh.block_type != EV_BLOCK_TYPE_V2 &&
 		   bh.block_type != EV_BLOCK_TYPE_INT &&
@@ -2772,23 +3346,47 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 			return SCAP_FAILURE;
 		}
 
-		readsize = gzread(f, handle->m_file_evt_buf, readlen);
+		if(in_chunk)
+		{
+			readsize = chunk_read(handle, &buf, readlen);
+		}
+		else if(handle->m_file_map != NULL)
+		{
+			readsize = file_map_read(handle, &buf, readlen);
+			file_map_readahead(handle);
+		}
+		else
+		{
+			buf = handle->m_file_evt_buf;
+			readsize = gzread(f, buf, readlen);
+		}
 		CHECK_READ_SIZE(readsize, readlen);
 
+		//
+		// Old events grow when converted below, which can only be done on
+		// a copy
+		//
+		if(buf != handle->m_file_evt_buf &&
+		   bh.block_type != EV_BLOCK_TYPE_V2 && bh.block_type != EVF_BLOCK_TYPE_V2)
+		{
+			memcpy(handle->m_file_evt_buf, buf, readlen);
+			buf = handle->m_file_evt_buf;
+		}
+
 		//
 		// EVF_BLOCK_TYPE has 32 bits of flags
 		//
-		*pcpuid = *(uint16_t *)handle->m_file_evt_buf;
+		*pcpuid = *(uint16_t *)buf;
 
 		if(bh.block_type == EVF_BLOCK_TYPE || bh.block_type == EVF_BLOCK_TYPE_V2)
 		{
-			handle->m_last_evt_dump_flags = *(uint32_t*)(handle->m_file_evt_buf + sizeof(uint16_t));
-			*pevent = (struct ppm_evt_hdr *)(handle->m_file_evt_buf + sizeof(uint16_t) + sizeof(uint32_t));
+			handle->m_last_evt_dump_flags = *(uint32_t*)(buf + sizeof(uint16_t));
+			*pevent = (struct ppm_evt_hdr *)(buf + sizeof(uint16_t) + sizeof(uint32_t));
 		}
 		else
 		{
 			handle->m_last_evt_dump_flags = 0;
-			*pevent = (struct ppm_evt_hdr *)(handle->m_file_evt_buf + sizeof(uint16_t));
+			*pevent = (struct ppm_evt_hdr *)(buf + sizeof(uint16_t));
 		}
 
 		if((*pevent)->type >= PPM_EVENT_MAX)
@@ -2800,6 +3398,15 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 			continue;
 		}
 
+		//
+		// scap_fseek_ts() lands at the start of the chunk with ts
+		//
+		if((*pevent)->ts < handle->m_chunk_seek_ts)
+		{
+			continue;
+		}
+		handle->m_chunk_seek_ts = 0;
+
 		if(bh.block_type != EV_BLOCK_TYPE_V2 && bh.block_type != EVF_BLOCK_TYPE_V2)
 		{
 			//
@@ -2816,7 +3423,7 @@ int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *p
 
 			memmove((char *)*pevent + sizeof(struct ppm_evt_hdr),
 				(char *)*pevent + sizeof(struct ppm_evt_hdr) - sizeof(uint32_t),
-				readlen - ((char *)*pevent - handle->m_file_evt_buf) - (sizeof(struct ppm_evt_hdr) - sizeof(uint32_t)));
+				readlen - ((char *)*pevent - buf) - (sizeof(struct ppm_evt_hdr) - sizeof(uint32_t)));
 			(*pevent)->len += sizeof(uint32_t);
 
 			// In old captures, the length of PPME_NOTIFICATION_E and PPME_INFRASTRUCTURE_EVENT_E
@@ -2878,6 +3485,19 @@ uint64_t scap_ftell(scap_t *handle)
 	gzFile f = handle->m_file;
 	ASSERT(f != NULL);
 
+	//
+	// Inside a chunk, the offset of its block: seeking there loads it again
+	//
+	if(handle->m_chunk_off < handle->m_chunk_len)
+	{
+		return handle->m_chunk_block_off;
+	}
+
+	if(handle->m_file_map != NULL)
+	{
+		return handle->m_file_map_off;
+	}
+
 	return gztell(f);
 }
 
@@ -2886,5 +3506,16 @@ void scap_fseek(scap_t *handle, uint64_t off)
 	gzFile f = handle->m_file;
 	ASSERT(f != NULL);
 
+	handle->m_chunk_off = 0;
+	handle->m_chunk_len = 0;
+	handle->m_chunk_seek_ts = 0;
+
+	if(handle->m_file_map != NULL)
+	{
+		handle->m_file_map_off = MIN(off, handle->m_file_map_size);
+		handle->m_file_map_readahead = handle->m_file_map_off;
+		return;
+	}
+
 	gzseek(f, off, SEEK_SET);
 }
@@ -148,6 +148,39 @@ typedef struct _section_header_block
 
 #define EVF_BLOCK_TYPE_V2	0x217
 
+///////////////////////////////////////////////////////////////////////////////
+// EVENT CHUNK BLOCK
+///////////////////////////////////////////////////////////////////////////////
+// Written by SCAP_COMPRESSION_CHUNKED dumps. The chunk header is followed by
+// a zlib stream of event blocks (EV_BLOCK_TYPE_V2 and EVF_BLOCK_TYPE_V2),
+// compressed on their own so that each chunk can be read independently.
+#define EVC_BLOCK_TYPE		0x221
+
+typedef struct _chunk_header
+{
+	uint64_t first_ts; // Timestamp of the first event in the chunk
+	uint64_t last_ts; // Timestamp of the last event in the chunk
+	uint32_t nevts;
+	uint32_t len; // Length of the event blocks, uncompressed
+	uint32_t compressed_len;
+}chunk_header;
+
+///////////////////////////////////////////////////////////////////////////////
+// EVENT CHUNK INDEX BLOCK
+///////////////////////////////////////////////////////////////////////////////
+// Last block of SCAP_COMPRESSION_CHUNKED files, with an entry per chunk. It's
+// found from the end of the file, through its trailing block length.
+#define EVCI_BLOCK_TYPE		0x222
+
+typedef struct _chunk_index_entry
+{
+	uint64_t offset; // File offset of the chunk block
+	uint64_t first_ts;
+	uint64_t last_ts;
+	uint32_t nevts;
+	uint32_t reserved;
+}chunk_index_entry;
+
 #if defined __sun
 #pragma pack()
 #else
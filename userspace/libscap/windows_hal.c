@@ -585,7 +585,7 @@ static int32_t addprocess_windows(wh_procinfo* wpi, scap_t* handle, char* error)
 				continue;
 			}
 
-			int32_t ares = scap_add_fd_to_proc_table(handle, tinfo, fdi, error);
+			int32_t ares = scap_add_fd_to_proc_table(handle, tinfo, fdi, handle->m_proc_callback, error);
 			if(ares != SCAP_SUCCESS)
 			{
 				return ares;
@@ -248,7 +248,7 @@ string sinsp_container_manager::container_to_json(const sinsp_container_info& co
 	return Json::FastWriter().write(obj);
 }
 
-bool sinsp_container_manager::container_to_sinsp_event(const string& json, sinsp_evt* evt, shared_ptr<sinsp_threadinfo> tinfo)
+bool sinsp_container_manager::container_to_sinsp_event(const string& json, sinsp_evt* evt, libsinsp::intrusive_ptr<sinsp_threadinfo> tinfo)
 {
 	size_t totlen = sizeof(scap_evt) +  sizeof(uint16_t) + json.length() + 1;
 
@@ -353,7 +353,7 @@ void sinsp_container_manager::dump_containers(scap_dumper_t* dumper)
 			int32_t res = scap_dump(m_inspector->m_h, dumper, evt.m_pevt, evt.m_cpuid, 0);
 			if(res != SCAP_SUCCESS)
 			{
-				throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
+				throw sinsp_exception(scap_dump_getlasterr(dumper));
 			}
 		}
 	}
@@ -195,7 +195,7 @@ public:
 	}
 private:
 	std::string container_to_json(const sinsp_container_info& container_info);
-	bool container_to_sinsp_event(const std::string& json, sinsp_evt* evt, std::shared_ptr<sinsp_threadinfo> tinfo);
+	bool container_to_sinsp_event(const std::string& json, sinsp_evt* evt, libsinsp::intrusive_ptr<sinsp_threadinfo> tinfo);
 	std::string get_docker_env(const Json::Value &env_vars, const std::string &mti);
 
 	std::list<std::shared_ptr<libsinsp::container_engine::container_engine_base>> m_container_engines;
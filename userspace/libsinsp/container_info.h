@@ -24,6 +24,7 @@ limitations under the License.
 #include <string>
 #include <vector>
 #include "container_engine/sinsp_container_type.h"
+#include "intrusive_ptr.h"
 #include "json/json.h"
 
 class sinsp;
@@ -217,7 +218,7 @@ public:
 		return m_lookup_state == sinsp_container_lookup_state::SUCCESSFUL;
 	}
 
-	std::shared_ptr<sinsp_threadinfo> get_tinfo(sinsp* inspector) const;
+	libsinsp::intrusive_ptr<sinsp_threadinfo> get_tinfo(sinsp* inspector) const;
 
 	// Match a process against the set of health probes
 	container_health_probe::probe_type match_health_probe(sinsp_threadinfo *tinfo) const;
@@ -0,0 +1,324 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace libsinsp
+{
+
+template<class T> class cow_intern_table;
+
+/**
+ * Copy-on-write vector. Copies share the same storage, which is only
+ * duplicated when a shared instance is modified; clear() never copies.
+ * Read access goes through a const std::vector, so the usual read-only
+ * vector idioms keep working.
+ */
+template<class T>
+class cow_vector
+{
+public:
+	typedef std::vector<T> vector_t;
+	typedef T value_type;
+	typedef typename vector_t::size_type size_type;
+	typedef typename vector_t::const_iterator const_iterator;
+	typedef const_iterator iterator;
+
+	cow_vector()
+	{
+	}
+
+	cow_vector(const vector_t& v):
+		m_data(v.empty()? nullptr : std::make_shared<vector_t>(v))
+	{
+	}
+
+	const vector_t& get() const
+	{
+		if(m_data)
+		{
+			return *m_data;
+		}
+
+		static const vector_t empty_vector;
+		return empty_vector;
+	}
+
+	operator const vector_t&() const
+	{
+		return get();
+	}
+
+	size_type size() const
+	{
+		return m_data? m_data->size() : 0;
+	}
+
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+	const T& operator[](size_type n) const
+	{
+		return (*m_data)[n];
+	}
+
+	const T& front() const
+	{
+		return m_data->front();
+	}
+
+	const T& back() const
+	{
+		return m_data->back();
+	}
+
+	const_iterator begin() const
+	{
+		return get().begin();
+	}
+
+	const_iterator end() const
+	{
+		return get().end();
+	}
+
+	void clear()
+	{
+		m_data.reset();
+	}
+
+	void reserve(size_type n)
+	{
+		mutable_data().reserve(n);
+	}
+
+	void push_back(const T& v)
+	{
+		mutable_data().push_back(v);
+	}
+
+	void push_back(T&& v)
+	{
+		mutable_data().push_back(std::move(v));
+	}
+
+	template<class... Args>
+	void emplace_back(Args&&... args)
+	{
+		mutable_data().emplace_back(std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Return a private, modifiable copy of the contents.
+	 */
+	vector_t& mutable_data()
+	{
+		if(!m_data)
+		{
+			m_data = std::make_shared<vector_t>();
+		}
+		else if(m_data.use_count() > 1)
+		{
+			m_data = std::make_shared<vector_t>(*m_data);
+		}
+
+		return *m_data;
+	}
+
+	/**
+	 * True if the two instances point to the same storage.
+	 */
+	bool shares_with(const cow_vector& other) const
+	{
+		return m_data == other.m_data;
+	}
+
+private:
+	std::shared_ptr<vector_t> m_data;
+
+	friend class cow_intern_table<T>;
+};
+
+template<class T>
+inline bool operator==(const cow_vector<T>& a, const cow_vector<T>& b)
+{
+	return a.shares_with(b) || a.get() == b.get();
+}
+
+template<class T>
+inline bool operator!=(const cow_vector<T>& a, const cow_vector<T>& b)
+{
+	return !(a == b);
+}
+
+template<class T>
+inline bool operator==(const std::vector<T>& a, const cow_vector<T>& b)
+{
+	return a == b.get();
+}
+
+template<class T>
+inline bool operator==(const cow_vector<T>& a, const std::vector<T>& b)
+{
+	return a.get() == b;
+}
+
+inline size_t cow_hash_combine(size_t seed, size_t h)
+{
+	return seed ^ (h + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+template<class T>
+inline size_t cow_hash_value(const T& v)
+{
+	return std::hash<T>()(v);
+}
+
+template<class A, class B>
+inline size_t cow_hash_value(const std::pair<A, B>& v)
+{
+	return cow_hash_combine(cow_hash_value(v.first), cow_hash_value(v.second));
+}
+
+/**
+ * Table of the distinct cow_vector contents currently in use, so that
+ * equal vectors built independently end up sharing one copy.
+ *
+ * The table holds a reference to every storage it knows about, which
+ * also guarantees that interned storage is never modified in place.
+ * Entries that nobody else references are dropped every time the table
+ * doubles in size.
+ */
+template<class T>
+class cow_intern_table
+{
+public:
+	cow_intern_table():
+		m_purge_threshold(min_purge_threshold),
+		m_hits(0)
+	{
+	}
+
+	/**
+	 * Replace the storage of v with an equal one from the table, or add
+	 * it to the table if there's none. Returns true on a hit.
+	 */
+	bool intern(cow_vector<T>& v)
+	{
+		if(!v.m_data || v.m_data->empty())
+		{
+			v.m_data.reset();
+			return false;
+		}
+
+		size_t h = hash(*v.m_data);
+		auto range = m_table.equal_range(h);
+		for(auto it = range.first; it != range.second; ++it)
+		{
+			if(it->second == v.m_data)
+			{
+				return true;
+			}
+
+			if(*it->second == *v.m_data)
+			{
+				v.m_data = it->second;
+				m_hits++;
+				return true;
+			}
+		}
+
+		v.m_data->shrink_to_fit();
+		m_table.emplace(h, v.m_data);
+
+		if(m_table.size() >= m_purge_threshold)
+		{
+			purge();
+		}
+
+		return false;
+	}
+
+	/**
+	 * Drop the entries that are only referenced by the table.
+	 */
+	void purge()
+	{
+		for(auto it = m_table.begin(); it != m_table.end();)
+		{
+			if(it->second.use_count() == 1)
+			{
+				it = m_table.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		m_purge_threshold = m_table.size() * 2;
+		if(m_purge_threshold < min_purge_threshold)
+		{
+			m_purge_threshold = min_purge_threshold;
+		}
+	}
+
+	void clear()
+	{
+		m_table.clear();
+		m_purge_threshold = min_purge_threshold;
+	}
+
+	size_t size() const
+	{
+		return m_table.size();
+	}
+
+	uint64_t hits() const
+	{
+		return m_hits;
+	}
+
+private:
+	static const size_t min_purge_threshold = 1024;
+
+	static size_t hash(const std::vector<T>& v)
+	{
+		size_t h = v.size();
+		for(const auto& e : v)
+		{
+			h = cow_hash_combine(h, cow_hash_value(e));
+		}
+
+		return h;
+	}
+
+	std::unordered_multimap<size_t, std::shared_ptr<std::vector<T>>> m_table;
+	size_t m_purge_threshold;
+	uint64_t m_hits;
+};
+
+}
@@ -83,7 +83,7 @@ bool cycle_writer::setup(string base_file_name, int rollover_mb, int duration_se
 //  * NEWFILE - use a new file (inquiry with get_current_file_name())
 //  * DOQUIT - end the capture.
 //
-cycle_writer::conclusion cycle_writer::consider(sinsp_evt* evt) 
+cycle_writer::conclusion cycle_writer::consider(sinsp_evt* evt, int64_t dump_offset) 
 {
 	if(m_first_consider == false) 
 	{
@@ -123,7 +123,12 @@ cycle_writer::conclusion cycle_writer::consider(sinsp_evt* evt)
 		}
 	}
 
-	if(m_rollover_mb > 0 && scap_dump_get_offset(*m_dumper) > m_rollover_mb)
+	if(m_rollover_mb > 0 && dump_offset < 0)
+	{
+		dump_offset = scap_dump_get_offset(*m_dumper);
+	}
+
+	if(m_rollover_mb > 0 && dump_offset > m_rollover_mb)
 	{
 		m_last_reason = "Maximum File Size Reached";
 		return next_file();
@@ -80,8 +80,11 @@ public:
 	// thought so, and in the case of a new file,
 	// get_current_file_name() will tell us the new
 	// capture file name to use.
+	//
+	// dump_offset is the size of the current file, or -1 to
+	// get it from the dumper passed to setup().
 	// 
-	cycle_writer::conclusion consider(sinsp_evt* evt);
+	cycle_writer::conclusion consider(sinsp_evt* evt, int64_t dump_offset = -1);
 
 	//
 	// The yields the current file name 
@@ -147,7 +147,7 @@ void sinsp_dumper::dump(sinsp_evt* evt)
 
 	if(res != SCAP_SUCCESS)
 	{
-		throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
+		throw sinsp_exception(scap_dump_getlasterr(m_dumper));
 	}
 
 	m_nevts++;
@@ -194,3 +194,16 @@ void sinsp_dumper::flush()
 
 	scap_dump_flush(m_dumper);
 }
+
+void sinsp_dumper::enable_async(uint32_t buffer_size)
+{
+	if(m_dumper == NULL)
+	{
+		throw sinsp_exception("dumper not opened yet");
+	}
+
+	if(scap_dump_enable_async(m_dumper, buffer_size) == SCAP_FAILURE)
+	{
+		throw sinsp_exception("can't start the dump writer thread");
+	}
+}
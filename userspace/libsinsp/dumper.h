@@ -109,6 +109,13 @@ public:
 	*/
 	void flush();
 
+	/*!
+	  \brief Write the events from a background thread from now on, see
+	   scap_dump_enable_async(). Does nothing for memory dumps.
+	  \param buffer_size The size of the staging buffers, 0 for the default.
+	*/
+	void enable_async(uint32_t buffer_size = 0);
+
 	/*!
 	  \brief Writes an event to the file.
 
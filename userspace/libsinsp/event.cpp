@@ -68,6 +68,9 @@ sinsp_evt::sinsp_evt() :
 {
 	m_flags = EF_NONE;
 	m_tinfo = NULL;
+	m_decoded_params = NULL;
+	m_ndecoded_params = 0;
+	m_decoded_pevt = NULL;
 #ifdef _DEBUG
 	m_filtered_out = false;
 #endif
@@ -81,6 +84,9 @@ sinsp_evt::sinsp_evt(sinsp *inspector) :
 	m_inspector = inspector;
 	m_flags = EF_NONE;
 	m_tinfo = NULL;
+	m_decoded_params = NULL;
+	m_ndecoded_params = 0;
+	m_decoded_pevt = NULL;
 #ifdef _DEBUG
 	m_filtered_out = false;
 #endif
@@ -156,13 +162,16 @@ int64_t sinsp_evt::get_fd_num()
 
 uint32_t sinsp_evt::get_num_params()
 {
-	if((m_flags & sinsp_evt::SINSP_EF_PARAMS_LOADED) == 0)
+	//
+	// The count load_params() would end up with, without loading
+	// the parameters
+	//
+	if(m_decoded_pevt == m_pevt && m_decoded_params != NULL)
 	{
-		load_params();
-		m_flags |= (uint32_t)sinsp_evt::SINSP_EF_PARAMS_LOADED;
+		return m_ndecoded_params;
 	}
 
-	return (uint32_t)m_params.size();
+	return m_info->nparams < m_pevt->nparams ? m_info->nparams : m_pevt->nparams;
 }
 
 sinsp_evt_param *sinsp_evt::get_param(uint32_t id)
@@ -178,12 +187,6 @@ sinsp_evt_param *sinsp_evt::get_param(uint32_t id)
 
 const char *sinsp_evt::get_param_name(uint32_t id)
 {
-	if((m_flags & sinsp_evt::SINSP_EF_PARAMS_LOADED) == 0)
-	{
-		load_params();
-		m_flags |= (uint32_t)sinsp_evt::SINSP_EF_PARAMS_LOADED;
-	}
-
 	ASSERT(id < m_info->nparams);
 
 	return m_info->params[id].name;
@@ -191,12 +194,6 @@ const char *sinsp_evt::get_param_name(uint32_t id)
 
 const struct ppm_param_info* sinsp_evt::get_param_info(uint32_t id)
 {
-	if((m_flags & sinsp_evt::SINSP_EF_PARAMS_LOADED) == 0)
-	{
-		load_params();
-		m_flags |= (uint32_t)sinsp_evt::SINSP_EF_PARAMS_LOADED;
-	}
-
 	ASSERT(id < m_info->nparams);
 
 	return &(m_info->params[id]);
@@ -587,7 +584,7 @@ int sinsp_evt::render_fd_json(Json::Value *ret, int64_t fd, const char** resolve
 			//
 			// Make sure we remove invalid characters from the resolved name
 			//
-			string sanitized_str = fdinfo->m_name;
+			string sanitized_str = fdinfo->get_name();
 
 			sanitize_string(sanitized_str);
 
@@ -680,7 +677,7 @@ char* sinsp_evt::render_fd(int64_t fd, const char** resolved_str, sinsp_evt::par
 			//
 			// Make sure we remove invalid characters from the resolved name
 			//
-			string sanitized_str = fdinfo->m_name;
+			string sanitized_str = fdinfo->get_name();
 
 			sanitize_string(sanitized_str);
 
@@ -837,7 +834,7 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 			sinsp_threadinfo* atinfo = &*m_inspector->get_thread_ref(*(int64_t *)payload, false, true);
 			if(atinfo != NULL)
 			{
-				string& tcomm = atinfo->m_comm;
+				const string& tcomm = atinfo->m_comm;
 
 				//
 				// Make sure the string will fit
@@ -1556,7 +1553,7 @@ const char* sinsp_evt::get_param_as_str(uint32_t id, OUT const char** resolved_s
 			sinsp_threadinfo* atinfo = &*m_inspector->get_thread_ref(*(int64_t *)payload, false, true);
 			if(atinfo != NULL)
 			{
-				string& tcomm = atinfo->m_comm;
+				const string& tcomm = atinfo->m_comm;
 
 				//
 				// Make sure the string will fit
@@ -2757,6 +2754,9 @@ bool sinsp_evt::evtcpy(sinsp_evt& dest, const sinsp_evt& src)
 
 	// vectors
 	dest.m_params = src.m_params;
+	dest.m_decoded_params = NULL;
+	dest.m_ndecoded_params = 0;
+	dest.m_decoded_pevt = NULL;
 	dest.m_paramstr_storage = src.m_paramstr_storage;
 	dest.m_resolved_paramstr_storage = src.m_resolved_paramstr_storage;
 
@@ -17,6 +17,7 @@ limitations under the License.
 
 #pragma once
 #include <json/json.h>
+#include <cstring>
 
 #ifndef VISIBILITY_PRIVATE
 #define VISIBILITY_PRIVATE private:
@@ -27,6 +28,7 @@ limitations under the License.
 #include "scap.h"
 #include "gen_filter.h"
 #include "settings.h"
+#include "intrusive_ptr.h"
 
 typedef class sinsp sinsp;
 typedef class sinsp_threadinfo sinsp_threadinfo;
@@ -304,6 +306,64 @@ public:
 	*/
 	sinsp_evt_param* get_param(uint32_t id);
 
+	/*!
+	  \brief Get a parameter in raw format, without building the
+	   parameter table of the event.
+
+	  \param id The parameter number.
+
+	  \note The returned wrapper points into the event buffer, so it's
+	   only valid until the next event. Use it instead of get_param()
+	   on the hot paths that only need a few parameters.
+	*/
+	inline sinsp_evt_param get_param_view(uint32_t id)
+	{
+		sinsp_evt_param par;
+
+		if(m_decoded_pevt == m_pevt && m_decoded_params != NULL)
+		{
+			ASSERT(id < m_ndecoded_params);
+			return m_decoded_params[id];
+		}
+
+		ASSERT(id < m_info->nparams && id < m_pevt->nparams);
+
+		//
+		// Same layout walk as load_params(), stopping at the
+		// requested parameter
+		//
+		uint16_t *lens = (uint16_t *)((char *)m_pevt + sizeof(struct ppm_evt_hdr));
+		char *valptr = (char *)lens + m_pevt->nparams * sizeof(uint16_t);
+
+		for(uint32_t j = 0; j < id; j++)
+		{
+			valptr += lens[j];
+		}
+
+		par.init(valptr, lens[id]);
+		return par;
+	}
+
+	/*!
+	  \brief Get a fixed size parameter, e.g. a return value or an fd,
+	   by value.
+
+	  \param id The parameter number.
+
+	  \note Parameters shorter than T, which only come from malformed
+	   events, are zero extended.
+	*/
+	template<typename T>
+	inline T get_param_as(uint32_t id)
+	{
+		sinsp_evt_param par = get_param_view(id);
+		T ret = 0;
+
+		ASSERT(par.m_len == sizeof(T));
+		memcpy(&ret, par.m_val, par.m_len < sizeof(T)? par.m_len : sizeof(T));
+		return ret;
+	}
+
 	/*!
 	  \brief Get a parameter in raw format.
 
@@ -442,6 +502,12 @@ private:
 		uint32_t nparams;
 		sinsp_evt_param par;
 
+		if(m_decoded_pevt == m_pevt && m_decoded_params != NULL)
+		{
+			m_params.assign(m_decoded_params, m_decoded_params + m_ndecoded_params);
+			return;
+		}
+
 		// If we're reading a capture created with a newer version, it may contain
 		// new parameters. If instead we're reading an older version, the current
 		// event table entry may contain new parameters.
@@ -486,12 +552,18 @@ VISIBILITY_PRIVATE
 	const struct ppm_event_info* m_info;
 	std::vector<sinsp_evt_param> m_params;
 
+	// Parameter table decoded ahead of time by the pipeline readers.
+	// Only used while m_pevt still points to m_decoded_pevt.
+	const sinsp_evt_param* m_decoded_params;
+	uint32_t m_ndecoded_params;
+	const scap_evt* m_decoded_pevt;
+
 	std::vector<char> m_paramstr_storage;
 	std::vector<char> m_resolved_paramstr_storage;
 
 	// reference to keep threadinfo alive. currently only used for synthetic container event thread info
 	// it should either be null, or point to the same place as m_tinfo
-	std::shared_ptr<sinsp_threadinfo> m_tinfo_ref;
+	libsinsp::intrusive_ptr<sinsp_threadinfo> m_tinfo_ref;
 	sinsp_threadinfo* m_tinfo;
 	sinsp_fdinfo_t* m_fdinfo;
 
@@ -0,0 +1,548 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//
+// Replays the fd table operations of a capture file, or of a synthetic
+// socket-heavy workload, against sinsp_fdtable and against the
+// std::unordered_map based table it replaced. Each implementation runs in
+// its own process so that the RSS numbers don't influence each other.
+//
+
+#include <iostream>
+#include <set>
+#include <unordered_set>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sinsp.h>
+#include "../../libscap/examples/bench_util.h"
+
+using namespace std;
+
+enum fd_op_type
+{
+	FD_OP_FIND = 0,
+	FD_OP_ADD = 1,
+	FD_OP_ERASE = 2,
+};
+
+struct fd_op
+{
+	uint32_t m_table;
+	uint32_t m_type;
+	int64_t m_fd;
+};
+
+//
+// The fd table as it was before the switch to libsinsp::fd_map
+//
+class unordered_fdtable
+{
+public:
+	unordered_fdtable(sinsp* inspector): m_inspector(inspector), m_last_accessed_fd(-1), m_last_accessed_fdinfo(NULL)
+	{
+	}
+
+	sinsp_fdinfo_t* find(int64_t fd)
+	{
+		if(m_last_accessed_fd != -1 && fd == m_last_accessed_fd)
+		{
+			return m_last_accessed_fdinfo;
+		}
+
+		unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit = m_table.find(fd);
+		if(fdit == m_table.end())
+		{
+			return NULL;
+		}
+
+		m_last_accessed_fd = fd;
+		m_last_accessed_fdinfo = &(fdit->second);
+		lookup_device(&(fdit->second));
+		return &(fdit->second);
+	}
+
+	sinsp_fdinfo_t* add(int64_t fd, sinsp_fdinfo_t* fdinfo)
+	{
+		unordered_map<int64_t, sinsp_fdinfo_t>::iterator it = m_table.find(fd);
+
+		if(it == m_table.end())
+		{
+			if(m_table.size() >= MAX_FD_TABLE_SIZE)
+			{
+				return NULL;
+			}
+
+			m_last_accessed_fd = -1;
+			return &(m_table.emplace(fd, *fdinfo).first->second);
+		}
+
+		it->second.copy(*fdinfo, true);
+		return &(it->second);
+	}
+
+	void erase(int64_t fd)
+	{
+		if(fd == m_last_accessed_fd)
+		{
+			m_last_accessed_fd = -1;
+		}
+
+		m_table.erase(fd);
+	}
+
+	//
+	// Same checks as sinsp_fdtable::lookup_device(). None of the fds
+	// here are files, so it never goes further.
+	//
+	bool lookup_device(sinsp_fdinfo_t* fdi)
+	{
+		return !m_inspector->is_capture() && fdi->is_file() && fdi->get_device() == 0;
+	}
+
+	sinsp* m_inspector;
+	unordered_map<int64_t, sinsp_fdinfo_t> m_table;
+	int64_t m_last_accessed_fd;
+	sinsp_fdinfo_t* m_last_accessed_fdinfo;
+};
+
+static sinsp* g_inspector;
+
+static unordered_fdtable* new_table(unordered_fdtable*)
+{
+	return new unordered_fdtable(g_inspector);
+}
+
+static sinsp_fdtable* new_table(sinsp_fdtable*)
+{
+	return new sinsp_fdtable(g_inspector);
+}
+
+//
+// Turns the events of a capture into fd table operations. The fds that
+// are used before being created are the ones found in /proc when the
+// capture started, so they are added first.
+//
+class op_recorder
+{
+public:
+	op_recorder(vector<fd_op>* ops): m_ops(ops)
+	{
+	}
+
+	uint32_t ntables() const
+	{
+		return (uint32_t)m_live.size();
+	}
+
+	void push(int64_t pid, uint32_t type, int64_t fd)
+	{
+		uint32_t table;
+		unordered_map<int64_t, uint32_t>::iterator it = m_tables.find(pid);
+
+		if(it == m_tables.end())
+		{
+			table = (uint32_t)m_live.size();
+			m_tables[pid] = table;
+			m_live.push_back(unordered_set<int64_t>());
+		}
+		else
+		{
+			table = it->second;
+		}
+
+		unordered_set<int64_t>& live = m_live[table];
+
+		if(type == FD_OP_FIND && live.find(fd) == live.end())
+		{
+			add(table, FD_OP_ADD, fd);
+			live.insert(fd);
+		}
+		else if(type == FD_OP_ADD)
+		{
+			live.insert(fd);
+		}
+		else if(type == FD_OP_ERASE)
+		{
+			if(live.erase(fd) == 0)
+			{
+				return;
+			}
+		}
+
+		add(table, type, fd);
+	}
+
+private:
+	void add(uint32_t table, uint32_t type, int64_t fd)
+	{
+		fd_op op;
+		op.m_table = table;
+		op.m_type = type;
+		op.m_fd = fd;
+		m_ops->push_back(op);
+	}
+
+	vector<fd_op>* m_ops;
+	unordered_map<int64_t, uint32_t> m_tables;
+	vector<unordered_set<int64_t>> m_live;
+};
+
+static int64_t fd_param(sinsp_evt* evt)
+{
+	sinsp_evt_param* p = evt->get_param(0);
+
+	if(p->m_len == sizeof(int64_t))
+	{
+		int64_t fd;
+		memcpy(&fd, p->m_val, sizeof(fd));
+		return fd;
+	}
+	else if(p->m_len == sizeof(int32_t))
+	{
+		int32_t fd;
+		memcpy(&fd, p->m_val, sizeof(fd));
+		return fd;
+	}
+
+	return -1;
+}
+
+static uint32_t record_file(const string& filename, vector<fd_op>* ops)
+{
+	sinsp inspector;
+	op_recorder rec(ops);
+	sinsp_evt* evt;
+
+	inspector.open(filename);
+
+	while(true)
+	{
+		int32_t res = inspector.next(&evt);
+
+		if(res == SCAP_EOF)
+		{
+			break;
+		}
+		else if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			throw sinsp_exception(inspector.getlasterr());
+		}
+
+		sinsp_threadinfo* tinfo = evt->get_thread_info();
+		if(tinfo == NULL || evt->get_num_params() == 0)
+		{
+			continue;
+		}
+
+		ppm_event_flags flags = evt->get_info_flags();
+		int64_t fd;
+
+		if((flags & EF_CREATES_FD) && evt->get_direction() == SCAP_ED_OUT)
+		{
+			if((fd = fd_param(evt)) >= 0)
+			{
+				rec.push(tinfo->m_pid, FD_OP_ADD, fd);
+			}
+		}
+		else if((flags & EF_DESTROYS_FD) && evt->get_direction() == SCAP_ED_IN)
+		{
+			if((fd = fd_param(evt)) >= 0)
+			{
+				rec.push(tinfo->m_pid, FD_OP_ERASE, fd);
+			}
+		}
+		else if(flags & EF_USES_FD)
+		{
+			if((fd = evt->get_fd_num()) != sinsp_evt::INVALID_FD_NUM)
+			{
+				rec.push(tinfo->m_pid, FD_OP_FIND, fd);
+			}
+		}
+	}
+
+	inspector.close();
+	return rec.ntables();
+}
+
+//
+// Every tenth process is a server that keeps up to nconns connections
+// open, the others keep a handful. New fds get the lowest free number,
+// like in the kernel.
+//
+static uint32_t record_synthetic(uint32_t nprocs, uint32_t nconns, uint64_t nops, vector<fd_op>* ops)
+{
+	op_recorder rec(ops);
+	vector<set<int64_t>> free_fds(nprocs);
+	vector<int64_t> next_fd(nprocs, 10);
+	vector<vector<int64_t>> open_fds(nprocs);
+	uint64_t state = 1;
+
+	for(uint32_t j = 0; j < nprocs; j++)
+	{
+		for(int64_t fd = 0; fd < 10; fd++)
+		{
+			rec.push(j, FD_OP_ADD, fd);
+		}
+	}
+
+	while(ops->size() < nops)
+	{
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		uint32_t proc = (uint32_t)((state >> 33) % nprocs);
+		uint32_t target = (proc % 10 == 0)? nconns : 8;
+		vector<int64_t>& open = open_fds[proc];
+
+		if(open.size() < target && ((state >> 20) & 3) != 0)
+		{
+			int64_t fd;
+			if(free_fds[proc].empty())
+			{
+				fd = next_fd[proc]++;
+			}
+			else
+			{
+				fd = *free_fds[proc].begin();
+				free_fds[proc].erase(free_fds[proc].begin());
+			}
+
+			rec.push(proc, FD_OP_ADD, fd);
+			open.push_back(fd);
+		}
+		else if(!open.empty())
+		{
+			uint32_t idx = (uint32_t)((state >> 40) % open.size());
+			int64_t fd = open[idx];
+
+			// A few reads and writes on the connection, then close it
+			for(uint32_t k = 0; k < 6; k++)
+			{
+				rec.push(proc, FD_OP_FIND, fd);
+				rec.push(proc, FD_OP_FIND, (int64_t)(k & 1));
+			}
+
+			rec.push(proc, FD_OP_ERASE, fd);
+			open[idx] = open.back();
+			open.pop_back();
+			free_fds[proc].insert(fd);
+		}
+	}
+
+	return rec.ntables();
+}
+
+template<class T>
+static void run(const char* name, const vector<fd_op>& ops, uint32_t ntables)
+{
+	vector<T*> tables(ntables);
+	vector<pair<uint32_t, int64_t>> live;
+	sinsp_fdinfo_t proto;
+	uint64_t counts[3] = {0, 0, 0};
+	uint64_t nfound = 0;
+	uint64_t rss_start = rss_bytes();
+
+	proto.m_type = SCAP_FD_IPV4_SOCK;
+	proto.m_name = "10.0.0.1:43210->10.0.0.2:8080";
+
+	for(uint32_t j = 0; j < ntables; j++)
+	{
+		tables[j] = new_table((T*)NULL);
+	}
+
+	uint64_t start = ns_now();
+	for(size_t j = 0; j < ops.size(); j++)
+	{
+		const fd_op& op = ops[j];
+
+		switch(op.m_type)
+		{
+		case FD_OP_FIND:
+			nfound += (tables[op.m_table]->find(op.m_fd) != NULL);
+			break;
+		case FD_OP_ADD:
+			tables[op.m_table]->add(op.m_fd, &proto);
+			break;
+		case FD_OP_ERASE:
+			tables[op.m_table]->erase(op.m_fd);
+			break;
+		}
+
+		counts[op.m_type]++;
+	}
+	uint64_t replay = ns_now() - start;
+	uint64_t rss = rss_bytes() - rss_start;
+
+	//
+	// Then time each operation on its own: look up all the fds that are
+	// still open, and move them to a new set of tables
+	//
+	for(uint32_t j = 0; j < ntables; j++)
+	{
+		for(auto it = tables[j]->m_table.begin(); it != tables[j]->m_table.end(); ++it)
+		{
+			live.push_back(make_pair(j, it->first));
+		}
+	}
+
+	start = ns_now();
+	for(uint32_t r = 0; r < 10; r++)
+	{
+		for(size_t j = 0; j < live.size(); j++)
+		{
+			nfound += (tables[live[j].first]->find(live[j].second) != NULL);
+		}
+	}
+	uint64_t find = ns_now() - start;
+
+	start = ns_now();
+	for(size_t j = 0; j < live.size(); j++)
+	{
+		tables[live[j].first]->erase(live[j].second);
+	}
+	uint64_t erase = ns_now() - start;
+
+	start = ns_now();
+	for(size_t j = 0; j < live.size(); j++)
+	{
+		tables[live[j].first]->add(live[j].second, &proto);
+	}
+	uint64_t add = ns_now() - start;
+
+	printf("%-10s replay: %" PRIu64 " find, %" PRIu64 " add, %" PRIu64 " erase, %.1f ns/op, %.1f MB of tables\n",
+	       name, counts[FD_OP_FIND], counts[FD_OP_ADD], counts[FD_OP_ERASE],
+	       (double)replay / ops.size(), (double)rss / (1024 * 1024));
+
+	if(!live.empty())
+	{
+		printf("%-10s %zu fds: find %.1f ns, erase %.1f ns, add %.1f ns (%" PRIu64 " found)\n",
+		       name, live.size(),
+		       (double)find / (live.size() * 10),
+		       (double)erase / live.size(),
+		       (double)add / live.size(),
+		       nfound);
+	}
+
+	for(uint32_t j = 0; j < ntables; j++)
+	{
+		delete tables[j];
+	}
+}
+
+template<class T>
+static int run_isolated(const char* name, const vector<fd_op>& ops, uint32_t ntables)
+{
+	int status;
+
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if(pid < 0)
+	{
+		perror("fork");
+		return -1;
+	}
+	else if(pid == 0)
+	{
+		run<T>(name, ops, ntables);
+		fflush(stdout);
+		_exit(0);
+	}
+
+	if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		fprintf(stderr, "%s: benchmark failed\n", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [-r capture file] [-p processes] [-c connections per server] [-n operations]\n", prog);
+}
+
+int main(int argc, char** argv)
+{
+	string filename;
+	uint32_t nprocs = 1000;
+	uint32_t nconns = 2000;
+	uint64_t nops = 20000000;
+	vector<fd_op> ops;
+	uint32_t ntables;
+	int op;
+
+	while((op = getopt(argc, argv, "r:p:c:n:h")) != -1)
+	{
+		switch(op)
+		{
+		case 'r':
+			filename = optarg;
+			break;
+		case 'p':
+			nprocs = atoi(optarg);
+			break;
+		case 'c':
+			nconns = atoi(optarg);
+			break;
+		case 'n':
+			nops = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if(nprocs == 0)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	try
+	{
+		if(!filename.empty())
+		{
+			ntables = record_file(filename, &ops);
+		}
+		else
+		{
+			ntables = record_synthetic(nprocs, nconns, nops, &ops);
+		}
+
+		sinsp inspector;
+		g_inspector = &inspector;
+
+		if(run_isolated<unordered_fdtable>("unordered", ops, ntables) != 0 ||
+		   run_isolated<sinsp_fdtable>("fdtable", ops, ntables) != 0)
+		{
+			return -1;
+		}
+	}
+	catch(const sinsp_exception& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,321 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//
+// Runs a set of Falco-like rules on every event of a capture file, or of a
+// synthetic stream of open/read/close events, once walking the expression
+// trees and once running the compiled programs. Reports the events/sec of
+// filter evaluation alone for both, and checks that they agree.
+//
+
+#include <iostream>
+#include <memory>
+#include <getopt.h>
+#include <time.h>
+#include <sinsp.h>
+#include <filter.h>
+#include "../../libscap/examples/bench_util.h"
+
+using namespace std;
+
+static const char* rules[] = {
+	"evt.type in (open, openat) and evt.dir=< and fd.typechar=f and fd.name startswith /etc and not proc.name in (sshd, sudo, passwd, systemd)",
+	"evt.type = execve and evt.dir=< and proc.name in (bash, sh, zsh, dash) and proc.pname in (nginx, apache2, httpd, java)",
+	"evt.type = connect and evt.dir=< and fd.sport in (4444, 1337, 31337)",
+	"container.id != host and proc.name = bash and evt.type = execve",
+	"evt.type in (unlink, unlinkat, rename, renameat) and fd.name contains /var/log",
+	"(evt.type = write or evt.type = read) and evt.dir=< and evt.rawres > 1048576",
+	"evt.type = execve and evt.dir=< and proc.exe endswith /nc",
+	"evt.type = setuid and evt.dir=> and user.name != root",
+	"evt.type = open and evt.rawres < 0 and fd.name glob /proc/*/mem",
+	"evt.type = ptrace and not proc.name in (systemd, dockerd, containerd, gdb, strace)",
+	"proc.name icontains miner or proc.args contains stratum+tcp",
+	"evt.type = close and proc.pid = 1 and evt.rawres != 0",
+};
+
+static const uint32_t nrules = sizeof(rules) / sizeof(rules[0]);
+
+class rule_set
+{
+public:
+	rule_set(sinsp* inspector, bool bytecode):
+		m_ns(0),
+		m_nmatches(0)
+	{
+		for(uint32_t j = 0; j < nrules; j++)
+		{
+			sinsp_filter_compiler compiler(inspector, rules[j]);
+			compiler.set_bytecode(bytecode);
+			m_filters.push_back(unique_ptr<sinsp_filter>(compiler.compile()));
+		}
+	}
+
+	//
+	// Returns a bitmap of the matching rules
+	//
+	uint64_t run(sinsp_evt* evt)
+	{
+		uint64_t res = 0;
+		uint64_t start = ns_now();
+
+		for(uint32_t j = 0; j < m_filters.size(); j++)
+		{
+			if(m_filters[j]->run(evt))
+			{
+				res |= (1ULL << j);
+			}
+		}
+
+		m_ns += ns_now() - start;
+		m_nmatches += __builtin_popcountll(res);
+		return res;
+	}
+
+	vector<unique_ptr<sinsp_filter>> m_filters;
+	uint64_t m_ns;
+	uint64_t m_nmatches;
+};
+
+static void report(const char* name, rule_set& rs, uint64_t nevents)
+{
+	double secs = (double)rs.m_ns / 1000000000;
+
+	printf("%-8s %" PRIu64 " events, %u rules: %.2f M events/sec, %.1f ns/event, %" PRIu64 " matches\n",
+	       name, nevents, nrules,
+	       secs > 0? nevents / secs / 1000000 : 0,
+	       nevents? (double)rs.m_ns / nevents : 0,
+	       rs.m_nmatches);
+}
+
+static bool run_both(rule_set& tree, rule_set& vm, sinsp_evt* evt, uint64_t nevents)
+{
+	//
+	// Alternate which one goes first, so that neither always gets the
+	// caches warmed by the other
+	//
+	uint64_t tres;
+	uint64_t vres;
+
+	if(nevents & 1)
+	{
+		tres = tree.run(evt);
+		vres = vm.run(evt);
+	}
+	else
+	{
+		vres = vm.run(evt);
+		tres = tree.run(evt);
+	}
+
+	if(tres != vres)
+	{
+		fprintf(stderr, "mismatch on event %" PRIu64 ": tree %" PRIx64 ", bytecode %" PRIx64 "\n",
+			nevents, tres, vres);
+		return false;
+	}
+
+	return true;
+}
+
+static int run_file(const string& filename)
+{
+	sinsp inspector;
+	sinsp_evt* evt;
+	uint64_t nevents = 0;
+
+	inspector.open(filename);
+
+	rule_set tree(&inspector, false);
+	rule_set vm(&inspector, true);
+
+	while(true)
+	{
+		int32_t res = inspector.next(&evt);
+
+		if(res == SCAP_EOF)
+		{
+			break;
+		}
+		else if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			throw sinsp_exception(inspector.getlasterr());
+		}
+
+		if(!run_both(tree, vm, evt, nevents++))
+		{
+			return -1;
+		}
+	}
+
+	inspector.close();
+
+	report("tree", tree, nevents);
+	report("bytecode", vm, nevents);
+	return 0;
+}
+
+static void add_param(vector<uint8_t>& params, vector<uint16_t>& lens, const void* val, uint16_t len)
+{
+	params.insert(params.end(), (const uint8_t*)val, (const uint8_t*)val + len);
+	lens.push_back(len);
+}
+
+static vector<uint8_t> make_event(uint16_t type, uint64_t tid, const vector<uint8_t>& params, const vector<uint16_t>& lens)
+{
+	vector<uint8_t> buf(sizeof(scap_evt) + lens.size() * sizeof(uint16_t) + params.size());
+	scap_evt* hdr = (scap_evt*)&buf[0];
+
+	hdr->ts = 0;
+	hdr->tid = tid;
+	hdr->len = (uint32_t)buf.size();
+	hdr->type = type;
+	hdr->nparams = (uint32_t)lens.size();
+	memcpy(&buf[sizeof(scap_evt)], &lens[0], lens.size() * sizeof(uint16_t));
+	memcpy(&buf[sizeof(scap_evt) + lens.size() * sizeof(uint16_t)], &params[0], params.size());
+
+	return buf;
+}
+
+static int run_synthetic(uint64_t nevents)
+{
+	static const char* programs[] = {"nginx", "java", "bash", "postgres", "sshd", "python3", "node", "systemd"};
+	static const char* paths[] = {"/etc/passwd", "/var/log/syslog", "/usr/lib/libc.so.6", "/proc/1/mem", "/tmp/x"};
+	const uint32_t nprograms = sizeof(programs) / sizeof(programs[0]);
+	const uint32_t npaths = sizeof(paths) / sizeof(paths[0]);
+	sinsp inspector;
+	vector<vector<uint8_t>> events;
+
+	for(uint32_t j = 0; j < nprograms; j++)
+	{
+		sinsp_threadinfo* tinfo = inspector.build_threadinfo();
+		tinfo->m_tid = 100 + j;
+		tinfo->m_pid = 100 + j;
+		tinfo->m_ptid = 1;
+		tinfo->m_comm = programs[j];
+		tinfo->m_exe = programs[j];
+		tinfo->m_exepath = string("/usr/bin/") + programs[j];
+		tinfo->m_args.push_back("--config");
+		tinfo->m_args.push_back("/etc/app.conf");
+		inspector.add_thread(tinfo);
+	}
+
+	for(uint32_t j = 0; j < 256; j++)
+	{
+		vector<uint8_t> params;
+		vector<uint16_t> lens;
+		uint64_t tid = 100 + j % nprograms;
+
+		switch(j % 3)
+		{
+		case 0:
+			{
+				int64_t fd = (j % 7 == 0)? -2 : 3;
+				uint32_t flags = 1;
+				uint32_t mode = 0644;
+				uint32_t dev = 0;
+				const char* name = paths[j % npaths];
+				add_param(params, lens, &fd, sizeof(fd));
+				add_param(params, lens, name, (uint16_t)strlen(name) + 1);
+				add_param(params, lens, &flags, sizeof(flags));
+				add_param(params, lens, &mode, sizeof(mode));
+				add_param(params, lens, &dev, sizeof(dev));
+				events.push_back(make_event(PPME_SYSCALL_OPEN_X, tid, params, lens));
+			}
+			break;
+		case 1:
+			{
+				int64_t res = 4096 * (j % 5);
+				char data[16] = "0123456789abcde";
+				add_param(params, lens, &res, sizeof(res));
+				add_param(params, lens, data, sizeof(data));
+				events.push_back(make_event(PPME_SYSCALL_READ_X, tid, params, lens));
+			}
+			break;
+		default:
+			{
+				int64_t res = (j % 11 == 0)? -9 : 0;
+				add_param(params, lens, &res, sizeof(res));
+				events.push_back(make_event(PPME_SYSCALL_CLOSE_X, tid, params, lens));
+			}
+			break;
+		}
+	}
+
+	rule_set tree(&inspector, false);
+	rule_set vm(&inspector, true);
+	sinsp_evt evt(&inspector);
+
+	for(uint64_t j = 0; j < nevents; j++)
+	{
+		evt.init(&events[j % events.size()][0], 0);
+
+		if(!run_both(tree, vm, &evt, j))
+		{
+			return -1;
+		}
+	}
+
+	report("tree", tree, nevents);
+	report("bytecode", vm, nevents);
+	return 0;
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [-r capture file] [-n synthetic events]\n", prog);
+}
+
+int main(int argc, char** argv)
+{
+	string filename;
+	uint64_t nevents = 1000000;
+	int op;
+
+	while((op = getopt(argc, argv, "r:n:h")) != -1)
+	{
+		switch(op)
+		{
+		case 'r':
+			filename = optarg;
+			break;
+		case 'n':
+			nevents = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	try
+	{
+		if(!filename.empty())
+		{
+			return run_file(filename);
+		}
+
+		return run_synthetic(nevents);
+	}
+	catch(const sinsp_exception& e)
+	{
+		cerr << e.what() << endl;
+		return -1;
+	}
+}
@@ -0,0 +1,337 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//
+// Measures what interning comm/exe/exepath/container id buys on a thread
+// table where many threads run the same few programs:
+//  - heap bytes per thread for the strings, interned vs one std::string
+//    copy per thread as they were stored before
+//  - proc.name = x and proc.exe in (...): the old extract-into-a-string
+//    plus strcmp/hash set lookup vs the interned entry compare, and the
+//    whole filter evaluation end to end for reference
+//
+
+#include <iostream>
+#include <algorithm>
+#include <unordered_set>
+#include <new>
+#include <getopt.h>
+#include <time.h>
+
+#define VISIBILITY_PRIVATE public:
+#include <sinsp.h>
+#include <filter.h>
+#include <filter_value.h>
+#include "../../libscap/examples/bench_util.h"
+
+using namespace std;
+
+static uint64_t g_nbytes = 0;
+
+void* operator new(size_t size)
+{
+	void* p = malloc(size? size : 1);
+	if(p == NULL)
+	{
+		throw std::bad_alloc();
+	}
+
+	g_nbytes += size;
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+static const char* programs[][2] = {
+	{"nginx", "/usr/sbin/nginx"},
+	{"java", "/usr/lib/jvm/java-11-openjdk-amd64/bin/java"},
+	{"python3", "/usr/bin/python3.8"},
+	{"node", "/usr/local/lib/nodejs/node-v14.17.0-linux-x64/bin/node"},
+	{"php-fpm7.4", "/usr/sbin/php-fpm7.4"},
+	{"postgres", "/usr/lib/postgresql/12/bin/postgres"},
+	{"redis-server", "/usr/local/bin/redis-server"},
+	{"containerd-shim", "/usr/bin/containerd-shim-runc-v2"},
+	{"kubelet", "/usr/local/bin/kubelet"},
+	{"bash", "/bin/bash"},
+	{"sshd", "/usr/sbin/sshd"},
+	{"dockerd", "/usr/bin/dockerd"},
+};
+
+static const uint32_t nprograms = sizeof(programs) / sizeof(programs[0]);
+
+struct thread_strings
+{
+	char comm[16];
+	char exe[256];
+	char exepath[256];
+	char container_id[16];
+};
+
+//
+// What the thread table used to keep for these fields
+//
+struct legacy_thread
+{
+	string m_comm;
+	string m_exe;
+	string m_exepath;
+	string m_container_id;
+};
+
+static void make_strings(uint32_t j, uint32_t ncontainers, thread_strings* s)
+{
+	uint32_t prog = j % nprograms;
+
+	snprintf(s->comm, sizeof(s->comm), "%s", programs[prog][0]);
+	snprintf(s->exe, sizeof(s->exe), "%s: worker process", programs[prog][1]);
+	snprintf(s->exepath, sizeof(s->exepath), "%s", programs[prog][1]);
+	snprintf(s->container_id, sizeof(s->container_id), "%012x", (j / nprograms) % ncontainers + 0xabc000);
+}
+
+static void bench_memory(uint32_t nthreads, uint32_t ncontainers)
+{
+	thread_strings s;
+	vector<legacy_thread> legacy(nthreads);
+	uint64_t before = g_nbytes;
+
+	for(uint32_t j = 0; j < nthreads; j++)
+	{
+		make_strings(j, ncontainers, &s);
+		legacy[j].m_comm = s.comm;
+		legacy[j].m_exe = s.exe;
+		legacy[j].m_exepath = s.exepath;
+		legacy[j].m_container_id = s.container_id;
+	}
+
+	uint64_t legacy_bytes = g_nbytes - before;
+
+	sinsp inspector;
+	before = g_nbytes;
+
+	for(uint32_t j = 0; j < nthreads; j++)
+	{
+		make_strings(j, ncontainers, &s);
+		sinsp_threadinfo* tinfo = inspector.build_threadinfo();
+		tinfo->m_tid = 1000 + j;
+		tinfo->m_pid = 1000 + j;
+		tinfo->m_comm = s.comm;
+		tinfo->m_exe = s.exe;
+		tinfo->m_exepath = s.exepath;
+		tinfo->m_container_id = s.container_id;
+		inspector.add_thread(tinfo);
+	}
+
+	uint64_t table_bytes = g_nbytes - before;
+
+	printf("%u threads, %u distinct strings in the intern table\n",
+	       nthreads, (uint32_t)libsinsp::interned_string::table_size());
+	printf("string fields: %zu bytes/thread inline before, %zu after\n",
+	       sizeof(legacy_thread), 4 * sizeof(libsinsp::interned_string));
+	printf("string fields: %.1f heap bytes/thread before\n",
+	       (double)legacy_bytes / nthreads);
+	printf("whole thread table: %.1f heap bytes/thread (sizeof(sinsp_threadinfo) = %zu)\n",
+	       (double)table_bytes / nthreads, sizeof(sinsp_threadinfo));
+}
+
+static void report(const char* name, uint64_t ns, uint64_t nevals, uint64_t nmatches)
+{
+	printf("%-40s %6.1f ns/eval, %" PRIu64 " matches\n",
+	       name, nevals? (double)ns / nevals : 0, nmatches);
+}
+
+static void bench_filter(uint32_t nthreads, uint64_t nevals)
+{
+	sinsp inspector;
+	vector<sinsp_threadinfo*> threads;
+	vector<legacy_thread> legacy(nthreads);
+	thread_strings s;
+
+	for(uint32_t j = 0; j < nthreads; j++)
+	{
+		make_strings(j, 16, &s);
+		sinsp_threadinfo* tinfo = inspector.build_threadinfo();
+		tinfo->m_tid = 1000 + j;
+		tinfo->m_pid = 1000 + j;
+		tinfo->m_comm = s.comm;
+		tinfo->m_exe = s.exe;
+		tinfo->m_exepath = s.exepath;
+		inspector.add_thread(tinfo);
+		threads.push_back(tinfo);
+
+		legacy[j].m_comm = s.comm;
+		legacy[j].m_exe = s.exe;
+		legacy[j].m_exepath = s.exepath;
+	}
+
+	const char* eq_value = "postgres";
+	string in_values[] = {
+		"/usr/sbin/nginx: worker process",
+		"/usr/bin/python3.8: worker process",
+		"/bin/sh",
+		"/bin/dash",
+		"/usr/bin/zsh",
+		"/bin/bash: worker process",
+	};
+
+	sinsp_filter_compiler eq_compiler(&inspector, string("proc.name=") + eq_value);
+	sinsp_filter* eq_filter = eq_compiler.compile();
+
+	string in_str = "proc.exe in (";
+	for(uint32_t j = 0; j < sizeof(in_values) / sizeof(in_values[0]); j++)
+	{
+		in_str += (j? ", '" : "'") + in_values[j] + "'";
+	}
+	in_str += ")";
+	sinsp_filter_compiler in_compiler(&inspector, in_str);
+	sinsp_filter* in_filter = in_compiler.compile();
+
+	unordered_set<filter_value_t, g_hash_membuf, g_equal_to_membuf> in_set;
+	for(uint32_t j = 0; j < sizeof(in_values) / sizeof(in_values[0]); j++)
+	{
+		in_set.insert(filter_value_t((uint8_t*)in_values[j].c_str(), in_values[j].size()));
+	}
+
+	sinsp_evt evt;
+	evt.m_inspector = &inspector;
+	string tstr;
+	uint64_t nmatches;
+	uint64_t start;
+
+	//
+	// Old path: proc.name/proc.exe were extracted by copying into the
+	// filtercheck's string, then compared by value
+	//
+	nmatches = 0;
+	start = ns_now();
+	for(uint64_t j = 0; j < nevals; j++)
+	{
+		tstr = legacy[j % nthreads].m_comm;
+		nmatches += (strcmp(tstr.c_str(), eq_value) == 0);
+	}
+	report("proc.name = x, copy + strcmp (before)", ns_now() - start, nevals, nmatches);
+
+	libsinsp::interned_string eq_interned(eq_value);
+	nmatches = 0;
+	start = ns_now();
+	for(uint64_t j = 0; j < nevals; j++)
+	{
+		nmatches += (threads[j % nthreads]->m_comm == eq_interned);
+	}
+	report("proc.name = x, interned (after)", ns_now() - start, nevals, nmatches);
+
+	nmatches = 0;
+	start = ns_now();
+	for(uint64_t j = 0; j < nevals; j++)
+	{
+		evt.m_tinfo = threads[j % nthreads];
+		nmatches += eq_filter->run(&evt);
+	}
+	report("proc.name = x, whole filter", ns_now() - start, nevals, nmatches);
+
+	nmatches = 0;
+	start = ns_now();
+	for(uint64_t j = 0; j < nevals; j++)
+	{
+		tstr = legacy[j % nthreads].m_exe;
+		filter_value_t item((uint8_t*)tstr.c_str(), tstr.size());
+		nmatches += (in_set.find(item) != in_set.end());
+	}
+	report("proc.exe in (...), copy + lookup (before)", ns_now() - start, nevals, nmatches);
+
+	vector<const void*> in_ids;
+	vector<libsinsp::interned_string> in_interned;
+	for(uint32_t j = 0; j < sizeof(in_values) / sizeof(in_values[0]); j++)
+	{
+		in_interned.push_back(libsinsp::interned_string(in_values[j]));
+		in_ids.push_back(in_interned.back().id());
+	}
+	sort(in_ids.begin(), in_ids.end());
+
+	nmatches = 0;
+	start = ns_now();
+	for(uint64_t j = 0; j < nevals; j++)
+	{
+		nmatches += binary_search(in_ids.begin(), in_ids.end(), threads[j % nthreads]->m_exe.id());
+	}
+	report("proc.exe in (...), interned (after)", ns_now() - start, nevals, nmatches);
+
+	nmatches = 0;
+	start = ns_now();
+	for(uint64_t j = 0; j < nevals; j++)
+	{
+		evt.m_tinfo = threads[j % nthreads];
+		nmatches += in_filter->run(&evt);
+	}
+	report("proc.exe in (...), whole filter", ns_now() - start, nevals, nmatches);
+
+	evt.m_tinfo = NULL;
+	delete eq_filter;
+	delete in_filter;
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-c containers] [-n filter evaluations]\n", prog);
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t nthreads = 20000;
+	uint32_t ncontainers = 50;
+	uint64_t nevals = 10000000;
+	int op;
+
+	while((op = getopt(argc, argv, "t:c:n:h")) != -1)
+	{
+		switch(op)
+		{
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'c':
+			ncontainers = atoi(optarg);
+			break;
+		case 'n':
+			nevals = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if(nthreads == 0 || ncontainers == 0)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	try
+	{
+		bench_memory(nthreads, ncontainers);
+		bench_filter(nthreads, nevals);
+	}
+	catch(const sinsp_exception& e)
+	{
+		cerr << e.what() << endl;
+		return -1;
+	}
+
+	return 0;
+}
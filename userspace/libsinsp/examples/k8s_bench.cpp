@@ -0,0 +1,281 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//
+// Replays a k8s watch stream through k8s_dispatcher::extract_data() and
+// reports the events/sec. With -f, the stream is read from a file, one
+// watch event JSON per line, as recorded from the API server or written
+// by -o. Without it, a synthetic stream adds, modifies and deletes the
+// given number of pods, each phase timed on its own, and the state is
+// checked after each phase.
+//
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <random>
+#include <map>
+#include <memory>
+#include <getopt.h>
+#include <time.h>
+#include <sinsp.h>
+#include "k8s_dispatcher.h"
+#include "../../libscap/examples/bench_util.h"
+
+using namespace std;
+
+static string pod_name(uint32_t j)
+{
+	return "bench-" + to_string(j);
+}
+
+static string pod_namespace(uint32_t j, uint32_t nnamespaces)
+{
+	return "ns-" + to_string(j % nnamespaces);
+}
+
+static string pod_uid(uint32_t j)
+{
+	char uid[64];
+	snprintf(uid, sizeof(uid), "%08x-0000-4000-8000-%012x", j, j);
+	return uid;
+}
+
+//
+// A pod watch event, in the shape the dispatcher reads: metadata as sent by
+// the API server, the pod fields it extracts at the top of the object
+//
+static string pod_event(const char* type, uint32_t j, uint32_t nnamespaces, uint32_t restarts)
+{
+	char container_id[80];
+	snprintf(container_id, sizeof(container_id), "docker://%064x", j);
+
+	return string("{\"type\":\"") + type + "\",\"object\":{\"kind\":\"Pod\",\"apiVersion\":\"v1\","
+		"\"metadata\":{\"name\":\"" + pod_name(j) + "\",\"namespace\":\"" + pod_namespace(j, nnamespaces) + "\","
+		"\"uid\":\"" + pod_uid(j) + "\",\"labels\":{\"app\":\"bench\",\"shard\":\"" + to_string(j % 16) + "\"}},"
+		"\"nodeName\":\"node-" + to_string(j % 100) + "\",\"hostIP\":\"10.0.0." + to_string(j % 100) + "\","
+		"\"podIP\":\"10.1." + to_string(j / 250 % 250) + "." + to_string(j % 250) + "\","
+		"\"containerStatuses\":[{\"containerID\":\"" + container_id + "\",\"restartCount\":" + to_string(restarts) + "}]}}";
+}
+
+static k8s_component::type component_type(const Json::Value& root)
+{
+	static const map<string, k8s_component::type> types = {
+		{"Node", k8s_component::K8S_NODES},
+		{"Namespace", k8s_component::K8S_NAMESPACES},
+		{"Pod", k8s_component::K8S_PODS},
+		{"ReplicationController", k8s_component::K8S_REPLICATIONCONTROLLERS},
+		{"ReplicaSet", k8s_component::K8S_REPLICASETS},
+		{"Service", k8s_component::K8S_SERVICES},
+		{"DaemonSet", k8s_component::K8S_DAEMONSETS},
+		{"Deployment", k8s_component::K8S_DEPLOYMENTS},
+	};
+
+	auto it = types.find(root["object"]["kind"].asString());
+	if(it == types.end())
+	{
+		return k8s_component::K8S_COMPONENT_COUNT;
+	}
+	return it->second;
+}
+
+static int run_file(const string& filename)
+{
+	k8s_state_t state;
+	map<k8s_component::type, unique_ptr<k8s_dispatcher>> dispatchers;
+	vector<Json::Value> events;
+	ifstream in(filename);
+	Json::Reader reader;
+	string line;
+
+	if(!in)
+	{
+		cerr << "can't open " << filename << endl;
+		return -1;
+	}
+
+	//
+	// Parse everything upfront, so only the dispatching is timed
+	//
+	while(getline(in, line))
+	{
+		Json::Value root;
+		if(line.empty() || !reader.parse(line, root, false))
+		{
+			continue;
+		}
+		events.push_back(root);
+	}
+
+	uint64_t start = ns_now();
+	for(auto& root : events)
+	{
+		k8s_component::type t = component_type(root);
+		if(t == k8s_component::K8S_COMPONENT_COUNT)
+		{
+			continue;
+		}
+
+		unique_ptr<k8s_dispatcher>& dispatcher = dispatchers[t];
+		if(!dispatcher)
+		{
+			dispatcher.reset(new k8s_dispatcher(t, state));
+		}
+		dispatcher->extract_data(root);
+	}
+	report("replay", events.size(), ns_now() - start);
+
+	printf("%zu pods, %zu services, %zu deployments, %zu replica sets\n",
+	       state.get_pods().size(), state.get_services().size(),
+	       state.get_deployments().size(), state.get_rss().size());
+
+	return 0;
+}
+
+static void check(bool cond, const char* what)
+{
+	if(!cond)
+	{
+		cerr << "unexpected " << what << endl;
+		exit(1);
+	}
+}
+
+static uint64_t run_phase(k8s_dispatcher& dispatcher, vector<Json::Value>& events)
+{
+	uint64_t start = ns_now();
+
+	for(auto& root : events)
+	{
+		dispatcher.extract_data(root);
+	}
+
+	return ns_now() - start;
+}
+
+static int run_synthetic(uint32_t npods, uint32_t nnamespaces, const string& outfile)
+{
+	k8s_state_t state;
+	k8s_dispatcher dispatcher(k8s_component::K8S_PODS, state);
+	const char* types[] = {"ADDED", "MODIFIED", "DELETED"};
+	vector<Json::Value> events[3];
+	vector<uint32_t> order(npods);
+	Json::Reader reader;
+	ofstream out;
+
+	if(!outfile.empty())
+	{
+		out.open(outfile);
+	}
+
+	//
+	// Modify and delete in a different order than the additions
+	//
+	for(uint32_t j = 0; j < npods; j++)
+	{
+		order[j] = j;
+	}
+
+	for(uint32_t k = 0; k < 3; k++)
+	{
+		for(uint32_t j = 0; j < npods; j++)
+		{
+			string json = pod_event(types[k], order[j], nnamespaces, k);
+			Json::Value root;
+
+			reader.parse(json, root, false);
+			events[k].push_back(root);
+			if(out.is_open())
+			{
+				out << json << '\n';
+			}
+		}
+		shuffle(order.begin(), order.end(), mt19937(k));
+	}
+
+	report("added", npods, run_phase(dispatcher, events[0]));
+
+	check(state.get_pods().size() == npods, "pod count after ADDED");
+	for(uint32_t j = 0; j < npods; j += npods / 100 + 1)
+	{
+		const k8s_pod_t* pod = state.get_component_by_name<k8s_pods, k8s_pod_t>(state.get_pods(), pod_namespace(j, nnamespaces), pod_name(j));
+		check(pod != nullptr && pod->get_uid() == pod_uid(j), "pod by name");
+		check(state.get_component<k8s_pods, k8s_pod_t>(state.get_pods(), pod_uid(j)) == pod, "pod by uid");
+	}
+
+	report("modified", npods, run_phase(dispatcher, events[1]));
+
+	for(uint32_t j = 0; j < npods; j += npods / 100 + 1)
+	{
+		const k8s_pod_t* pod = state.get_component<k8s_pods, k8s_pod_t>(state.get_pods(), pod_uid(j));
+		check(pod != nullptr && pod->get_restart_count() == 1, "pod after MODIFIED");
+	}
+
+	report("deleted", npods, run_phase(dispatcher, events[2]));
+
+	check(state.get_pods().empty(), "pod count after DELETED");
+
+	return 0;
+}
+
+static void usage(const char* prog)
+{
+	cerr << "usage: " << prog << " [-p pods] [-n namespaces] [-o write the stream to file] [-f replay file]" << endl;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t npods = 30000;
+	uint32_t nnamespaces = 50;
+	string infile;
+	string outfile;
+	int op;
+
+	while((op = getopt(argc, argv, "p:n:o:f:h")) != -1)
+	{
+		switch(op)
+		{
+		case 'p':
+			npods = atoi(optarg);
+			break;
+		case 'n':
+			nnamespaces = atoi(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'f':
+			infile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if(npods == 0 || nnamespaces == 0)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	if(!infile.empty())
+	{
+		return run_file(infile);
+	}
+
+	return run_synthetic(npods, nnamespaces, outfile);
+}
@@ -0,0 +1,271 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//
+// With -r, reports the events/sec of sinsp::next() on a capture file, i.e.
+// of the whole parsing path, and which share of the events were reads and
+// writes. Without it, replays a synthetic read/write/close/connect heavy
+// stream and reports the cost of the parameter accesses the hot parsers
+// do, once through the parameter table (get_param()) and once through
+// get_param_as()/get_param_view(), checking that they agree.
+//
+
+#include <iostream>
+#include <getopt.h>
+#include <time.h>
+#include <sinsp.h>
+#include "../../libscap/examples/bench_util.h"
+
+using namespace std;
+
+static int run_file(const string& filename)
+{
+	sinsp inspector;
+	sinsp_evt* evt;
+	uint64_t nevents = 0;
+	uint64_t nrw = 0;
+
+	inspector.open(filename);
+
+	uint64_t start = ns_now();
+
+	while(true)
+	{
+		int32_t res = inspector.next(&evt);
+
+		if(res == SCAP_EOF)
+		{
+			break;
+		}
+		else if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			throw sinsp_exception(inspector.getlasterr());
+		}
+
+		nevents++;
+		if(evt->get_info_flags() & (EF_READS_FROM_FD | EF_WRITES_TO_FD))
+		{
+			nrw++;
+		}
+	}
+
+	uint64_t ns = ns_now() - start;
+	inspector.close();
+
+	report("parse", nevents, ns);
+	printf("%.1f%% read/write events\n", nevents? 100.0 * nrw / nevents : 0);
+	return 0;
+}
+
+static void add_param(vector<uint8_t>& params, vector<uint16_t>& lens, const void* val, uint16_t len)
+{
+	params.insert(params.end(), (const uint8_t*)val, (const uint8_t*)val + len);
+	lens.push_back(len);
+}
+
+static vector<uint8_t> make_event(uint16_t type, uint64_t tid, const vector<uint8_t>& params, const vector<uint16_t>& lens)
+{
+	vector<uint8_t> buf(sizeof(scap_evt) + lens.size() * sizeof(uint16_t) + params.size());
+	scap_evt* hdr = (scap_evt*)&buf[0];
+
+	hdr->ts = 0;
+	hdr->tid = tid;
+	hdr->len = (uint32_t)buf.size();
+	hdr->type = type;
+	hdr->nparams = (uint32_t)lens.size();
+	memcpy(&buf[sizeof(scap_evt)], &lens[0], lens.size() * sizeof(uint16_t));
+	memcpy(&buf[sizeof(scap_evt) + lens.size() * sizeof(uint16_t)], &params[0], params.size());
+
+	return buf;
+}
+
+//
+// The parameters parse_rw_exit(), parse_connect_exit() and
+// parse_close_exit() look at, folded into a checksum
+//
+static uint64_t access_table(sinsp_evt* evt)
+{
+	uint64_t sum = *(int64_t*)evt->get_param(0)->m_val;
+
+	switch(evt->get_type())
+	{
+	case PPME_SYSCALL_READ_X:
+	case PPME_SYSCALL_WRITE_X:
+	case PPME_SOCKET_CONNECT_X:
+		sum += evt->get_param(1)->m_len;
+		break;
+	case PPME_SOCKET_RECVFROM_X:
+		sum += evt->get_param(1)->m_len;
+		sum += evt->get_param(2)->m_len;
+		break;
+	default:
+		break;
+	}
+
+	return sum;
+}
+
+static uint64_t access_view(sinsp_evt* evt)
+{
+	uint64_t sum = evt->get_param_as<int64_t>(0);
+
+	switch(evt->get_type())
+	{
+	case PPME_SYSCALL_READ_X:
+	case PPME_SYSCALL_WRITE_X:
+	case PPME_SOCKET_CONNECT_X:
+		sum += evt->get_param_view(1).m_len;
+		break;
+	case PPME_SOCKET_RECVFROM_X:
+		sum += evt->get_param_view(1).m_len;
+		sum += evt->get_param_view(2).m_len;
+		break;
+	default:
+		break;
+	}
+
+	return sum;
+}
+
+static int run_synthetic(uint64_t nevents)
+{
+	sinsp inspector;
+	vector<vector<uint8_t>> events;
+	char data[80] = "GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	uint8_t tuple[1 + 4 + 2 + 4 + 2] = {PPM_AF_INET, 10, 0, 0, 1, 0x1f, 0x90, 10, 0, 0, 2, 0xd2, 0x04};
+
+	for(uint32_t j = 0; j < 256; j++)
+	{
+		vector<uint8_t> params;
+		vector<uint16_t> lens;
+		uint64_t tid = 100 + j % 8;
+		int64_t res = (j % 13 == 0)? -11 : sizeof(data);
+
+		switch(j % 8)
+		{
+		case 0:
+		case 1:
+		case 2:
+			add_param(params, lens, &res, sizeof(res));
+			add_param(params, lens, data, sizeof(data));
+			events.push_back(make_event(PPME_SYSCALL_READ_X, tid, params, lens));
+			break;
+		case 3:
+		case 4:
+			add_param(params, lens, &res, sizeof(res));
+			add_param(params, lens, data, sizeof(data));
+			events.push_back(make_event(PPME_SYSCALL_WRITE_X, tid, params, lens));
+			break;
+		case 5:
+			add_param(params, lens, &res, sizeof(res));
+			add_param(params, lens, data, sizeof(data));
+			add_param(params, lens, tuple, sizeof(tuple));
+			events.push_back(make_event(PPME_SOCKET_RECVFROM_X, tid, params, lens));
+			break;
+		case 6:
+			res = 0;
+			add_param(params, lens, &res, sizeof(res));
+			add_param(params, lens, tuple, sizeof(tuple));
+			events.push_back(make_event(PPME_SOCKET_CONNECT_X, tid, params, lens));
+			break;
+		default:
+			res = 0;
+			add_param(params, lens, &res, sizeof(res));
+			events.push_back(make_event(PPME_SYSCALL_CLOSE_X, tid, params, lens));
+			break;
+		}
+	}
+
+	sinsp_evt evt(&inspector);
+	uint64_t table_sum = 0;
+	uint64_t view_sum = 0;
+	uint64_t start;
+	uint64_t table_ns;
+	uint64_t view_ns;
+
+	start = ns_now();
+	for(uint64_t j = 0; j < nevents; j++)
+	{
+		evt.init(&events[j % events.size()][0], 0);
+		table_sum += access_table(&evt);
+	}
+	table_ns = ns_now() - start;
+
+	start = ns_now();
+	for(uint64_t j = 0; j < nevents; j++)
+	{
+		evt.init(&events[j % events.size()][0], 0);
+		view_sum += access_view(&evt);
+	}
+	view_ns = ns_now() - start;
+
+	if(table_sum != view_sum)
+	{
+		fprintf(stderr, "mismatch: table %" PRIu64 ", view %" PRIu64 "\n", table_sum, view_sum);
+		return -1;
+	}
+
+	report("table", nevents, table_ns);
+	report("view", nevents, view_ns);
+	return 0;
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [-r capture file] [-n synthetic events]\n", prog);
+}
+
+int main(int argc, char** argv)
+{
+	string filename;
+	uint64_t nevents = 10000000;
+	int op;
+
+	while((op = getopt(argc, argv, "r:n:h")) != -1)
+	{
+		switch(op)
+		{
+		case 'r':
+			filename = optarg;
+			break;
+		case 'n':
+			nevents = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	try
+	{
+		if(!filename.empty())
+		{
+			return run_file(filename);
+		}
+
+		return run_synthetic(nevents);
+	}
+	catch(const sinsp_exception& e)
+	{
+		cerr << e.what() << endl;
+		return -1;
+	}
+}
@@ -0,0 +1,327 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//
+// Measures the allocator traffic of thread creation and removal, either by
+// reading a capture file or by running a synthetic fork bomb against the
+// thread manager the same way parse_clone_exit() and remove_thread() do.
+// The configurations are compared each in its own process:
+//  - copy: threadinfo objects from new, args/env/cgroups deep-copied on
+//    every fork, like before copy-on-write sharing (synthetic runs only)
+//  - heap: threadinfo objects from new, args/env/cgroups shared
+//  - pool: threadinfo objects from the slab pool, args/env/cgroups shared
+//
+
+#include <iostream>
+#include <deque>
+#include <new>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sinsp.h>
+#include "../../libscap/examples/bench_util.h"
+
+using namespace std;
+
+static uint64_t g_nallocs = 0;
+
+void* operator new(size_t size)
+{
+	void* p = malloc(size? size : 1);
+	if(p == NULL)
+	{
+		throw std::bad_alloc();
+	}
+
+	g_nallocs++;
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+enum bench_mode
+{
+	MODE_COPY = 0,
+	MODE_HEAP = 1,
+	MODE_POOL = 2,
+};
+
+static const char* mode_names[] = {"copy", "heap", "pool"};
+
+static void report(bench_mode mode, uint64_t nforks, uint64_t nallocs, uint64_t ns, uint64_t rss, uint32_t nthreads)
+{
+	double secs = (double)ns / 1000000000;
+
+	printf("%-5s %" PRIu64 " forks: %.0f ns/fork, %.1f allocs/fork, %.2f M allocs/sec, RSS +%.1f MB, %u threads left\n",
+	       mode_names[mode], nforks,
+	       nforks? (double)ns / nforks : 0,
+	       nforks? (double)nallocs / nforks : 0,
+	       secs > 0? nallocs / secs / 1000000 : 0,
+	       (double)rss / (1024 * 1024),
+	       nthreads);
+}
+
+static void fill_parent(sinsp& inspector, sinsp_threadinfo* tinfo, int64_t tid)
+{
+	char buf[256];
+
+	tinfo->m_tid = tid;
+	tinfo->m_pid = tid;
+	tinfo->m_ptid = 1;
+	tinfo->m_comm = "php-fpm";
+	tinfo->m_exe = "php-fpm: pool www";
+	tinfo->m_exepath = "/usr/sbin/php-fpm7.4";
+	tinfo->m_root = "/";
+
+	tinfo->m_args.push_back("--nodaemonize");
+	tinfo->m_args.push_back("--fpm-config");
+	tinfo->m_args.push_back("/etc/php/7.4/fpm/php-fpm.conf");
+
+	for(uint32_t j = 0; j < 40; j++)
+	{
+		snprintf(buf, sizeof(buf), "ENV_VARIABLE_%u=some/reasonably/long/value/%" PRId64, j, tid % 4);
+		tinfo->m_env.push_back(buf);
+	}
+
+	static const char* subsys[] = {"cpuset", "cpu", "cpuacct", "blkio", "memory", "devices",
+				       "freezer", "net_cls", "perf_event", "net_prio", "hugetlb", "pids"};
+	for(uint32_t j = 0; j < sizeof(subsys) / sizeof(subsys[0]); j++)
+	{
+		snprintf(buf, sizeof(buf), "/kubepods/burstable/pod%" PRId64 "/0123456789abcdef", tid % 4);
+		tinfo->m_cgroups.push_back(make_pair(string(subsys[j]), string(buf)));
+	}
+
+	inspector.m_thread_manager->intern(tinfo->m_args);
+	inspector.m_thread_manager->intern(tinfo->m_env);
+	inspector.m_thread_manager->intern(tinfo->m_cgroups);
+}
+
+//
+// Same copies as parse_clone_exit() for a new process
+//
+static void clone_from(sinsp_threadinfo* tinfo, sinsp_threadinfo* ptinfo, bench_mode mode)
+{
+	tinfo->m_ptid = ptinfo->m_tid;
+	tinfo->m_comm = ptinfo->m_comm;
+	tinfo->m_exe = ptinfo->m_exe;
+	tinfo->m_exepath = ptinfo->m_exepath;
+	tinfo->m_args = ptinfo->m_args;
+	tinfo->m_root = ptinfo->m_root;
+	tinfo->m_sid = ptinfo->m_sid;
+	tinfo->m_vpgid = ptinfo->m_vpgid;
+	tinfo->m_tty = ptinfo->m_tty;
+	tinfo->m_loginuid = ptinfo->m_loginuid;
+	tinfo->m_env = ptinfo->m_env;
+	tinfo->m_cgroups = ptinfo->m_cgroups;
+
+	if(mode == MODE_COPY)
+	{
+		tinfo->m_args.mutable_data();
+		tinfo->m_env.mutable_data();
+		tinfo->m_cgroups.mutable_data();
+	}
+}
+
+static void run_synthetic(bench_mode mode, uint32_t nparents, uint32_t nlive, uint64_t nforks)
+{
+	sinsp inspector;
+	deque<int64_t> live;
+	uint64_t state = 1;
+	int64_t next_tid = 1000;
+
+	inspector.set_threadinfo_pool(mode == MODE_POOL);
+
+	for(uint32_t j = 0; j < nparents; j++)
+	{
+		sinsp_threadinfo* tinfo = inspector.build_threadinfo();
+		fill_parent(inspector, tinfo, 100 + j);
+		inspector.add_thread(tinfo);
+	}
+
+	uint64_t rss_start = rss_bytes();
+	uint64_t nallocs = g_nallocs;
+	uint64_t start = ns_now();
+
+	for(uint64_t j = 0; j < nforks; j++)
+	{
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		int64_t ptid = 100 + (int64_t)((state >> 33) % nparents);
+		threadinfo_map_t::ptr_t ptinfo = inspector.get_thread_ref(ptid, false, false);
+		int64_t tid = next_tid++;
+
+		sinsp_threadinfo* tinfo = inspector.build_threadinfo();
+		tinfo->m_tid = tid;
+		tinfo->m_pid = tid;
+		clone_from(tinfo, ptinfo.get(), mode);
+		inspector.add_thread(tinfo);
+		live.push_back(tid);
+
+		if(live.size() > nlive)
+		{
+			inspector.m_thread_manager->remove_thread(live.front(), false);
+			live.pop_front();
+		}
+	}
+
+	uint64_t ns = ns_now() - start;
+	report(mode, nforks, g_nallocs - nallocs, ns, rss_bytes() - rss_start, inspector.m_thread_manager->get_thread_count());
+}
+
+static void run_file(bench_mode mode, const string& filename)
+{
+	sinsp inspector;
+	sinsp_evt* evt;
+	uint64_t nforks = 0;
+
+	inspector.set_threadinfo_pool(mode == MODE_POOL);
+
+	uint64_t rss_start = rss_bytes();
+	uint64_t nallocs = g_nallocs;
+	uint64_t start = ns_now();
+
+	inspector.open(filename);
+
+	while(true)
+	{
+		int32_t res = inspector.next(&evt);
+
+		if(res == SCAP_EOF)
+		{
+			break;
+		}
+		else if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			throw sinsp_exception(inspector.getlasterr());
+		}
+
+		switch(evt->get_type())
+		{
+		case PPME_SYSCALL_CLONE_20_X:
+		case PPME_SYSCALL_FORK_20_X:
+		case PPME_SYSCALL_VFORK_20_X:
+			nforks++;
+			break;
+		default:
+			break;
+		}
+	}
+
+	uint64_t ns = ns_now() - start;
+	report(mode, nforks, g_nallocs - nallocs, ns, rss_bytes() - rss_start, inspector.m_thread_manager->get_thread_count());
+	inspector.close();
+}
+
+static int run_isolated(bench_mode mode, const string& filename, uint32_t nparents, uint32_t nlive, uint64_t nforks)
+{
+	int status;
+
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if(pid < 0)
+	{
+		perror("fork");
+		return -1;
+	}
+	else if(pid == 0)
+	{
+		try
+		{
+			if(!filename.empty())
+			{
+				run_file(mode, filename);
+			}
+			else
+			{
+				run_synthetic(mode, nparents, nlive, nforks);
+			}
+		}
+		catch(const sinsp_exception& e)
+		{
+			cerr << e.what() << endl;
+			_exit(1);
+		}
+		fflush(stdout);
+		_exit(0);
+	}
+
+	if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		fprintf(stderr, "%s: benchmark failed\n", mode_names[mode]);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [-r capture file] [-p parents] [-l live children] [-n forks]\n", prog);
+}
+
+int main(int argc, char** argv)
+{
+	string filename;
+	uint32_t nparents = 64;
+	uint32_t nlive = 4000;
+	uint64_t nforks = 1000000;
+	int op;
+
+	while((op = getopt(argc, argv, "r:p:l:n:h")) != -1)
+	{
+		switch(op)
+		{
+		case 'r':
+			filename = optarg;
+			break;
+		case 'p':
+			nparents = atoi(optarg);
+			break;
+		case 'l':
+			nlive = atoi(optarg);
+			break;
+		case 'n':
+			nforks = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if(nparents == 0)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	if((filename.empty() && run_isolated(MODE_COPY, filename, nparents, nlive, nforks) != 0) ||
+	   run_isolated(MODE_HEAP, filename, nparents, nlive, nforks) != 0 ||
+	   run_isolated(MODE_POOL, filename, nparents, nlive, nforks) != 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
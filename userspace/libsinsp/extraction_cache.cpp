@@ -0,0 +1,53 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#ifdef HAS_FILTERING
+
+sinsp_extraction_cache::sinsp_extraction_cache(sinsp* inspector)
+{
+#ifdef GATHER_INTERNAL_STATS
+	m_hits = &inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("extraction_cache_hits","Field extractions served from the per-event cache"));
+	m_misses = &inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("extraction_cache_misses","Field extractions not found in the per-event cache"));
+#endif
+}
+
+check_extraction_cache_entry* sinsp_extraction_cache::get_entry(const std::string& field_name, bool sanitize_strings)
+{
+	//
+	// The same field extracted with and without string sanitization can
+	// give different values, keep them apart
+	//
+	std::string key = field_name;
+	key += sanitize_strings? '\1' : '\0';
+
+	check_extraction_cache_entry* entry = &m_entries[key];
+	entry->m_sanitize_strings = sanitize_strings;
+	return entry;
+}
+
+void sinsp_extraction_cache::invalidate()
+{
+	for(auto& it : m_entries)
+	{
+		it.second.m_evtnum = UINT64_MAX;
+	}
+}
+
+#endif // HAS_FILTERING
@@ -0,0 +1,84 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#ifdef HAS_FILTERING
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "sinsp_public.h"
+#include "internal_metrics.h"
+
+class sinsp;
+
+class check_extraction_cache_entry
+{
+public:
+	uint64_t m_evtnum = UINT64_MAX;
+	uint8_t* m_res;
+	uint32_t m_len = 0;
+	bool m_sanitize_strings = false;
+	// Private copy of the extracted value, m_res points here
+	std::vector<uint8_t> m_storage;
+};
+
+/*!
+  \brief Memoizes field extractions for the current event.
+
+  The filter, the formatters and the tables each have their own checks,
+  and often extract the same fields from every event. Checks with the same
+  full field name (e.g. "fd.name" or "evt.arg.flags") and the same string
+  sanitization share an entry here, so the value is extracted once per
+  event and the other checks reuse it. Entries are tagged with the number
+  of the event they were filled for, so they become stale as soon as
+  sinsp::next() moves to the next event.
+
+  The value is copied into the entry, since the extracting check (or the
+  event, for parameters) may reuse the storage it points to before the
+  other consumers get to it.
+*/
+class sinsp_extraction_cache
+{
+public:
+	sinsp_extraction_cache(sinsp* inspector);
+
+	//
+	// The returned entry stays valid for the lifetime of the cache
+	//
+	check_extraction_cache_entry* get_entry(const std::string& field_name, bool sanitize_strings);
+
+	//
+	// Mark every entry as stale, for when event numbers start over
+	//
+	void invalidate();
+
+	size_t size() const
+	{
+		return m_entries.size();
+	}
+
+	INTERNAL_COUNTER(m_hits);
+	INTERNAL_COUNTER(m_misses);
+
+private:
+	std::unordered_map<std::string, check_extraction_cache_entry> m_entries;
+};
+
+#endif // HAS_FILTERING
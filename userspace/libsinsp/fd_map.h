@@ -0,0 +1,550 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace libsinsp
+{
+
+/**
+ * Map from file descriptor numbers to V, with the same interface as the
+ * subset of std::unordered_map<int64_t, V> that the fd tables use.
+ *
+ * Small fds, which are the vast majority, live in fixed-size chunks
+ * indexed by the fd itself, so a lookup is an array access and adding
+ * one doesn't allocate unless its chunk is new. The other fds go in an
+ * open addressing table with linear probing. Entries never move, so like
+ * with std::unordered_map, references to them stay valid until they are
+ * erased, while iterators are invalidated by any insertion or erase.
+ *
+ * Iteration visits the small fds in increasing order, then the others.
+ */
+template<class V>
+class fd_map
+{
+public:
+	typedef std::pair<const int64_t, V> value_type;
+
+	template<class M, class T>
+	class iterator_base
+	{
+	public:
+		iterator_base(): m_map(nullptr), m_pos(0)
+		{
+		}
+
+		iterator_base(M* map, uint32_t pos): m_map(map), m_pos(pos)
+		{
+		}
+
+		// Allow converting an iterator to a const_iterator
+		template<class M2, class T2>
+		iterator_base(const iterator_base<M2, T2>& other): m_map(other.m_map), m_pos(other.m_pos)
+		{
+		}
+
+		T& operator*() const
+		{
+			return *m_map->node_at(m_pos);
+		}
+
+		T* operator->() const
+		{
+			return m_map->node_at(m_pos);
+		}
+
+		iterator_base& operator++()
+		{
+			m_pos = m_map->next_pos(m_pos + 1);
+			return *this;
+		}
+
+		iterator_base operator++(int)
+		{
+			iterator_base res = *this;
+			++(*this);
+			return res;
+		}
+
+		bool operator==(const iterator_base& other) const
+		{
+			return m_pos == other.m_pos;
+		}
+
+		bool operator!=(const iterator_base& other) const
+		{
+			return m_pos != other.m_pos;
+		}
+
+	private:
+		M* m_map;
+		uint32_t m_pos;
+
+		template<class M2, class T2> friend class iterator_base;
+		friend class fd_map;
+	};
+
+	typedef iterator_base<fd_map, value_type> iterator;
+	typedef iterator_base<const fd_map, const value_type> const_iterator;
+
+	/**
+	 * Fds in [0, direct_size) are the small ones. Chunks are only
+	 * allocated for the ranges that have fds in them, so that the
+	 * many processes with just a handful of fds stay small.
+	 */
+	explicit fd_map(uint32_t direct_size = 1024):
+		m_direct_size(direct_size),
+		m_size(0),
+		m_nslots_used(0)
+	{
+	}
+
+	fd_map(const fd_map& other):
+		m_direct_size(other.m_direct_size),
+		m_size(0),
+		m_nslots_used(0)
+	{
+		copy_from(other);
+	}
+
+	fd_map& operator=(const fd_map& other)
+	{
+		if(this != &other)
+		{
+			clear();
+			m_direct_size = other.m_direct_size;
+			copy_from(other);
+		}
+
+		return *this;
+	}
+
+	~fd_map()
+	{
+		clear();
+	}
+
+	iterator begin()
+	{
+		return iterator(this, next_pos(0));
+	}
+
+	iterator end()
+	{
+		return iterator(this, end_pos());
+	}
+
+	const_iterator begin() const
+	{
+		return const_iterator(this, next_pos(0));
+	}
+
+	const_iterator end() const
+	{
+		return const_iterator(this, end_pos());
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	bool empty() const
+	{
+		return m_size == 0;
+	}
+
+	iterator find(int64_t key)
+	{
+		return iterator(this, find_pos(key));
+	}
+
+	const_iterator find(int64_t key) const
+	{
+		return const_iterator(this, find_pos(key));
+	}
+
+	/**
+	 * Shortcut for find() that returns a pointer to the value, or
+	 * nullptr if the key isn't there.
+	 */
+	V* find_value(int64_t key)
+	{
+		if(is_direct(key))
+		{
+			uint32_t c = (uint32_t)key >> CHUNK_BITS;
+			uint32_t bit = 1U << ((uint32_t)key & CHUNK_MASK);
+
+			if(c < m_chunks.size() && m_chunks[c] != nullptr && (m_chunks[c]->m_used & bit))
+			{
+				return &m_chunks[c]->entry((uint32_t)key & CHUNK_MASK)->second;
+			}
+
+			return nullptr;
+		}
+
+		uint32_t pos = find_pos(key);
+		return (pos == end_pos())? nullptr : &node_at(pos)->second;
+	}
+
+	/**
+	 * Insert a copy of val unless the key is already there. Like
+	 * std::unordered_map::emplace(), returns the position of the entry
+	 * and whether it was inserted.
+	 */
+	std::pair<iterator, bool> emplace(int64_t key, const V& val)
+	{
+		uint32_t pos = find_pos(key);
+		if(pos != end_pos())
+		{
+			return std::make_pair(iterator(this, pos), false);
+		}
+
+		pos = insert(key, val);
+		return std::make_pair(iterator(this, pos), true);
+	}
+
+	V& operator[](int64_t key)
+	{
+		uint32_t pos = find_pos(key);
+		if(pos == end_pos())
+		{
+			pos = insert(key, V());
+		}
+
+		return node_at(pos)->second;
+	}
+
+	void erase(iterator it)
+	{
+		uint32_t pos = it.m_pos;
+
+		if(pos < direct_end())
+		{
+			//
+			// Empty chunks are kept until clear(), so that a process
+			// opening and closing the same fd doesn't allocate a chunk
+			// every time
+			//
+			chunk* ch = m_chunks[pos >> CHUNK_BITS];
+
+			ch->entry(pos & CHUNK_MASK)->~value_type();
+			ch->m_used &= ~(1U << (pos & CHUNK_MASK));
+		}
+		else
+		{
+			erase_slot(pos - direct_end());
+		}
+
+		m_size--;
+	}
+
+	size_t erase(int64_t key)
+	{
+		iterator it = find(key);
+		if(it == end())
+		{
+			return 0;
+		}
+
+		erase(it);
+		return 1;
+	}
+
+	void clear()
+	{
+		for(size_t c = 0; c < m_chunks.size(); c++)
+		{
+			chunk* ch = m_chunks[c];
+			if(ch == nullptr)
+			{
+				continue;
+			}
+
+			for(uint32_t j = 0; j < CHUNK_SIZE; j++)
+			{
+				if(ch->m_used & (1U << j))
+				{
+					ch->entry(j)->~value_type();
+				}
+			}
+
+			delete ch;
+		}
+
+		for(size_t j = 0; j < m_slots.size(); j++)
+		{
+			delete m_slots[j].m_node;
+		}
+
+		m_chunks.clear();
+		m_slots.clear();
+		m_size = 0;
+		m_nslots_used = 0;
+	}
+
+private:
+	static const uint32_t CHUNK_BITS = 4;
+	static const uint32_t CHUNK_SIZE = 1 << CHUNK_BITS;
+	static const uint32_t CHUNK_MASK = CHUNK_SIZE - 1;
+
+	struct chunk
+	{
+		chunk(): m_used(0)
+		{
+		}
+
+		value_type* entry(uint32_t j)
+		{
+			return reinterpret_cast<value_type*>(&m_entries[j]);
+		}
+
+		uint32_t m_used;
+		typename std::aligned_storage<sizeof(value_type), std::alignment_of<value_type>::value>::type m_entries[CHUNK_SIZE];
+	};
+
+	struct slot
+	{
+		int64_t m_key;
+		value_type* m_node;
+	};
+
+	static uint64_t hash(int64_t key)
+	{
+		uint64_t h = (uint64_t)key;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	bool is_direct(int64_t key) const
+	{
+		return key >= 0 && key < (int64_t)m_direct_size;
+	}
+
+	//
+	// Positions [0, direct_end()) are small fds, the following ones are
+	// slots of the hash table
+	//
+	uint32_t direct_end() const
+	{
+		return (uint32_t)m_chunks.size() << CHUNK_BITS;
+	}
+
+	uint32_t end_pos() const
+	{
+		return direct_end() + (uint32_t)m_slots.size();
+	}
+
+	value_type* node_at(uint32_t pos) const
+	{
+		if(pos < direct_end())
+		{
+			chunk* ch = m_chunks[pos >> CHUNK_BITS];
+
+			if(ch == nullptr || !(ch->m_used & (1U << (pos & CHUNK_MASK))))
+			{
+				return nullptr;
+			}
+
+			return ch->entry(pos & CHUNK_MASK);
+		}
+
+		return m_slots[pos - direct_end()].m_node;
+	}
+
+	uint32_t next_pos(uint32_t pos) const
+	{
+		uint32_t end = end_pos();
+
+		while(pos < end && node_at(pos) == nullptr)
+		{
+			// Skip whole empty chunks
+			if(pos < direct_end() && m_chunks[pos >> CHUNK_BITS] == nullptr)
+			{
+				pos = (pos | CHUNK_MASK) + 1;
+				continue;
+			}
+
+			pos++;
+		}
+
+		return pos;
+	}
+
+	uint32_t find_pos(int64_t key) const
+	{
+		if(is_direct(key))
+		{
+			uint32_t c = (uint32_t)key >> CHUNK_BITS;
+
+			if(c < m_chunks.size() && m_chunks[c] != nullptr &&
+			   (m_chunks[c]->m_used & (1U << ((uint32_t)key & CHUNK_MASK))))
+			{
+				return (uint32_t)key;
+			}
+
+			return end_pos();
+		}
+
+		if(m_slots.empty())
+		{
+			return end_pos();
+		}
+
+		uint32_t mask = (uint32_t)m_slots.size() - 1;
+		uint32_t idx = (uint32_t)(hash(key) & mask);
+
+		while(m_slots[idx].m_node != nullptr)
+		{
+			if(m_slots[idx].m_key == key)
+			{
+				return direct_end() + idx;
+			}
+
+			idx = (idx + 1) & mask;
+		}
+
+		return end_pos();
+	}
+
+	//
+	// The key must not be in the map
+	//
+	uint32_t insert(int64_t key, const V& val)
+	{
+		if(is_direct(key))
+		{
+			uint32_t c = (uint32_t)key >> CHUNK_BITS;
+			uint32_t j = (uint32_t)key & CHUNK_MASK;
+
+			if(c >= m_chunks.size())
+			{
+				m_chunks.resize(c + 1, nullptr);
+			}
+
+			if(m_chunks[c] == nullptr)
+			{
+				m_chunks[c] = new chunk();
+			}
+
+			new(m_chunks[c]->entry(j)) value_type(key, val);
+			m_chunks[c]->m_used |= 1U << j;
+			m_size++;
+			return (uint32_t)key;
+		}
+
+		value_type* node = new value_type(key, val);
+
+		if((m_nslots_used + 1) * 4 > m_slots.size() * 3)
+		{
+			rehash((m_slots.empty())? 16 : m_slots.size() * 2);
+		}
+
+		m_nslots_used++;
+		m_size++;
+		return direct_end() + place(node);
+	}
+
+	uint32_t place(value_type* node)
+	{
+		uint32_t mask = (uint32_t)m_slots.size() - 1;
+		uint32_t idx = (uint32_t)(hash(node->first) & mask);
+
+		while(m_slots[idx].m_node != nullptr)
+		{
+			idx = (idx + 1) & mask;
+		}
+
+		m_slots[idx].m_key = node->first;
+		m_slots[idx].m_node = node;
+		return idx;
+	}
+
+	void rehash(size_t size)
+	{
+		std::vector<slot> old;
+		slot empty = {0, nullptr};
+
+		old.swap(m_slots);
+		m_slots.resize(size, empty);
+
+		for(size_t j = 0; j < old.size(); j++)
+		{
+			if(old[j].m_node != nullptr)
+			{
+				place(old[j].m_node);
+			}
+		}
+	}
+
+	//
+	// Backward-shift deletion, so that there are no tombstones to skip
+	// or to clean up
+	//
+	void erase_slot(uint32_t i)
+	{
+		uint32_t mask = (uint32_t)m_slots.size() - 1;
+		uint32_t j = i;
+
+		delete m_slots[i].m_node;
+
+		while(true)
+		{
+			j = (j + 1) & mask;
+			if(m_slots[j].m_node == nullptr)
+			{
+				break;
+			}
+
+			uint32_t home = (uint32_t)(hash(m_slots[j].m_key) & mask);
+			if((i <= j)? (i < home && home <= j) : (i < home || home <= j))
+			{
+				continue;
+			}
+
+			m_slots[i] = m_slots[j];
+			i = j;
+		}
+
+		m_slots[i].m_node = nullptr;
+		m_nslots_used--;
+	}
+
+	void copy_from(const fd_map& other)
+	{
+		for(const_iterator it = other.begin(); it != other.end(); ++it)
+		{
+			insert(it->first, it->second);
+		}
+	}
+
+	uint32_t m_direct_size;
+	std::vector<chunk*> m_chunks;
+	std::vector<slot> m_slots;
+	size_t m_size;
+	size_t m_nslots_used;
+};
+
+}
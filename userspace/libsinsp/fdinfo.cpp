@@ -33,6 +33,11 @@ template<> sinsp_fdinfo_t::sinsp_fdinfo()
 	m_flags = FLAGS_NONE;
 	m_callbacks = NULL;
 	m_usrstate = NULL;
+	m_name_source = NAME_READY;
+	m_name_type = SCAP_FD_UNINITIALIZED;
+	m_name_l4proto = SCAP_L4_UNKNOWN;
+	m_name_resolve = false;
+	m_oldname_saved = false;
 }
 
 template<> void sinsp_fdinfo_t::reset()
@@ -46,6 +51,7 @@ template<> void sinsp_fdinfo_t::reset()
 
 template<> string* sinsp_fdinfo_t::tostring()
 {
+	render_pending_name();
 	return &m_name;
 }
 
@@ -130,7 +136,7 @@ template<> char* sinsp_fdinfo_t::get_typestring()
 
 template<> string sinsp_fdinfo_t::tostring_clean()
 {
-	string m_tstr = m_name;
+	string m_tstr = get_name();
 	sanitize_string(m_tstr);
 
 	return m_tstr;
@@ -138,7 +144,31 @@ template<> string sinsp_fdinfo_t::tostring_clean()
 
 template<> void sinsp_fdinfo_t::add_filename(const char* fullpath)
 {
-	m_name = fullpath;
+	set_name(fullpath);
+}
+
+template<> void sinsp_fdinfo_t::render_name()
+{
+	if(m_name_source == NAME_FROM_SOCKINFO)
+	{
+		char buf[1024];
+
+		sinsp_utils::sockinfo_to_str(&m_sockinfo, (scap_fd_type)m_name_type, buf, sizeof(buf), m_name_resolve);
+		m_name = buf;
+	}
+	else if(m_name_source == NAME_FROM_IPV4_TUPLE)
+	{
+		ipv4tuple addr;
+
+		addr.m_fields.m_sip = m_sockinfo.m_ipv4info.m_fields.m_sip;
+		addr.m_fields.m_sport = m_sockinfo.m_ipv4info.m_fields.m_sport;
+		addr.m_fields.m_dip = m_sockinfo.m_ipv4info.m_fields.m_dip;
+		addr.m_fields.m_dport = m_sockinfo.m_ipv4info.m_fields.m_dport;
+		addr.m_fields.m_l4proto = m_name_l4proto;
+		m_name = ipv4tuple_to_string(&addr, m_name_resolve);
+	}
+
+	m_name_source = NAME_READY;
 }
 
 template<> bool sinsp_fdinfo_t::set_net_role_by_guessing(sinsp* inspector,
@@ -327,7 +357,7 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 #ifdef GATHER_INTERNAL_STATS
 			m_inspector->m_stats.m_n_added_fds++;
 #endif
-			pair<unordered_map<int64_t, sinsp_fdinfo_t>::iterator, bool> insert_res = m_table.emplace(fd, *fdinfo);
+			pair<table_t::iterator, bool> insert_res = m_table.emplace(fd, *fdinfo);
 			return &(insert_res.first->second);
 		}
 		else
@@ -378,7 +408,7 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 
 void sinsp_fdtable::erase(int64_t fd)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit = m_table.find(fd);
+	table_t::iterator fdit = m_table.find(fd);
 
 	if(fd == m_last_accessed_fd)
 	{
@@ -17,6 +17,7 @@ limitations under the License.
 
 #pragma once
 #include "sinsp_pd_callback_type.h"
+#include "fd_map.h"
 #include <unordered_map>
 #include <vector>
 
@@ -114,6 +115,11 @@ public:
 		m_sockinfo = other.m_sockinfo;
 		m_name = other.m_name;
 		m_oldname = other.m_oldname;
+		m_name_source = other.m_name_source;
+		m_name_type = other.m_name_type;
+		m_name_l4proto = other.m_name_l4proto;
+		m_name_resolve = other.m_name_resolve;
+		m_oldname_saved = other.m_oldname_saved;
 		m_flags = other.m_flags;
 		m_dev = other.m_dev;
 		m_mount_id = other.m_mount_id;
@@ -336,8 +342,35 @@ public:
 	*/
 	sinsp_sockinfo m_sockinfo;
 
-	std::string m_name; ///< Human readable rendering of this FD. For files, this is the full file name. For sockets, this is the tuple. And so on.
-	std::string m_oldname; // The name of this fd at the beginning of event parsing. Used to detect name changes that result from parsing an event.
+	std::string m_name; ///< Human readable rendering of this FD. For files, this is the full file name. For sockets, this is the tuple. And so on. Socket tuples are rendered on demand, read it with get_name().
+	std::string m_oldname; // The name of this fd before it was first changed while parsing the current event, see name_changed().
+
+	/*!
+	  \brief Return the human readable rendering of this FD, see m_name.
+	*/
+	inline const std::string& get_name()
+	{
+		if(m_name_source != NAME_READY)
+		{
+			render_name();
+		}
+
+		return m_name;
+	}
+
+	inline void set_name(const std::string& name)
+	{
+		save_oldname();
+		m_name = name;
+		m_name_source = NAME_READY;
+	}
+
+	inline void set_name(const char* name)
+	{
+		save_oldname();
+		m_name = name;
+		m_name_source = NAME_READY;
+	}
 
 	inline bool has_decoder_callbacks()
 	{
@@ -488,11 +521,108 @@ private:
 		m_flags |= FLAGS_IS_CLONED;
 	}
 
+	/*!
+	  \brief Where the name comes from, if it's still to be rendered.
+	*/
+	enum name_source
+	{
+		NAME_READY = 0,
+		// sinsp_utils::sockinfo_to_str() of m_sockinfo
+		NAME_FROM_SOCKINFO = 1,
+		// ipv4tuple_to_string() of the m_sockinfo tuple, with
+		// m_name_l4proto as protocol, like a PT_SOCKTUPLE parameter
+		NAME_FROM_IPV4_TUPLE = 2,
+	};
+
+	//
+	// Most socket names are never read, so they are rendered from
+	// m_sockinfo on the first get_name(). Until then m_sockinfo must
+	// stay as it is: call render_pending_name() before changing it.
+	//
+	inline void set_name_from_sockinfo(bool resolve)
+	{
+		save_oldname();
+		m_name_source = NAME_FROM_SOCKINFO;
+		m_name_type = (uint8_t)m_type;
+		m_name_resolve = resolve;
+	}
+
+	inline void set_name_from_ipv4_tuple(uint8_t l4proto, bool resolve)
+	{
+		save_oldname();
+		m_name_source = NAME_FROM_IPV4_TUPLE;
+		m_name_l4proto = l4proto;
+		m_name_resolve = resolve;
+	}
+
+	//
+	// Pending names are rendered tuples, which are never empty
+	//
+	inline bool is_name_empty() const
+	{
+		return m_name_source == NAME_READY && m_name.empty();
+	}
+
+	inline void render_pending_name()
+	{
+		if(m_name_source != NAME_READY)
+		{
+			render_name();
+		}
+	}
+
+	void render_name();
+
+	//
+	// Its current name is now its old name. m_oldname is only saved if
+	// the name is set afterwards, which saves a string copy per event.
+	//
+	inline void reset_oldname()
+	{
+		m_oldname_saved = false;
+	}
+
+	inline void save_oldname()
+	{
+		if(!m_oldname_saved)
+		{
+			m_oldname = get_name();
+			m_oldname_saved = true;
+		}
+	}
+
+	//
+	// True if the name changed since reset_oldname()
+	//
+	inline bool name_changed()
+	{
+		if(!m_oldname_saved)
+		{
+			return false;
+		}
+
+		//
+		// Rendered tuples are never empty, no need to render them
+		// to compare them with an empty name
+		//
+		if(m_name_source != NAME_READY && m_oldname.empty())
+		{
+			return true;
+		}
+
+		return get_name() != m_oldname;
+	}
+
 	T* m_usrstate;
 	uint32_t m_flags;
 	uint32_t m_dev;
 	uint32_t m_mount_id;
 	uint64_t m_ino;
+	uint8_t m_name_source;
+	uint8_t m_name_type;
+	uint8_t m_name_l4proto;
+	bool m_name_resolve;
+	bool m_oldname_saved;
 
 	fd_callbacks_info* m_callbacks;
 
@@ -519,9 +649,11 @@ class sinsp_fdtable
 public:
 	sinsp_fdtable(sinsp* inspector);
 
+	typedef libsinsp::fd_map<sinsp_fdinfo_t> table_t;
+
 	inline sinsp_fdinfo_t* find(int64_t fd)
 	{
-		std::unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+		sinsp_fdinfo_t* fdinfo;
 
 		//
 		// Try looking up in our simple cache
@@ -537,9 +669,9 @@ public:
 		//
 		// Caching failed, do a real lookup
 		//
-		fdit = m_table.find(fd);
+		fdinfo = m_table.find_value(fd);
 
-		if(fdit == m_table.end())
+		if(fdinfo == NULL)
 		{
 	#ifdef GATHER_INTERNAL_STATS
 			m_inspector->m_stats.m_n_failed_fd_lookups++;
@@ -552,9 +684,9 @@ public:
 			m_inspector->m_stats.m_n_noncached_fd_lookups++;
 	#endif
 			m_last_accessed_fd = fd;
-			m_last_accessed_fdinfo = &(fdit->second);
-			lookup_device(&(fdit->second), fd);
-			return &(fdit->second);
+			m_last_accessed_fdinfo = fdinfo;
+			lookup_device(fdinfo, fd);
+			return fdinfo;
 		}
 	}
 	
@@ -567,7 +699,7 @@ public:
 	void reset_cache();
 
 	sinsp* m_inspector;
-	std::unordered_map<int64_t, sinsp_fdinfo_t> m_table;
+	table_t m_table;
 
 	//
 	// Simple fd cache
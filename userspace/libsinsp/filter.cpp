@@ -1131,7 +1131,7 @@ char* sinsp_filter_check::rawval_to_string(uint8_t* rawval,
 char* sinsp_filter_check::tostring(sinsp_evt* evt)
 {
 	uint32_t len;
-	uint8_t* rawval = extract(evt, &len);
+	uint8_t* rawval = extract_cached(evt, &len);
 
 	if(rawval == NULL)
 	{
@@ -1148,7 +1148,7 @@ Json::Value sinsp_filter_check::tojson(sinsp_evt* evt)
 
 	if(jsonval == Json::nullValue)
 	{
-		uint8_t* rawval = extract(evt, &len);
+		uint8_t* rawval = extract_cached(evt, &len);
 		if(rawval == NULL)
 		{
 			return Json::nullValue;
@@ -1347,22 +1347,104 @@ uint8_t* sinsp_filter_check::extract(gen_event *evt, OUT uint32_t* len, bool san
 
 uint8_t* sinsp_filter_check::extract_cached(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings)
 {
-	if(m_extraction_cache_entry != NULL)
+	uint64_t en = evt->get_num();
+
+	//
+	// Only the events returned by sinsp::next() are numbered. The ones
+	// built on the side, e.g. by the parsers, are all 0 and can't be cached.
+	//
+	if(en == 0 || m_field_name.empty() || m_inspector == NULL)
 	{
-		uint64_t en = ((sinsp_evt *)evt)->get_num();
+		return extract(evt, len, sanitize_strings);
+	}
+
+	//
+	// Sanitization only changes strings, other values can be shared
+	// between the filter and the formatters
+	//
+	bool sanitized_entry = false;
+
+	if(sanitize_strings)
+	{
+		switch(m_field->m_type)
+		{
+		case PT_CHARBUF:
+		case PT_FSPATH:
+		case PT_FSRELPATH:
+		case PT_BYTEBUF:
+			sanitized_entry = true;
+			break;
+		default:
+			break;
+		}
+	}
 
-		if(en != m_extraction_cache_entry->m_evtnum)
+	check_extraction_cache_entry* entry = m_extraction_cache_entry;
+
+	if(entry == NULL || entry->m_sanitize_strings != sanitized_entry)
+	{
+		if(!is_extraction_shareable())
 		{
-			m_extraction_cache_entry->m_evtnum = en;
-			m_extraction_cache_entry->m_res = extract(evt, len, sanitize_strings);
+			return extract(evt, len, sanitize_strings);
 		}
 
-		return m_extraction_cache_entry->m_res;
+		entry = m_inspector->m_extraction_cache->get_entry(m_field_name, sanitized_entry);
+		m_extraction_cache_entry = entry;
 	}
-	else
+
+	if(en == entry->m_evtnum)
 	{
-		return extract(evt, len, sanitize_strings);
+#ifdef GATHER_INTERNAL_STATS
+		m_inspector->m_extraction_cache->m_hits->increment();
+#endif
+		*len = entry->m_len;
+		return entry->m_res;
 	}
+
+#ifdef GATHER_INTERNAL_STATS
+	m_inspector->m_extraction_cache->m_misses->increment();
+#endif
+
+	*len = 0;
+	uint8_t* res = extract(evt, len, sanitize_strings);
+
+	if(res == NULL)
+	{
+		entry->m_evtnum = en;
+		entry->m_res = NULL;
+		entry->m_len = 0;
+		return NULL;
+	}
+
+	//
+	// Copy the value, terminated so that strings stay valid C strings.
+	// Values whose size wasn't reported can only be copied if they are
+	// strings, the others are just not cached.
+	//
+	uint32_t size = *len;
+
+	if(size == 0)
+	{
+		switch(m_field->m_type)
+		{
+		case PT_CHARBUF:
+		case PT_FSPATH:
+		case PT_FSRELPATH:
+			size = (uint32_t)strlen((char*)res);
+			break;
+		default:
+			return res;
+		}
+	}
+
+	entry->m_storage.resize(size + 1);
+	memcpy(&entry->m_storage[0], res, size);
+	entry->m_storage[size] = 0;
+
+	entry->m_evtnum = en;
+	entry->m_res = &entry->m_storage[0];
+	entry->m_len = *len;
+	return entry->m_res;
 }
 
 bool sinsp_filter_check::compare(gen_event *evt)
@@ -1406,10 +1488,38 @@ bool sinsp_filter_check::compare(sinsp_evt *evt)
 sinsp_filter::sinsp_filter(sinsp *inspector)
 {
 	m_inspector = inspector;
+	m_program = NULL;
 }
 
 sinsp_filter::~sinsp_filter()
 {
+	clear_program();
+}
+
+bool sinsp_filter::run(gen_event *evt)
+{
+	if(m_program != NULL)
+	{
+		return m_program->run((sinsp_evt *) evt);
+	}
+
+	return gen_event_filter::run(evt);
+}
+
+void sinsp_filter::compile_program()
+{
+	if(m_program == NULL)
+	{
+		m_program = new sinsp_filter_program();
+	}
+
+	m_program->compile(m_filter);
+}
+
+void sinsp_filter::clear_program()
+{
+	delete m_program;
+	m_program = NULL;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1425,6 +1535,7 @@ sinsp_filter_compiler::sinsp_filter_compiler(sinsp* inspector, const string& flt
 	m_filter = new sinsp_filter(m_inspector);
 	m_last_boolop = BO_NONE;
 	m_nest_level = 0;
+	m_bytecode = true;
 	m_fltstr = fltstr;
 }
 
@@ -1432,6 +1543,11 @@ sinsp_filter_compiler::~sinsp_filter_compiler()
 {
 }
 
+void sinsp_filter_compiler::set_bytecode(bool enabled)
+{
+	m_bytecode = enabled;
+}
+
 bool sinsp_filter_compiler::isblank(char c)
 {
 	if(c == ' ' || c == '\t' || c == '\n' || c == '\r')
@@ -1792,6 +1908,7 @@ void sinsp_filter_compiler::parse_check()
 
 	chk->m_boolop = op;
 	chk->m_cmpop = co;
+	chk->m_field_name = str_operand1;
 
 	chk->parse_field_name((char *)&operand1[0], true, true);
 
@@ -1890,6 +2007,7 @@ void sinsp_filter_compiler::parse_check()
 				sinsp_filter_check* newchk = g_filterlist.new_filter_check_from_another(chk);
 				newchk->m_boolop = op;
 				newchk->m_cmpop = CO_EQ;
+				newchk->m_field_name = str_operand1;
 				newchk->add_filter_value((char *)&operand2[0], (uint32_t)operand2.size() - 1);
 
 				m_filter->add_check(newchk);
@@ -1996,6 +2114,11 @@ sinsp_filter* sinsp_filter_compiler::compile_()
 			//
 			// Good filter
 			//
+			if(m_bytecode)
+			{
+				m_filter->compile_program();
+			}
+
 			return m_filter;
 
 			break;
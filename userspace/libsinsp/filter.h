@@ -23,6 +23,7 @@ limitations under the License.
 #ifdef HAS_FILTERING
 
 #include "gen_filter.h"
+#include "filter_program.h"
 
 /** @defgroup filter Filtering events
  * Filtering infrastructure.
@@ -38,8 +39,32 @@ public:
 	sinsp_filter(sinsp* inspector);
 	~sinsp_filter();
 
+	/*!
+	  \brief Applies the filter to the given event, running the compiled
+	   program if there is one.
+	*/
+	bool run(gen_event *evt);
+
+	/*!
+	  \brief Lowers the expression tree into a bytecode program that run()
+	   executes in place of the tree, with the same results. Must be called
+	   again if the tree changes.
+	*/
+	void compile_program();
+
+	/*!
+	  \brief Discards the compiled program, so that run() walks the tree.
+	*/
+	void clear_program();
+
+	sinsp_filter_program* get_program()
+	{
+		return m_program;
+	}
+
 private:
 	sinsp* m_inspector;
+	sinsp_filter_program* m_program;
 
 	friend class sinsp_evt_formatter;
 };
@@ -67,6 +92,12 @@ public:
 
 	sinsp_filter* compile();
 
+	/*!
+	  \brief Choose whether compile() also lowers the filter into a
+	   bytecode program, see sinsp_filter::compile_program(). On by default.
+	*/
+	void set_bytecode(bool enabled);
+
 private:
 	enum state
 	{
@@ -96,6 +127,7 @@ private:
 	state m_state;
 	boolop m_last_boolop;
 	int32_t m_nest_level;
+	bool m_bytecode;
 
 	sinsp_filter* m_filter;
 
@@ -0,0 +1,615 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#ifdef HAS_FILTERING
+#include "filter_program.h"
+#include "filterchecks.h"
+
+static const char* opcode_names[] =
+{
+	"true",
+	"not",
+	"jmp_true",
+	"jmp_false",
+	"set_check_id",
+	"check",
+	"extract",
+	"exists",
+	"str_eq",
+	"str_ne",
+	"str_order",
+	"str_contains",
+	"str_icontains",
+	"str_startswith",
+	"str_endswith",
+	"str_glob",
+	"str_in",
+	"uint",
+	"int",
+	"double",
+	"generic",
+};
+
+template<typename T>
+static inline bool compare_numbers(uint8_t op, T operand1, T operand2)
+{
+	switch(op)
+	{
+	case CO_EQ:
+		return operand1 == operand2;
+	case CO_NE:
+		return operand1 != operand2;
+	case CO_LT:
+		return operand1 < operand2;
+	case CO_LE:
+		return operand1 <= operand2;
+	case CO_GT:
+		return operand1 > operand2;
+	case CO_GE:
+		return operand1 >= operand2;
+	default:
+		ASSERT(false);
+		return false;
+	}
+}
+
+sinsp_filter_program::sinsp_filter_program()
+{
+}
+
+size_t sinsp_filter_program::emit(uint8_t op, gen_event_filter_check* chk)
+{
+	insn i;
+
+	memset(&i, 0, sizeof(i));
+	i.m_op = op;
+	i.m_target = 0;
+	i.m_slot = NO_SLOT;
+	i.m_check = chk;
+	m_code.push_back(i);
+
+	return m_code.size() - 1;
+}
+
+void sinsp_filter_program::compile(gen_event_filter_expression* root)
+{
+	m_code.clear();
+	m_slot_names.clear();
+
+	compile_expression(root);
+	thread_jumps();
+}
+
+//
+// Mirrors gen_event_filter_expression::compare(): the first check sets the
+// result, each following one is skipped along with the rest of the
+// expression if the result is already decided.
+//
+void sinsp_filter_program::compile_expression(gen_event_filter_expression* expr)
+{
+	std::vector<size_t> exits;
+
+	if(expr->m_checks.empty())
+	{
+		emit(OP_TRUE);
+		return;
+	}
+
+	for(uint32_t j = 0; j < expr->m_checks.size(); j++)
+	{
+		gen_event_filter_check* chk = expr->m_checks[j];
+		boolop op = chk->m_boolop;
+
+		if(j == 0)
+		{
+			if(op != BO_NONE && op != BO_NOT)
+			{
+				ASSERT(false);
+				emit(OP_TRUE);
+				continue;
+			}
+		}
+		else
+		{
+			switch(op)
+			{
+			case BO_OR:
+			case BO_ORNOT:
+				exits.push_back(emit(OP_JMP_TRUE));
+				break;
+			case BO_AND:
+			case BO_ANDNOT:
+				exits.push_back(emit(OP_JMP_FALSE));
+				break;
+			default:
+				ASSERT(false);
+				continue;
+			}
+		}
+
+		compile_check(chk);
+
+		if(op & BO_NOT)
+		{
+			emit(OP_NOT);
+		}
+
+		if(op != BO_NOT)
+		{
+			emit(OP_SET_CHECK_ID, chk);
+		}
+	}
+
+	for(size_t e : exits)
+	{
+		m_code[e].m_target = (uint32_t)m_code.size();
+	}
+}
+
+void sinsp_filter_program::compile_check(gen_event_filter_check* chk)
+{
+	gen_event_filter_expression* expr = dynamic_cast<gen_event_filter_expression*>(chk);
+
+	if(expr != NULL)
+	{
+		compile_expression(expr);
+		return;
+	}
+
+	sinsp_filter_check* fchk = dynamic_cast<sinsp_filter_check*>(chk);
+
+	if(fchk == NULL || fchk->m_eval_cache_entry != NULL || !fchk->has_generic_compare())
+	{
+		emit(OP_CHECK, chk);
+		return;
+	}
+
+	size_t extract = emit(OP_EXTRACT, chk);
+	m_code[extract].m_filter_check = fchk;
+	m_code[extract].m_slot = get_slot(fchk);
+
+	size_t cmp = emit(OP_GENERIC, chk);
+	m_code[cmp].m_filter_check = fchk;
+	m_code[cmp].m_cmpop = fchk->m_cmpop;
+	m_code[cmp].m_type = fchk->m_info.m_fields[fchk->m_field_id].m_type;
+
+	if(!compile_compare(fchk, &m_code[cmp]))
+	{
+		m_code[cmp].m_op = OP_GENERIC;
+	}
+
+	m_code[extract].m_target = (uint32_t)m_code.size();
+}
+
+//
+// Pick the compare opcode for the field type and operator and decode the
+// constant operand. Returns false for the combinations that are left to
+// sinsp_filter_check::flt_compare(), including the invalid ones, so that
+// they throw the same exceptions as before.
+//
+bool sinsp_filter_program::compile_compare(sinsp_filter_check* chk, insn* i)
+{
+	cmpop op = chk->m_cmpop;
+
+	if(op == CO_EXISTS)
+	{
+		i->m_op = OP_EXISTS;
+		return true;
+	}
+
+	if(chk->m_val_storages.empty())
+	{
+		return false;
+	}
+
+	uint8_t* operand = chk->filter_value_p();
+	bool is_signed = false;
+
+	switch(i->m_type)
+	{
+	case PT_CHARBUF:
+		i->m_str = (const char*)operand;
+		i->m_len = (uint32_t)strlen(i->m_str);
+
+		switch(op)
+		{
+		case CO_EQ:
+			i->m_op = OP_STR_EQ;
+			return true;
+		case CO_NE:
+			i->m_op = OP_STR_NE;
+			return true;
+		case CO_LT:
+		case CO_LE:
+		case CO_GT:
+		case CO_GE:
+			i->m_op = OP_STR_ORDER;
+			return true;
+		case CO_CONTAINS:
+			i->m_op = OP_STR_CONTAINS;
+			return true;
+#ifndef _WIN32
+		case CO_ICONTAINS:
+			i->m_op = OP_STR_ICONTAINS;
+			return true;
+#endif
+		case CO_STARTSWITH:
+			i->m_op = OP_STR_STARTSWITH;
+			return true;
+		case CO_ENDSWITH:
+			i->m_op = OP_STR_ENDSWITH;
+			return true;
+		case CO_GLOB:
+			i->m_op = OP_STR_GLOB;
+			return true;
+		case CO_IN:
+		case CO_INTERSECTS:
+			i->m_op = OP_STR_IN;
+			return true;
+		default:
+			return false;
+		}
+	case PT_INT8:
+		is_signed = true;
+		i->m_width = 1;
+		i->m_s64 = *(int8_t*)operand;
+		break;
+	case PT_INT16:
+		is_signed = true;
+		i->m_width = 2;
+		i->m_s64 = *(int16_t*)operand;
+		break;
+	case PT_INT32:
+		is_signed = true;
+		i->m_width = 4;
+		i->m_s64 = *(int32_t*)operand;
+		break;
+	case PT_INT64:
+	case PT_FD:
+	case PT_PID:
+	case PT_ERRNO:
+		is_signed = true;
+		i->m_width = 8;
+		i->m_s64 = *(int64_t*)operand;
+		break;
+	case PT_FLAGS8:
+	case PT_UINT8:
+	case PT_SIGTYPE:
+		i->m_width = 1;
+		i->m_u64 = *(uint8_t*)operand;
+		break;
+	case PT_FLAGS16:
+	case PT_UINT16:
+	case PT_PORT:
+	case PT_SYSCALLID:
+		i->m_width = 2;
+		i->m_u64 = *(uint16_t*)operand;
+		break;
+	case PT_UINT32:
+	case PT_FLAGS32:
+	case PT_MODE:
+	case PT_BOOL:
+	case PT_IPV4ADDR:
+		i->m_width = 4;
+		i->m_u64 = *(uint32_t*)operand;
+		break;
+	case PT_UINT64:
+	case PT_RELTIME:
+	case PT_ABSTIME:
+		i->m_width = 8;
+		i->m_u64 = *(uint64_t*)operand;
+		break;
+	case PT_DOUBLE:
+		i->m_width = 8;
+		i->m_double = *(double*)operand;
+		break;
+	default:
+		return false;
+	}
+
+	switch(op)
+	{
+	case CO_EQ:
+	case CO_NE:
+	case CO_LT:
+	case CO_LE:
+	case CO_GT:
+	case CO_GE:
+		break;
+	default:
+		return false;
+	}
+
+	if(i->m_type == PT_DOUBLE)
+	{
+		i->m_op = OP_DOUBLE;
+	}
+	else
+	{
+		i->m_op = is_signed? OP_INT : OP_UINT;
+	}
+
+	return true;
+}
+
+uint32_t sinsp_filter_program::get_slot(sinsp_filter_check* chk)
+{
+	if(chk->m_field_name.empty())
+	{
+		return NO_SLOT;
+	}
+
+	for(uint32_t j = 0; j < m_slot_names.size(); j++)
+	{
+		if(m_slot_names[j] == chk->m_field_name)
+		{
+			return j;
+		}
+	}
+
+	m_slot_names.push_back(chk->m_field_name);
+	return (uint32_t)m_slot_names.size() - 1;
+}
+
+//
+// Retarget jumps that land on an instruction with a known outcome for the
+// value of the result at that point: a jump on the same condition is
+// followed, one on the opposite condition is skipped, and so is setting the
+// check id when the result is false.
+//
+void sinsp_filter_program::thread_jumps()
+{
+	uint32_t size = (uint32_t)m_code.size();
+
+	for(insn& i : m_code)
+	{
+		if(i.m_op != OP_JMP_TRUE && i.m_op != OP_JMP_FALSE && i.m_op != OP_EXTRACT)
+		{
+			continue;
+		}
+
+		bool res = (i.m_op == OP_JMP_TRUE);
+		uint32_t target = i.m_target;
+
+		while(target < size)
+		{
+			const insn& dst = m_code[target];
+
+			if((dst.m_op == OP_JMP_TRUE && res) || (dst.m_op == OP_JMP_FALSE && !res))
+			{
+				target = dst.m_target;
+			}
+			else if((dst.m_op == OP_JMP_TRUE && !res) || (dst.m_op == OP_JMP_FALSE && res) ||
+				(dst.m_op == OP_SET_CHECK_ID && !res))
+			{
+				target++;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		i.m_target = target;
+	}
+}
+
+bool sinsp_filter_program::run(sinsp_evt* evt)
+{
+	const insn* code = m_code.data();
+	uint32_t size = (uint32_t)m_code.size();
+	uint32_t pc = 0;
+	bool res = true;
+	uint8_t* val = NULL;
+	uint32_t len = 0;
+	uint32_t slot = NO_SLOT;
+
+	while(pc < size)
+	{
+		const insn& i = code[pc];
+
+		switch(i.m_op)
+		{
+		case OP_TRUE:
+			res = true;
+			break;
+		case OP_NOT:
+			res = !res;
+			break;
+		case OP_JMP_TRUE:
+			if(res)
+			{
+				pc = i.m_target;
+				continue;
+			}
+			break;
+		case OP_JMP_FALSE:
+			if(!res)
+			{
+				pc = i.m_target;
+				continue;
+			}
+			break;
+		case OP_SET_CHECK_ID:
+			if(res)
+			{
+				evt->set_check_id(i.m_check->get_check_id());
+			}
+			break;
+		case OP_CHECK:
+			res = i.m_check->compare(evt);
+			slot = NO_SLOT;
+			break;
+		case OP_EXTRACT:
+			if(i.m_slot == NO_SLOT || i.m_slot != slot)
+			{
+				len = 0;
+				val = i.m_filter_check->extract_cached(evt, &len, false);
+				slot = i.m_slot;
+			}
+
+			if(val == NULL)
+			{
+				res = false;
+				pc = i.m_target;
+				continue;
+			}
+			break;
+		case OP_EXISTS:
+			res = true;
+			break;
+		case OP_STR_EQ:
+			res = (*(char*)val == *i.m_str && strcmp((char*)val, i.m_str) == 0);
+			break;
+		case OP_STR_NE:
+			res = (*(char*)val != *i.m_str || strcmp((char*)val, i.m_str) != 0);
+			break;
+		case OP_STR_ORDER:
+			res = compare_numbers(i.m_cmpop, strcmp((char*)val, i.m_str), 0);
+			break;
+		case OP_STR_CONTAINS:
+			res = (strstr((char*)val, i.m_str) != NULL);
+			break;
+#ifndef _WIN32
+		case OP_STR_ICONTAINS:
+			res = (strcasestr((char*)val, i.m_str) != NULL);
+			break;
+#endif
+		case OP_STR_STARTSWITH:
+			res = (strncmp((char*)val, i.m_str, i.m_len) == 0);
+			break;
+		case OP_STR_ENDSWITH:
+			res = sinsp_utils::endswith((char*)val, i.m_str, (uint32_t)strlen((char*)val), i.m_len);
+			break;
+		case OP_STR_GLOB:
+			res = sinsp_utils::glob_match(i.m_str, (char*)val);
+			break;
+		case OP_STR_IN:
+			{
+				sinsp_filter_check* chk = i.m_filter_check;
+				uint32_t vlen = len? len : (uint32_t)strlen((char*)val);
+
+				res = (vlen >= chk->m_val_storages_min_size &&
+				       vlen <= chk->m_val_storages_max_size &&
+				       chk->m_val_storages_members.find(filter_value_t(val, vlen)) != chk->m_val_storages_members.end());
+			}
+			break;
+		case OP_UINT:
+			switch(i.m_width)
+			{
+			case 1:
+				res = compare_numbers<uint64_t>(i.m_cmpop, *(uint8_t*)val, i.m_u64);
+				break;
+			case 2:
+				res = compare_numbers<uint64_t>(i.m_cmpop, *(uint16_t*)val, i.m_u64);
+				break;
+			case 4:
+				res = compare_numbers<uint64_t>(i.m_cmpop, *(uint32_t*)val, i.m_u64);
+				break;
+			default:
+				res = compare_numbers<uint64_t>(i.m_cmpop, *(uint64_t*)val, i.m_u64);
+				break;
+			}
+			break;
+		case OP_INT:
+			switch(i.m_width)
+			{
+			case 1:
+				res = compare_numbers<int64_t>(i.m_cmpop, *(int8_t*)val, i.m_s64);
+				break;
+			case 2:
+				res = compare_numbers<int64_t>(i.m_cmpop, *(int16_t*)val, i.m_s64);
+				break;
+			case 4:
+				res = compare_numbers<int64_t>(i.m_cmpop, *(int32_t*)val, i.m_s64);
+				break;
+			default:
+				res = compare_numbers<int64_t>(i.m_cmpop, *(int64_t*)val, i.m_s64);
+				break;
+			}
+			break;
+		case OP_DOUBLE:
+			res = compare_numbers<double>(i.m_cmpop, *(double*)val, i.m_double);
+			break;
+		default:
+			res = i.m_filter_check->flt_compare((cmpop)i.m_cmpop,
+							    (ppm_param_type)i.m_type,
+							    val,
+							    len,
+							    i.m_filter_check->m_val_storage_len);
+			break;
+		}
+
+		pc++;
+	}
+
+	return res;
+}
+
+std::string sinsp_filter_program::dump() const
+{
+	std::string out;
+	char line[64];
+
+	for(uint32_t j = 0; j < m_code.size(); j++)
+	{
+		const insn& i = m_code[j];
+
+		snprintf(line, sizeof(line), "%3u: %s", j, opcode_names[i.m_op]);
+		out += line;
+
+		switch(i.m_op)
+		{
+		case OP_JMP_TRUE:
+		case OP_JMP_FALSE:
+			out += " " + std::to_string(i.m_target);
+			break;
+		case OP_EXTRACT:
+			out += " " + (i.m_filter_check->m_field_name.empty()?
+				      std::string(i.m_filter_check->get_field_info()->m_name) :
+				      i.m_filter_check->m_field_name);
+			out += ", else " + std::to_string(i.m_target);
+			break;
+		case OP_STR_EQ:
+		case OP_STR_NE:
+		case OP_STR_CONTAINS:
+		case OP_STR_ICONTAINS:
+		case OP_STR_STARTSWITH:
+		case OP_STR_ENDSWITH:
+		case OP_STR_GLOB:
+			out += std::string(" \"") + i.m_str + "\"";
+			break;
+		case OP_UINT:
+			out += " " + std::to_string(i.m_u64);
+			break;
+		case OP_INT:
+			out += " " + std::to_string(i.m_s64);
+			break;
+		default:
+			break;
+		}
+
+		out += "\n";
+	}
+
+	return out;
+}
+
+#endif // HAS_FILTERING
@@ -0,0 +1,126 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#ifdef HAS_FILTERING
+
+#include <string>
+#include <vector>
+#include "gen_filter.h"
+
+class sinsp_evt;
+class sinsp_filter_check;
+
+/*!
+  \brief A filter expression tree lowered into a linear program.
+
+  Evaluation keeps a single boolean result register, like
+  gen_event_filter_expression::compare() does, and 'and'/'or' become
+  conditional jumps past the rest of the expression. Checks whose compare()
+  is a plain extract() + flt_compare() are split into an extraction and a
+  compare opcode specialized for the field type and operator, with the
+  constant operand decoded at compile time. Consecutive extractions of the
+  same field, as in the 'or' chains generated for 'in' clauses, are done
+  only once per event. Everything else calls the check's compare(), so
+  results and matched check ids are the same as walking the tree.
+
+  The program points to the checks of the tree it was compiled from, which
+  must outlive it.
+*/
+class sinsp_filter_program
+{
+public:
+	sinsp_filter_program();
+
+	void compile(gen_event_filter_expression* root);
+
+	bool run(sinsp_evt* evt);
+
+	size_t size() const
+	{
+		return m_code.size();
+	}
+
+	//
+	// Human readable listing of the program, for debugging
+	//
+	std::string dump() const;
+
+private:
+	enum opcode
+	{
+		OP_TRUE,
+		OP_NOT,
+		OP_JMP_TRUE,
+		OP_JMP_FALSE,
+		OP_SET_CHECK_ID,
+		OP_CHECK,
+		OP_EXTRACT,
+		OP_EXISTS,
+		OP_STR_EQ,
+		OP_STR_NE,
+		OP_STR_ORDER,
+		OP_STR_CONTAINS,
+		OP_STR_ICONTAINS,
+		OP_STR_STARTSWITH,
+		OP_STR_ENDSWITH,
+		OP_STR_GLOB,
+		OP_STR_IN,
+		OP_UINT,
+		OP_INT,
+		OP_DOUBLE,
+		OP_GENERIC,
+	};
+
+	static const uint32_t NO_SLOT = 0xffffffff;
+
+	struct insn
+	{
+		uint8_t m_op;
+		uint8_t m_cmpop;
+		uint8_t m_width;
+		uint8_t m_type;
+		// Jump target. For OP_EXTRACT, where to go when there's no value.
+		uint32_t m_target;
+		// Extraction slot, checks extracting the same field share one
+		uint32_t m_slot;
+		gen_event_filter_check* m_check;
+		sinsp_filter_check* m_filter_check;
+		// Constant operand
+		union
+		{
+			uint64_t m_u64;
+			int64_t m_s64;
+			double m_double;
+		};
+		const char* m_str;
+		uint32_t m_len;
+	};
+
+	void compile_expression(gen_event_filter_expression* expr);
+	void compile_check(gen_event_filter_check* chk);
+	bool compile_compare(sinsp_filter_check* chk, insn* i);
+	uint32_t get_slot(sinsp_filter_check* chk);
+	void thread_jumps();
+	size_t emit(uint8_t op, gen_event_filter_check* chk = NULL);
+
+	std::vector<insn> m_code;
+	std::vector<std::string> m_slot_names;
+};
+
+#endif // HAS_FILTERING
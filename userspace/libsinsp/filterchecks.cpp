@@ -455,11 +455,11 @@ uint8_t* sinsp_filter_check_fd::extract(sinsp_evt *evt, OUT uint32_t* len, bool
 		if(m_field_id == TYPE_CONTAINERNAME)
 		{
 			ASSERT(m_tinfo != NULL);
-			m_tstr = m_tinfo->m_container_id + ':' + m_fdinfo->m_name;
+			m_tstr = m_tinfo->m_container_id + ':' + m_fdinfo->get_name();
 		}
 		else
 		{
-			m_tstr = m_fdinfo->m_name;
+			m_tstr = m_fdinfo->get_name();
 		}
 
 		if(sanitize_strings)
@@ -491,7 +491,7 @@ uint8_t* sinsp_filter_check_fd::extract(sinsp_evt *evt, OUT uint32_t* len, bool
 				return NULL;
 			}
 
-			m_tstr = m_fdinfo->m_name;
+			m_tstr = m_fdinfo->get_name();
 			if(sanitize_strings)
 			{
 				sanitize_string(m_tstr);
@@ -532,7 +532,7 @@ uint8_t* sinsp_filter_check_fd::extract(sinsp_evt *evt, OUT uint32_t* len, bool
 				return NULL;
 			}
 
-			m_tstr = m_fdinfo->m_name;
+			m_tstr = m_fdinfo->get_name();
 			if(sanitize_strings)
 			{
 				sanitize_string(m_tstr);
@@ -1800,6 +1800,24 @@ bool sinsp_filter_check_fd::compare(sinsp_evt *evt)
 			   len);
 }
 
+bool sinsp_filter_check_fd::has_generic_compare()
+{
+	switch(m_field_id)
+	{
+	case TYPE_IP:
+	case TYPE_PORT:
+	case TYPE_PROTO:
+	case TYPE_NET:
+	case TYPE_CLIENTIP_NAME:
+	case TYPE_SERVERIP_NAME:
+	case TYPE_LIP_NAME:
+	case TYPE_RIP_NAME:
+		return false;
+	default:
+		return true;
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter_check_thread implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -2161,14 +2179,11 @@ uint8_t* sinsp_filter_check_thread::extract(sinsp_evt *evt, OUT uint32_t* len, b
 	case TYPE_TTY:
 		RETURN_EXTRACT_VAR(tinfo->m_tty);
 	case TYPE_NAME:
-		m_tstr = tinfo->get_comm();
-		RETURN_EXTRACT_STRING(m_tstr);
+		RETURN_EXTRACT_STRING(tinfo->m_comm.str());
 	case TYPE_EXE:
-		m_tstr = tinfo->get_exe();
-		RETURN_EXTRACT_STRING(m_tstr);
+		RETURN_EXTRACT_STRING(tinfo->m_exe.str());
 	case TYPE_EXEPATH:
-		m_tstr = tinfo->get_exepath();
-		RETURN_EXTRACT_STRING(m_tstr);
+		RETURN_EXTRACT_STRING(tinfo->m_exepath.str());
 	case TYPE_ARGS:
 		{
 			m_tstr.clear();
@@ -2763,9 +2778,62 @@ bool sinsp_filter_check_thread::compare_full_aname(sinsp_evt *evt)
 	return found;
 }
 
+//
+// proc.name, proc.exe and proc.exepath are interned in the thread table, so
+// equality and set membership are decided by comparing the table entries
+// of the filter values against the one of the thread, with no string
+// compare.
+//
+bool sinsp_filter_check_thread::compare_interned(sinsp_evt *evt)
+{
+	sinsp_threadinfo* tinfo = evt->get_thread_info();
+
+	if(tinfo == NULL)
+	{
+		return false;
+	}
+
+	if(m_interned_vals.empty())
+	{
+		for(const filter_value_t& val : m_val_storages_members)
+		{
+			m_interned_vals.push_back(libsinsp::interned_string((const char*)val.first, val.second));
+			m_interned_ids.push_back(m_interned_vals.back().id());
+		}
+
+		sort(m_interned_ids.begin(), m_interned_ids.end());
+	}
+
+	const libsinsp::interned_string* str;
+
+	switch(m_field_id)
+	{
+	case TYPE_NAME:
+		str = &tinfo->m_comm;
+		break;
+	case TYPE_EXE:
+		str = &tinfo->m_exe;
+		break;
+	default:
+		str = &tinfo->m_exepath;
+		break;
+	}
+
+	bool found = binary_search(m_interned_ids.begin(), m_interned_ids.end(), str->id());
+
+	return (m_cmpop == CO_NE)? !found : found;
+}
+
 bool sinsp_filter_check_thread::compare(sinsp_evt *evt)
 {
-	if(m_field_id == TYPE_APID)
+	if(m_field_id == TYPE_NAME || m_field_id == TYPE_EXE || m_field_id == TYPE_EXEPATH)
+	{
+		if(m_cmpop == CO_EQ || m_cmpop == CO_NE || m_cmpop == CO_IN)
+		{
+			return compare_interned(evt);
+		}
+	}
+	else if(m_field_id == TYPE_APID)
 	{
 		if(m_argid == -1)
 		{
@@ -2783,6 +2851,32 @@ bool sinsp_filter_check_thread::compare(sinsp_evt *evt)
 	return sinsp_filter_check::compare(evt);
 }
 
+bool sinsp_filter_check_thread::has_generic_compare()
+{
+	if(m_field_id == TYPE_APID || m_field_id == TYPE_ANAME)
+	{
+		return m_argid != -1;
+	}
+	else if(m_field_id == TYPE_NAME || m_field_id == TYPE_EXE || m_field_id == TYPE_EXEPATH)
+	{
+		return m_cmpop != CO_EQ && m_cmpop != CO_NE && m_cmpop != CO_IN;
+	}
+
+	return true;
+}
+
+bool sinsp_filter_check_thread::is_extraction_shareable()
+{
+	//
+	// These compute deltas from the last time this check was extracted
+	//
+	return m_field_id != TYPE_EXECTIME &&
+		m_field_id != TYPE_TOTEXECTIME &&
+		m_field_id != TYPE_THREAD_CPU &&
+		m_field_id != TYPE_THREAD_CPU_USER &&
+		m_field_id != TYPE_THREAD_CPU_SYSTEM;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter_check_event implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -3292,13 +3386,15 @@ uint8_t *sinsp_filter_check_event::extract_abspath(sinsp_evt *evt, OUT uint32_t
 		}
 		else
 		{
-			if(evt->m_fdinfo->m_name[evt->m_fdinfo->m_name.length()] == '/')
+			const string& name = evt->m_fdinfo->get_name();
+
+			if(name[name.length()] == '/')
 			{
-				sdir = evt->m_fdinfo->m_name;
+				sdir = name;
 			}
 			else
 			{
-				sdir = evt->m_fdinfo->m_name + '/';
+				sdir = name + '/';
 			}
 		}
 	}
@@ -4143,7 +4239,7 @@ uint8_t* sinsp_filter_check_event::extract(sinsp_evt *evt, OUT uint32_t* len, bo
 
 				if(fdinfo != NULL)
 				{
-					if(fdinfo->m_name.find("/dev/log") != string::npos)
+					if(fdinfo->get_name().find("/dev/log") != string::npos)
 					{
 						m_u32val = 1;
 					}
@@ -4575,6 +4671,23 @@ bool sinsp_filter_check_event::compare(sinsp_evt *evt)
 	return res;
 }
 
+bool sinsp_filter_check_event::has_generic_compare()
+{
+	return m_field_id != TYPE_ARGRAW &&
+		m_field_id != TYPE_AROUND &&
+		m_field_id != TYPE_BUFFER;
+}
+
+bool sinsp_filter_check_event::is_extraction_shareable()
+{
+	//
+	// The latency fields keep per-check state in the thread, and the
+	// buffer is extracted raw when comparing and formatted otherwise
+	//
+	return m_field_id != TYPE_BUFFER &&
+		(m_field_id < TYPE_LATENCY || m_field_id > TYPE_LATENCY_HUMAN);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter_check_user implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -5883,6 +5996,16 @@ fcec_end:
 	return res;
 }
 
+bool sinsp_filter_check_evtin::has_generic_compare()
+{
+	return false;
+}
+
+bool sinsp_filter_check_evtin::is_extraction_shareable()
+{
+	return false;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // rawstring_check implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -6980,9 +7103,9 @@ uint8_t* sinsp_filter_check_fdlist::extract(sinsp_evt *evt, OUT uint32_t* len, b
 		{
 			if(fdinfo != NULL)
 			{
-				if(fdinfo->m_name != "")
+				if(fdinfo->get_name() != "")
 				{
-					m_strval += fdinfo->m_name;
+					m_strval += fdinfo->get_name();
 				}
 				else
 				{
@@ -20,6 +20,8 @@ limitations under the License.
 #include <json/json.h>
 #include "filter_value.h"
 #include "prefix_search.h"
+#include "interned_string.h"
+#include "extraction_cache.h"
 #if !defined(CYGWING_AGENT) && !defined(MINIMAL_BUILD)
 #include "k8s.h"
 #include "mesos.h"
@@ -47,13 +49,6 @@ public:
 	string m_description;
 };
 
-class check_extraction_cache_entry
-{
-public:
-	uint64_t m_evtnum = UINT64_MAX;
-	uint8_t* m_res;
-};
-
 class check_eval_cache_entry
 {
 public:
@@ -123,7 +118,8 @@ public:
 
 	//
 	// Wrapper for extract() that implements caching to speed up multiple extractions of the same value,
-	// which are common in Falco.
+	// which are common in Falco. Checks with a field name share the inspector's sinsp_extraction_cache,
+	// so the filter, the formatters and the tables extract each field only once per event.
 	//
 	uint8_t* extract_cached(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
 
@@ -142,6 +138,27 @@ public:
 	bool compare(gen_event *evt);
 	virtual bool compare(sinsp_evt *evt);
 
+	//
+	// True if compare() is just extract() followed by flt_compare() for the
+	// current field, which lets compiled filters do the comparison inline.
+	// Checks that special-case compare() return false for those fields.
+	//
+	virtual bool has_generic_compare()
+	{
+		return true;
+	}
+
+	//
+	// True if every check with the same field name extracts the same value
+	// from a given event. Fields that keep per-check state, or that extract
+	// differently while comparing, return false and bypass the extraction
+	// cache.
+	//
+	virtual bool is_extraction_shareable()
+	{
+		return true;
+	}
+
 	//
 	// Extract the value from the event and convert it into a string
 	//
@@ -155,6 +172,9 @@ public:
 
 	sinsp* m_inspector;
 	bool m_needs_state_tracking = false;
+	// Full field name including the argument, set by whoever parsed the
+	// check. Checks with the same name share extracted values.
+	string m_field_name;
 	sinsp_field_aggregation m_aggregation;
 	sinsp_field_aggregation m_merge_aggregation;
 	check_eval_cache_entry* m_eval_cache_entry = NULL;
@@ -195,6 +215,7 @@ private:
 
 friend class sinsp_filter_check_list;
 friend class sinsp_filter_optimizer;
+friend class sinsp_filter_program;
 friend class chk_compare_helper;
 };
 
@@ -295,6 +316,7 @@ public:
 	bool compare_port(sinsp_evt *evt);
 	bool compare_domain(sinsp_evt *evt);
 	bool compare(sinsp_evt *evt);
+	bool has_generic_compare();
 
 	sinsp_threadinfo* m_tinfo;
 	sinsp_fdinfo_t* m_fdinfo;
@@ -373,6 +395,8 @@ public:
 	int32_t parse_field_name(const char* str, bool alloc_state, bool needed_for_filtering);
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
 	bool compare(sinsp_evt *evt);
+	bool has_generic_compare();
+	bool is_extraction_shareable();
 
 private:
 	uint64_t extract_exectime(sinsp_evt *evt);
@@ -380,6 +404,7 @@ private:
 	uint8_t* extract_thread_cpu(sinsp_evt *evt, OUT uint32_t* len, sinsp_threadinfo* tinfo, bool extract_user, bool extract_system);
 	inline bool compare_full_apid(sinsp_evt *evt);
 	bool compare_full_aname(sinsp_evt *evt);
+	bool compare_interned(sinsp_evt *evt);
 
 	int32_t m_argid;
 	string m_argname;
@@ -391,6 +416,8 @@ private:
 	vector<uint64_t> m_last_proc_switch_times;
 	uint32_t m_th_state_id;
 	uint64_t m_cursec_ts;
+	vector<libsinsp::interned_string> m_interned_vals;
+	vector<const void*> m_interned_ids;
 };
 
 //
@@ -481,6 +508,8 @@ public:
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
 	Json::Value extract_as_js(sinsp_evt *evt, OUT uint32_t* len);
 	bool compare(sinsp_evt *evt);
+	bool has_generic_compare();
+	bool is_extraction_shareable();
 
 	uint64_t m_u64val;
 	uint64_t m_tsdelta;
@@ -655,6 +684,8 @@ public:
 	sinsp_filter_check* allocate_new();
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
 	bool compare(sinsp_evt *evt);
+	bool has_generic_compare();
+	bool is_extraction_shareable();
 
 	uint64_t m_u64val;
 	uint64_t m_tsdelta;
@@ -179,7 +179,7 @@ public:
 	  \param evt Pointer that needs to be filtered.
 	  \return true if the event is accepted by the filter, false if it's rejected.
 	*/
-	bool run(gen_event *evt);
+	virtual bool run(gen_event *evt);
 	void push_expression(boolop op);
 	void pop_expression();
 	void add_check(gen_event_filter_check* chk);
@@ -0,0 +1,174 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <mutex>
+#include <vector>
+#include "interned_string.h"
+
+using namespace libsinsp;
+
+namespace
+{
+
+//
+// FNV-1a, so that lookups can hash the caller's buffer without building
+// a std::string first
+//
+size_t hash_buffer(const char* str, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	for(size_t j = 0; j < len; j++)
+	{
+		h ^= (unsigned char)str[j];
+		h *= 1099511628211ULL;
+	}
+
+	return (size_t)h;
+}
+
+}
+
+//
+// Chained hash table of the live entries. It's allocated on first use and
+// never destroyed, so that handles held by static objects stay valid
+// during exit.
+//
+struct interned_string::table
+{
+	table():
+		m_buckets(256, nullptr),
+		m_count(0)
+	{
+	}
+
+	std::mutex m_mutex;
+	std::vector<entry*> m_buckets;
+	size_t m_count;
+};
+
+interned_string::table* interned_string::get_table()
+{
+	static table* t = new table();
+	return t;
+}
+
+interned_string::entry* interned_string::intern(const char* str, size_t len)
+{
+	if(len == 0)
+	{
+		return nullptr;
+	}
+
+	table* t = get_table();
+	size_t hash = hash_buffer(str, len);
+	std::lock_guard<std::mutex> lock(t->m_mutex);
+	size_t nbuckets = t->m_buckets.size();
+	entry** bucket = &t->m_buckets[hash & (nbuckets - 1)];
+
+	for(entry* e = *bucket; e != nullptr; e = e->m_next)
+	{
+		if(e->m_hash == hash && e->m_str.size() == len && memcmp(e->m_str.c_str(), str, len) == 0)
+		{
+			e->m_refs.fetch_add(1, std::memory_order_relaxed);
+			return e;
+		}
+	}
+
+	//
+	// Keep the load factor below 1
+	//
+	if(t->m_count >= nbuckets)
+	{
+		std::vector<entry*> buckets(nbuckets * 2, nullptr);
+
+		for(size_t j = 0; j < nbuckets; j++)
+		{
+			entry* e = t->m_buckets[j];
+			while(e != nullptr)
+			{
+				entry* next = e->m_next;
+				entry** dst = &buckets[e->m_hash & (nbuckets * 2 - 1)];
+				e->m_next = *dst;
+				*dst = e;
+				e = next;
+			}
+		}
+
+		t->m_buckets.swap(buckets);
+		nbuckets *= 2;
+		bucket = &t->m_buckets[hash & (nbuckets - 1)];
+	}
+
+	entry* e = new entry();
+	e->m_refs.store(1, std::memory_order_relaxed);
+	e->m_hash = hash;
+	e->m_str.assign(str, len);
+	e->m_next = *bucket;
+	*bucket = e;
+	t->m_count++;
+
+	return e;
+}
+
+void interned_string::release(entry* e)
+{
+	//
+	// Drop the reference without locking as long as it's not the last one.
+	// The last one is dropped under the lock, which intern() also holds
+	// when it hands out new references to existing entries.
+	//
+	uint32_t refs = e->m_refs.load(std::memory_order_relaxed);
+	while(refs > 1)
+	{
+		if(e->m_refs.compare_exchange_weak(refs, refs - 1, std::memory_order_release, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+
+	table* t = get_table();
+	std::lock_guard<std::mutex> lock(t->m_mutex);
+
+	if(e->m_refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+	{
+		return;
+	}
+
+	entry** prev = &t->m_buckets[e->m_hash & (t->m_buckets.size() - 1)];
+	while(*prev != e)
+	{
+		prev = &(*prev)->m_next;
+	}
+
+	*prev = e->m_next;
+	t->m_count--;
+	delete e;
+}
+
+const std::string& interned_string::empty_string()
+{
+	static const std::string empty;
+	return empty;
+}
+
+size_t interned_string::table_size()
+{
+	table* t = get_table();
+	std::lock_guard<std::mutex> lock(t->m_mutex);
+	return t->m_count;
+}
@@ -0,0 +1,295 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace libsinsp
+{
+
+/**
+ * Reference-counted handle to a string in a process-wide intern table.
+ *
+ * Equal strings always map to the same table entry, so copying a handle
+ * doesn't allocate and two handles compare equal if and only if they
+ * point to the same entry. An entry is freed when its last handle goes
+ * away. Handles can be created and destroyed from any thread; the empty
+ * string doesn't use the table at all.
+ *
+ * Read access goes through a const std::string, so the usual read-only
+ * string idioms keep working.
+ */
+class interned_string
+{
+public:
+	interned_string():
+		m_entry(nullptr)
+	{
+	}
+
+	interned_string(const char* str):
+		m_entry(intern(str, strlen(str)))
+	{
+	}
+
+	interned_string(const char* str, size_t len):
+		m_entry(intern(str, len))
+	{
+	}
+
+	interned_string(const std::string& str):
+		m_entry(intern(str.c_str(), str.size()))
+	{
+	}
+
+	interned_string(const interned_string& other):
+		m_entry(other.m_entry)
+	{
+		if(m_entry)
+		{
+			m_entry->m_refs.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	interned_string(interned_string&& other):
+		m_entry(other.m_entry)
+	{
+		other.m_entry = nullptr;
+	}
+
+	~interned_string()
+	{
+		if(m_entry)
+		{
+			release(m_entry);
+		}
+	}
+
+	interned_string& operator=(const interned_string& other)
+	{
+		interned_string(other).swap(*this);
+		return *this;
+	}
+
+	interned_string& operator=(interned_string&& other)
+	{
+		interned_string(std::move(other)).swap(*this);
+		return *this;
+	}
+
+	interned_string& operator=(const char* str)
+	{
+		interned_string(str).swap(*this);
+		return *this;
+	}
+
+	interned_string& operator=(const std::string& str)
+	{
+		interned_string(str).swap(*this);
+		return *this;
+	}
+
+	void swap(interned_string& other)
+	{
+		entry* e = m_entry;
+		m_entry = other.m_entry;
+		other.m_entry = e;
+	}
+
+	const std::string& str() const
+	{
+		return m_entry? m_entry->m_str : empty_string();
+	}
+
+	operator const std::string&() const
+	{
+		return str();
+	}
+
+	const char* c_str() const
+	{
+		return str().c_str();
+	}
+
+	size_t size() const
+	{
+		return m_entry? m_entry->m_str.size() : 0;
+	}
+
+	size_t length() const
+	{
+		return size();
+	}
+
+	bool empty() const
+	{
+		return m_entry == nullptr;
+	}
+
+	char operator[](size_t pos) const
+	{
+		return str()[pos];
+	}
+
+	std::string substr(size_t pos = 0, size_t len = std::string::npos) const
+	{
+		return str().substr(pos, len);
+	}
+
+	void clear()
+	{
+		interned_string().swap(*this);
+	}
+
+	/**
+	 * Opaque identity of the string: equal strings have the same id.
+	 */
+	const void* id() const
+	{
+		return m_entry;
+	}
+
+	/**
+	 * Number of distinct strings currently in the table.
+	 */
+	static size_t table_size();
+
+private:
+	struct entry
+	{
+		std::atomic<uint32_t> m_refs;
+		size_t m_hash;
+		entry* m_next;
+		std::string m_str;
+	};
+
+	struct table;
+
+	static table* get_table();
+	static entry* intern(const char* str, size_t len);
+	static void release(entry* e);
+	static const std::string& empty_string();
+
+	entry* m_entry;
+};
+
+inline bool operator==(const interned_string& a, const interned_string& b)
+{
+	return a.id() == b.id();
+}
+
+inline bool operator!=(const interned_string& a, const interned_string& b)
+{
+	return a.id() != b.id();
+}
+
+inline bool operator==(const interned_string& a, const std::string& b)
+{
+	return a.str() == b;
+}
+
+inline bool operator==(const std::string& a, const interned_string& b)
+{
+	return a == b.str();
+}
+
+inline bool operator!=(const interned_string& a, const std::string& b)
+{
+	return a.str() != b;
+}
+
+inline bool operator!=(const std::string& a, const interned_string& b)
+{
+	return a != b.str();
+}
+
+inline bool operator==(const interned_string& a, const char* b)
+{
+	return a.str() == b;
+}
+
+inline bool operator==(const char* a, const interned_string& b)
+{
+	return a == b.str();
+}
+
+inline bool operator!=(const interned_string& a, const char* b)
+{
+	return a.str() != b;
+}
+
+inline bool operator!=(const char* a, const interned_string& b)
+{
+	return a != b.str();
+}
+
+inline bool operator<(const interned_string& a, const interned_string& b)
+{
+	return a.str() < b.str();
+}
+
+inline std::string operator+(const std::string& a, const interned_string& b)
+{
+	return a + b.str();
+}
+
+inline std::string operator+(const interned_string& a, const std::string& b)
+{
+	return a.str() + b;
+}
+
+inline std::string operator+(const char* a, const interned_string& b)
+{
+	return a + b.str();
+}
+
+inline std::string operator+(const interned_string& a, const char* b)
+{
+	return a.str() + b;
+}
+
+inline std::string operator+(const interned_string& a, char b)
+{
+	return a.str() + b;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const interned_string& s)
+{
+	return os << s.str();
+}
+
+}
+
+namespace std
+{
+//
+// Equal strings share an entry, so the entry address is a valid hash
+//
+template<> struct hash<libsinsp::interned_string>
+{
+	size_t operator()(const libsinsp::interned_string& s) const
+	{
+		return std::hash<const void*>()(s.id());
+	}
+};
+}
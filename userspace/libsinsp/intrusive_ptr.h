@@ -0,0 +1,175 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+namespace libsinsp
+{
+
+/**
+ * Smart pointer to an object that carries its own reference count.
+ *
+ * The pointee type must provide intrusive_ptr_add_ref(T*) and
+ * intrusive_ptr_release(T*), found by argument-dependent lookup; the
+ * latter is in charge of freeing the object when the last reference goes
+ * away. Unlike std::shared_ptr there's no separate control block, so
+ * taking ownership of a raw pointer doesn't allocate, and a raw pointer
+ * can be wrapped again at any time without creating a second owner.
+ */
+template<class T>
+class intrusive_ptr
+{
+public:
+	intrusive_ptr():
+		m_ptr(nullptr)
+	{
+	}
+
+	intrusive_ptr(std::nullptr_t):
+		m_ptr(nullptr)
+	{
+	}
+
+	explicit intrusive_ptr(T* ptr):
+		m_ptr(ptr)
+	{
+		if(m_ptr)
+		{
+			intrusive_ptr_add_ref(m_ptr);
+		}
+	}
+
+	intrusive_ptr(const intrusive_ptr& other):
+		m_ptr(other.m_ptr)
+	{
+		if(m_ptr)
+		{
+			intrusive_ptr_add_ref(m_ptr);
+		}
+	}
+
+	intrusive_ptr(intrusive_ptr&& other):
+		m_ptr(other.m_ptr)
+	{
+		other.m_ptr = nullptr;
+	}
+
+	~intrusive_ptr()
+	{
+		if(m_ptr)
+		{
+			intrusive_ptr_release(m_ptr);
+		}
+	}
+
+	intrusive_ptr& operator=(const intrusive_ptr& other)
+	{
+		intrusive_ptr(other).swap(*this);
+		return *this;
+	}
+
+	intrusive_ptr& operator=(intrusive_ptr&& other)
+	{
+		intrusive_ptr(std::move(other)).swap(*this);
+		return *this;
+	}
+
+	intrusive_ptr& operator=(std::nullptr_t)
+	{
+		reset();
+		return *this;
+	}
+
+	void reset()
+	{
+		intrusive_ptr().swap(*this);
+	}
+
+	void reset(T* ptr)
+	{
+		intrusive_ptr(ptr).swap(*this);
+	}
+
+	void swap(intrusive_ptr& other)
+	{
+		std::swap(m_ptr, other.m_ptr);
+	}
+
+	T* get() const
+	{
+		return m_ptr;
+	}
+
+	T& operator*() const
+	{
+		return *m_ptr;
+	}
+
+	T* operator->() const
+	{
+		return m_ptr;
+	}
+
+	explicit operator bool() const
+	{
+		return m_ptr != nullptr;
+	}
+
+private:
+	T* m_ptr;
+};
+
+template<class T>
+inline bool operator==(const intrusive_ptr<T>& a, const intrusive_ptr<T>& b)
+{
+	return a.get() == b.get();
+}
+
+template<class T>
+inline bool operator!=(const intrusive_ptr<T>& a, const intrusive_ptr<T>& b)
+{
+	return a.get() != b.get();
+}
+
+template<class T>
+inline bool operator==(const intrusive_ptr<T>& a, std::nullptr_t)
+{
+	return a.get() == nullptr;
+}
+
+template<class T>
+inline bool operator!=(const intrusive_ptr<T>& a, std::nullptr_t)
+{
+	return a.get() != nullptr;
+}
+
+template<class T>
+inline bool operator==(std::nullptr_t, const intrusive_ptr<T>& a)
+{
+	return a.get() == nullptr;
+}
+
+template<class T>
+inline bool operator!=(std::nullptr_t, const intrusive_ptr<T>& a)
+{
+	return a.get() != nullptr;
+}
+
+}
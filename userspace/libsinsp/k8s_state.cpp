@@ -262,57 +262,49 @@ k8s_component& k8s_state_t::add_common_single_value(k8s_component::type componen
 
 k8s_node_t* k8s_state_t::get_node(const std::string& uid)
 {
-	for (auto& node : m_nodes)
-	{
-		if(node.get_uid() == uid)
-		{
-			return &node;
-		}
-	}
-
-	return nullptr;
+	return get_component<k8s_nodes, k8s_node_t>(m_nodes, uid);
 }
 
 void k8s_state_t::clear(k8s_component::type type)
 {
 	if(type == k8s_component::K8S_COMPONENT_COUNT)
 	{
-		m_namespaces.clear();
-		m_nodes.clear();
-		m_pods.clear();
-		m_controllers.clear();
-		m_services.clear();
+		clear_components(m_namespaces);
+		clear_components(m_nodes);
+		clear_components(m_pods);
+		clear_components(m_controllers);
+		clear_components(m_services);
 	}
 	else
 	{
 		switch (type)
 		{
 		case k8s_component::K8S_NODES:
-			m_nodes.clear();
+			clear_components(m_nodes);
 			break;
 		case k8s_component::K8S_NAMESPACES:
-			m_namespaces.clear();
+			clear_components(m_namespaces);
 			break;
 		case k8s_component::K8S_PODS:
-			m_pods.clear();
+			clear_components(m_pods);
 			break;
 		case k8s_component::K8S_REPLICATIONCONTROLLERS:
-			m_controllers.clear();
+			clear_components(m_controllers);
 			break;
 		case k8s_component::K8S_REPLICASETS:
-			m_replicasets.clear();
+			clear_components(m_replicasets);
 			break;
 		case k8s_component::K8S_SERVICES:
-			m_services.clear();
+			clear_components(m_services);
 			break;
 		case k8s_component::K8S_DAEMONSETS:
-			m_daemonsets.clear();
+			clear_components(m_daemonsets);
 			break;
 		case k8s_component::K8S_DEPLOYMENTS:
-			m_deployments.clear();
+			clear_components(m_deployments);
 			break;
 		case k8s_component::K8S_EVENTS:
-			m_events.clear();
+			clear_components(m_events);
 			break;
 		case k8s_component::K8S_COMPONENT_COUNT:
 		default:
@@ -153,14 +153,7 @@ public:
 	template <typename C>
 	bool has(const C& components, const std::string& uid) const
 	{
-		for (auto& comp : components)
-		{
-			if(uid == comp.get_uid())
-			{
-				return true;
-			}
-		}
-		return false;
+		return find_component(components, uid) != components.size();
 	}
 
 	bool has(const std::string& uid) const
@@ -173,12 +166,10 @@ public:
 	template <typename C, typename T>
 	T* get_component(C& components, const std::string& uid)
 	{
-		for (auto& comp : components)
+		size_t pos = find_component(components, uid);
+		if(pos != components.size())
 		{
-			if(comp.get_uid() == uid)
-			{
-				return &comp;
-			}
+			return &components[pos];
 		}
 		return 0;
 	}
@@ -186,12 +177,34 @@ public:
 	template <typename C, typename T>
 	const T* get_component(const C& components, const std::string& uid) const
 	{
-		for (const auto& comp : components)
+		size_t pos = find_component(components, uid);
+		if(pos != components.size())
 		{
-			if(comp.get_uid() == uid)
-			{
-				return &comp;
-			}
+			return &components[pos];
+		}
+		return 0;
+	}
+
+	// Returns a pointer to the component with the given namespace and
+	// name, if it exists. If it does not exist, it returns null pointer.
+	template <typename C, typename T>
+	T* get_component_by_name(C& components, const std::string& ns, const std::string& name)
+	{
+		size_t pos = find_component_by_name(components, ns, name);
+		if(pos != components.size())
+		{
+			return &components[pos];
+		}
+		return 0;
+	}
+
+	template <typename C, typename T>
+	const T* get_component_by_name(const C& components, const std::string& ns, const std::string& name) const
+	{
+		size_t pos = find_component_by_name(components, ns, name);
+		if(pos != components.size())
+		{
+			return &components[pos];
 		}
 		return 0;
 	}
@@ -201,6 +214,7 @@ public:
 	{
 		m_component_map[uid] = T::COMPONENT_TYPE;
 		container.emplace_back(std::move(T(name, uid, ns)));
+		index_component(container, container.size() - 1);
 		return container.back();
 	}
 
@@ -210,33 +224,34 @@ public:
 	template <typename C, typename T>
 	T& get_component(C& container, const std::string& name, const std::string& uid, const std::string& ns = "")
 	{
-		for (auto& comp : container)
+		size_t pos = find_component(container, uid);
+		if(pos != container.size())
 		{
-			if(comp.get_uid() == uid)
-			{
-				return comp;
-			}
+			return container[pos];
 		}
 		return add_component<C, T>(container, name, uid, ns);
 	}
 
+	// Removes the component, moving the last one of the container in
+	// its place, so the order of the container is not preserved.
 	template <typename C>
 	bool delete_component(C& components, const std::string& uid)
 	{
-		for (typename C::iterator component = components.begin(),
-			end = components.end();
-			component != end;
-			++component)
+		size_t pos = find_component(components, uid);
+		if(pos == components.size())
 		{
-			if(component->get_uid() == uid)
-			{
-				components.erase(component);
-				m_component_map.erase(uid);
-				return true;
-			}
+			return false;
 		}
 
-		return false;
+		unindex_component(components, pos);
+		if(pos != components.size() - 1)
+		{
+			components[pos] = std::move(components.back());
+			index_component(components, pos);
+		}
+		components.pop_back();
+		m_component_map.erase(uid);
+		return true;
 	}
 
 	void clear(k8s_component::type type = k8s_component::K8S_COMPONENT_COUNT);
@@ -286,6 +301,108 @@ private:
 	static k8s_component::type component_from_json(const Json::Value& item);
 	static Json::Value extract_capture_data(const Json::Value& item);
 
+	//
+	// Component indexes: the position of each component in its container,
+	// by uid and by namespace/name, so that watch updates don't need to
+	// scan the containers. The containers passed to these functions must
+	// be the ones of this state.
+	//
+
+	struct component_index
+	{
+		std::unordered_map<std::string, size_t> m_by_uid;
+		std::unordered_map<std::string, size_t> m_by_name;
+	};
+
+	static std::string index_name(const std::string& ns, const std::string& name)
+	{
+		// '/' can't be part of a namespace name
+		return ns + '/' + name;
+	}
+
+	template<typename C>
+	component_index& get_index(const C&)
+	{
+		return m_indexes[C::value_type::COMPONENT_TYPE];
+	}
+
+	template<typename C>
+	const component_index& get_index(const C&) const
+	{
+		return m_indexes[C::value_type::COMPONENT_TYPE];
+	}
+
+	// Returns the position of the component with the given uid, or the
+	// size of the container if there's none
+	template<typename C>
+	size_t find_component(const C& components, const std::string& uid) const
+	{
+		const component_index& index = get_index(components);
+		auto it = index.m_by_uid.find(uid);
+		if(it != index.m_by_uid.end())
+		{
+			ASSERT(it->second < components.size() && components[it->second].get_uid() == uid);
+			return it->second;
+		}
+		return components.size();
+	}
+
+	template<typename C>
+	size_t find_component_by_name(const C& components, const std::string& ns, const std::string& name) const
+	{
+		const component_index& index = get_index(components);
+		auto it = index.m_by_name.find(index_name(ns, name));
+		if(it != index.m_by_name.end())
+		{
+			ASSERT(it->second < components.size() && components[it->second].get_name() == name);
+			return it->second;
+		}
+		return components.size();
+	}
+
+	template<typename C>
+	void index_component(const C& components, size_t pos)
+	{
+		component_index& index = get_index(components);
+		const auto& comp = components[pos];
+		index.m_by_uid[comp.get_uid()] = pos;
+		index.m_by_name[index_name(comp.get_namespace(), comp.get_name())] = pos;
+	}
+
+	template<typename C>
+	void unindex_component(const C& components, size_t pos)
+	{
+		component_index& index = get_index(components);
+		const auto& comp = components[pos];
+		index.m_by_uid.erase(comp.get_uid());
+
+		// A newer component can have taken the name over
+		auto it = index.m_by_name.find(index_name(comp.get_namespace(), comp.get_name()));
+		if(it != index.m_by_name.end() && it->second == pos)
+		{
+			index.m_by_name.erase(it);
+		}
+	}
+
+	template<typename C>
+	void reindex_components(const C& components)
+	{
+		component_index& index = get_index(components);
+		index.m_by_uid.clear();
+		index.m_by_name.clear();
+		for(size_t j = 0; j < components.size(); j++)
+		{
+			index_component(components, j);
+		}
+	}
+
+	template<typename C>
+	void clear_components(C& components)
+	{
+		components.clear();
+		reindex_components(components);
+	}
+
 	template<typename C>
 	const typename C::mapped_type* get_component(const C& map, const std::string& key)
 	{
@@ -384,6 +501,8 @@ private:
 	// map for uid/type cache for all components
 	// used by to quickly lookup any component by uid
 	component_map_t m_component_map;
+	// indexes of the containers above, by component type
+	component_index m_indexes[k8s_component::K8S_COMPONENT_COUNT];
 	bool            m_is_captured;
 	int             m_capture_version = -1;
 
@@ -406,11 +525,13 @@ inline k8s_namespaces& k8s_state_t::get_namespaces()
 inline void k8s_state_t::push_namespace(const k8s_ns_t& ns)
 {
 	m_namespaces.push_back(ns);
+	index_component(m_namespaces, m_namespaces.size() - 1);
 }
 
 inline void k8s_state_t::emplace_namespace(k8s_ns_t&& ns)
 {
 	m_namespaces.emplace_back(std::move(ns));
+	index_component(m_namespaces, m_namespaces.size() - 1);
 }
 
 // nodes
@@ -427,11 +548,13 @@ inline k8s_nodes& k8s_state_t::get_nodes()
 inline void k8s_state_t::push_node(const k8s_node_t& node)
 {
 	m_nodes.push_back(node);
+	index_component(m_nodes, m_nodes.size() - 1);
 }
 
 inline void k8s_state_t::emplace_node(k8s_node_t&& node)
 {
 	m_nodes.emplace_back(std::move(node));
+	index_component(m_nodes, m_nodes.size() - 1);
 }
 
 // pods
@@ -448,11 +571,13 @@ inline k8s_pods& k8s_state_t::get_pods()
 inline void k8s_state_t::push_pod(const k8s_pod_t& pod)
 {
 	m_pods.push_back(pod);
+	index_component(m_pods, m_pods.size() - 1);
 }
 
 inline void k8s_state_t::emplace_pod(k8s_pod_t&& pod)
 {
 	m_pods.emplace_back(std::move(pod));
+	index_component(m_pods, m_pods.size() - 1);
 }
 
 inline const k8s_pod_t::container_id_list& k8s_state_t::get_pod_container_ids(k8s_pod_t& pod)
@@ -474,11 +599,13 @@ inline k8s_controllers& k8s_state_t::get_rcs()
 inline void k8s_state_t::push_rc(const k8s_rc_t& rc)
 {
 	m_controllers.push_back(rc);
+	index_component(m_controllers, m_controllers.size() - 1);
 }
 
 inline void k8s_state_t::emplace_rc(k8s_rc_t&& rc)
 {
 	m_controllers.emplace_back(std::move(rc));
+	index_component(m_controllers, m_controllers.size() - 1);
 }
 
 // replica sets
@@ -495,11 +622,13 @@ inline k8s_replicasets& k8s_state_t::get_rss()
 inline void k8s_state_t::push_rs(const k8s_rs_t& rs)
 {
 	m_replicasets.push_back(rs);
+	index_component(m_replicasets, m_replicasets.size() - 1);
 }
 
 inline void k8s_state_t::emplace_rs(k8s_rs_t&& rs)
 {
 	m_replicasets.emplace_back(std::move(rs));
+	index_component(m_replicasets, m_replicasets.size() - 1);
 }
 
 // services
@@ -516,11 +645,13 @@ inline k8s_services& k8s_state_t::get_services()
 inline void k8s_state_t::push_service(const k8s_service_t& service)
 {
 	m_services.push_back(service);
+	index_component(m_services, m_services.size() - 1);
 }
 
 inline void k8s_state_t::emplace_service(k8s_service_t&& service)
 {
 	m_services.emplace_back(std::move(service));
+	index_component(m_services, m_services.size() - 1);
 }
 
 // daemonsets
@@ -537,11 +668,13 @@ inline k8s_daemonsets& k8s_state_t::get_daemonsets()
 inline void k8s_state_t::push_daemonset(const k8s_daemonset_t& daemonset)
 {
 	m_daemonsets.push_back(daemonset);
+	index_component(m_daemonsets, m_daemonsets.size() - 1);
 }
 
 inline void k8s_state_t::emplace_daemonset(k8s_daemonset_t&& daemonset)
 {
 	m_daemonsets.emplace_back(std::move(daemonset));
+	index_component(m_daemonsets, m_daemonsets.size() - 1);
 }
 
 // deployments
@@ -558,11 +691,13 @@ inline k8s_deployments& k8s_state_t::get_deployments()
 inline void k8s_state_t::push_deployment(const k8s_deployment_t& deployment)
 {
 	m_deployments.push_back(deployment);
+	index_component(m_deployments, m_deployments.size() - 1);
 }
 
 inline void k8s_state_t::emplace_deployment(k8s_deployment_t&& deployment)
 {
 	m_deployments.emplace_back(std::move(deployment));
+	index_component(m_deployments, m_deployments.size() - 1);
 }
 
 // events
@@ -578,6 +713,8 @@ inline k8s_events& k8s_state_t::get_events()
 
 inline void k8s_state_t::clear_events()
 {
+	size_t count = m_events.size();
+
 	for(auto it = m_events.begin(); it != m_events.end();)
 	{
 		it->post_process((*this));
@@ -590,16 +727,23 @@ inline void k8s_state_t::clear_events()
 			++it;
 		}
 	}
+
+	if(m_events.size() != count)
+	{
+		reindex_components(m_events);
+	}
 }
 
 inline void k8s_state_t::push_event(const k8s_event_t& evt)
 {
 	m_events.push_back(evt);
+	index_component(m_events, m_events.size() - 1);
 }
 
 inline void k8s_state_t::emplace_event(k8s_event_t&& evt)
 {
 	m_events.emplace_back(std::move(evt));
+	index_component(m_events, m_events.size() - 1);
 }
 
 // general
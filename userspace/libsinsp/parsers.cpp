@@ -503,7 +503,7 @@ void sinsp_parser::process_event(sinsp_evt *evt)
 	// compare for every event.
 	if(evt->m_fdinfo)
 	{
-		evt->set_fdinfo_name_changed(evt->m_fdinfo->m_name != evt->m_fdinfo->m_oldname);
+		evt->set_fdinfo_name_changed(evt->m_fdinfo->name_changed());
 	}
 }
 
@@ -658,17 +658,13 @@ bool sinsp_parser::reset(sinsp_evt *evt)
 
 		if(eflags & EF_USES_FD)
 		{
-			sinsp_evt_param *parinfo;
-
 			//
 			// Get the fd.
 			// The fd is always the first parameter of the enter event.
 			//
-			parinfo = evt->get_param(0);
-			ASSERT(parinfo->m_len == sizeof(int64_t));
 			ASSERT(evt->get_param_info(0)->type == PT_FD);
 
-			evt->m_tinfo->m_lastevent_fd = *(int64_t *)parinfo->m_val;
+			evt->m_tinfo->m_lastevent_fd = evt->get_param_as<int64_t>(0);
 			evt->m_fdinfo = evt->m_tinfo->get_fd(evt->m_tinfo->m_lastevent_fd);
 		}
 
@@ -714,11 +710,7 @@ bool sinsp_parser::reset(sinsp_evt *evt)
 			  evt->m_info->params[0].name[1] == 'd' &&
 			  evt->m_info->params[0].name[2] == '\0')))
 		{
-			sinsp_evt_param *parinfo;
-
-			parinfo = evt->get_param(0);
-			ASSERT(parinfo->m_len == sizeof(int64_t));
-			int64_t res = *(int64_t *)parinfo->m_val;
+			int64_t res = evt->get_param_as<int64_t>(0);
 
 			if(res < 0)
 			{
@@ -1140,11 +1132,12 @@ void sinsp_parser::parse_clone_exit(sinsp_evt *evt)
 	}
 
 	//
-	// Allocate the new thread info and initialize it
-	// XXX this should absolutely not do a malloc, but get the item from a
-	// preallocated list
+	// Allocate the new thread info and initialize it. The reference keeps it
+	// alive until the end of the function, and frees it if it doesn't make
+	// it into the thread table.
 	//
 	sinsp_threadinfo* tinfo = m_inspector->build_threadinfo();
+	threadinfo_map_t::ptr_t tinfo_ref(tinfo);
 
 	//
 	// Set the tid and parent tid
@@ -1518,7 +1511,7 @@ void sinsp_parser::parse_clone_exit(sinsp_evt *evt)
 	//
 	// Add the new thread to the table
 	//
-	bool thread_added = m_inspector->add_thread(tinfo);
+	m_inspector->add_thread(tinfo);
 
 	//
 	// If there's a listener, invoke it
@@ -1544,10 +1537,6 @@ void sinsp_parser::parse_clone_exit(sinsp_evt *evt)
 		               tinfo->m_comm.c_str());
 	}
 
-	if (!thread_added) {
-		delete tinfo;
-	}
-
 	return;
 }
 
@@ -1884,13 +1873,15 @@ void sinsp_parser::parse_openat_dir(sinsp_evt *evt, char* name, int64_t dirfd, O
 		}
 		else
 		{
-			if(evt->m_fdinfo->m_name[evt->m_fdinfo->m_name.length()] == '/')
+			const string& name = evt->m_fdinfo->get_name();
+
+			if(name[name.length()] == '/')
 			{
-				*sdir = evt->m_fdinfo->m_name;
+				*sdir = name;
 			}
 			else
 			{
-				tdirstr = evt->m_fdinfo->m_name + '/';
+				tdirstr = name + '/';
 				*sdir = tdirstr;
 			}
 		}
@@ -2165,7 +2156,7 @@ void sinsp_parser::parse_open_openat_creat_exit(sinsp_evt *evt)
 		//
 		// If this is a user event fd, mark it with the proper flag
 		//
-		if(fdi.m_name == USER_EVT_DEVICE_NAME)
+		if(fdi.get_name() == USER_EVT_DEVICE_NAME)
 		{
 			fdi.m_flags |= sinsp_fdinfo_t::FLAGS_IS_TRACER_FILE;
 		}
@@ -2468,6 +2459,8 @@ void sinsp_parser::parse_bind_exit(sinsp_evt *evt)
 
 	family = *packed_data;
 
+	evt->m_fdinfo->render_pending_name();
+
 	//
 	// Update the FD info with this tuple, assume that if port > 0, means that
 	// the socket is used for listening
@@ -2514,7 +2507,7 @@ void sinsp_parser::parse_bind_exit(sinsp_evt *evt)
 	//
 	// Update the name of this socket
 	//
-	evt->m_fdinfo->m_name = evt->get_param_as_str(1, &parstr, sinsp_evt::PF_SIMPLE);
+	evt->m_fdinfo->set_name(evt->get_param_as_str(1, &parstr, sinsp_evt::PF_SIMPLE));
 
 	//
 	// If there's a listener callback, invoke it
@@ -2533,7 +2526,7 @@ void sinsp_parser::parse_connect_enter(sinsp_evt *evt){
         return;
     }
 
-    sinsp_evt_param *parinfo;
+    sinsp_evt_param parinfo;
     uint8_t *packed_data;
 
     if(evt->m_fdinfo == NULL)
@@ -2542,8 +2535,8 @@ void sinsp_parser::parse_connect_enter(sinsp_evt *evt){
     }
 
     evt->m_fdinfo->set_socket_pending();
-    parinfo = evt->get_param(1);
-    if(parinfo->m_len == 0)
+    parinfo = evt->get_param_view(1);
+    if(parinfo.m_len == 0)
     {
         //
         // No address, there's nothing we can really do with this.
@@ -2554,7 +2547,7 @@ void sinsp_parser::parse_connect_enter(sinsp_evt *evt){
         return;
     }
 
-    packed_data = (uint8_t*)parinfo->m_val;
+    packed_data = (uint8_t*)parinfo.m_val;
 
     fill_client_socket_info(evt, packed_data);
 
@@ -2567,6 +2560,31 @@ void sinsp_parser::parse_connect_enter(sinsp_evt *evt){
     }
 }
 
+//
+// True if parameter id of evt is a well formed IPv4 or IPv6 socket tuple,
+// i.e. if get_param_as_str() renders it with ipv4tuple_to_string() when
+// the fd ends up as an IPv4 socket
+//
+static inline bool is_ipv4_socktuple_param(sinsp_evt *evt, uint32_t id)
+{
+	sinsp_evt_param parinfo = evt->get_param_view(id);
+
+	if(evt->get_param_info(id)->type != PT_SOCKTUPLE || parinfo.m_len == 0)
+	{
+		return false;
+	}
+
+	switch(*(uint8_t*)parinfo.m_val)
+	{
+	case PPM_AF_INET:
+		return parinfo.m_len == 1 + 4 + 2 + 4 + 2;
+	case PPM_AF_INET6:
+		return parinfo.m_len == 1 + 16 + 2 + 16 + 2;
+	default:
+		return false;
+	}
+}
+
 inline void sinsp_parser::fill_client_socket_info(sinsp_evt *evt, uint8_t *packed_data){
     uint8_t family;
     const char *parstr;
@@ -2623,16 +2641,20 @@ inline void sinsp_parser::fill_client_socket_info(sinsp_evt *evt, uint8_t *packe
         //
         if(evt->m_fdinfo->is_role_server() && evt->m_fdinfo->is_udp_socket())
         {
-            sinsp_utils::sockinfo_to_str(&evt->m_fdinfo->m_sockinfo,
-                                         evt->m_fdinfo->m_type, &evt->m_paramstr_storage[0],
-                                         (uint32_t)evt->m_paramstr_storage.size(),
-                                         m_inspector->m_hostname_and_port_resolution_enabled);
-
-            evt->m_fdinfo->m_name = &evt->m_paramstr_storage[0];
+            evt->m_fdinfo->set_name_from_sockinfo(m_inspector->m_hostname_and_port_resolution_enabled);
+        }
+        else if(changed && evt->m_fdinfo->m_type == SCAP_FD_IPV4_SOCK && is_ipv4_socktuple_param(evt, 1))
+        {
+            //
+            // The tuple was copied as is, render it like the parameter
+            // when the name is read
+            //
+            evt->m_fdinfo->set_name_from_ipv4_tuple(evt->m_fdinfo->get_l4proto(),
+                                                    m_inspector->m_hostname_and_port_resolution_enabled);
         }
         else
         {
-            evt->m_fdinfo->m_name = evt->get_param_as_str(1, &parstr, sinsp_evt::PF_SIMPLE);
+            evt->m_fdinfo->set_name(evt->get_param_as_str(1, &parstr, sinsp_evt::PF_SIMPLE));
         }
     }
     else
@@ -2650,7 +2672,7 @@ inline void sinsp_parser::fill_client_socket_info(sinsp_evt *evt, uint8_t *packe
         //
         // Add the friendly name to the fd info
         //
-        evt->m_fdinfo->m_name = evt->get_param_as_str(1, &parstr, sinsp_evt::PF_SIMPLE);
+        evt->m_fdinfo->set_name(evt->get_param_as_str(1, &parstr, sinsp_evt::PF_SIMPLE));
 
 #ifndef HAS_ANALYZER
         //
@@ -2671,9 +2693,9 @@ inline void sinsp_parser::fill_client_socket_info(sinsp_evt *evt, uint8_t *packe
 
 void sinsp_parser::parse_connect_exit(sinsp_evt *evt)
 {
-	sinsp_evt_param *parinfo;
+	sinsp_evt_param parinfo;
 	uint8_t *packed_data;
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	sinsp_fdtable::table_t::iterator fdit;
 	int64_t retval;
 
 	if(evt->m_fdinfo == NULL)
@@ -2681,9 +2703,7 @@ void sinsp_parser::parse_connect_exit(sinsp_evt *evt)
 		return;
 	}
 
-	parinfo = evt->get_param(0);
-	ASSERT(parinfo->m_len == sizeof(uint64_t));
-	retval = *(int64_t*)parinfo->m_val;
+	retval = evt->get_param_as<int64_t>(0);
 
 	if (m_track_connection_status)
 	{
@@ -2707,8 +2727,8 @@ void sinsp_parser::parse_connect_exit(sinsp_evt *evt)
 		}
 	}
 
-	parinfo = evt->get_param(1);
-	if(parinfo->m_len == 0)
+	parinfo = evt->get_param_view(1);
+	if(parinfo.m_len == 0)
 	{
 		//
 		// No address, there's nothing we can really do with this.
@@ -2719,7 +2739,7 @@ void sinsp_parser::parse_connect_exit(sinsp_evt *evt)
 		return;
 	}
 
-	packed_data = (uint8_t*)parinfo->m_val;
+	packed_data = (uint8_t*)parinfo.m_val;
 
     fill_client_socket_info(evt, packed_data);
 
@@ -2746,7 +2766,7 @@ void sinsp_parser::parse_accept_exit(sinsp_evt *evt)
 	sinsp_evt_param *parinfo;
 	int64_t fd;
 	uint8_t* packed_data;
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	sinsp_fdtable::table_t::iterator fdit;
 	sinsp_fdinfo_t fdi;
 	const char *parstr;
 
@@ -2840,7 +2860,15 @@ void sinsp_parser::parse_accept_exit(sinsp_evt *evt)
 		return;
 	}
 
-	fdi.m_name = evt->get_param_as_str(1, &parstr, sinsp_evt::PF_SIMPLE);
+	if(fdi.m_type == SCAP_FD_IPV4_SOCK && is_ipv4_socktuple_param(evt, 1))
+	{
+		fdi.set_name_from_ipv4_tuple(evt->m_fdinfo != NULL? evt->m_fdinfo->get_l4proto() : SCAP_L4_UNKNOWN,
+					     m_inspector->m_hostname_and_port_resolution_enabled);
+	}
+	else
+	{
+		fdi.set_name(evt->get_param_as_str(1, &parstr, sinsp_evt::PF_SIMPLE));
+	}
 	fdi.m_flags = 0;
 
 	if(m_fd_listener)
@@ -2919,15 +2947,12 @@ void sinsp_parser::erase_fd(erase_fd_params* params)
 
 void sinsp_parser::parse_close_exit(sinsp_evt *evt)
 {
-	sinsp_evt_param *parinfo;
 	int64_t retval;
 
 	//
 	// Extract the return value
 	//
-	parinfo = evt->get_param(0);
-	retval = *(int64_t *)parinfo->m_val;
-	ASSERT(parinfo->m_len == sizeof(int64_t));
+	retval = evt->get_param_as<int64_t>(0);
 
 	//
 	// If the close() was successful, do the cleanup
@@ -3005,7 +3030,7 @@ void sinsp_parser::add_pipe(sinsp_evt *evt, int64_t tid, int64_t fd, uint64_t in
 	// Populate the new fdi
 	//
 	fdi.m_type = SCAP_FD_FIFO;
-	fdi.m_name = "";
+	fdi.set_name("");
 	fdi.m_ino = ino;
 
 	//
@@ -3139,6 +3164,7 @@ bool sinsp_parser::set_ipv4_addresses_and_ports(sinsp_fdinfo_t* fdinfo, uint8_t*
 		}
 	}
 
+	fdinfo->render_pending_name();
 	fdinfo->m_sockinfo.m_ipv4info.m_fields.m_sip = tsip;
 	fdinfo->m_sockinfo.m_ipv4info.m_fields.m_sport = tsport;
 	fdinfo->m_sockinfo.m_ipv4info.m_fields.m_dip = tdip;
@@ -3173,6 +3199,7 @@ bool sinsp_parser::set_ipv4_mapped_ipv6_addresses_and_ports(sinsp_fdinfo_t* fdin
 		}
 	}
 
+	fdinfo->render_pending_name();
 	fdinfo->m_sockinfo.m_ipv4info.m_fields.m_sip = tsip;
 	fdinfo->m_sockinfo.m_ipv4info.m_fields.m_sport = tsport;
 	fdinfo->m_sockinfo.m_ipv4info.m_fields.m_dip = tdip;
@@ -3208,6 +3235,7 @@ bool sinsp_parser::set_ipv6_addresses_and_ports(sinsp_fdinfo_t* fdinfo, uint8_t*
 		}
 	}
 
+	fdinfo->render_pending_name();
 	fdinfo->m_sockinfo.m_ipv6info.m_fields.m_sip = tsip;
 	fdinfo->m_sockinfo.m_ipv6info.m_fields.m_sport = tsport;
 	fdinfo->m_sockinfo.m_ipv6info.m_fields.m_dip = tdip;
@@ -3218,6 +3246,7 @@ bool sinsp_parser::set_ipv6_addresses_and_ports(sinsp_fdinfo_t* fdinfo, uint8_t*
 
 bool sinsp_parser::set_unix_info(sinsp_fdinfo_t* fdinfo, uint8_t* packed_data)
 {
+	fdinfo->render_pending_name();
 	fdinfo->m_sockinfo.m_unixinfo.m_fields.m_source = *(uint64_t *)(packed_data + 1);
 	fdinfo->m_sockinfo.m_unixinfo.m_fields.m_dest = *(uint64_t *)(packed_data + 9);
 
@@ -3288,7 +3317,7 @@ bool sinsp_parser::update_fd(sinsp_evt *evt, sinsp_evt_param *parinfo)
 			return false;
 		}
 
-		evt->m_fdinfo->m_name = ((char*)packed_data) + 17;
+		evt->m_fdinfo->set_name(((char*)packed_data) + 17);
 
 		//
 		// Call the protocol decoder callbacks to notify the decoders that this FD
@@ -3343,6 +3372,8 @@ bool sinsp_parser::update_fd(sinsp_evt *evt, sinsp_evt_param *parinfo)
 
 void sinsp_parser::swap_addresses(sinsp_fdinfo_t* fdinfo)
 {
+	fdinfo->render_pending_name();
+
 	if(fdinfo->m_type == SCAP_FD_IPV4_SOCK)
 	{
 		uint32_t tip;
@@ -3542,7 +3573,7 @@ bool sinsp_parser::detect_and_process_tracer_write(sinsp_evt *evt,
 
 void sinsp_parser::parse_rw_exit(sinsp_evt *evt)
 {
-	sinsp_evt_param *parinfo;
+	sinsp_evt_param parinfo;
 	int64_t retval;
 	int64_t tid = evt->get_tid();
 	sinsp_evt *enter_evt = &m_tmp_evt;
@@ -3551,9 +3582,7 @@ void sinsp_parser::parse_rw_exit(sinsp_evt *evt)
 	//
 	// Extract the return value
 	//
-	parinfo = evt->get_param(0);
-	ASSERT(parinfo->m_len == sizeof(int64_t));
-	retval = *(int64_t *)parinfo->m_val;
+	retval = evt->get_param_as<int64_t>(0);
 
 	if(evt->m_fdinfo == NULL)
 	{
@@ -3604,7 +3633,7 @@ void sinsp_parser::parse_rw_exit(sinsp_evt *evt)
 				tupleparam = 3;
 			}
 
-			if(tupleparam != -1 && (evt->m_fdinfo->m_name.length() == 0 || !evt->m_fdinfo->is_tcp_socket()))
+			if(tupleparam != -1 && (evt->m_fdinfo->is_name_empty() || !evt->m_fdinfo->is_tcp_socket()))
 			{
 				//
 				// recvfrom contains tuple info.
@@ -3612,7 +3641,9 @@ void sinsp_parser::parse_rw_exit(sinsp_evt *evt)
 				// datagram one or because some event was lost),
 				// add it here.
 				//
-				if(update_fd(evt, evt->get_param(tupleparam)))
+				parinfo = evt->get_param_view(tupleparam);
+
+				if(update_fd(evt, &parinfo))
 				{
 					const char *parstr;
 
@@ -3634,16 +3665,11 @@ void sinsp_parser::parse_rw_exit(sinsp_evt *evt)
 							swap_addresses(evt->m_fdinfo);
 						}
 
-						sinsp_utils::sockinfo_to_str(&evt->m_fdinfo->m_sockinfo,
-							fdtype, &evt->m_paramstr_storage[0],
-							(uint32_t)evt->m_paramstr_storage.size(),
-							m_inspector->m_hostname_and_port_resolution_enabled);
-
-						evt->m_fdinfo->m_name = &evt->m_paramstr_storage[0];
+						evt->m_fdinfo->set_name_from_sockinfo(m_inspector->m_hostname_and_port_resolution_enabled);
 					}
 					else
 					{
-						evt->m_fdinfo->m_name = evt->get_param_as_str(tupleparam, &parstr, sinsp_evt::PF_SIMPLE);
+						evt->m_fdinfo->set_name(evt->get_param_as_str(tupleparam, &parstr, sinsp_evt::PF_SIMPLE));
 					}
 				}
 			}
@@ -3653,15 +3679,15 @@ void sinsp_parser::parse_rw_exit(sinsp_evt *evt)
 			//
 			if(etype == PPME_SYSCALL_READV_X || etype == PPME_SYSCALL_PREADV_X || etype == PPME_SOCKET_RECVMSG_X)
 			{
-				parinfo = evt->get_param(2);
+				parinfo = evt->get_param_view(2);
 			}
 			else
 			{
-				parinfo = evt->get_param(1);
+				parinfo = evt->get_param_view(1);
 			}
 
-			datalen = parinfo->m_len;
-			data = parinfo->m_val;
+			datalen = parinfo.m_len;
+			data = parinfo.m_val;
 
 			//
 			// If there's an fd listener, call it now
@@ -3696,7 +3722,7 @@ void sinsp_parser::parse_rw_exit(sinsp_evt *evt)
 				tupleparam = 2;
 			}
 
-			if(tupleparam != -1 && (evt->m_fdinfo->m_name.length() == 0 || !evt->m_fdinfo->is_tcp_socket()))
+			if(tupleparam != -1 && (evt->m_fdinfo->is_name_empty() || !evt->m_fdinfo->is_tcp_socket()))
 			{
 				//
 				// sendto contains tuple info in the enter event.
@@ -3708,7 +3734,9 @@ void sinsp_parser::parse_rw_exit(sinsp_evt *evt)
 					return;
 				}
 
-				if(update_fd(evt, enter_evt->get_param(tupleparam)))
+				parinfo = enter_evt->get_param_view(tupleparam);
+
+				if(update_fd(evt, &parinfo))
 				{
 					const char *parstr;
 
@@ -3730,16 +3758,11 @@ void sinsp_parser::parse_rw_exit(sinsp_evt *evt)
 							swap_addresses(evt->m_fdinfo);
 						}
 
-						sinsp_utils::sockinfo_to_str(&evt->m_fdinfo->m_sockinfo,
-							fdtype, &evt->m_paramstr_storage[0],
-							(uint32_t)evt->m_paramstr_storage.size(),
-							m_inspector->m_hostname_and_port_resolution_enabled);
-
-						evt->m_fdinfo->m_name = &evt->m_paramstr_storage[0];
+						evt->m_fdinfo->set_name_from_sockinfo(m_inspector->m_hostname_and_port_resolution_enabled);
 					}
 					else
 					{
-						evt->m_fdinfo->m_name = enter_evt->get_param_as_str(tupleparam, &parstr, sinsp_evt::PF_SIMPLE);
+						evt->m_fdinfo->set_name(enter_evt->get_param_as_str(tupleparam, &parstr, sinsp_evt::PF_SIMPLE));
 					}
 				}
 			}
@@ -3747,9 +3770,9 @@ void sinsp_parser::parse_rw_exit(sinsp_evt *evt)
 			//
 			// Extract the data buffer
 			//
-			parinfo = evt->get_param(1);
-			datalen = parinfo->m_len;
-			data = parinfo->m_val;
+			parinfo = evt->get_param_view(1);
+			datalen = parinfo.m_len;
+			data = parinfo.m_val;
 
 			//
 			// If there's an fd listener, call it now
@@ -3863,7 +3886,7 @@ void sinsp_parser::parse_eventfd_exit(sinsp_evt *evt)
 	// Populate the new fdi
 	//
 	fdi.m_type = SCAP_FD_EVENT;
-	fdi.m_name = "";
+	fdi.set_name("");
 
 	//
 	// Add the fd to the table.
@@ -3927,8 +3950,8 @@ void sinsp_parser::parse_fchdir_exit(sinsp_evt *evt)
 		}
 
 		// Update the thread working directory
-		evt->m_tinfo->set_cwd((char *)evt->m_fdinfo->m_name.c_str(),
-		                 (uint32_t)evt->m_fdinfo->m_name.size());
+		evt->m_tinfo->set_cwd((char *)evt->m_fdinfo->get_name().c_str(),
+		                 (uint32_t)evt->m_fdinfo->get_name().size());
 	}
 }
 
@@ -4122,7 +4145,7 @@ void sinsp_parser::parse_signalfd_exit(sinsp_evt *evt)
 		// Populate the new fdi
 		//
 		fdi.m_type = SCAP_FD_SIGNALFD;
-		fdi.m_name = "";
+		fdi.set_name("");
 
 		//
 		// Add the fd to the table.
@@ -4159,7 +4182,7 @@ void sinsp_parser::parse_timerfd_create_exit(sinsp_evt *evt)
 		// Populate the new fdi
 		//
 		fdi.m_type = SCAP_FD_TIMERFD;
-		fdi.m_name = "";
+		fdi.set_name("");
 
 		//
 		// Add the fd to the table.
@@ -4196,7 +4219,7 @@ void sinsp_parser::parse_inotify_init_exit(sinsp_evt *evt)
 		// Populate the new fdi
 		//
 		fdi.m_type = SCAP_FD_INOTIFY;
-		fdi.m_name = "";
+		fdi.set_name("");
 
 		//
 		// Add the fd to the table.
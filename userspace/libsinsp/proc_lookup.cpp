@@ -0,0 +1,62 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "proc_lookup.h"
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+using namespace libsinsp;
+
+proc_lookup_source::proc_lookup_source(scap_t* h, uint64_t ttl_ms):
+	async_key_value_source(NO_WAIT_LOOKUP, ttl_ms),
+	m_h(h)
+{
+}
+
+proc_lookup_source::~proc_lookup_source()
+{
+	this->stop();
+}
+
+void proc_lookup_source::run_impl()
+{
+	proc_lookup_key key;
+	char error[SCAP_LASTERR_SIZE];
+
+	while(dequeue_next_key(key))
+	{
+		//
+		// scap_proc_get() writes its errors to a buffer of this
+		// thread rather than the handle's, fills the returned fd
+		// table instead of firing the proc callback, takes a lock
+		// around the mount id cache and leaves the vtid maps to the
+		// capture thread, which records the vtid when it merges the
+		// result. The thread manager doesn't use this source when
+		// comms are suppressed, since that set is updated too.
+		//
+		scap_threadinfo* pi = scap_proc_get(m_h, key.m_tid, key.m_scan_sockets, error);
+		std::shared_ptr<scap_threadinfo> proc;
+
+		if(pi)
+		{
+			scap_t* h = m_h;
+			proc.reset(pi, [h](scap_threadinfo* p) { scap_proc_free(h, p); });
+		}
+
+		store_value(key, proc);
+	}
+}
@@ -0,0 +1,112 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <memory>
+#include "async_key_value_source.h"
+#include "scap.h"
+
+namespace libsinsp {
+
+/**
+ * \brief The key for a /proc lookup
+ *
+ * The arguments of scap_proc_get()
+ */
+struct proc_lookup_key {
+	proc_lookup_key():
+		m_tid(0),
+		m_scan_sockets(false) {}
+	proc_lookup_key(int64_t tid, bool scan_sockets):
+		m_tid(tid),
+		m_scan_sockets(scan_sockets) {}
+
+	bool operator<(const proc_lookup_key& rhs) const
+	{
+		if(m_tid != rhs.m_tid)
+		{
+			return m_tid < rhs.m_tid;
+		}
+		return m_scan_sockets < rhs.m_scan_sockets;
+	}
+
+	bool operator==(const proc_lookup_key& rhs) const
+	{
+		return m_tid == rhs.m_tid &&
+		       m_scan_sockets == rhs.m_scan_sockets;
+	}
+
+	int64_t m_tid;
+	bool m_scan_sockets;
+};
+
+/**
+ * \brief A completed /proc lookup, on its way back to the capture thread
+ *
+ * m_proc is empty if the thread wasn't found.
+ */
+struct proc_lookup_result {
+	proc_lookup_result():
+		m_tid(0) {}
+	proc_lookup_result(int64_t tid, std::shared_ptr<scap_threadinfo> proc):
+		m_tid(tid),
+		m_proc(std::move(proc)) {}
+
+	int64_t m_tid;
+	std::shared_ptr<scap_threadinfo> m_proc;
+};
+
+/**
+ * \brief Reads threads from /proc away from the capture thread
+ *
+ * Used by the thread manager when async /proc lookups are enabled:
+ * lookups never wait, each result is handed to the callback passed to
+ * lookup(), on this source's thread.
+ */
+class proc_lookup_source : public sysdig::async_key_value_source<proc_lookup_key, std::shared_ptr<scap_threadinfo>>
+{
+public:
+	/**
+	 * @param h the capture handle, it must outlive this object
+	 * @param ttl_ms how long a request can wait to be served
+	 */
+	proc_lookup_source(scap_t* h, uint64_t ttl_ms);
+	~proc_lookup_source();
+
+private:
+	void run_impl() override;
+
+	scap_t* m_h;
+};
+
+}
+
+namespace std {
+/**
+ * \brief Specialization of std::hash for proc_lookup_key
+ *
+ * It allows `proc_lookup_key` instances to be used as `unordered_map` keys
+ */
+template<> struct hash<libsinsp::proc_lookup_key> {
+	std::size_t operator()(const libsinsp::proc_lookup_key& k) const {
+		size_t h1 = ::std::hash<int64_t>{}(k.m_tid);
+		size_t h2 = ::std::hash<bool>{}(k.m_scan_sockets);
+		return h1 ^ (h2 << 1u);
+	}
+};
+}
@@ -194,7 +194,7 @@ void sinsp_decoder_syslog::on_fd_from_proc(sinsp_fdinfo_t* fdinfo)
 		return ;
 	}
 
-	if(fdinfo->m_name.find("/dev/log") != string::npos)
+	if(fdinfo->get_name().find("/dev/log") != string::npos)
 	{
 		register_write_callback(fdinfo);
 	}
@@ -211,7 +211,7 @@ void sinsp_decoder_syslog::on_event(sinsp_evt* evt, sinsp_pd_callback_type etype
 			return ;
 		}
 
-		if(fdinfo->m_name.find("/dev/log") != string::npos)
+		if(fdinfo->get_name().find("/dev/log") != string::npos)
 		{
 			register_write_callback(fdinfo);
 		}
@@ -224,7 +224,7 @@ void sinsp_decoder_syslog::on_event(sinsp_evt* evt, sinsp_pd_callback_type etype
 			return ;
 		}
 
-		if(fdinfo->m_name.find("/dev/log") != string::npos)
+		if(fdinfo->get_name().find("/dev/log") != string::npos)
 		{
 			register_write_callback(fdinfo);
 		}
@@ -35,6 +35,7 @@ limitations under the License.
 #include "cyclewriter.h"
 #include "protodecoder.h"
 #include "dns_manager.h"
+#include "sinsp_pipeline.h"
 
 #ifndef CYGWING_AGENT
 #ifndef MINIMAL_BUILD
@@ -78,6 +79,7 @@ sinsp::sinsp(bool static_container, const std::string static_id, const std::stri
 	m_parser = NULL;
 	m_dumper = NULL;
 	m_is_dumping = false;
+	m_autodump_async = false;
 	m_metaevt = NULL;
 	m_meinfo.m_piscapevt = NULL;
 	m_network_interfaces = NULL;
@@ -91,6 +93,7 @@ sinsp::sinsp(bool static_container, const std::string static_id, const std::stri
 #ifdef HAS_FILTERING
 	m_filter = NULL;
 	m_evttype_filter = NULL;
+	m_extraction_cache = new sinsp_extraction_cache(this);
 #endif
 
 	m_fds_to_remove = new vector<int64_t>;
@@ -122,6 +125,8 @@ sinsp::sinsp(bool static_container, const std::string static_id, const std::stri
 	m_large_envs_enabled = false;
 	m_increased_snaplen_port_range = DEFAULT_INCREASE_SNAPLEN_PORT_RANGE;
 	m_statsd_port = -1;
+	m_kernel_prefilter.m_set = false;
+	m_detailed_stats = false;
 
 	// Unless the cmd line arg "-pc" or "-pcontainer" is supplied this is false
 	m_print_container_data = false;
@@ -132,6 +137,13 @@ sinsp::sinsp(bool static_container, const std::string static_id, const std::stri
 
 	m_proc_scan_timeout_ms = SCAP_PROC_SCAN_TIMEOUT_NONE;
 	m_proc_scan_log_interval_ms = SCAP_PROC_SCAN_LOG_NONE;
+	m_merge_mode = SCAP_MERGE_LINEAR;
+	m_wakeup_watermark = 0;
+	m_proc_scan_threads = 0;
+	m_pipeline_workers = 0;
+	m_pipeline_drop_simple_consumer_events = false;
+	m_pipeline = NULL;
+	m_threadinfo_pool = NULL;
 
 	uint32_t evlen = sizeof(scap_evt) + 2 * sizeof(uint16_t) + 2 * sizeof(uint64_t);
 	m_meinfo.m_piscapevt = (scap_evt*)new char[evlen];
@@ -189,6 +201,13 @@ sinsp::~sinsp()
 		m_thread_manager = NULL;
 	}
 
+#ifdef HAS_FILTERING
+	delete m_extraction_cache;
+	m_extraction_cache = NULL;
+#endif
+
+	set_threadinfo_pool(false);
+
 	if(m_cycle_writer)
 	{
 		delete m_cycle_writer;
@@ -313,6 +332,8 @@ void sinsp::init()
 	m_lastevent_ts = 0;
 #ifdef HAS_FILTERING
 	m_firstevent_ts = 0;
+	// Event numbers start over
+	m_extraction_cache->invalidate();
 #endif
 	m_fds_to_remove->clear();
 
@@ -433,6 +454,19 @@ void sinsp::init()
 		set_statsd_port(m_statsd_port);
 	}
 
+	//
+	// Same for the kernel prefilter
+	//
+	if(m_kernel_prefilter.m_set && is_live())
+	{
+		apply_kernel_prefilter();
+	}
+
+	if(m_detailed_stats && is_live())
+	{
+		set_detailed_stats(true);
+	}
+
 #if defined(HAS_CAPTURE)
 	if(m_mode == SCAP_MODE_LIVE)
 	{
@@ -473,6 +507,9 @@ void sinsp::open_live_common(uint32_t timeout_ms, scap_mode_t mode)
 	oargs.debug_log_fn = &sinsp_scap_debug_log_fn;
 	oargs.proc_scan_timeout_ms = m_proc_scan_timeout_ms;
 	oargs.proc_scan_log_interval_ms = m_proc_scan_log_interval_ms;
+	oargs.merge_mode = m_merge_mode;
+	oargs.wakeup_watermark = m_wakeup_watermark;
+	oargs.proc_scan_threads = m_proc_scan_threads;
 
 	if(!m_filter_proc_table_when_saving)
 	{
@@ -505,6 +542,12 @@ void sinsp::open_live_common(uint32_t timeout_ms, scap_mode_t mode)
 	scap_set_refresh_proc_table_when_saving(m_h, !m_filter_proc_table_when_saving);
 
 	init();
+
+	if(m_pipeline_workers != 0 && !m_udig)
+	{
+		m_pipeline = new sinsp_pipeline(m_h, m_pipeline_workers, m_pipeline_drop_simple_consumer_events);
+		m_pipeline->start();
+	}
 }
 
 void sinsp::open(uint32_t timeout_ms)
@@ -547,6 +590,9 @@ void sinsp::open_nodriver()
 	oargs.debug_log_fn = &sinsp_scap_debug_log_fn;
 	oargs.proc_scan_timeout_ms = m_proc_scan_timeout_ms;
 	oargs.proc_scan_log_interval_ms = m_proc_scan_log_interval_ms;
+	oargs.merge_mode = m_merge_mode;
+	oargs.wakeup_watermark = m_wakeup_watermark;
+	oargs.proc_scan_threads = m_proc_scan_threads;
 
 	int32_t scap_rc;
 	m_h = scap_open(oargs, error, &scap_rc);
@@ -692,6 +738,9 @@ void sinsp::open_int()
 	oargs.debug_log_fn = &sinsp_scap_debug_log_fn;
 	oargs.proc_scan_timeout_ms = m_proc_scan_timeout_ms;
 	oargs.proc_scan_log_interval_ms = m_proc_scan_log_interval_ms;
+	oargs.merge_mode = m_merge_mode;
+	oargs.wakeup_watermark = m_wakeup_watermark;
+	oargs.proc_scan_threads = m_proc_scan_threads;
 
 	int32_t scap_rc;
 	m_h = scap_open(oargs, error, &scap_rc);
@@ -745,6 +794,20 @@ void sinsp::fdopen(int fd)
 
 void sinsp::close()
 {
+	if(m_pipeline)
+	{
+		delete m_pipeline;
+		m_pipeline = NULL;
+		m_evt.m_decoded_params = NULL;
+		m_evt.m_decoded_pevt = NULL;
+	}
+
+	//
+	// The liveness probes and the /proc lookups use the handle
+	//
+	m_thread_manager->stop_liveness_probes();
+	m_thread_manager->stop_proc_lookups();
+
 	if(m_h)
 	{
 		scap_close(m_h);
@@ -803,6 +866,11 @@ void sinsp::autodump_start(const string& dump_filename, bool compress)
 		throw sinsp_exception(scap_getlasterr(m_h));
 	}
 
+	if(m_autodump_async && scap_dump_enable_async(m_dumper, 0) == SCAP_FAILURE)
+	{
+		throw sinsp_exception("can't start the dump writer thread");
+	}
+
 	m_container_manager.dump_containers(m_dumper);
 }
 
@@ -821,6 +889,11 @@ void sinsp::autodump_stop()
 
 	if(m_dumper != NULL)
 	{
+		if(m_pipeline)
+		{
+			m_pipeline->flush_dumper();
+		}
+
 		scap_dump_close(m_dumper);
 		m_dumper = NULL;
 	}
@@ -859,23 +932,19 @@ void sinsp::on_new_entry_from_proc(void* context,
 	//
 	if(fdinfo == NULL)
 	{
-		bool thread_added = false;
-		sinsp_threadinfo* newti = build_threadinfo();
+		threadinfo_map_t::ptr_t newti(build_threadinfo());
 		newti->init(tinfo);
 		if(is_nodriver())
 		{
 			auto sinsp_tinfo = find_thread(tid, true);
 			if(sinsp_tinfo == nullptr || newti->m_clone_ts > sinsp_tinfo->m_clone_ts)
 			{
-				thread_added = m_thread_manager->add_thread(newti, true);
+				m_thread_manager->add_thread(newti.get(), true);
 			}
 		}
 		else
 		{
-			thread_added = m_thread_manager->add_thread(newti, true);
-		}
-		if (!thread_added) {
-			delete newti;
+			m_thread_manager->add_thread(newti.get(), true);
 		}
 	}
 	else
@@ -884,12 +953,11 @@ void sinsp::on_new_entry_from_proc(void* context,
 
 		if(!sinsp_tinfo)
 		{
-			sinsp_threadinfo* newti = build_threadinfo();
+			threadinfo_map_t::ptr_t newti(build_threadinfo());
 			newti->init(tinfo);
 
-			if (!m_thread_manager->add_thread(newti, true)) {
+			if (!m_thread_manager->add_thread(newti.get(), true)) {
 				ASSERT(false);
-				delete newti;
 				return;
 			}
 
@@ -927,9 +995,9 @@ void sinsp::import_thread_table()
 	//
 	HASH_ITER(hh, table, pi, tpi)
 	{
-		sinsp_threadinfo* newti = build_threadinfo();
+		threadinfo_map_t::ptr_t newti(build_threadinfo());
 		newti->init(pi);
-		m_thread_manager->add_thread(newti, true);
+		m_thread_manager->add_thread(newti.get(), true);
 	}
 }
 
@@ -1171,7 +1239,14 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 		//
 		// Get the event from libscap
 		//
-		res = scap_next(m_h, &(evt->m_pevt), &(evt->m_cpuid));
+		if(m_pipeline)
+		{
+			res = next_pipelined(evt);
+		}
+		else
+		{
+			res = scap_next(m_h, &(evt->m_pevt), &(evt->m_cpuid));
+		}
 
 		if(res != SCAP_SUCCESS)
 		{
@@ -1198,6 +1273,10 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 				return SCAP_TIMEOUT;
 
 			}
+			else if(m_pipeline)
+			{
+				m_lasterr = m_pipeline->get_lasterr();
+			}
 			else
 			{
 				m_lasterr = scap_getlasterr(m_h);
@@ -1229,6 +1308,14 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 	evt->m_evtnum = m_nevts;
 	m_lastevent_ts = ts;
 
+	//
+	// Replace the placeholder threads whose /proc lookup completed
+	//
+	if(m_thread_manager->get_n_pending_proc_lookups() != 0)
+	{
+		m_thread_manager->merge_proc_lookups();
+	}
+
 	if (m_automatic_threadtable_purging)
 	{
 		//
@@ -1366,7 +1453,11 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 
 		if(m_write_cycling)
 		{
-			switch(m_cycle_writer->consider(evt))
+			//
+			// In pipeline mode the file is written by the dumper
+			// thread, which tracks its size
+			//
+			switch(m_cycle_writer->consider(evt, m_pipeline? m_pipeline->get_dump_offset() : -1))
 			{
 				case cycle_writer::NEWFILE:
 					autodump_next_file();
@@ -1385,11 +1476,23 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 
 		scap_evt* pdevt = (evt->m_poriginal_evt)? evt->m_poriginal_evt : evt->m_pevt;
 
-		res = scap_dump(m_h, m_dumper, pdevt, evt->m_cpuid, dflags);
+		if(m_pipeline)
+		{
+			res = m_pipeline->dump(m_dumper, pdevt, evt->m_cpuid, dflags);
 
-		if(SCAP_SUCCESS != res)
+			if(SCAP_SUCCESS != res)
+			{
+				throw sinsp_exception(m_pipeline->get_lasterr());
+			}
+		}
+		else
 		{
-			throw sinsp_exception(scap_getlasterr(m_h));
+			res = scap_dump(m_h, m_dumper, pdevt, evt->m_cpuid, dflags);
+
+			if(SCAP_SUCCESS != res)
+			{
+				throw sinsp_exception(scap_dump_getlasterr(m_dumper));
+			}
 		}
 	}
 
@@ -1437,6 +1540,56 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 	return res;
 }
 
+int32_t sinsp::next_pipelined(sinsp_evt* evt)
+{
+	sinsp_pipeline::event pevt;
+	int32_t res = m_pipeline->next(&pevt);
+
+	if(res != SCAP_SUCCESS)
+	{
+		return res;
+	}
+
+	evt->m_pevt = pevt.m_pevt;
+	evt->m_cpuid = pevt.m_cpuid;
+	evt->m_decoded_params = pevt.m_params;
+	evt->m_ndecoded_params = pevt.m_nparams;
+	evt->m_decoded_pevt = pevt.m_pevt;
+
+	return SCAP_SUCCESS;
+}
+
+int32_t sinsp::next_batch(OUT scap_evt** evts, uint32_t max_evts, OUT uint32_t* nevts, OUT uint16_t* cpuid)
+{
+	int32_t res = scap_next_batch(m_h, evts, max_evts, nevts, cpuid);
+
+	if(res != SCAP_SUCCESS)
+	{
+		if(res == SCAP_UNEXPECTED_BLOCK)
+		{
+			uint64_t filepos = scap_ftell(m_h) - scap_get_unexpected_block_readsize(m_h);
+			restart_capture_at_filepos(filepos);
+			return SCAP_TIMEOUT;
+		}
+		else if(res != SCAP_TIMEOUT && res != SCAP_EOF)
+		{
+			m_lasterr = scap_getlasterr(m_h);
+		}
+
+		return res;
+	}
+
+	if(m_firstevent_ts == 0)
+	{
+		m_firstevent_ts = evts[0]->ts;
+	}
+
+	m_nevts += *nevts;
+	m_lastevent_ts = evts[*nevts - 1]->ts;
+
+	return res;
+}
+
 uint64_t sinsp::get_num_events()
 {
 	if(m_h)
@@ -1629,6 +1782,134 @@ void sinsp::set_statsd_port(const uint16_t port)
 	}
 }
 
+void sinsp::set_kernel_prefilter(const std::vector<std::string>& cgroups,
+                                 const std::vector<int64_t>& pids,
+                                 const std::map<uint16_t, uint32_t>& sampling_ratios)
+{
+	m_kernel_prefilter.m_cgroup_ids.clear();
+	m_kernel_prefilter.m_tgids.clear();
+	m_kernel_prefilter.m_sampling_ratios.clear();
+
+	//
+	// The id of a cgroup v2 is the inode number of its directory, which is
+	// what bpf_get_current_cgroup_id() returns
+	//
+	for(const auto& path : cgroups)
+	{
+#ifndef _WIN32
+		struct stat st;
+
+		if(stat(path.c_str(), &st) != 0)
+		{
+			throw sinsp_exception("can't stat cgroup " + path + ": " + strerror(errno));
+		}
+
+		m_kernel_prefilter.m_cgroup_ids.push_back(st.st_ino);
+#else
+		throw sinsp_exception("cgroup prefiltering not supported on this platform");
+#endif
+	}
+
+	for(int64_t pid : pids)
+	{
+		m_kernel_prefilter.m_tgids.push_back((uint32_t)pid);
+	}
+
+	if(!sampling_ratios.empty())
+	{
+		m_kernel_prefilter.m_sampling_ratios.resize(PPM_EVENT_MAX, 0);
+
+		for(const auto& it : sampling_ratios)
+		{
+			if(it.first >= PPM_EVENT_MAX)
+			{
+				throw sinsp_exception("invalid event type " + std::to_string(it.first));
+			}
+
+			m_kernel_prefilter.m_sampling_ratios[it.first] = it.second;
+		}
+	}
+
+	m_kernel_prefilter.m_set = true;
+
+	//
+	// If this method is called before opening of the inspector,
+	// it's pushed to the kernel after its initialization.
+	//
+	if(m_h == NULL)
+	{
+		return;
+	}
+
+	apply_kernel_prefilter();
+}
+
+void sinsp::clear_kernel_prefilter()
+{
+	m_kernel_prefilter.m_set = false;
+	m_kernel_prefilter.m_cgroup_ids.clear();
+	m_kernel_prefilter.m_tgids.clear();
+	m_kernel_prefilter.m_sampling_ratios.clear();
+
+	if(m_h == NULL)
+	{
+		return;
+	}
+
+	if(!is_live())
+	{
+		throw sinsp_exception("clear_kernel_prefilter called on a trace file");
+	}
+
+	if(scap_set_kernel_prefilter(m_h, NULL) != SCAP_SUCCESS)
+	{
+		throw sinsp_exception(scap_getlasterr(m_h));
+	}
+}
+
+void sinsp::apply_kernel_prefilter()
+{
+	scap_prefilter prefilter;
+
+	if(!is_live())
+	{
+		throw sinsp_exception("set_kernel_prefilter called on a trace file");
+	}
+
+	prefilter.cgroup_ids = m_kernel_prefilter.m_cgroup_ids.data();
+	prefilter.ncgroup_ids = (uint32_t)m_kernel_prefilter.m_cgroup_ids.size();
+	prefilter.tgids = m_kernel_prefilter.m_tgids.data();
+	prefilter.ntgids = (uint32_t)m_kernel_prefilter.m_tgids.size();
+	prefilter.sampling_ratios = m_kernel_prefilter.m_sampling_ratios.empty()?
+		NULL : m_kernel_prefilter.m_sampling_ratios.data();
+
+	if(scap_set_kernel_prefilter(m_h, &prefilter) != SCAP_SUCCESS)
+	{
+		throw sinsp_exception(scap_getlasterr(m_h));
+	}
+}
+
+void sinsp::set_detailed_stats(bool enable)
+{
+	m_detailed_stats = enable;
+
+	if(m_h == NULL)
+	{
+		return;
+	}
+
+	if(!is_live())
+	{
+		throw sinsp_exception("set_detailed_stats called on a trace file");
+	}
+
+	int32_t res = enable? scap_enable_detailed_stats(m_h) : scap_disable_detailed_stats(m_h);
+	if(res != SCAP_SUCCESS)
+	{
+		throw sinsp_exception(scap_getlasterr(m_h));
+	}
+}
+
 void sinsp::stop_capture()
 {
 	if(scap_stop_capture(m_h) != SCAP_SUCCESS)
@@ -1800,6 +2081,17 @@ void sinsp::get_capture_stats(scap_stats* stats) const
 	}
 }
 
+void sinsp::get_detailed_stats(std::vector<scap_evt_type_stats>& stats) const
+{
+	uint32_t ncpus = scap_get_possible_cpus(m_h);
+
+	stats.resize((size_t)ncpus * PPM_EVENT_MAX);
+	if(scap_get_detailed_stats(m_h, stats.data(), ncpus) != SCAP_SUCCESS)
+	{
+		throw sinsp_exception(scap_getlasterr(m_h));
+	}
+}
+
 #ifdef GATHER_INTERNAL_STATS
 sinsp_stats sinsp::get_stats()
 {
@@ -2423,6 +2715,11 @@ void sinsp::set_thread_timeout_s(uint32_t val)
 	m_thread_timeout_ns = (uint64_t)val * ONE_SECOND_IN_NS;
 }
 
+void sinsp::set_async_proc_lookups(uint32_t nworkers)
+{
+	m_thread_manager->set_async_proc_lookups(nworkers);
+}
+
 void sinsp::set_proc_scan_timeout_ms(uint64_t val)
 {
 	m_proc_scan_timeout_ms = val;
@@ -2433,6 +2730,43 @@ void sinsp::set_proc_scan_log_interval_ms(uint64_t val)
 	m_proc_scan_log_interval_ms = val;
 }
 
+void sinsp::set_merge_mode(scap_merge_mode_t mode)
+{
+	m_merge_mode = mode;
+}
+
+void sinsp::set_wakeup_watermark(uint32_t bytes)
+{
+	m_wakeup_watermark = bytes;
+}
+
+void sinsp::set_proc_scan_threads(uint32_t nthreads)
+{
+	m_proc_scan_threads = nthreads;
+}
+
+void sinsp::set_pipeline_mode(uint32_t nworkers, bool drop_simple_consumer_events)
+{
+	m_pipeline_workers = nworkers;
+	m_pipeline_drop_simple_consumer_events = drop_simple_consumer_events;
+}
+
+void sinsp::set_threadinfo_pool(bool enable)
+{
+	if(enable && m_threadinfo_pool == NULL)
+	{
+		m_threadinfo_pool = new libsinsp::slab_pool(sizeof(sinsp_threadinfo));
+	}
+	else if(!enable && m_threadinfo_pool != NULL)
+	{
+		//
+		// The threads already in the table keep the pool alive
+		//
+		m_threadinfo_pool->release_owner();
+		m_threadinfo_pool = NULL;
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Note: this is defined here so we can inline it in sinso::next
 ///////////////////////////////////////////////////////////////////////////////
@@ -2440,70 +2774,40 @@ bool sinsp_thread_manager::remove_inactive_threads()
 {
 	bool res = false;
 
-	if(m_last_flush_time_ns == 0)
+	if(m_purge_start_ns == 0)
 	{
 		//
-		// Set the first table scan for 30 seconds in, so that we can spot bugs in the logic without having
+		// Start purging 30 seconds in, so that we can spot bugs in the logic without having
 		// to wait for tens of minutes
 		//
 		if(m_inspector->m_inactive_thread_scan_time_ns > 30 * ONE_SECOND_IN_NS)
 		{
-			m_last_flush_time_ns =
-				(m_inspector->m_lastevent_ts - m_inspector->m_inactive_thread_scan_time_ns + 30 * ONE_SECOND_IN_NS);
+			m_purge_start_ns = m_inspector->m_lastevent_ts + 30 * ONE_SECOND_IN_NS;
 		}
 		else
 		{
-			m_last_flush_time_ns =
-				(m_inspector->m_lastevent_ts - m_inspector->m_inactive_thread_scan_time_ns);
+			m_purge_start_ns = m_inspector->m_lastevent_ts;
 		}
 	}
 
-	if(m_inspector->m_lastevent_ts >
-		m_last_flush_time_ns + m_inspector->m_inactive_thread_scan_time_ns)
+	if(m_inspector->m_lastevent_ts < m_purge_start_ns)
 	{
-		std::unordered_map<uint64_t, bool> to_delete;
+		return false;
+	}
 
+	if(!m_pending_probes.empty() && m_inspector->m_lastevent_ts >= m_next_probe_check_ns)
+	{
+		collect_probe_results();
 		res = true;
+	}
 
-		m_last_flush_time_ns = m_inspector->m_lastevent_ts;
-
-		g_logger.format(sinsp_logger::SEV_INFO, "Flushing thread table");
-
-		//
-		// Go through the table and remove dead entries.
-		//
-		m_threadtable.loop([&] (sinsp_threadinfo& tinfo) {
-			bool closed = (tinfo.m_flags & PPM_CL_CLOSED) != 0;
-
-			if(closed ||
-				((m_inspector->m_lastevent_ts > tinfo.m_lastaccess_ts + m_inspector->m_thread_timeout_ns) &&
-					!scap_is_thread_alive(m_inspector->m_h, tinfo.m_pid, tinfo.m_tid, tinfo.m_comm.c_str()))
-					)
-			{
-				//
-				// Reset the cache
-				//
-				m_last_tid = 0;
-				m_last_tinfo.reset();
-
-#ifdef GATHER_INTERNAL_STATS
-				m_removed_threads->increment();
-#endif
-				to_delete[tinfo.m_tid] = closed;
-			}
-			return true;
-		});
-
-		for (auto& it : to_delete)
-		{
-			remove_thread(it.first, it.second);
-		}
-
-		//
-		// Rebalance the thread table dependency tree, so we free up threads that
-		// exited but that are stuck because of reference counting.
-		//
-		recreate_child_dependencies();
+	//
+	// Look at a bounded number of threads per event, instead of
+	// walking the whole table at once
+	//
+	if(!m_purge_queue.empty() && m_purge_queue.top().first <= m_inspector->m_lastevent_ts)
+	{
+		res = purge_due_threads() || res;
 	}
 
 	return res;
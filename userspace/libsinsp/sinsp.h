@@ -74,6 +74,7 @@ using namespace std;
 #include "filter.h"
 #include "dumper.h"
 #include "stats.h"
+#include "extraction_cache.h"
 #include "ifinfo.h"
 #include "container.h"
 #include "viewinfo.h"
@@ -92,6 +93,7 @@ using namespace std;
 #include "tuples.h"
 #include "fdinfo.h"
 #include "threadinfo.h"
+#include "proc_lookup.h"
 #include "ifinfo.h"
 #include "eventformatter.h"
 #include "sinsp_pd_callback_type.h"
@@ -108,6 +110,7 @@ class k8s;
 #endif // !defined(CYGWING_AGENT) && !defined(MINIMAL_BUILD)
 class sinsp_partial_tracer;
 class mesos;
+class sinsp_pipeline;
 
 #if defined(HAS_CAPTURE) && !defined(_WIN32)
 class sinsp_ssl;
@@ -272,6 +275,28 @@ public:
 	*/
 	virtual int32_t next(OUT sinsp_evt **evt);
 
+	/*!
+	  \brief Get a run of raw events captured on a single CPU, bypassing
+	   cross-CPU ordering and the state engine.
+
+	  This is meant for consumers that only aggregate events (counters,
+	  per-CPU analysis) and don't need the thread/fd state or a global
+	  timestamp order. The events are neither parsed, filtered nor dumped.
+	  Don't mix it with next() on the same capture.
+
+	  \param evts array that will be filled with up to max_evts pointers to
+	   the events, which point straight into the driver buffer.
+	  \param max_evts size of the evts array.
+	  \param nevts will be set to the number of events returned.
+	  \param cpuid will be set to the CPU all the returned events come from.
+
+	  \return the same values as next().
+
+	  \note: the returned events can be considered valid only until the next
+	   call to next_batch()
+	*/
+	int32_t next_batch(OUT scap_evt** evts, uint32_t max_evts, OUT uint32_t* nevts, OUT uint16_t* cpuid);
+
 	/*!
 	  \brief Get the maximum number of bytes currently in use by any CPU buffer
      */
@@ -407,19 +432,29 @@ public:
 	void disable_automatic_threadtable_purging();
 
 	/*!
-	 * \brief sets the interval at which the thread purge code runs. This does
-	 *        not run every event as it's mildly expensive if there are lots of threads
+	 * \brief sets how long the thread purge code waits before looking again at a
+	 *        thread that was found inactive but alive, or that can't be removed yet
+	 *        because of its children
 	 */
 	void set_thread_purge_interval_s(uint32_t val);
 
 	/*!
 	 * \brief sets the amount of time after which a thread which has seen no events
-	 *        can be purged. As the purging happens only every m_thread_purge_interval_s,
-	 *        the max time a thread may linger is actually m_thread_purge_interval +
+	 *        can be purged. Inactive threads are looked at a few per event and
+	 *        checked in /proc in the background, so they are removed shortly after
 	 *        m_thread_timeout_s
 	 */
 	void set_thread_timeout_s(uint32_t val);
 
+	/*!
+	 * \brief sets how many background threads read from /proc the threads that
+	 *        show up in events without being in the thread table. With 0, the
+	 *        default, they are read on the capture thread. Otherwise a placeholder
+	 *        thread is used until the lookup completes. Ignored when comms are
+	 *        suppressed with suppress_events_comm()
+	 */
+	void set_async_proc_lookups(uint32_t nworkers);
+
 	/*!
 	 * \brief sets the max amount of time that the initial scan of /proc should execute,
 	 *        after which a so-far-successful scan should be stopped and success returned.
@@ -433,6 +468,51 @@ public:
 	 */
 	void set_proc_scan_log_interval_ms(uint64_t val);
 
+	/*!
+	 * \brief sets how a live capture merges the per-CPU ring buffers.
+	 *        SCAP_MERGE_LINEAR (default) scans every ring for each event,
+	 *        SCAP_MERGE_HEAP keeps the ring heads in a min-heap and scales
+	 *        better on machines with many CPUs. Must be called before open().
+	 */
+	void set_merge_mode(scap_merge_mode_t mode);
+
+	/*!
+	 * \brief if non-zero, next() blocks in poll() on the driver while the buffers
+	 *        are empty and wakes up as soon as a buffer holds this many bytes,
+	 *        instead of sleeping with an exponential backoff. Must be called
+	 *        before open().
+	 */
+	void set_wakeup_watermark(uint32_t bytes);
+
+	/*!
+	 * \brief the number of threads scanning /proc when a live or nodriver
+	 *        capture is opened. 0 or 1 scan it on the calling thread.
+	 *        Must be called before open().
+	 */
+	void set_proc_scan_threads(uint32_t nthreads);
+
+	/*!
+	 * \brief if nworkers is non-zero, live captures run pipelined: nworkers
+	 *        threads read the per-CPU buffers, copy the events out and decode
+	 *        their parameters, next() merges them in timestamp order and runs
+	 *        the state engine, and a separate thread writes the dump file.
+	 *        If drop_simple_consumer_events is true, the readers also drop the
+	 *        events rejected by simple_consumer_consider_evtnum() before they
+	 *        reach the state engine. Must be called before open(). Only kernel
+	 *        module and BPF captures can be pipelined.
+	 */
+	void set_pipeline_mode(uint32_t nworkers, bool drop_simple_consumer_events = false);
+
+	/*!
+	 * \brief if enabled, the thread info objects built by the inspector are
+	 *        carved out of a slab pool instead of being allocated one by one,
+	 *        which keeps malloc off the clone and exit paths of fork-heavy
+	 *        workloads. Has no effect on the objects built by an external
+	 *        event processor. Thread info objects that come from the pool
+	 *        are freed by dropping their last reference, never with delete.
+	 */
+	void set_threadinfo_pool(bool enable);
+
 
 	/*!
 	  \brief Start writing the captured events to file.
@@ -466,6 +546,16 @@ public:
 	*/
 	void autodump_stop();
 
+	/*!
+	  \brief Write the events of the dumps started by \ref autodump_start()
+	   from a background thread, see scap_dump_enable_async(). Applies to
+	   the dumps started from now on.
+	*/
+	void set_autodump_async(bool enable)
+	{
+		m_autodump_async = enable;
+	}
+
 	/*!
 	  \brief Populate the given vector with the full list of filter check fields
 	   that this version of the library supports.
@@ -548,6 +638,16 @@ public:
 	*/
 	void get_capture_stats(scap_stats* stats) const override;
 
+	/*!
+	  \brief Fill stats with the per event type counters of the eBPF
+	   probe, the ones of event type t on CPU c being
+	   stats[c * PPM_EVENT_MAX + t], c counting the possible CPUs, which
+	   can be more than the online ones. See set_detailed_stats().
+
+	  \note this call won't work on file captures.
+	*/
+	void get_detailed_stats(std::vector<scap_evt_type_stats>& stats) const;
+
 #ifdef GATHER_INTERNAL_STATS
 	sinsp_stats get_stats();
 #endif
@@ -556,8 +656,19 @@ public:
 
 	sinsp_threadinfo* build_threadinfo()
     {
-        return m_external_event_processor ? m_external_event_processor->build_threadinfo(this)
-                                          : new sinsp_threadinfo(this);
+        if(m_external_event_processor)
+        {
+            return m_external_event_processor->build_threadinfo(this);
+        }
+
+        if(m_threadinfo_pool)
+        {
+            sinsp_threadinfo* tinfo = new(m_threadinfo_pool->allocate()) sinsp_threadinfo(this);
+            tinfo->m_pool = m_threadinfo_pool;
+            return tinfo;
+        }
+
+        return new sinsp_threadinfo(this);
     }
 
 	/*!
@@ -954,6 +1065,33 @@ public:
 
 	void set_statsd_port(uint16_t port);
 
+	/*!
+	  \brief Have the eBPF probe drop events before filling them, so that
+	  they use neither ring buffer space nor parsing time. If pids or
+	  cgroups is non empty, only the events of those processes, or of the
+	  threads in those cgroup v2 directories (e.g.
+	  /sys/fs/cgroup/system.slice/docker-<id>.scope), are kept. Then
+	  1 in every sampling_ratios[type] events of each listed type is kept.
+	  Events the inspector can't lose, e.g. process exits, always go
+	  through.
+
+	  \note This is a coarse filter in front of the regular one. Children
+	  of the processes in pids are not followed, and cgroups are ignored
+	  before Linux 4.18.
+	*/
+	void set_kernel_prefilter(const std::vector<std::string>& cgroups,
+	                          const std::vector<int64_t>& pids,
+	                          const std::map<uint16_t, uint32_t>& sampling_ratios);
+	void clear_kernel_prefilter();
+
+	/*!
+	  \brief Have the eBPF probe count the events, bytes, buffer full
+	  drops and filler time of each event type on each CPU, to tell which
+	  ones are responsible for the drops. Read them with
+	  get_detailed_stats().
+	*/
+	void set_detailed_stats(bool enable);
+
 	void set_cri_socket_path(const std::string& path);
 	void set_cri_timeout(int64_t timeout_ms);
 	void set_cri_async(bool async);
@@ -987,6 +1125,7 @@ private:
 	void import_ifaddr_list();
 	void import_user_list();
 	void add_protodecoders();
+	int32_t next_pipelined(sinsp_evt* evt);
 
 	void remove_thread(int64_t tid, bool force);
 
@@ -1033,6 +1172,8 @@ private:
 		       m_increased_snaplen_port_range.range_end > 0;
 	}
 
+	void apply_kernel_prefilter();
+
 	void get_procs_cpu_from_driver(uint64_t ts);
 
 	scap_t* m_h;
@@ -1056,6 +1197,7 @@ private:
 	char m_output_time_flag;
 	uint32_t m_max_evt_output_len;
 	bool m_compress;
+	bool m_autodump_async;
 	sinsp_evt m_evt;
 	std::string m_lasterr;
 	int64_t m_tid_to_remove;
@@ -1083,6 +1225,10 @@ private:
 public:
 	sinsp_thread_manager* m_thread_manager;
 
+#ifdef HAS_FILTERING
+	sinsp_extraction_cache* m_extraction_cache;
+#endif
+
 	sinsp_container_manager m_container_manager;
 
 	metadata_download_params m_metadata_download_params;
@@ -1162,6 +1308,19 @@ public:
 
 	int32_t m_statsd_port;
 
+	//
+	// Saved kernel prefilter, resolved to what scap expects
+	//
+	struct
+	{
+		bool m_set;
+		std::vector<uint64_t> m_cgroup_ids;
+		std::vector<uint32_t> m_tgids;
+		std::vector<uint32_t> m_sampling_ratios;
+	} m_kernel_prefilter;
+
+	bool m_detailed_stats;
+
 	//
 	// Some thread table limits
 	//
@@ -1229,6 +1388,13 @@ public:
 	// Holds an event dequeued from the above queue
 	std::shared_ptr<sinsp_evt> m_container_evt;
 
+	// A queue of completed /proc lookups. Written from the async
+	// proc lookup sources, merged into the thread table from
+	// sinsp::next().
+#ifndef _WIN32
+	tbb::concurrent_queue<libsinsp::proc_lookup_result> m_completed_proc_lookups;
+#endif
+
 	//
 	// End of second housekeeping
 	//
@@ -1249,6 +1415,14 @@ public:
 	uint64_t m_proc_scan_timeout_ms;
 	uint64_t m_proc_scan_log_interval_ms;
 
+	scap_merge_mode_t m_merge_mode;
+	uint32_t m_wakeup_watermark;
+	uint32_t m_proc_scan_threads;
+	uint32_t m_pipeline_workers;
+	bool m_pipeline_drop_simple_consumer_events;
+	sinsp_pipeline* m_pipeline;
+	libsinsp::slab_pool* m_threadinfo_pool;
+
 	// Any thread with a comm in this set will not have its events
 	// returned in sinsp::next()
 	std::set<std::string> m_suppressed_comms;
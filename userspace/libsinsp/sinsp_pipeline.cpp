@@ -0,0 +1,572 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <string.h>
+#include <chrono>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "sinsp_pipeline.h"
+
+//
+// Per-CPU ring between a reader and the state engine, and ring between
+// the state engine and the dumper thread
+//
+#define PIPELINE_CPU_RING_SIZE (2 * 1024 * 1024)
+#define PIPELINE_DUMP_RING_SIZE (8 * 1024 * 1024)
+
+//
+// Max number of events a reader moves from a CPU before looking at the
+// next one, so that a busy CPU doesn't starve the others
+//
+#define PIPELINE_READ_BATCH 256
+
+//
+// Same backoff as the scap refill when the buffers are empty
+//
+#define PIPELINE_WAIT_TIME_US_START 500
+#define PIPELINE_WAIT_TIME_US_MAX 30000
+#define PIPELINE_DUMPER_WAIT_TIME_US 1000
+
+//
+// The dumper thread publishes the offset of the file every this many
+// events, for the cycle writer
+//
+#define PIPELINE_DUMP_OFFSET_INTERVAL 64
+
+//
+// Layout of a record in a CPU ring: the header, the decoded parameter
+// table, then a copy of the event. The parameters point into the copy.
+//
+struct pipeline_evt_hdr
+{
+	uint32_t m_nparams;
+	uint16_t m_cpuid;
+	uint16_t m_reserved;
+};
+
+//
+// Layout of a record in the dump ring: the header, then the event
+//
+struct pipeline_dump_hdr
+{
+	scap_dumper_t* m_dumper;
+	uint32_t m_flags;
+	uint16_t m_cpuid;
+	uint16_t m_reserved;
+};
+
+static inline scap_evt* record_evt(uint8_t* rec)
+{
+	pipeline_evt_hdr* hdr = (pipeline_evt_hdr*)rec;
+	return (scap_evt*)(rec + sizeof(pipeline_evt_hdr) + hdr->m_nparams * sizeof(sinsp_evt_param));
+}
+
+sinsp_pipeline::sinsp_pipeline(scap_t* h, uint32_t nworkers, bool drop_simple_consumer_events):
+	m_h(h),
+	m_drop_simple_consumer_events(drop_simple_consumer_events),
+	m_stop(false),
+	m_failed(false),
+	m_served_cpu(-1),
+	m_wait_time_us(PIPELINE_WAIT_TIME_US_START),
+	m_dump_ring(PIPELINE_DUMP_RING_SIZE),
+	m_dumper_stop(false),
+	m_dump_offset(0)
+{
+	m_ncpus = scap_get_ndevs(h);
+	m_nworkers = (nworkers < m_ncpus)? nworkers : m_ncpus;
+	if(m_nworkers == 0)
+	{
+		m_nworkers = 1;
+	}
+
+	m_cpus.resize(m_ncpus);
+	for(auto& cs : m_cpus)
+	{
+		cs.m_ring.reset(new libsinsp::spsc_ring(PIPELINE_CPU_RING_SIZE));
+		cs.m_pending = NULL;
+		cs.m_limit = 0;
+	}
+
+	m_heap.reserve(m_ncpus);
+}
+
+sinsp_pipeline::~sinsp_pipeline()
+{
+	stop();
+}
+
+void sinsp_pipeline::start()
+{
+	m_stop = false;
+	m_dumper_stop = false;
+
+	for(uint32_t j = 0; j < m_nworkers; j++)
+	{
+		std::unique_ptr<worker_state> ws(new worker_state());
+		ws->m_nprefiltered = 0;
+		m_workers.push_back(std::move(ws));
+	}
+
+	for(uint32_t j = 0; j < m_nworkers; j++)
+	{
+		m_workers[j]->m_thread = std::thread(&sinsp_pipeline::run_worker, this, j);
+	}
+
+	m_dumper_thread = std::thread(&sinsp_pipeline::run_dumper, this);
+}
+
+void sinsp_pipeline::stop()
+{
+	m_stop = true;
+	for(auto& ws : m_workers)
+	{
+		if(ws->m_thread.joinable())
+		{
+			ws->m_thread.join();
+		}
+	}
+	m_workers.clear();
+
+	//
+	// Whatever was handed to the dumper still gets written
+	//
+	m_dumper_stop = true;
+	if(m_dumper_thread.joinable())
+	{
+		m_dumper_thread.join();
+	}
+}
+
+uint64_t sinsp_pipeline::get_num_prefiltered() const
+{
+	uint64_t res = 0;
+
+	for(auto& ws : m_workers)
+	{
+		res += ws->m_nprefiltered.load(std::memory_order_relaxed);
+	}
+
+	return res;
+}
+
+void sinsp_pipeline::set_error(const char* error)
+{
+	std::lock_guard<std::mutex> lock(m_error_mutex);
+
+	if(!m_failed)
+	{
+		m_error = error;
+		m_failed = true;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reader threads
+///////////////////////////////////////////////////////////////////////////////
+void sinsp_pipeline::run_worker(uint32_t id)
+{
+	uint64_t wait_time_us = PIPELINE_WAIT_TIME_US_START;
+
+	while(!m_stop.load(std::memory_order_relaxed))
+	{
+		uint32_t nread = 0;
+		uint32_t nblocked = 0;
+
+		for(uint32_t cpuid = id; cpuid < m_ncpus; cpuid += m_nworkers)
+		{
+			if(read_cpu((uint16_t)cpuid, &nread) != SCAP_SUCCESS)
+			{
+				return;
+			}
+
+			if(m_cpus[cpuid].m_pending != NULL)
+			{
+				nblocked++;
+			}
+		}
+
+		if(nblocked != 0)
+		{
+			//
+			// The state engine is about to free some space, don't
+			// leave it without events from these CPUs for a whole
+			// backoff period
+			//
+			std::this_thread::yield();
+			wait_time_us = PIPELINE_WAIT_TIME_US_START;
+		}
+		else if(nread == 0)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(wait_time_us));
+			wait_time_us = MIN(wait_time_us * 2, PIPELINE_WAIT_TIME_US_MAX);
+		}
+		else
+		{
+			wait_time_us = PIPELINE_WAIT_TIME_US_START;
+		}
+	}
+}
+
+int32_t sinsp_pipeline::read_cpu(uint16_t cpuid, uint32_t* nread)
+{
+	cpu_state& cs = m_cpus[cpuid];
+	worker_state& ws = *m_workers[cpuid % m_nworkers];
+
+	for(uint32_t j = 0; j < PIPELINE_READ_BATCH; j++)
+	{
+		scap_evt* pe = cs.m_pending;
+
+		if(pe == NULL)
+		{
+			int32_t res = scap_next_dev(m_h, cpuid, &pe);
+
+			if(res == SCAP_TIMEOUT)
+			{
+				break;
+			}
+			else if(res != SCAP_SUCCESS)
+			{
+				set_error(scap_dev_getlasterr(m_h, cpuid));
+				return res;
+			}
+
+			if(m_drop_simple_consumer_events &&
+			   !sinsp::simple_consumer_consider_evtnum(pe->type))
+			{
+				ws.m_nprefiltered.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+		}
+
+		//
+		// If the state engine is behind, keep the event in the
+		// driver ring (it stays valid until the next scap_next_dev()
+		// for this CPU) and retry on the next round
+		//
+		if(!push(cs, pe))
+		{
+			cs.m_pending = pe;
+			break;
+		}
+
+		cs.m_pending = NULL;
+		(*nread)++;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+bool sinsp_pipeline::push(cpu_state& cs, scap_evt* pe)
+{
+	uint32_t nparams = 0;
+
+	if(pe->type < PPM_EVENT_MAX)
+	{
+		//
+		// Same as sinsp_evt::load_params()
+		//
+		nparams = g_infotables.m_event_info[pe->type].nparams;
+		nparams = (nparams < pe->nparams)? nparams : pe->nparams;
+	}
+
+	uint32_t params_size = nparams * sizeof(sinsp_evt_param);
+	uint8_t* rec = cs.m_ring->reserve(sizeof(pipeline_evt_hdr) + params_size + pe->len);
+	if(rec == NULL)
+	{
+		return false;
+	}
+
+	pipeline_evt_hdr* hdr = (pipeline_evt_hdr*)rec;
+	hdr->m_nparams = nparams;
+	hdr->m_cpuid = (uint16_t)(&cs - &m_cpus[0]);
+
+	scap_evt* copy = record_evt(rec);
+	memcpy(copy, pe, pe->len);
+
+	sinsp_evt_param* params = (sinsp_evt_param*)(rec + sizeof(pipeline_evt_hdr));
+	uint16_t* lens = (uint16_t*)((char*)copy + sizeof(struct ppm_evt_hdr));
+	char* valptr = (char*)lens + copy->nparams * sizeof(uint16_t);
+
+	for(uint32_t j = 0; j < nparams; j++)
+	{
+		params[j].m_val = valptr;
+		params[j].m_len = lens[j];
+		valptr += lens[j];
+	}
+
+	cs.m_ring->commit();
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// State engine side
+///////////////////////////////////////////////////////////////////////////////
+bool sinsp_pipeline::merge_entry_less(const merge_entry& a, const merge_entry& b)
+{
+	//
+	// Break timestamp ties on the CPU, like the scap merge, so that
+	// equal timestamps always come out in the same order
+	//
+	return a.m_ts < b.m_ts || (a.m_ts == b.m_ts && a.m_cpuid < b.m_cpuid);
+}
+
+void sinsp_pipeline::sift_down(uint32_t j)
+{
+	uint32_t size = (uint32_t)m_heap.size();
+	merge_entry e = m_heap[j];
+
+	while(true)
+	{
+		uint32_t child = 2 * j + 1;
+		if(child >= size)
+		{
+			break;
+		}
+
+		if(child + 1 < size && merge_entry_less(m_heap[child + 1], m_heap[child]))
+		{
+			child++;
+		}
+
+		if(!merge_entry_less(m_heap[child], e))
+		{
+			break;
+		}
+
+		m_heap[j] = m_heap[child];
+		j = child;
+	}
+
+	m_heap[j] = e;
+}
+
+//
+// Take a snapshot of what the readers produced so far. Like the scap
+// refill, nothing produced after the snapshot is considered until all
+// the rings have been drained up to it, so that a busy CPU can't starve
+// the others.
+//
+bool sinsp_pipeline::rebuild_heap()
+{
+	m_heap.clear();
+
+	for(uint32_t j = 0; j < m_ncpus; j++)
+	{
+		cpu_state& cs = m_cpus[j];
+		uint32_t len;
+		uint8_t* rec;
+
+		cs.m_limit = cs.m_ring->head();
+		rec = cs.m_ring->front(cs.m_limit, &len);
+		if(rec == NULL)
+		{
+			continue;
+		}
+
+		merge_entry e;
+		e.m_ts = record_evt(rec)->ts;
+		e.m_cpuid = (uint16_t)j;
+		m_heap.push_back(e);
+	}
+
+	for(uint32_t j = (uint32_t)m_heap.size() / 2; j-- > 0;)
+	{
+		sift_down(j);
+	}
+
+	return !m_heap.empty();
+}
+
+int32_t sinsp_pipeline::next(event* evt)
+{
+	uint32_t len;
+	uint8_t* rec;
+
+	//
+	// The state engine is done with the previous event
+	//
+	if(m_served_cpu != -1)
+	{
+		cpu_state& cs = m_cpus[m_served_cpu];
+
+		cs.m_ring->pop();
+		rec = cs.m_ring->front(cs.m_limit, &len);
+		if(rec != NULL)
+		{
+			m_heap[0].m_ts = record_evt(rec)->ts;
+		}
+		else
+		{
+			m_heap[0] = m_heap.back();
+			m_heap.pop_back();
+		}
+
+		if(!m_heap.empty())
+		{
+			sift_down(0);
+		}
+
+		m_served_cpu = -1;
+	}
+
+	if(m_failed.load(std::memory_order_acquire))
+	{
+		std::lock_guard<std::mutex> lock(m_error_mutex);
+		m_lasterr = m_error;
+		return SCAP_FAILURE;
+	}
+
+	if(m_heap.empty() && !rebuild_heap())
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(m_wait_time_us));
+		m_wait_time_us = MIN(m_wait_time_us * 2, PIPELINE_WAIT_TIME_US_MAX);
+		return SCAP_TIMEOUT;
+	}
+
+	m_wait_time_us = PIPELINE_WAIT_TIME_US_START;
+
+	uint16_t cpuid = m_heap[0].m_cpuid;
+	rec = m_cpus[cpuid].m_ring->front(m_cpus[cpuid].m_limit, &len);
+	ASSERT(rec != NULL);
+	m_served_cpu = cpuid;
+
+	pipeline_evt_hdr* hdr = (pipeline_evt_hdr*)rec;
+	scap_evt* pe = record_evt(rec);
+	bool suppressed;
+
+	//
+	// Suppression tracks clones and exits, so it has to see the events
+	// in order, i.e. here rather than in the readers
+	//
+	if(scap_check_suppressed_evt(m_h, pe, &suppressed) != SCAP_SUCCESS)
+	{
+		m_lasterr = scap_getlasterr(m_h);
+		return SCAP_FAILURE;
+	}
+
+	if(suppressed)
+	{
+		return SCAP_TIMEOUT;
+	}
+
+	evt->m_pevt = pe;
+	evt->m_cpuid = hdr->m_cpuid;
+	evt->m_params = (const sinsp_evt_param*)(rec + sizeof(pipeline_evt_hdr));
+	evt->m_nparams = hdr->m_nparams;
+
+	return SCAP_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Dumper stage
+///////////////////////////////////////////////////////////////////////////////
+int32_t sinsp_pipeline::dump(scap_dumper_t* dumper, scap_evt* e, uint16_t cpuid, uint32_t flags)
+{
+	uint8_t* rec;
+
+	while((rec = m_dump_ring.reserve(sizeof(pipeline_dump_hdr) + e->len)) == NULL)
+	{
+		if(m_failed.load(std::memory_order_acquire) || !m_dumper_thread.joinable())
+		{
+			break;
+		}
+
+		std::this_thread::yield();
+	}
+
+	if(m_failed.load(std::memory_order_acquire))
+	{
+		std::lock_guard<std::mutex> lock(m_error_mutex);
+		m_lasterr = m_error;
+		return SCAP_FAILURE;
+	}
+
+	if(rec == NULL)
+	{
+		m_lasterr = "pipeline dumper not running";
+		return SCAP_FAILURE;
+	}
+
+	pipeline_dump_hdr* hdr = (pipeline_dump_hdr*)rec;
+	hdr->m_dumper = dumper;
+	hdr->m_flags = flags;
+	hdr->m_cpuid = cpuid;
+	memcpy(rec + sizeof(pipeline_dump_hdr), e, e->len);
+	m_dump_ring.commit();
+
+	return SCAP_SUCCESS;
+}
+
+void sinsp_pipeline::flush_dumper()
+{
+	while(!m_dump_ring.empty() &&
+	      !m_failed.load(std::memory_order_acquire) &&
+	      m_dumper_thread.joinable())
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+
+	m_dump_offset.store(0, std::memory_order_relaxed);
+}
+
+int64_t sinsp_pipeline::get_dump_offset() const
+{
+	return m_dump_offset.load(std::memory_order_relaxed);
+}
+
+void sinsp_pipeline::run_dumper()
+{
+	uint64_t ndumped = 0;
+
+	while(true)
+	{
+		uint32_t len;
+		uint8_t* rec = m_dump_ring.front(&len);
+
+		if(rec == NULL)
+		{
+			if(m_dumper_stop.load(std::memory_order_acquire))
+			{
+				return;
+			}
+
+			std::this_thread::sleep_for(std::chrono::microseconds(PIPELINE_DUMPER_WAIT_TIME_US));
+			continue;
+		}
+
+		pipeline_dump_hdr* hdr = (pipeline_dump_hdr*)rec;
+		scap_evt* e = (scap_evt*)(rec + sizeof(pipeline_dump_hdr));
+
+		if(scap_dump(m_h, hdr->m_dumper, e, hdr->m_cpuid, hdr->m_flags) != SCAP_SUCCESS)
+		{
+			set_error(scap_dump_getlasterr(hdr->m_dumper));
+			return;
+		}
+
+		//
+		// Before the pop, since the dumper can be closed as soon as
+		// flush_dumper() sees the ring empty
+		//
+		if(++ndumped % PIPELINE_DUMP_OFFSET_INTERVAL == 0)
+		{
+			m_dump_offset.store(scap_dump_get_offset(hdr->m_dumper), std::memory_order_relaxed);
+		}
+
+		m_dump_ring.pop();
+	}
+}
@@ -0,0 +1,156 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <scap.h>
+#include "spsc_ring.h"
+
+class sinsp_evt_param;
+
+/*!
+  \brief Pipelined event source for live captures.
+
+  Reader threads own disjoint sets of CPU buffers. They copy each event
+  out of the driver ring, decode its parameter table and push it onto a
+  per-CPU SPSC ring. The state engine thread (the one calling
+  sinsp::next()) merges the per-CPU rings in timestamp order, with the
+  same semantics as the scap merge, so that the thread and fd state is
+  updated in order. Dumping runs on its own thread, fed by another SPSC
+  ring.
+*/
+class sinsp_pipeline
+{
+public:
+	/*!
+	  \brief Describes an event handed to the state engine.
+	*/
+	struct event
+	{
+		scap_evt* m_pevt;
+		uint16_t m_cpuid;
+		const sinsp_evt_param* m_params;
+		uint32_t m_nparams;
+	};
+
+	sinsp_pipeline(scap_t* h, uint32_t nworkers, bool drop_simple_consumer_events);
+	~sinsp_pipeline();
+
+	void start();
+	void stop();
+
+	/*!
+	  \brief Get the next event in timestamp order. The event stays valid
+	  until the next call. Returns SCAP_SUCCESS, SCAP_TIMEOUT if nothing
+	  is available, or SCAP_FAILURE if a reader failed, see get_lasterr().
+	*/
+	int32_t next(event* evt);
+
+	/*!
+	  \brief Queue an event to be written by the dumper thread. Returns
+	  SCAP_FAILURE if a previous write failed, see get_lasterr().
+	*/
+	int32_t dump(scap_dumper_t* dumper, scap_evt* e, uint16_t cpuid, uint32_t flags);
+
+	/*!
+	  \brief Wait until all the queued events have been written.
+	*/
+	void flush_dumper();
+
+	/*!
+	  \brief Offset of the dump file as of the last few events written by
+	  the dumper thread, to use instead of scap_dump_get_offset(), which
+	  would race with that thread. It reads 0 after flush_dumper(), since
+	  the dumper can then be closed or replaced.
+	*/
+	int64_t get_dump_offset() const;
+
+	const std::string& get_lasterr() const
+	{
+		return m_lasterr;
+	}
+
+	/*!
+	  \brief Number of events dropped by the readers before reaching
+	  the state engine.
+	*/
+	uint64_t get_num_prefiltered() const;
+
+private:
+	struct merge_entry
+	{
+		uint64_t m_ts;
+		uint16_t m_cpuid;
+	};
+
+	struct cpu_state
+	{
+		std::unique_ptr<libsinsp::spsc_ring> m_ring;
+		scap_evt* m_pending;
+		uint64_t m_limit;
+	};
+
+	struct worker_state
+	{
+		std::thread m_thread;
+		std::atomic<uint64_t> m_nprefiltered;
+	};
+
+	void run_worker(uint32_t id);
+	void run_dumper();
+	int32_t read_cpu(uint16_t cpuid, uint32_t* nread);
+	bool push(cpu_state& cs, scap_evt* pe);
+	bool rebuild_heap();
+	static bool merge_entry_less(const merge_entry& a, const merge_entry& b);
+	void sift_down(uint32_t j);
+	void set_error(const char* error);
+
+	scap_t* m_h;
+	uint32_t m_ncpus;
+	uint32_t m_nworkers;
+	bool m_drop_simple_consumer_events;
+
+	std::vector<cpu_state> m_cpus;
+	std::vector<std::unique_ptr<worker_state>> m_workers;
+	std::atomic<bool> m_stop;
+	std::atomic<bool> m_failed;
+	std::mutex m_error_mutex;
+	std::string m_error;
+
+	//
+	// State engine side
+	//
+	std::vector<merge_entry> m_heap;
+	int32_t m_served_cpu;
+	uint64_t m_wait_time_us;
+	std::string m_lasterr;
+
+	//
+	// Dumper stage
+	//
+	libsinsp::spsc_ring m_dump_ring;
+	std::thread m_dumper_thread;
+	std::atomic<bool> m_dumper_stop;
+	std::atomic<int64_t> m_dump_offset;
+};
@@ -0,0 +1,154 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace libsinsp
+{
+
+/**
+ * Pool of fixed-size memory blocks carved out of larger slabs.
+ *
+ * Freed blocks go to a free list and are handed out again LIFO, so a
+ * steady churn of same-size objects stops hitting malloc once the pool
+ * has grown to the peak number of live objects. Slabs are only given back
+ * when the pool is destroyed. An owner that goes away while blocks are
+ * still in use calls release_owner() instead of deleting the pool, and the
+ * pool deletes itself once the last block comes back. Not thread safe.
+ */
+class slab_pool
+{
+public:
+	slab_pool(size_t block_size, uint32_t blocks_per_slab = 128):
+		m_block_size(round_up(block_size < sizeof(free_block)? sizeof(free_block) : block_size)),
+		m_blocks_per_slab(blocks_per_slab? blocks_per_slab : 1),
+		m_free(nullptr),
+		m_nlive(0),
+		m_orphaned(false)
+	{
+	}
+
+	~slab_pool()
+	{
+		for(void* slab : m_slabs)
+		{
+			::operator delete(slab);
+		}
+	}
+
+	slab_pool(const slab_pool&) = delete;
+	slab_pool& operator=(const slab_pool&) = delete;
+
+	void* allocate()
+	{
+		if(m_free == nullptr)
+		{
+			add_slab();
+		}
+
+		free_block* b = m_free;
+		m_free = b->m_next;
+		m_nlive++;
+		return b;
+	}
+
+	void deallocate(void* p)
+	{
+		free_block* b = static_cast<free_block*>(p);
+		b->m_next = m_free;
+		m_free = b;
+		m_nlive--;
+
+		if(m_orphaned && m_nlive == 0)
+		{
+			delete this;
+		}
+	}
+
+	/**
+	 * Delete a pool allocated with new, now or as soon as the last block
+	 * in use is deallocated.
+	 */
+	void release_owner()
+	{
+		if(m_nlive == 0)
+		{
+			delete this;
+		}
+		else
+		{
+			m_orphaned = true;
+		}
+	}
+
+	size_t block_size() const
+	{
+		return m_block_size;
+	}
+
+	uint64_t num_live() const
+	{
+		return m_nlive;
+	}
+
+	uint64_t capacity() const
+	{
+		return (uint64_t)m_slabs.size() * m_blocks_per_slab;
+	}
+
+private:
+	struct free_block
+	{
+		free_block* m_next;
+	};
+
+	static size_t round_up(size_t size)
+	{
+		const size_t align = alignof(std::max_align_t);
+		return (size + align - 1) & ~(align - 1);
+	}
+
+	void add_slab()
+	{
+		char* slab = static_cast<char*>(::operator new(m_block_size * m_blocks_per_slab));
+		m_slabs.push_back(slab);
+
+		//
+		// Chain the blocks so that they're handed out in address order
+		//
+		for(uint32_t j = m_blocks_per_slab; j > 0; j--)
+		{
+			free_block* b = reinterpret_cast<free_block*>(slab + (j - 1) * m_block_size);
+			b->m_next = m_free;
+			m_free = b;
+		}
+	}
+
+	size_t m_block_size;
+	uint32_t m_blocks_per_slab;
+	free_block* m_free;
+	uint64_t m_nlive;
+	bool m_orphaned;
+	std::vector<void*> m_slabs;
+};
+
+}
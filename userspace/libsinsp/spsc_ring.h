@@ -0,0 +1,205 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+namespace libsinsp
+{
+
+/**
+ * Lock-free single-producer/single-consumer ring of variable-length
+ * records. Records are stored contiguously: when one doesn't fit before
+ * the end of the buffer, the producer writes a padding record and wraps
+ * around. A record stays valid for the consumer until it is popped.
+ *
+ * Producer side: reserve() + commit().
+ * Consumer side: front() + pop().
+ */
+class spsc_ring
+{
+public:
+	/**
+	 * The size is rounded up to a power of two. A single record can't
+	 * be larger than half of it.
+	 */
+	explicit spsc_ring(uint32_t size):
+		m_head(0),
+		m_tail(0),
+		m_write_pos(0),
+		m_cached_tail(0),
+		m_reserved_len(0),
+		m_read_pos(0)
+	{
+		uint32_t cap = 64;
+		while(cap < size)
+		{
+			cap <<= 1;
+		}
+
+		m_buf.resize(cap);
+		m_mask = cap - 1;
+	}
+
+	/**
+	 * Return a pointer to len bytes that the producer can fill, or
+	 * nullptr if the consumer hasn't freed enough space yet.
+	 */
+	uint8_t* reserve(uint32_t len)
+	{
+		uint64_t pos = m_write_pos;
+		uint32_t need = record_size(len);
+		uint32_t off = (uint32_t)(pos & m_mask);
+		uint32_t contig = (uint32_t)m_buf.size() - off;
+		uint32_t total = (need > contig)? contig + need : need;
+
+		if(need > m_buf.size() / 2)
+		{
+			return nullptr;
+		}
+
+		if(total > m_buf.size() - (pos - m_cached_tail))
+		{
+			m_cached_tail = m_tail.load(std::memory_order_acquire);
+			if(total > m_buf.size() - (pos - m_cached_tail))
+			{
+				return nullptr;
+			}
+		}
+
+		if(need > contig)
+		{
+			header(off)->m_len = contig;
+			header(off)->m_pad = 1;
+			pos += contig;
+			off = 0;
+		}
+
+		header(off)->m_len = len;
+		header(off)->m_pad = 0;
+		m_write_pos = pos;
+		m_reserved_len = len;
+
+		return &m_buf[off + sizeof(record_hdr)];
+	}
+
+	/**
+	 * Publish the record returned by the last reserve().
+	 */
+	void commit()
+	{
+		m_write_pos += record_size(m_reserved_len);
+		m_head.store(m_write_pos, std::memory_order_release);
+	}
+
+	/**
+	 * Producer position, to be used as a consumer limit in front().
+	 */
+	uint64_t head() const
+	{
+		return m_head.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * Return the oldest record published before limit, or nullptr.
+	 */
+	uint8_t* front(uint64_t limit, uint32_t* len)
+	{
+		uint64_t pos = m_read_pos;
+		if(pos >= limit)
+		{
+			return nullptr;
+		}
+
+		uint32_t off = (uint32_t)(pos & m_mask);
+		if(header(off)->m_pad)
+		{
+			//
+			// The padding is always published together with the
+			// record that follows it
+			//
+			m_read_pos = pos + header(off)->m_len;
+			off = 0;
+		}
+
+		*len = header(off)->m_len;
+		return &m_buf[off + sizeof(record_hdr)];
+	}
+
+	uint8_t* front(uint32_t* len)
+	{
+		return front(head(), len);
+	}
+
+	/**
+	 * Give the record returned by front() back to the producer.
+	 */
+	void pop()
+	{
+		m_read_pos += record_size(header((uint32_t)(m_read_pos & m_mask))->m_len);
+		m_tail.store(m_read_pos, std::memory_order_release);
+	}
+
+	bool empty() const
+	{
+		return m_tail.load(std::memory_order_acquire) == head();
+	}
+
+private:
+	struct record_hdr
+	{
+		uint32_t m_len;
+		uint32_t m_pad;
+	};
+
+	static uint32_t record_size(uint32_t len)
+	{
+		return (uint32_t)sizeof(record_hdr) + ((len + 7) & ~7U);
+	}
+
+	record_hdr* header(uint32_t off)
+	{
+		return (record_hdr*)&m_buf[off];
+	}
+
+	std::vector<uint8_t> m_buf;
+	uint64_t m_mask;
+
+	//
+	// Keep the two shared positions on separate cache lines, so that
+	// the producer and the consumer don't bounce them at every record
+	//
+	char m_pad0[64];
+	std::atomic<uint64_t> m_head;
+	char m_pad1[64];
+	std::atomic<uint64_t> m_tail;
+	char m_pad2[64];
+
+	// producer only
+	uint64_t m_write_pos;
+	uint64_t m_cached_tail;
+	uint32_t m_reserved_len;
+	char m_pad3[64];
+
+	// consumer only
+	uint64_t m_read_pos;
+};
+
+}
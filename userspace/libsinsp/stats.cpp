@@ -39,6 +39,12 @@ void sinsp_stats::clear()
 	m_n_store_drops = 0;
 	m_n_retrieved_evts = 0;
 	m_n_retrieve_drops = 0;
+	m_n_async_proc_lookups = 0;
+	m_n_async_proc_lookups_done = 0;
+	m_n_async_proc_lookups_pending = 0;
+	m_n_async_proc_lookup_drops = 0;
+	m_async_proc_lookup_latency_ns = 0;
+	m_async_proc_lookup_max_latency_ns = 0;
 	m_metrics_registry.clear_all_metrics();
 }
 
@@ -62,6 +68,14 @@ void sinsp_stats::emit(FILE* f)
 	fprintf(f, "store drops: %" PRIu64 "\n", m_n_store_drops);
 	fprintf(f, "retrieved evts: %" PRIu64 "\n", m_n_retrieved_evts);
 	fprintf(f, "retrieve drops: %" PRIu64 "\n", m_n_retrieve_drops);
+	fprintf(f, "async proc lookups: %" PRIu64 " (%" PRIu64 " done %" PRIu64 " pending %" PRIu64 " dropped)\n",
+		m_n_async_proc_lookups,
+		m_n_async_proc_lookups_done,
+		m_n_async_proc_lookups_pending,
+		m_n_async_proc_lookup_drops);
+	fprintf(f, "async proc lookup latency: %" PRIu64 "us avg %" PRIu64 "us max\n",
+		m_n_async_proc_lookups_done? m_async_proc_lookup_latency_ns / m_n_async_proc_lookups_done / 1000 : 0,
+		m_async_proc_lookup_max_latency_ns / 1000);
 
 	for(internal_metrics::registry::metric_map_iterator_t it = m_metrics_registry.get_metrics().begin(); it != m_metrics_registry.get_metrics().end(); it++)
 	{
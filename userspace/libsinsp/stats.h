@@ -51,6 +51,12 @@ public:
 	uint64_t m_n_store_drops;
 	uint64_t m_n_retrieved_evts;
 	uint64_t m_n_retrieve_drops;
+	uint64_t m_n_async_proc_lookups;
+	uint64_t m_n_async_proc_lookups_done;
+	uint64_t m_n_async_proc_lookups_pending;
+	uint64_t m_n_async_proc_lookup_drops;
+	uint64_t m_async_proc_lookup_latency_ns;
+	uint64_t m_async_proc_lookup_max_latency_ns;
 
 private:
 	internal_metrics::registry m_metrics_registry;
@@ -177,6 +177,7 @@ void sinsp_table::configure(vector<sinsp_view_column_info>* entries, const strin
 		m_chks_to_free.push_back(chk);
 
 		chk->parse_field_name(vit.get_field(m_view_depth).c_str(), true, false);
+		chk->m_field_name = vit.get_field(m_view_depth);
 
 		if((vit.m_flags & TEF_IS_KEY) != 0)
 		{
@@ -450,7 +451,7 @@ void sinsp_table::process_event(sinsp_evt* evt)
 	for(j = 0; j < m_n_premerge_fields; j++)
 	{
 		uint32_t len;
-		uint8_t* val = m_premerge_extractors[j]->extract(evt, &len);
+		uint8_t* val = m_premerge_extractors[j]->extract_cached(evt, &len);
 
 		sinsp_table_field* pfld = &(m_premerge_fld_pointers[j]);
 
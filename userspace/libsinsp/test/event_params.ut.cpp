@@ -0,0 +1,61 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <gtest.h>
+#include <vector>
+#include <sinsp.h>
+#include "test_utils.h"
+
+static std::vector<uint8_t> make_read_exit(int64_t res, const char* data, uint16_t datalen)
+{
+	return test_utils::event_builder(PPME_SYSCALL_READ_X, 1).param(res).param(data, datalen).build();
+}
+
+TEST(event_params, view_matches_table)
+{
+	sinsp inspector;
+	sinsp_evt evt(&inspector);
+	std::vector<uint8_t> buf = make_read_exit(-11, "hello", 6);
+
+	evt.init(&buf[0], 0);
+
+	ASSERT_EQ(2u, evt.get_num_params());
+	ASSERT_EQ(-11, evt.get_param_as<int64_t>(0));
+
+	sinsp_evt_param data = evt.get_param_view(1);
+	ASSERT_EQ(6, data.m_len);
+	ASSERT_STREQ("hello", data.m_val);
+
+	for(uint32_t j = 0; j < evt.get_num_params(); j++)
+	{
+		sinsp_evt_param view = evt.get_param_view(j);
+		sinsp_evt_param* par = evt.get_param(j);
+
+		ASSERT_EQ(par->m_val, view.m_val);
+		ASSERT_EQ(par->m_len, view.m_len);
+	}
+
+	//
+	// Views follow the event the sinsp_evt is pointed to
+	//
+	std::vector<uint8_t> buf2 = make_read_exit(4096, "", 1);
+	evt.init(&buf2[0], 0);
+
+	ASSERT_EQ(4096, evt.get_param_as<int64_t>(0));
+	ASSERT_EQ(1, evt.get_param_view(1).m_len);
+	ASSERT_EQ(4096, *(int64_t*)evt.get_param(0)->m_val);
+}
@@ -0,0 +1,122 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+// Event numbers are only set by sinsp::next()
+#define VISIBILITY_PRIVATE public:
+#include "sinsp.h"
+#include "filter.h"
+#include "filterchecks.h"
+#include <gtest.h>
+#include "test_utils.h"
+
+using namespace test_utils;
+
+static std::vector<uint8_t> make_close_x(uint64_t tid, int64_t res)
+{
+	return event_builder(PPME_SYSCALL_CLOSE_X, tid, 1000).param(res).build();
+}
+
+static sinsp_filter_check* new_check(sinsp_filter_check_list& list, sinsp* inspector, const char* name)
+{
+	sinsp_filter_check* chk = list.new_filter_check_from_fldname(name, inspector, true);
+	chk->parse_field_name(name, true, false);
+	chk->m_field_name = name;
+	return chk;
+}
+
+TEST(extraction_cache, shared_between_checks)
+{
+	sinsp inspector;
+	sinsp_filter_check_list list;
+	add_thread(inspector, 100, "test");
+	add_thread(inspector, 200, "other");
+
+	std::vector<uint8_t> buf1 = make_close_x(100, 0);
+	std::vector<uint8_t> buf2 = make_close_x(200, 0);
+	sinsp_evt evt(&inspector);
+
+	std::unique_ptr<sinsp_filter_check> chk1(new_check(list, &inspector, "proc.name"));
+	std::unique_ptr<sinsp_filter_check> chk2(new_check(list, &inspector, "proc.name"));
+	std::unique_ptr<sinsp_filter_check> pid(new_check(list, &inspector, "proc.pid"));
+	uint32_t len;
+
+	// The second check gets the value extracted by the first
+	evt.init(&buf1[0], 0);
+	evt.m_evtnum = 1;
+	uint8_t* val1 = chk1->extract_cached(&evt, &len, false);
+	ASSERT_NE(nullptr, val1);
+	EXPECT_STREQ("test", (char*)val1);
+	EXPECT_EQ(4u, len);
+	len = 0;
+	EXPECT_EQ(val1, chk2->extract_cached(&evt, &len, false));
+	EXPECT_EQ(4u, len);
+
+	uint8_t* pidval = pid->extract_cached(&evt, &len, false);
+	ASSERT_NE(nullptr, pidval);
+	EXPECT_EQ(100, *(int64_t*)pidval);
+	EXPECT_EQ(pidval, pid->extract_cached(&evt, &len, false));
+
+	// Sanitized and raw strings are kept apart, other types are not
+	uint8_t* sanitized = chk2->extract_cached(&evt, &len, true);
+	EXPECT_NE(val1, sanitized);
+	EXPECT_STREQ("test", (char*)sanitized);
+	EXPECT_EQ(pidval, pid->extract_cached(&evt, &len, true));
+
+	// A new event number invalidates the entries
+	evt.init(&buf2[0], 0);
+	evt.m_evtnum = 2;
+	EXPECT_STREQ("other", (char*)chk2->extract_cached(&evt, &len, false));
+	EXPECT_STREQ("other", (char*)chk1->extract_cached(&evt, &len, false));
+	EXPECT_EQ(200, *(int64_t*)pid->extract_cached(&evt, &len, false));
+
+	// Events that don't come from sinsp::next() are not cached
+	evt.init(&buf1[0], 0);
+	EXPECT_EQ(0u, evt.get_num());
+	EXPECT_STREQ("test", (char*)chk1->extract_cached(&evt, &len, false));
+
+	EXPECT_EQ(3u, inspector.m_extraction_cache->size());
+}
+
+TEST(extraction_cache, filter_and_formatter)
+{
+	sinsp inspector;
+	add_thread(inspector, 100, "test");
+	add_thread(inspector, 200, "other");
+
+	sinsp_filter_compiler compiler(&inspector, "proc.pid in (100, 200) and proc.name contains e");
+	std::unique_ptr<sinsp_filter> filter(compiler.compile());
+	sinsp_evt_formatter formatter(&inspector, "%proc.pid %proc.name %thread.exectime");
+
+	std::vector<uint8_t> buf1 = make_close_x(100, 0);
+	std::vector<uint8_t> buf2 = make_close_x(200, 0);
+	sinsp_evt evt(&inspector);
+	std::string out;
+
+	for(uint64_t j = 1; j <= 4; j++)
+	{
+		evt.init(j % 2? &buf1[0] : &buf2[0], 0);
+		evt.m_evtnum = j;
+		EXPECT_TRUE(filter->run(&evt));
+		ASSERT_TRUE(formatter.tostring(&evt, &out));
+		EXPECT_EQ(j % 2? "100 test 0" : "200 other 0", out);
+	}
+
+	// proc.pid is shared by the filter and the formatter, proc.name is
+	// raw for the filter and sanitized for the formatter. thread.exectime
+	// keeps per-check state and is never cached.
+	EXPECT_EQ(3u, inspector.m_extraction_cache->size());
+}
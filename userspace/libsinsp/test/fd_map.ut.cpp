@@ -0,0 +1,157 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <gtest.h>
+#include <map>
+#include <string>
+#include <fd_map.h>
+
+using namespace libsinsp;
+
+TEST(fd_map_test, direct_and_hashed)
+{
+	fd_map<std::string> m(64);
+	int64_t keys[] = {0, 3, 63, 64, 1000, -1, -100, INT64_MAX};
+
+	ASSERT_TRUE(m.empty());
+	ASSERT_TRUE(m.find(3) == m.end());
+
+	for(int64_t k : keys)
+	{
+		ASSERT_TRUE(m.emplace(k, std::to_string(k)).second);
+	}
+
+	ASSERT_EQ(sizeof(keys) / sizeof(keys[0]), m.size());
+	ASSERT_FALSE(m.emplace(3, "x").second);
+	ASSERT_EQ("3", m.find(3)->second);
+
+	for(int64_t k : keys)
+	{
+		auto it = m.find(k);
+		ASSERT_TRUE(it != m.end());
+		ASSERT_EQ(k, it->first);
+		ASSERT_EQ(std::to_string(k), it->second);
+	}
+
+	m[INT64_MAX] = "max";
+	ASSERT_EQ("max", m.find(INT64_MAX)->second);
+	m[5] = "five";
+	ASSERT_EQ(sizeof(keys) / sizeof(keys[0]) + 1, m.size());
+
+	ASSERT_EQ(1u, m.erase((int64_t)63));
+	ASSERT_EQ(1u, m.erase((int64_t)-100));
+	ASSERT_EQ(0u, m.erase((int64_t)-100));
+	ASSERT_TRUE(m.find(63) == m.end());
+	ASSERT_TRUE(m.find(-100) == m.end());
+	ASSERT_EQ(sizeof(keys) / sizeof(keys[0]) - 1, m.size());
+}
+
+TEST(fd_map_test, iteration)
+{
+	fd_map<int> m(32);
+	std::map<int64_t, int> expected;
+
+	for(int64_t k = 0; k < 200; k += 3)
+	{
+		m.emplace(k, (int)k * 2);
+		expected[k] = (int)k * 2;
+	}
+
+	std::map<int64_t, int> seen;
+	int64_t last_direct = -1;
+	for(auto it = m.begin(); it != m.end(); ++it)
+	{
+		ASSERT_TRUE(seen.insert(*it).second);
+
+		// The direct fds come first, in order
+		if(it->first < 32)
+		{
+			ASSERT_GT(it->first, last_direct);
+			last_direct = it->first;
+		}
+		else
+		{
+			last_direct = 32;
+		}
+	}
+
+	ASSERT_EQ(expected, seen);
+}
+
+TEST(fd_map_test, churn)
+{
+	fd_map<int64_t> m(16);
+	std::map<int64_t, int64_t> ref;
+	uint64_t state = 1;
+
+	// Random insertions and removals, checked against std::map
+	for(uint32_t j = 0; j < 100000; j++)
+	{
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		int64_t k = (int64_t)((state >> 33) % 2000) - 100;
+
+		if((state >> 20) & 1)
+		{
+			m[k] = (int64_t)j;
+			ref[k] = (int64_t)j;
+		}
+		else
+		{
+			ASSERT_EQ(ref.erase(k), m.erase(k));
+		}
+	}
+
+	ASSERT_EQ(ref.size(), m.size());
+	for(auto& e : ref)
+	{
+		auto it = m.find(e.first);
+		ASSERT_TRUE(it != m.end());
+		ASSERT_EQ(e.second, it->second);
+	}
+}
+
+TEST(fd_map_test, stable_references_and_copy)
+{
+	fd_map<std::string> m(8);
+	std::string* small = &m[2];
+	std::string* large = &m[100];
+	*small = "small";
+	*large = "large";
+
+	// Grow both parts
+	for(int64_t k = 0; k < 1000; k++)
+	{
+		m[k + 200];
+		m[k % 8];
+	}
+
+	ASSERT_EQ(small, &m.find(2)->second);
+	ASSERT_EQ(large, &m.find(100)->second);
+
+	fd_map<std::string> c(m);
+	ASSERT_EQ(m.size(), c.size());
+	ASSERT_EQ("small", c.find(2)->second);
+	ASSERT_NE(small, &c.find(2)->second);
+
+	c.clear();
+	ASSERT_TRUE(c.empty());
+	ASSERT_TRUE(c.begin() == c.end());
+
+	c = m;
+	ASSERT_EQ("large", c.find(100)->second);
+	ASSERT_EQ(m.size(), c.size());
+}
@@ -0,0 +1,126 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "sinsp.h"
+#include "filter.h"
+#include <gtest.h>
+#include "test_utils.h"
+
+using namespace test_utils;
+
+static std::vector<uint8_t> make_close_x(uint64_t tid, int64_t res)
+{
+	return event_builder(PPME_SYSCALL_CLOSE_X, tid, 1000).param(res).build();
+}
+
+static std::vector<uint8_t> make_open_x(uint64_t tid, int64_t fd, const char* name)
+{
+	return event_builder(PPME_SYSCALL_OPEN_X, tid, 2000)
+		.param(fd)
+		.param(name)
+		.param((uint32_t)1)
+		.param((uint32_t)0644)
+		.param((uint32_t)0)
+		.build();
+}
+
+TEST(filter_program, same_results_as_tree)
+{
+	sinsp inspector;
+	add_thread(inspector, 100, "test", {"--verbose"});
+	add_thread(inspector, 200, "other", {"--verbose"});
+
+	std::vector<std::vector<uint8_t>> events = {
+		make_open_x(100, 3, "/etc/passwd"),
+		make_open_x(200, -2, "/tmp/missing"),
+		make_close_x(100, 0),
+		make_close_x(200, -9),
+		make_close_x(300, 0),
+	};
+
+	// Filter, number of events it's expected to match
+	std::vector<std::pair<std::string, uint32_t>> filters = {
+		{"evt.type=open", 2},
+		{"evt.type in (open, close) and proc.name=test", 2},
+		{"not evt.type=close or proc.pid > 150", 3},
+		{"proc.name in (test, other) and not (evt.rawres < 0 or evt.dir = >)", 2},
+		{"evt.rawres exists and proc.name startswith te", 2},
+		{"proc.pid in (1, 2, 100)", 2},
+		{"proc.pid in (1, 2, 100) or proc.pid in (200)", 4},
+		{"proc.name contains es and proc.name endswith st and proc.name glob t*t", 2},
+		{"proc.name icontains TH or proc.args contains verbose", 4},
+		{"evt.arg.name = /etc/passwd", 1},
+		{"evt.rawarg.res < 0", 1},
+		{"proc.aname = init or proc.exe != test", 2},
+		{"fd.name = /etc/passwd", 1},
+		{"not (evt.type = close and (proc.name = test or proc.name = other))", 3},
+		{"evt.rawres >= 0 and evt.rawres <= 3 and evt.cpu = 0", 3},
+		{"proc.name > other", 2},
+	};
+
+	for(const auto& f : filters)
+	{
+		sinsp_filter_compiler tree_compiler(&inspector, f.first);
+		tree_compiler.set_bytecode(false);
+		std::unique_ptr<sinsp_filter> tree(tree_compiler.compile());
+		ASSERT_TRUE(tree->get_program() == NULL);
+
+		sinsp_filter_compiler vm_compiler(&inspector, f.first);
+		std::unique_ptr<sinsp_filter> vm(vm_compiler.compile());
+		ASSERT_TRUE(vm->get_program() != NULL);
+
+		uint32_t nmatches = 0;
+
+		for(auto& buf : events)
+		{
+			sinsp_evt evt(&inspector);
+
+			evt.init(&buf[0], 0);
+			evt.set_check_id(-1);
+			bool expected = tree->run(&evt);
+			int32_t expected_id = evt.get_check_id();
+
+			evt.init(&buf[0], 0);
+			evt.set_check_id(-1);
+			EXPECT_EQ(expected, vm->run(&evt)) << f.first << "\n" << vm->get_program()->dump();
+			EXPECT_EQ(expected_id, evt.get_check_id()) << f.first;
+
+			nmatches += expected;
+		}
+
+		EXPECT_EQ(f.second, nmatches) << f.first;
+	}
+}
+
+TEST(filter_program, lowering)
+{
+	sinsp inspector;
+
+	sinsp_filter_compiler compiler(&inspector, "(proc.pid in (1, 2) and not evt.type in (open, close) and proc.name startswith x) or proc.aname = init");
+	std::unique_ptr<sinsp_filter> filter(compiler.compile());
+	std::string listing = filter->get_program()->dump();
+
+	// Plain compares get typed opcodes with decoded operands, the others
+	// call the check
+	EXPECT_NE(std::string::npos, listing.find("extract proc.pid")) << listing;
+	EXPECT_NE(std::string::npos, listing.find("int 1")) << listing;
+	EXPECT_NE(std::string::npos, listing.find("int 2")) << listing;
+	EXPECT_NE(std::string::npos, listing.find("str_in")) << listing;
+	EXPECT_NE(std::string::npos, listing.find("str_startswith \"x\"")) << listing;
+	EXPECT_NE(std::string::npos, listing.find("jmp_false")) << listing;
+	EXPECT_NE(std::string::npos, listing.find("check\n")) << listing;
+}
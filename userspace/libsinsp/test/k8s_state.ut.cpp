@@ -0,0 +1,138 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef MINIMAL_BUILD
+
+#include <gtest.h>
+#include <string>
+#include "k8s_state.h"
+
+static void add_pod(k8s_state_t& state, const std::string& name, const std::string& uid)
+{
+	state.add_component<k8s_pods, k8s_pod_t>(state.get_pods(), name, uid, "default");
+}
+
+static const k8s_pod_t* pod_by_uid(k8s_state_t& state, const std::string& uid)
+{
+	return state.get_component<k8s_pods, k8s_pod_t>(state.get_pods(), uid);
+}
+
+static const k8s_pod_t* pod_by_name(k8s_state_t& state, const std::string& name)
+{
+	return state.get_component_by_name<k8s_pods, k8s_pod_t>(state.get_pods(), "default", name);
+}
+
+TEST(k8s_state_test, delete_component)
+{
+	k8s_state_t state;
+	add_pod(state, "pod0", "uid0");
+	add_pod(state, "pod1", "uid1");
+	add_pod(state, "pod2", "uid2");
+	add_pod(state, "pod3", "uid3");
+
+	// The last pod is moved in the place of a middle one
+	ASSERT_TRUE(state.delete_component(state.get_pods(), "uid1"));
+	ASSERT_EQ(3u, state.get_pods().size());
+	ASSERT_TRUE(pod_by_uid(state, "uid1") == nullptr);
+	ASSERT_TRUE(pod_by_name(state, "pod1") == nullptr);
+	ASSERT_FALSE(state.has("uid1"));
+	ASSERT_EQ(&state.get_pods()[1], pod_by_uid(state, "uid3"));
+	ASSERT_EQ(&state.get_pods()[1], pod_by_name(state, "pod3"));
+	ASSERT_EQ("uid0", pod_by_uid(state, "uid0")->get_uid());
+	ASSERT_EQ("uid2", pod_by_uid(state, "uid2")->get_uid());
+
+	// The last pod is just dropped
+	ASSERT_TRUE(state.delete_component(state.get_pods(), "uid2"));
+	ASSERT_EQ(2u, state.get_pods().size());
+	ASSERT_TRUE(pod_by_uid(state, "uid2") == nullptr);
+	ASSERT_TRUE(pod_by_name(state, "pod2") == nullptr);
+	ASSERT_EQ("uid0", pod_by_uid(state, "uid0")->get_uid());
+	ASSERT_EQ("uid3", pod_by_name(state, "pod3")->get_uid());
+
+	// Missing pods are left alone
+	ASSERT_FALSE(state.delete_component(state.get_pods(), "uid1"));
+	ASSERT_FALSE(state.delete_component(state.get_pods(), "missing"));
+	ASSERT_EQ(2u, state.get_pods().size());
+
+	ASSERT_TRUE(state.delete_component(state.get_pods(), "uid3"));
+	ASSERT_TRUE(state.delete_component(state.get_pods(), "uid0"));
+	ASSERT_TRUE(state.get_pods().empty());
+	ASSERT_TRUE(pod_by_uid(state, "uid0") == nullptr);
+	ASSERT_TRUE(pod_by_name(state, "pod0") == nullptr);
+}
+
+TEST(k8s_state_test, duplicate_name)
+{
+	k8s_state_t state;
+	add_pod(state, "other", "uid0");
+	add_pod(state, "web", "old");
+
+	// A pod recreated with the same name takes the name over...
+	add_pod(state, "web", "new");
+	ASSERT_EQ("new", pod_by_name(state, "web")->get_uid());
+
+	// ...and keeps it when the delete of the old one comes in
+	ASSERT_TRUE(state.delete_component(state.get_pods(), "old"));
+	ASSERT_EQ(2u, state.get_pods().size());
+	ASSERT_EQ("new", pod_by_name(state, "web")->get_uid());
+	ASSERT_EQ("new", pod_by_uid(state, "new")->get_uid());
+
+	// The owner keeps it when moved to fill a hole
+	add_pod(state, "web", "old");
+	add_pod(state, "web", "newer");
+	ASSERT_TRUE(state.delete_component(state.get_pods(), "uid0"));
+	ASSERT_EQ("newer", pod_by_name(state, "web")->get_uid());
+	ASSERT_EQ("newer", pod_by_uid(state, "newer")->get_uid());
+	ASSERT_TRUE(state.delete_component(state.get_pods(), "old"));
+	ASSERT_TRUE(state.delete_component(state.get_pods(), "new"));
+	ASSERT_EQ("newer", pod_by_name(state, "web")->get_uid());
+
+	// Deleting the owner releases the name
+	ASSERT_TRUE(state.delete_component(state.get_pods(), "newer"));
+	ASSERT_TRUE(state.get_pods().empty());
+	ASSERT_TRUE(pod_by_name(state, "web") == nullptr);
+
+	add_pod(state, "web", "last");
+	ASSERT_EQ("last", pod_by_name(state, "web")->get_uid());
+}
+
+TEST(k8s_state_test, clear_events)
+{
+	k8s_state_t state;
+	k8s_events& events = state.get_events();
+
+	state.add_component<k8s_events, k8s_event_t>(events, "evt0", "evt-uid0", "default");
+	state.add_component<k8s_events, k8s_event_t>(events, "evt1", "evt-uid1", "default");
+	ASSERT_TRUE(state.has(events, "evt-uid1"));
+
+	// Events with nothing left to process are dropped, and so is
+	// their index
+	state.clear_events();
+	ASSERT_TRUE(events.empty());
+	ASSERT_FALSE(state.has(events, "evt-uid0"));
+	ASSERT_FALSE(state.has(events, "evt-uid1"));
+	ASSERT_TRUE((state.get_component_by_name<k8s_events, k8s_event_t>(events, "default", "evt1") == nullptr));
+
+	state.add_component<k8s_events, k8s_event_t>(events, "evt2", "evt-uid2", "default");
+	const k8s_event_t* evt = state.get_component<k8s_events, k8s_event_t>(events, "evt-uid2");
+	ASSERT_EQ(&events[0], evt);
+	ASSERT_EQ(evt, (state.get_component_by_name<k8s_events, k8s_event_t>(events, "default", "evt2")));
+	ASSERT_TRUE(state.delete_component(events, "evt-uid2"));
+	ASSERT_TRUE(events.empty());
+}
+
+#endif // MINIMAL_BUILD
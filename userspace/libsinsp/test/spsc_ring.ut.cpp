@@ -0,0 +1,139 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include <gtest.h>
+#include <string.h>
+#include <thread>
+#include <spsc_ring.h>
+
+using namespace libsinsp;
+
+TEST(spsc_ring_test, fifo_and_wraparound)
+{
+	spsc_ring ring(256);
+	uint32_t len;
+
+	ASSERT_TRUE(ring.empty());
+	ASSERT_EQ(nullptr, ring.front(&len));
+
+	// Records of varying size force the ring to wrap several times
+	for(uint32_t j = 0; j < 1000; j++)
+	{
+		uint32_t size = 1 + (j % 60);
+		uint8_t* p = ring.reserve(size);
+		ASSERT_NE(nullptr, p);
+		memset(p, (int)(j & 0xff), size);
+		ring.commit();
+
+		uint8_t* r = ring.front(&len);
+		ASSERT_NE(nullptr, r);
+		ASSERT_EQ(size, len);
+		ASSERT_EQ((uint8_t)(j & 0xff), r[0]);
+		ASSERT_EQ((uint8_t)(j & 0xff), r[size - 1]);
+		ring.pop();
+		ASSERT_TRUE(ring.empty());
+	}
+}
+
+TEST(spsc_ring_test, full)
+{
+	spsc_ring ring(256);
+	uint32_t n = 0;
+
+	while(ring.reserve(24) != nullptr)
+	{
+		ring.commit();
+		n++;
+	}
+
+	// 8 bytes of header + 24 of payload per record
+	ASSERT_EQ(8u, n);
+	ASSERT_EQ(nullptr, ring.reserve(200));
+
+	uint32_t len;
+	ASSERT_NE(nullptr, ring.front(&len));
+	ring.pop();
+	ASSERT_NE(nullptr, ring.reserve(24));
+	ring.commit();
+}
+
+TEST(spsc_ring_test, limit)
+{
+	spsc_ring ring(256);
+	uint32_t len;
+
+	ring.reserve(4);
+	ring.commit();
+	uint64_t limit = ring.head();
+	ring.reserve(4);
+	ring.commit();
+
+	ASSERT_NE(nullptr, ring.front(limit, &len));
+	ring.pop();
+	ASSERT_EQ(nullptr, ring.front(limit, &len));
+	ASSERT_NE(nullptr, ring.front(&len));
+}
+
+TEST(spsc_ring_test, threads)
+{
+	const uint64_t count = 200000;
+	spsc_ring ring(4096);
+
+	std::thread producer([&ring, count]() {
+		for(uint64_t j = 0; j < count; j++)
+		{
+			uint32_t size = sizeof(uint64_t) * (1 + (j % 7));
+			uint8_t* p;
+			while((p = ring.reserve(size)) == nullptr)
+			{
+				std::this_thread::yield();
+			}
+
+			for(uint32_t k = 0; k < size / sizeof(uint64_t); k++)
+			{
+				memcpy(p + k * sizeof(uint64_t), &j, sizeof(j));
+			}
+			ring.commit();
+		}
+	});
+
+	uint64_t expected = 0;
+	while(expected < count)
+	{
+		uint32_t len;
+		uint8_t* r = ring.front(&len);
+		if(r == nullptr)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		ASSERT_EQ(sizeof(uint64_t) * (1 + (expected % 7)), len);
+		for(uint32_t k = 0; k < len / sizeof(uint64_t); k++)
+		{
+			uint64_t v;
+			memcpy(&v, r + k * sizeof(uint64_t), sizeof(v));
+			ASSERT_EQ(expected, v);
+		}
+
+		ring.pop();
+		expected++;
+	}
+
+	producer.join();
+	ASSERT_TRUE(ring.empty());
+}
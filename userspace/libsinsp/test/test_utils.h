@@ -0,0 +1,117 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+//
+// Helpers shared by the unit tests that feed hand-built events to sinsp
+//
+
+#pragma once
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include "sinsp.h"
+
+namespace test_utils
+{
+
+//
+// Builds the raw buffer of an event: the scap_evt header, the parameter
+// lengths and the parameter values, in the order they're added
+//
+class event_builder
+{
+public:
+	event_builder(uint16_t type, uint64_t tid, uint64_t ts = 0):
+		m_type(type),
+		m_tid(tid),
+		m_ts(ts)
+	{
+	}
+
+	event_builder& param(const void* val, uint16_t len)
+	{
+		m_params.insert(m_params.end(), (const uint8_t*)val, (const uint8_t*)val + len);
+		m_lens.push_back(len);
+		return *this;
+	}
+
+	// A NUL terminated string parameter
+	event_builder& param(const char* str)
+	{
+		return param(str, (uint16_t)strlen(str) + 1);
+	}
+
+	template<typename T>
+	event_builder& param(T val)
+	{
+		return param(&val, sizeof(T));
+	}
+
+	std::vector<uint8_t> build() const
+	{
+		size_t lens_size = m_lens.size() * sizeof(uint16_t);
+		std::vector<uint8_t> buf(sizeof(scap_evt) + lens_size + m_params.size());
+		scap_evt* hdr = (scap_evt*)&buf[0];
+
+		hdr->ts = m_ts;
+		hdr->tid = m_tid;
+		hdr->len = (uint32_t)buf.size();
+		hdr->type = m_type;
+		hdr->nparams = (uint32_t)m_lens.size();
+
+		if(!m_lens.empty())
+		{
+			memcpy(&buf[sizeof(scap_evt)], &m_lens[0], lens_size);
+		}
+
+		if(!m_params.empty())
+		{
+			memcpy(&buf[sizeof(scap_evt) + lens_size], &m_params[0], m_params.size());
+		}
+
+		return buf;
+	}
+
+private:
+	uint16_t m_type;
+	uint64_t m_tid;
+	uint64_t m_ts;
+	std::vector<uint16_t> m_lens;
+	std::vector<uint8_t> m_params;
+};
+
+//
+// Add a process with a single thread to the inspector's thread table
+//
+inline void add_thread(sinsp& inspector, int64_t tid, const char* comm,
+		       const std::vector<std::string>& args = {})
+{
+	sinsp_threadinfo* tinfo = inspector.build_threadinfo();
+	tinfo->m_tid = tid;
+	tinfo->m_pid = tid;
+	tinfo->m_ptid = 1;
+	tinfo->m_comm = comm;
+	tinfo->m_exe = comm;
+	for(const auto& arg : args)
+	{
+		tinfo->m_args.push_back(arg);
+	}
+	inspector.add_thread(tinfo);
+}
+
+}
@@ -0,0 +1,287 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+// The purge is driven by the last event timestamp
+#define VISIBILITY_PRIVATE public:
+#include "sinsp.h"
+#include <gtest.h>
+
+using namespace libsinsp;
+
+TEST(cow_vector_test, copy_on_write)
+{
+	cow_vector<std::string> a;
+	a.push_back("one");
+	a.push_back("two");
+
+	cow_vector<std::string> b = a;
+	ASSERT_TRUE(a.shares_with(b));
+	ASSERT_TRUE(a == b);
+
+	b.push_back("three");
+	ASSERT_FALSE(a.shares_with(b));
+	ASSERT_EQ(2u, a.size());
+	ASSERT_EQ(3u, b.size());
+	ASSERT_EQ("three", b.back());
+
+	cow_vector<std::string> c = a;
+	c.clear();
+	ASSERT_TRUE(c.empty());
+	ASSERT_EQ(2u, a.size());
+	ASSERT_EQ("one", a[0]);
+
+	std::vector<std::string> expected = {"one", "two"};
+	ASSERT_TRUE(expected == a);
+	const std::vector<std::string>& ref = a;
+	ASSERT_EQ(expected, ref);
+}
+
+TEST(cow_vector_test, intern)
+{
+	cow_intern_table<std::pair<std::string, std::string>> table;
+	cow_vector<std::pair<std::string, std::string>> a;
+	cow_vector<std::pair<std::string, std::string>> b;
+
+	a.push_back(std::make_pair("cpu", "/docker/abc"));
+	b.push_back(std::make_pair("cpu", "/docker/abc"));
+	ASSERT_FALSE(a.shares_with(b));
+
+	ASSERT_FALSE(table.intern(a));
+	ASSERT_TRUE(table.intern(b));
+	ASSERT_TRUE(a.shares_with(b));
+	ASSERT_EQ(1u, table.size());
+
+	// Interned storage is never modified in place
+	b.push_back(std::make_pair("memory", "/docker/abc"));
+	ASSERT_FALSE(a.shares_with(b));
+	ASSERT_EQ(1u, a.size());
+
+	a.clear();
+	b.clear();
+	table.purge();
+	ASSERT_EQ(0u, table.size());
+}
+
+TEST(interned_string_test, intern)
+{
+	size_t base = interned_string::table_size();
+
+	interned_string a("nginx");
+	interned_string b(std::string("nginx"));
+	interned_string c("nginx: worker", 5);
+	ASSERT_EQ(a.id(), b.id());
+	ASSERT_EQ(a.id(), c.id());
+	ASSERT_TRUE(a == b);
+	ASSERT_TRUE(a == "nginx");
+	ASSERT_TRUE(std::string("nginx") == a);
+	ASSERT_EQ(base + 1, interned_string::table_size());
+
+	b = "java";
+	ASSERT_TRUE(a != b);
+	ASSERT_EQ("java", b.str());
+	ASSERT_EQ(4u, b.size());
+	ASSERT_EQ(base + 2, interned_string::table_size());
+
+	// The empty string doesn't take a table entry
+	interned_string empty("");
+	ASSERT_TRUE(empty.empty());
+	ASSERT_TRUE(empty == interned_string());
+	ASSERT_STREQ("", empty.c_str());
+
+	// Entries go away with their last handle
+	interned_string moved(std::move(b));
+	ASSERT_TRUE(b.empty());
+	moved.clear();
+	ASSERT_EQ(base + 1, interned_string::table_size());
+	a.clear();
+	c = a;
+	ASSERT_EQ(base, interned_string::table_size());
+}
+
+static sinsp_threadinfo* add_test_thread(sinsp& inspector, int64_t tid, int64_t pid)
+{
+	sinsp_threadinfo* tinfo = inspector.build_threadinfo();
+	tinfo->m_tid = tid;
+	tinfo->m_pid = pid;
+	tinfo->m_ptid = 1;
+	tinfo->m_comm = "test";
+	tinfo->m_args.push_back("-d");
+	tinfo->m_args.push_back("-v");
+	inspector.m_thread_manager->intern(tinfo->m_args);
+	EXPECT_TRUE(inspector.add_thread(tinfo));
+	return tinfo;
+}
+
+TEST(threadinfo_test, pooled_thread_table)
+{
+	sinsp inspector;
+	inspector.set_threadinfo_pool(true);
+
+	sinsp_threadinfo* main_thread = add_test_thread(inspector, 100, 100);
+	sinsp_threadinfo* thread = add_test_thread(inspector, 101, 100);
+
+	ASSERT_EQ(2u, main_thread->m_args.size());
+	ASSERT_EQ("-v", main_thread->m_args[1]);
+	ASSERT_TRUE(thread->m_args.shares_with(main_thread->m_args));
+	ASSERT_EQ(main_thread, thread->get_main_thread());
+
+	// A reference keeps the thread alive after it leaves the table
+	threadinfo_map_t::ptr_t ref = inspector.get_thread_ref(100);
+	ASSERT_EQ(main_thread, ref.get());
+	inspector.m_thread_manager->remove_thread(100, true);
+	ASSERT_TRUE(inspector.get_thread_ref(100) == nullptr);
+	ASSERT_EQ(100, ref->m_tid);
+
+	// The cached main thread pointer doesn't survive the removal
+	ASSERT_NE(main_thread, thread->get_main_thread());
+	ref.reset();
+
+	// Churn through the pool
+	for(int64_t tid = 200; tid < 1200; tid++)
+	{
+		add_test_thread(inspector, tid, tid);
+		inspector.m_thread_manager->remove_thread(tid, true);
+	}
+	ASSERT_EQ(1u, inspector.m_thread_manager->get_thread_count());
+
+	// Turning the pool off doesn't affect the threads built from it
+	inspector.set_threadinfo_pool(false);
+	add_test_thread(inspector, 300, 300);
+	ASSERT_EQ(2u, inspector.m_thread_manager->get_thread_count());
+	inspector.m_thread_manager->remove_thread(101, true);
+	ASSERT_EQ(300, inspector.get_thread_ref(300)->m_tid);
+}
+
+TEST(threadinfo_test, incremental_purge)
+{
+	sinsp inspector;
+	inspector.set_thread_purge_interval_s(10);
+	inspector.m_lastevent_ts = ONE_SECOND_IN_NS;
+
+	sinsp_threadinfo* main_thread = add_test_thread(inspector, 100, 100);
+	sinsp_threadinfo* child = inspector.build_threadinfo();
+	child->m_tid = 101;
+	child->m_pid = 100;
+	child->m_ptid = 100;
+	child->m_comm = "test";
+	child->m_flags |= PPM_CL_CLONE_THREAD;
+	ASSERT_TRUE(inspector.add_thread(child));
+	ASSERT_EQ(1u, main_thread->m_nchilds);
+
+	// A closed main thread stays while it has children...
+	main_thread->m_flags |= PPM_CL_CLOSED;
+	inspector.m_thread_manager->remove_thread(100, false);
+	ASSERT_EQ(2u, inspector.m_thread_manager->get_thread_count());
+	ASSERT_FALSE(inspector.remove_inactive_threads());
+
+	// ...and is purged once the purge interval elapsed
+	inspector.m_lastevent_ts += 11 * ONE_SECOND_IN_NS;
+	ASSERT_TRUE(inspector.remove_inactive_threads());
+	ASSERT_EQ(1u, inspector.m_thread_manager->get_thread_count());
+	ASSERT_TRUE(inspector.get_thread_ref(100) == nullptr);
+
+	// The count of its children goes to the next main thread
+	main_thread = add_test_thread(inspector, 100, 100);
+	ASSERT_EQ(1u, main_thread->m_nchilds);
+	inspector.m_thread_manager->remove_thread(101, false);
+	ASSERT_EQ(0u, main_thread->m_nchilds);
+
+	// Threads in use are not looked at before their timeout
+	ASSERT_FALSE(inspector.remove_inactive_threads());
+	ASSERT_EQ(1u, inspector.m_thread_manager->get_thread_count());
+}
+
+TEST(threadinfo_test, offline_purge)
+{
+	sinsp inspector;
+	inspector.set_thread_purge_interval_s(10);
+	inspector.set_thread_timeout_s(10);
+	inspector.m_lastevent_ts = ONE_SECOND_IN_NS;
+
+	sinsp_threadinfo* tinfo = add_test_thread(inspector, 100, 100);
+	tinfo->m_lastaccess_ts = inspector.m_lastevent_ts;
+
+	// Live, without a handle to probe with, an inactive thread is kept
+	inspector.m_lastevent_ts += 11 * ONE_SECOND_IN_NS;
+	ASSERT_TRUE(inspector.remove_inactive_threads());
+	ASSERT_EQ(1u, inspector.m_thread_manager->get_thread_count());
+
+	// Offline it's removed right away
+	inspector.set_mode(SCAP_MODE_CAPTURE);
+	inspector.m_lastevent_ts += 11 * ONE_SECOND_IN_NS;
+	ASSERT_TRUE(inspector.remove_inactive_threads());
+	ASSERT_EQ(0u, inspector.m_thread_manager->get_thread_count());
+}
+
+TEST(threadinfo_test, async_proc_lookup_merge)
+{
+	sinsp inspector;
+
+	// What get_thread_ref() adds while the /proc lookup is in flight
+	sinsp_threadinfo* placeholder = inspector.build_threadinfo();
+	placeholder->m_tid = 200;
+	placeholder->m_pid = 200;
+	placeholder->m_ptid = -1;
+	placeholder->m_comm = "<NA>";
+	placeholder->m_exe = "<NA>";
+	placeholder->m_proc_lookup_pending = true;
+	ASSERT_TRUE(inspector.add_thread(placeholder));
+
+	sinsp_threadinfo* child = inspector.build_threadinfo();
+	child->m_tid = 201;
+	child->m_pid = 200;
+	child->m_ptid = 200;
+	child->m_flags |= PPM_CL_CLONE_THREAD;
+	ASSERT_TRUE(inspector.add_thread(child));
+	ASSERT_EQ(1u, placeholder->m_nchilds);
+
+	sinsp_fdinfo_t fdinfo;
+	fdinfo.m_type = SCAP_FD_FILE_V2;
+	fdinfo.set_name("/tmp/opened_meanwhile");
+	placeholder->add_fd(5, &fdinfo);
+
+	scap_threadinfo* pi = (scap_threadinfo*)calloc(1, sizeof(scap_threadinfo));
+	pi->tid = 200;
+	pi->pid = 200;
+	pi->ptid = 1;
+	pi->uid = 33;
+	strcpy(pi->comm, "nginx");
+	strcpy(pi->exe, "nginx");
+	strcpy(pi->exepath, "/usr/sbin/nginx");
+	strcpy(pi->cwd, "/");
+	inspector.m_completed_proc_lookups.push(libsinsp::proc_lookup_result(200, std::shared_ptr<scap_threadinfo>(pi, free)));
+	inspector.m_thread_manager->merge_proc_lookups();
+
+	sinsp_threadinfo* tinfo = &*inspector.get_thread_ref(200);
+	ASSERT_NE(placeholder, tinfo);
+	ASSERT_EQ("nginx", tinfo->get_comm());
+	ASSERT_EQ(1, tinfo->m_ptid);
+	ASSERT_EQ(33u, tinfo->m_uid);
+	ASSERT_EQ(1u, tinfo->m_nchilds);
+	ASSERT_FALSE(tinfo->m_proc_lookup_pending);
+	ASSERT_TRUE(tinfo->get_fd(5) != NULL);
+	ASSERT_EQ(tinfo, child->get_main_thread());
+
+	// Late results don't touch threads that are no placeholders
+	pi = (scap_threadinfo*)calloc(1, sizeof(scap_threadinfo));
+	pi->tid = 200;
+	pi->pid = 200;
+	strcpy(pi->comm, "other");
+	inspector.m_completed_proc_lookups.push(libsinsp::proc_lookup_result(200, std::shared_ptr<scap_threadinfo>(pi, free)));
+	inspector.m_thread_manager->merge_proc_lookups();
+	ASSERT_EQ("nginx", inspector.get_thread_ref(200)->get_comm());
+}
@@ -0,0 +1,49 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "thread_liveness.h"
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+using namespace libsinsp;
+
+thread_liveness_source::thread_liveness_source(scap_t* h, uint64_t ttl_ms):
+	async_key_value_source(NO_WAIT_LOOKUP, ttl_ms),
+	m_h(h)
+{
+}
+
+thread_liveness_source::~thread_liveness_source()
+{
+	this->stop();
+}
+
+void thread_liveness_source::run_impl()
+{
+	thread_liveness_key key;
+
+	while(dequeue_next_key(key))
+	{
+		//
+		// scap_is_thread_alive() only reads /proc and the handle mode,
+		// so it's safe to call it concurrently with the capture
+		//
+		bool alive = scap_is_thread_alive(m_h, key.m_pid, key.m_tid, key.m_comm.c_str());
+
+		store_value(key, alive);
+	}
+}
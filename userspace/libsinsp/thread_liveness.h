@@ -0,0 +1,104 @@
+/*
+Copyright (C) 2021 The Falco Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#pragma once
+
+#include <string>
+#include "async_key_value_source.h"
+#include "scap.h"
+
+namespace libsinsp {
+
+/**
+ * \brief The key for a thread liveness probe
+ *
+ * The arguments of scap_is_thread_alive()
+ */
+struct thread_liveness_key {
+	thread_liveness_key():
+		m_pid(0),
+		m_tid(0) {}
+	thread_liveness_key(int64_t pid, int64_t tid, std::string comm):
+		m_pid(pid),
+		m_tid(tid),
+		m_comm(std::move(comm)) {}
+
+	bool operator<(const thread_liveness_key& rhs) const
+	{
+		if(m_tid != rhs.m_tid)
+		{
+			return m_tid < rhs.m_tid;
+		}
+		if(m_pid != rhs.m_pid)
+		{
+			return m_pid < rhs.m_pid;
+		}
+		return m_comm < rhs.m_comm;
+	}
+
+	bool operator==(const thread_liveness_key& rhs) const
+	{
+		return m_tid == rhs.m_tid &&
+		       m_pid == rhs.m_pid &&
+		       m_comm == rhs.m_comm;
+	}
+
+	int64_t m_pid;
+	int64_t m_tid;
+	std::string m_comm;
+};
+
+/**
+ * \brief Checks in /proc whether threads are still alive, away from the
+ * capture thread
+ *
+ * Used by the thread table purge: lookups never wait, the results are
+ * collected on the capture thread with get_complete_results().
+ */
+class thread_liveness_source : public sysdig::async_key_value_source<thread_liveness_key, bool>
+{
+public:
+	/**
+	 * @param h the capture handle, it must outlive this object
+	 * @param ttl_ms how long uncollected results are kept
+	 */
+	thread_liveness_source(scap_t* h, uint64_t ttl_ms);
+	~thread_liveness_source();
+
+private:
+	void run_impl() override;
+
+	scap_t* m_h;
+};
+
+}
+
+namespace std {
+/**
+ * \brief Specialization of std::hash for thread_liveness_key
+ *
+ * It allows `thread_liveness_key` instances to be used as `unordered_map` keys
+ */
+template<> struct hash<libsinsp::thread_liveness_key> {
+	std::size_t operator()(const libsinsp::thread_liveness_key& k) const {
+		size_t h1 = ::std::hash<int64_t>{}(k.m_tid);
+		size_t h2 = ::std::hash<int64_t>{}(k.m_pid);
+		size_t h3 = ::std::hash<std::string>{}(k.m_comm);
+		return h1 ^ (h2 << 1u) ^ (h3 << 2u);
+	}
+};
+}
@@ -26,6 +26,8 @@ limitations under the License.
 #include "sinsp_int.h"
 #include "protodecoder.h"
 #include "tracers.h"
+#include "thread_liveness.h"
+#include "proc_lookup.h"
 
 #ifdef HAS_ANALYZER
 #include "tracer_emitter.h"
@@ -47,7 +49,13 @@ static void copy_ipv6_address(uint32_t* dest, uint32_t* src)
 sinsp_threadinfo::sinsp_threadinfo(sinsp* inspector) :
 	m_tracer_parser(NULL),
 	m_inspector(inspector),
-	m_fdtable(inspector)
+	m_fdtable(inspector),
+	m_refcount(0),
+	m_pool(NULL),
+	m_removed(false),
+	m_purge_probe_pending(false),
+	m_purge_deadline(0),
+	m_proc_lookup_pending(false)
 {
 	init();
 }
@@ -114,7 +122,7 @@ sinsp_threadinfo::~sinsp_threadinfo()
 
 void sinsp_threadinfo::fix_sockets_coming_from_proc()
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
+	sinsp_fdtable::table_t::iterator it;
 
 	for(it = m_fdtable.m_table.begin(); it != m_fdtable.m_table.end(); it++)
 	{
@@ -129,12 +137,14 @@ void sinsp_threadinfo::fix_sockets_coming_from_proc()
 				tip = it->second.m_sockinfo.m_ipv4info.m_fields.m_sip;
 				tport = it->second.m_sockinfo.m_ipv4info.m_fields.m_sport;
 
+				it->second.render_pending_name();
 				it->second.m_sockinfo.m_ipv4info.m_fields.m_sip = it->second.m_sockinfo.m_ipv4info.m_fields.m_dip;
 				it->second.m_sockinfo.m_ipv4info.m_fields.m_dip = tip;
 				it->second.m_sockinfo.m_ipv4info.m_fields.m_sport = it->second.m_sockinfo.m_ipv4info.m_fields.m_dport;
 				it->second.m_sockinfo.m_ipv4info.m_fields.m_dport = tport;
 
-				it->second.m_name = ipv4tuple_to_string(&it->second.m_sockinfo.m_ipv4info, m_inspector->m_hostname_and_port_resolution_enabled);
+				it->second.set_name_from_ipv4_tuple(it->second.m_sockinfo.m_ipv4info.m_fields.m_l4proto,
+								    m_inspector->m_hostname_and_port_resolution_enabled);
 
 				it->second.set_role_server();
 			}
@@ -156,7 +166,7 @@ void sinsp_threadinfo::fix_sockets_coming_from_proc()
 void sinsp_threadinfo::compute_program_hash()
 {
 	auto curr_hash = std::hash<std::string>()(m_exe);
-	hash_combine(curr_hash, m_container_id);
+	hash_combine(curr_hash, m_container_id.str());
 	auto rem_len = MAX_PROG_HASH_LEN - (m_exe.size() + m_container_id.size());
 
 	//
@@ -232,13 +242,14 @@ void sinsp_threadinfo::add_fd_from_scap(scap_fdinfo *fdi, OUT sinsp_fdinfo_t *re
 		{
 			m_inspector->m_network_interfaces->update_fd(newfdi);
 		}
-		newfdi->m_name = ipv4tuple_to_string(&newfdi->m_sockinfo.m_ipv4info, m_inspector->m_hostname_and_port_resolution_enabled);
+		newfdi->set_name_from_ipv4_tuple(newfdi->m_sockinfo.m_ipv4info.m_fields.m_l4proto,
+						 m_inspector->m_hostname_and_port_resolution_enabled);
 		break;
 	case SCAP_FD_IPV4_SERVSOCK:
 		newfdi->m_sockinfo.m_ipv4serverinfo.m_ip = fdi->info.ipv4serverinfo.ip;
 		newfdi->m_sockinfo.m_ipv4serverinfo.m_port = fdi->info.ipv4serverinfo.port;
 		newfdi->m_sockinfo.m_ipv4serverinfo.m_l4proto = fdi->info.ipv4serverinfo.l4proto;
-		newfdi->m_name = ipv4serveraddr_to_string(&newfdi->m_sockinfo.m_ipv4serverinfo, m_inspector->m_hostname_and_port_resolution_enabled);
+		newfdi->set_name(ipv4serveraddr_to_string(&newfdi->m_sockinfo.m_ipv4serverinfo, m_inspector->m_hostname_and_port_resolution_enabled));
 
 		//
 		// We keep note of all the host bound server ports.
@@ -269,7 +280,8 @@ void sinsp_threadinfo::add_fd_from_scap(scap_fdinfo *fdi, OUT sinsp_fdinfo_t *re
 			{
 				m_inspector->m_network_interfaces->update_fd(newfdi);
 			}
-			newfdi->m_name = ipv4tuple_to_string(&newfdi->m_sockinfo.m_ipv4info, m_inspector->m_hostname_and_port_resolution_enabled);
+			newfdi->set_name_from_ipv4_tuple(newfdi->m_sockinfo.m_ipv4info.m_fields.m_l4proto,
+							 m_inspector->m_hostname_and_port_resolution_enabled);
 		}
 		else
 		{
@@ -282,14 +294,14 @@ void sinsp_threadinfo::add_fd_from_scap(scap_fdinfo *fdi, OUT sinsp_fdinfo_t *re
 			{
 				newfdi->m_flags |= sinsp_fdinfo_t::FLAGS_SOCKET_CONNECTED;
 			}
-			newfdi->m_name = ipv6tuple_to_string(&newfdi->m_sockinfo.m_ipv6info, m_inspector->m_hostname_and_port_resolution_enabled);
+			newfdi->set_name(ipv6tuple_to_string(&newfdi->m_sockinfo.m_ipv6info, m_inspector->m_hostname_and_port_resolution_enabled));
 		}
 		break;
 	case SCAP_FD_IPV6_SERVSOCK:
 		copy_ipv6_address(newfdi->m_sockinfo.m_ipv6serverinfo.m_ip.m_b, fdi->info.ipv6serverinfo.ip);
 		newfdi->m_sockinfo.m_ipv6serverinfo.m_port = fdi->info.ipv6serverinfo.port;
 		newfdi->m_sockinfo.m_ipv6serverinfo.m_l4proto = fdi->info.ipv6serverinfo.l4proto;
-		newfdi->m_name = ipv6serveraddr_to_string(&newfdi->m_sockinfo.m_ipv6serverinfo, m_inspector->m_hostname_and_port_resolution_enabled);
+		newfdi->set_name(ipv6serveraddr_to_string(&newfdi->m_sockinfo.m_ipv6serverinfo, m_inspector->m_hostname_and_port_resolution_enabled));
 
 		//
 		// We keep note of all the host bound server ports.
@@ -301,8 +313,8 @@ void sinsp_threadinfo::add_fd_from_scap(scap_fdinfo *fdi, OUT sinsp_fdinfo_t *re
 	case SCAP_FD_UNIX_SOCK:
 		newfdi->m_sockinfo.m_unixinfo.m_fields.m_source = fdi->info.unix_socket_info.source;
 		newfdi->m_sockinfo.m_unixinfo.m_fields.m_dest = fdi->info.unix_socket_info.destination;
-		newfdi->m_name = fdi->info.unix_socket_info.fname;
-		if(newfdi->m_name.empty())
+		newfdi->set_name(fdi->info.unix_socket_info.fname);
+		if(newfdi->get_name().empty())
 		{
 			newfdi->set_role_client();
 		}
@@ -313,11 +325,11 @@ void sinsp_threadinfo::add_fd_from_scap(scap_fdinfo *fdi, OUT sinsp_fdinfo_t *re
 		break;
 	case SCAP_FD_FILE_V2:
 		newfdi->m_openflags = fdi->info.regularinfo.open_flags;
-		newfdi->m_name = fdi->info.regularinfo.fname;
+		newfdi->set_name(fdi->info.regularinfo.fname);
 		newfdi->m_dev = fdi->info.regularinfo.dev;
 		newfdi->m_mount_id = fdi->info.regularinfo.mount_id;
 
-		if(newfdi->m_name == USER_EVT_DEVICE_NAME)
+		if(newfdi->get_name() == USER_EVT_DEVICE_NAME)
 		{
 			newfdi->m_flags |= sinsp_fdinfo_t::FLAGS_IS_TRACER_FILE;
 		}
@@ -337,9 +349,9 @@ void sinsp_threadinfo::add_fd_from_scap(scap_fdinfo *fdi, OUT sinsp_fdinfo_t *re
 	case SCAP_FD_INOTIFY:
 	case SCAP_FD_TIMERFD:
 	case SCAP_FD_NETLINK:
-		newfdi->m_name = fdi->info.fname;
+		newfdi->set_name(fdi->info.fname);
 
-		if(newfdi->m_name == USER_EVT_DEVICE_NAME)
+		if(newfdi->get_name() == USER_EVT_DEVICE_NAME)
 		{
 			newfdi->m_flags |= sinsp_fdinfo_t::FLAGS_IS_TRACER_FILE;
 		}
@@ -499,8 +511,38 @@ std::string sinsp_threadinfo::get_exepath() const
 	return m_exepath;
 }
 
+//
+// True if the NUL-separated strings in buf are exactly the ones in strs.
+// Forked children get the same arguments as the parent they were copied
+// from, and this lets them keep sharing its storage.
+//
+static bool strvec_equals(const libsinsp::cow_vector<string>& strs, const char* buf, size_t len)
+{
+	size_t offset = 0;
+
+	for(const auto& str : strs)
+	{
+		size_t slen = str.length();
+		if(offset + slen >= len ||
+		   buf[offset + slen] != '\0' ||
+		   memcmp(buf + offset, str.c_str(), slen) != 0)
+		{
+			return false;
+		}
+
+		offset += slen + 1;
+	}
+
+	return offset >= len;
+}
+
 void sinsp_threadinfo::set_args(const char* args, size_t len)
 {
+	if(strvec_equals(m_args, args, len))
+	{
+		return;
+	}
+
 	m_args.clear();
 
 	size_t offset = 0;
@@ -509,6 +551,11 @@ void sinsp_threadinfo::set_args(const char* args, size_t len)
 		m_args.push_back(args + offset);
 		offset += m_args.back().length() + 1;
 	}
+
+	if(m_inspector != NULL)
+	{
+		m_inspector->m_thread_manager->intern(m_args);
+	}
 }
 
 void sinsp_threadinfo::set_env(const char* env, size_t len)
@@ -526,6 +573,11 @@ void sinsp_threadinfo::set_env(const char* env, size_t len)
 		}
 	}
 
+	if(strvec_equals(m_env, env, len))
+	{
+		return;
+	}
+
 	m_env.clear();
 	size_t offset = 0;
 	while(offset < len)
@@ -540,7 +592,7 @@ void sinsp_threadinfo::set_env(const char* env, size_t len)
 			if(!memcmp(left, zero, sz))
 			{
 				free(zero);
-				return;
+				break;
 			}
 			free(zero);
 		}
@@ -548,6 +600,11 @@ void sinsp_threadinfo::set_env(const char* env, size_t len)
 
 		offset += m_env.back().length() + 1;
 	}
+
+	if(m_inspector != NULL)
+	{
+		m_inspector->m_thread_manager->intern(m_env);
+	}
 }
 
 bool sinsp_threadinfo::set_env_from_proc() {
@@ -570,6 +627,11 @@ bool sinsp_threadinfo::set_env_from_proc() {
 		}
 	}
 
+	if(m_inspector != NULL)
+	{
+		m_inspector->m_thread_manager->intern(m_env);
+	}
+
 	return true;
 }
 
@@ -662,6 +724,11 @@ void sinsp_threadinfo::set_cgroups(const char* cgroups, size_t len)
 		m_cgroups.push_back(std::make_pair(subsys, cgroup));
 		offset += subsys_length + 1 + cgroup.length() + 1;
 	}
+
+	if(m_inspector != NULL)
+	{
+		m_inspector->m_thread_manager->intern(m_cgroups);
+	}
 }
 
 sinsp_threadinfo* sinsp_threadinfo::get_parent_thread()
@@ -688,7 +755,7 @@ void sinsp_threadinfo::remove_fd(int64_t fd)
 
 bool sinsp_threadinfo::is_bound_to_port(uint16_t number)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
+	sinsp_fdtable::table_t::iterator it;
 
 	sinsp_fdtable* fdt = get_fd_table();
 
@@ -715,7 +782,7 @@ bool sinsp_threadinfo::is_bound_to_port(uint16_t number)
 
 bool sinsp_threadinfo::uses_client_port(uint16_t number)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
+	sinsp_fdtable::table_t::iterator it;
 
 	sinsp_fdtable* fdt = get_fd_table();
 
@@ -786,13 +853,15 @@ void sinsp_threadinfo::set_cwd(const char* cwd, uint32_t cwdlen)
 			cwdlen,
 			m_inspector->m_is_windows);
 
-		tinfo->m_cwd = tpath;
-
-		uint32_t size = tinfo->m_cwd.size();
+		size_t size = strlen(tpath);
 
-		if(size == 0 || (tinfo->m_cwd[size - 1] != '/'))
+		if(size == 0 || (tpath[size - 1] != '/'))
 		{
-			tinfo->m_cwd += '/';
+			tinfo->m_cwd = string(tpath) + '/';
+		}
+		else
+		{
+			tinfo->m_cwd = libsinsp::interned_string(tpath, size);
 		}
 	}
 	else
@@ -972,7 +1041,7 @@ bool sinsp_threadinfo::is_health_probe()
 string sinsp_threadinfo::get_path_for_dir_fd(int64_t dir_fd)
 {
 	sinsp_fdinfo_t* dir_fdinfo = get_fd(dir_fd);
-	if (!dir_fdinfo || dir_fdinfo->m_name.empty())
+	if (!dir_fdinfo || dir_fdinfo->get_name().empty())
 	{
 #ifndef WIN32 // we will have to implement this for Windows
 #ifdef HAS_CAPTURE
@@ -1008,10 +1077,10 @@ string sinsp_threadinfo::get_path_for_dir_fd(int64_t dir_fd)
 #endif
 #endif // WIN32
 	}
-	return dir_fdinfo->m_name;
+	return dir_fdinfo->get_name();
 }
 
-shared_ptr<sinsp_threadinfo> sinsp_threadinfo::lookup_thread() const
+libsinsp::intrusive_ptr<sinsp_threadinfo> sinsp_threadinfo::lookup_thread() const
 {
 	return m_inspector->get_thread_ref(m_pid, true, true, true);
 }
@@ -1181,11 +1250,11 @@ void sinsp_threadinfo::fd_to_scap(scap_fdinfo *dst, sinsp_fdinfo_t* src)
 	case SCAP_FD_UNIX_SOCK:
 		dst->info.unix_socket_info.source = src->m_sockinfo.m_unixinfo.m_fields.m_source;
 		dst->info.unix_socket_info.destination = src->m_sockinfo.m_unixinfo.m_fields.m_dest;
-		strncpy(dst->info.unix_socket_info.fname, src->m_name.c_str(), SCAP_MAX_PATH_SIZE);
+		strncpy(dst->info.unix_socket_info.fname, src->get_name().c_str(), SCAP_MAX_PATH_SIZE);
 		break;
 	case SCAP_FD_FILE_V2:
 		dst->info.regularinfo.open_flags = src->m_openflags;
-		strncpy(dst->info.regularinfo.fname, src->m_name.c_str(), SCAP_MAX_PATH_SIZE);
+		strncpy(dst->info.regularinfo.fname, src->get_name().c_str(), SCAP_MAX_PATH_SIZE);
 		dst->info.regularinfo.dev = src->m_dev;
 		dst->info.regularinfo.mount_id = src->m_mount_id;
 		break;
@@ -1199,7 +1268,7 @@ void sinsp_threadinfo::fd_to_scap(scap_fdinfo *dst, sinsp_fdinfo_t* src)
 	case SCAP_FD_INOTIFY:
 	case SCAP_FD_TIMERFD:
 	case SCAP_FD_NETLINK:
-		strncpy(dst->info.fname, src->m_name.c_str(), SCAP_MAX_PATH_SIZE);
+		strncpy(dst->info.fname, src->get_name().c_str(), SCAP_MAX_PATH_SIZE);
 		break;
 	default:
 		ASSERT(false);
@@ -1217,13 +1286,26 @@ sinsp_thread_manager::sinsp_thread_manager(sinsp* inspector)
 	clear();
 }
 
+sinsp_thread_manager::~sinsp_thread_manager()
+{
+	stop_liveness_probes();
+	stop_proc_lookups();
+}
+
 void sinsp_thread_manager::clear()
 {
+	m_last_tinfo.reset();
 	m_threadtable.clear();
+	m_strvec_table.clear();
+	m_cgroups_table.clear();
 	m_last_tid = 0;
-	m_last_tinfo.reset();
-	m_last_flush_time_ns = 0;
 	m_n_drops = 0;
+	stop_liveness_probes();
+	stop_proc_lookups();
+	m_purge_queue = decltype(m_purge_queue)();
+	m_purge_start_ns = 0;
+	m_next_probe_check_ns = 0;
+	m_orphan_nchilds.clear();
 
 #ifdef GATHER_INTERNAL_STATS
 	m_failed_lookups = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_failed_lookups","Failed thread lookups"));
@@ -1280,6 +1362,30 @@ bool sinsp_thread_manager::add_thread(sinsp_threadinfo *threadinfo, bool from_sc
 		return false;
 	}
 
+	sinsp_threadinfo* old = m_threadtable.get(threadinfo->m_tid);
+	if(old != nullptr && old != threadinfo)
+	{
+		//
+		// A stale entry for this tid is being replaced. Its children
+		// refer to the tid, not to the object, and the main thread
+		// loses the reference of the old entry.
+		//
+		threadinfo->m_nchilds += old->m_nchilds;
+		if(!from_scap_proctable)
+		{
+			decrement_mainthread_childcount(old);
+		}
+	}
+	else
+	{
+		auto orphans = m_orphan_nchilds.find(threadinfo->m_tid);
+		if(orphans != m_orphan_nchilds.end())
+		{
+			threadinfo->m_nchilds += orphans->second;
+			m_orphan_nchilds.erase(orphans);
+		}
+	}
+
 	if(!from_scap_proctable)
 	{
 		increment_mainthread_childcount(threadinfo);
@@ -1289,9 +1395,50 @@ bool sinsp_thread_manager::add_thread(sinsp_threadinfo *threadinfo, bool from_sc
 	threadinfo->allocate_private_state();
 	m_threadtable.put(threadinfo);
 
+	threadinfo->m_purge_probe_pending = false;
+	schedule_purge(*threadinfo, inactive_deadline(*threadinfo));
+
 	return true;
 }
 
+void sinsp_thread_manager::decrement_mainthread_childcount(sinsp_threadinfo* threadinfo)
+{
+	if(threadinfo->m_flags & PPM_CL_CLONE_THREAD)
+	{
+		ASSERT(threadinfo->m_pid != threadinfo->m_tid);
+		sinsp_threadinfo* main_thread = &*m_inspector->get_thread_ref(threadinfo->m_pid, false, true);
+		if(main_thread)
+		{
+			if(main_thread->m_nchilds > 0)
+			{
+				--main_thread->m_nchilds;
+			}
+			else
+			{
+				ASSERT(false);
+			}
+		}
+		else
+		{
+			//
+			// The main thread went away first
+			//
+			auto orphans = m_orphan_nchilds.find(threadinfo->m_pid);
+			if(orphans != m_orphan_nchilds.end())
+			{
+				if(--orphans->second == 0)
+				{
+					m_orphan_nchilds.erase(orphans);
+				}
+			}
+			else
+			{
+				ASSERT(false);
+			}
+		}
+	}
+}
+
 void sinsp_thread_manager::remove_thread(int64_t tid, bool force)
 {
 	uint64_t nchilds;
@@ -1316,34 +1463,15 @@ void sinsp_thread_manager::remove_thread(int64_t tid, bool force)
 		// Decrement the refcount of the main thread/program because
 		// this reference is gone
 		//
-		if(tinfo->m_flags & PPM_CL_CLONE_THREAD)
-		{
-			ASSERT(tinfo->m_pid != tinfo->m_tid);
-			sinsp_threadinfo* main_thread = &*m_inspector->get_thread_ref(tinfo->m_pid, false, true);
-			if(main_thread)
-			{
-				if(main_thread->m_nchilds > 0)
-				{
-					--main_thread->m_nchilds;
-				}
-				else
-				{
-					ASSERT(false);
-				}
-			}
-			else
-			{
-				ASSERT(false);
-			}
-		}
+		decrement_mainthread_childcount(tinfo);
 
 		//
 		// If this is the main thread of a process, erase all the FDs that the process owns
 		//
 		if((tinfo->m_pid == tinfo->m_tid) || tinfo->m_flags & PPM_CL_IS_MAIN_THREAD)
 		{
-			unordered_map<int64_t, sinsp_fdinfo_t>* fdtable = &(tinfo->get_fd_table()->m_table);
-			unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+			sinsp_fdtable::table_t* fdtable = &(tinfo->get_fd_table()->m_table);
+			sinsp_fdtable::table_t::iterator fdit;
 
 			erase_fd_params eparams;
 			eparams.m_remove_from_table = false;
@@ -1380,14 +1508,21 @@ void sinsp_thread_manager::remove_thread(int64_t tid, bool force)
 		//
 		// If the thread has a nonzero refcount, it means that we are forcing the removal
 		// of a main process or program that some child refer to.
-		// We need to recalculate the child relationships, or the table will become
-		// corrupted.
+		// Keep the count around for whichever main thread comes next, or the table
+		// will become corrupted.
 		//
 		if(nchilds != 0)
 		{
-			recreate_child_dependencies();
+			m_orphan_nchilds[tid] += nchilds;
 		}
 	}
+	else if(!tinfo->m_purge_probe_pending)
+	{
+		//
+		// Look at it again later, its children might be gone by then
+		//
+		schedule_purge(*tinfo, m_inspector->m_lastevent_ts + m_inspector->m_inactive_thread_scan_time_ns);
+	}
 }
 
 void sinsp_thread_manager::fix_sockets_coming_from_proc()
@@ -1423,6 +1558,7 @@ void sinsp_thread_manager::reset_child_dependencies()
 {
 	m_last_tinfo.reset();
 	m_last_tid = 0;
+	m_orphan_nchilds.clear();
 
 	m_threadtable.loop([&] (sinsp_threadinfo& tinfo) {
 		tinfo.m_nchilds = 0;
@@ -1445,10 +1581,422 @@ void sinsp_thread_manager::recreate_child_dependencies()
 	create_child_dependencies();
 }
 
+void sinsp_thread_manager::schedule_purge(sinsp_threadinfo& tinfo, uint64_t deadline)
+{
+	tinfo.m_purge_deadline = deadline;
+	m_purge_queue.emplace(deadline, tinfo.m_tid);
+}
+
+uint64_t sinsp_thread_manager::inactive_deadline(const sinsp_threadinfo& tinfo) const
+{
+	return tinfo.m_lastaccess_ts + m_inspector->m_thread_timeout_ns + 1;
+}
+
+bool sinsp_thread_manager::purge_due_threads()
+{
+	uint64_t ts = m_inspector->m_lastevent_ts;
+	uint32_t n;
+
+	for(n = 0; n < m_purge_batch_size && !m_purge_queue.empty() && m_purge_queue.top().first <= ts; n++)
+	{
+		purge_entry entry = m_purge_queue.top();
+		sinsp_threadinfo* tinfo = m_threadtable.get(entry.second);
+
+		if(tinfo == nullptr || tinfo->m_purge_deadline != entry.first)
+		{
+			//
+			// The thread is gone, or was rescheduled since
+			//
+			m_purge_queue.pop();
+			continue;
+		}
+
+		if(tinfo->m_flags & PPM_CL_CLOSED)
+		{
+			m_purge_queue.pop();
+			tinfo->m_purge_deadline = 0;
+			remove_thread(entry.second, true);
+			continue;
+		}
+
+		uint64_t deadline = inactive_deadline(*tinfo);
+		if(deadline > ts)
+		{
+			//
+			// Used since it was queued
+			//
+			m_purge_queue.pop();
+			schedule_purge(*tinfo, deadline);
+			continue;
+		}
+
+		if(m_pending_probes.size() >= m_max_pending_probes)
+		{
+			//
+			// Leave the rest for when some probes are back
+			//
+			break;
+		}
+
+		m_purge_queue.pop();
+		tinfo->m_purge_deadline = 0;
+		probe_thread(*tinfo);
+	}
+
+	return n != 0;
+}
+
+void sinsp_thread_manager::probe_thread(sinsp_threadinfo& tinfo)
+{
+	if(m_inspector->is_capture())
+	{
+		//
+		// There's no /proc to look at for offline captures, where
+		// scap_is_thread_alive() always says no: don't start a
+		// thread to hear it
+		//
+		tinfo.m_purge_probe_pending = true;
+		on_probe_result(tinfo.m_tid, false);
+		return;
+	}
+
+	if(m_inspector->m_h == NULL || m_pending_probes.find(tinfo.m_tid) != m_pending_probes.end())
+	{
+		//
+		// Nothing to probe with, or a stale entry with the same tid is
+		// being probed. Try again later.
+		//
+		schedule_purge(tinfo, m_inspector->m_lastevent_ts + m_inspector->m_inactive_thread_scan_time_ns);
+		return;
+	}
+
+	tinfo.m_purge_probe_pending = true;
+
+	if(!m_liveness_source)
+	{
+		m_liveness_source.reset(new libsinsp::thread_liveness_source(m_inspector->m_h, m_probe_ttl_ms));
+	}
+
+	libsinsp::thread_liveness_key key(tinfo.m_pid, tinfo.m_tid, tinfo.m_comm);
+	bool alive = false;
+
+	if(m_liveness_source->lookup(key, alive))
+	{
+		on_probe_result(tinfo.m_tid, alive);
+		return;
+	}
+
+	m_pending_probes[tinfo.m_tid] = m_inspector->m_lastevent_ts;
+}
+
+void sinsp_thread_manager::collect_probe_results()
+{
+	uint64_t ts = m_inspector->m_lastevent_ts;
+
+	m_next_probe_check_ns = ts + m_probe_check_interval_ns;
+
+	for(const auto& it : m_liveness_source->get_complete_results())
+	{
+		const libsinsp::thread_liveness_key& key = it.first;
+		sinsp_threadinfo* tinfo = m_threadtable.get(key.m_tid);
+
+		m_pending_probes.erase(key.m_tid);
+
+		if(tinfo != nullptr && (tinfo->m_pid != key.m_pid || tinfo->m_comm != key.m_comm))
+		{
+			//
+			// The result is about a thread that has since been
+			// replaced, it says nothing about this one
+			//
+			on_probe_result(key.m_tid, true);
+			continue;
+		}
+
+		on_probe_result(key.m_tid, it.second);
+	}
+
+	//
+	// Probes whose requests expired in the source without an answer
+	//
+	for(auto it = m_pending_probes.begin(); it != m_pending_probes.end();)
+	{
+		if(ts > it->second + 2 * m_probe_ttl_ms * 1000000)
+		{
+			int64_t tid = it->first;
+			it = m_pending_probes.erase(it);
+			on_probe_result(tid, true);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+void sinsp_thread_manager::on_probe_result(int64_t tid, bool alive)
+{
+	uint64_t ts = m_inspector->m_lastevent_ts;
+	sinsp_threadinfo* tinfo = m_threadtable.get(tid);
+
+	if(tinfo == nullptr || !tinfo->m_purge_probe_pending)
+	{
+		return;
+	}
+
+	tinfo->m_purge_probe_pending = false;
+
+	if((tinfo->m_flags & PPM_CL_CLOSED) ||
+	   (!alive && ts >= inactive_deadline(*tinfo)))
+	{
+		//
+		// The process is gone, so are the threads that keep it in
+		// the table: don't wait for them
+		//
+		remove_thread(tid, true);
+		return;
+	}
+
+	//
+	// Still alive, or used while the probe was in flight
+	//
+	schedule_purge(*tinfo, std::max(inactive_deadline(*tinfo), ts + m_inspector->m_inactive_thread_scan_time_ns));
+}
+
+void sinsp_thread_manager::stop_liveness_probes()
+{
+	m_liveness_source.reset();
+
+	for(const auto& it : m_pending_probes)
+	{
+		sinsp_threadinfo* tinfo = m_threadtable.get(it.first);
+		if(tinfo != nullptr && tinfo->m_purge_probe_pending)
+		{
+			tinfo->m_purge_probe_pending = false;
+			schedule_purge(*tinfo, inactive_deadline(*tinfo));
+		}
+	}
+
+	m_pending_probes.clear();
+}
+
+void sinsp_thread_manager::set_async_proc_lookups(uint32_t nworkers)
+{
+	stop_proc_lookups();
+	m_n_proc_lookup_workers = nworkers;
+}
+
+bool sinsp_thread_manager::queue_proc_lookup(int64_t tid, bool scan_sockets)
+{
+#ifndef _WIN32
+	if(m_pending_proc_lookups.find(tid) != m_pending_proc_lookups.end())
+	{
+		//
+		// Already queued for an earlier placeholder, the result
+		// goes to whichever is in the table
+		//
+		return true;
+	}
+
+	if(m_pending_proc_lookups.size() >= m_max_pending_proc_lookups)
+	{
+#ifdef GATHER_INTERNAL_STATS
+		m_inspector->m_stats.m_n_async_proc_lookup_drops++;
+#endif
+		return false;
+	}
+
+	if(m_proc_lookup_sources.empty())
+	{
+		for(uint32_t j = 0; j < m_n_proc_lookup_workers; j++)
+		{
+			m_proc_lookup_sources.emplace_back(new libsinsp::proc_lookup_source(m_inspector->m_h, m_proc_lookup_ttl_ms));
+		}
+	}
+
+	sinsp* inspector = m_inspector;
+	libsinsp::proc_lookup_key key(tid, scan_sockets);
+	std::shared_ptr<scap_threadinfo> proc;
+	auto& source = m_proc_lookup_sources[(uint64_t)tid % m_proc_lookup_sources.size()];
+
+	if(source->lookup(key, proc, [inspector](const libsinsp::proc_lookup_key& k, const std::shared_ptr<scap_threadinfo>& p)
+		{
+			inspector->m_completed_proc_lookups.push(libsinsp::proc_lookup_result(k.m_tid, p));
+		}))
+	{
+		m_inspector->m_completed_proc_lookups.push(libsinsp::proc_lookup_result(tid, proc));
+	}
+
+	m_pending_proc_lookups[tid] = sinsp_utils::get_current_time_ns();
+
+#ifdef GATHER_INTERNAL_STATS
+	m_inspector->m_stats.m_n_async_proc_lookups++;
+#endif
+	return true;
+#else
+	return false;
+#endif
+}
+
+void sinsp_thread_manager::merge_proc_lookups()
+{
+#ifndef _WIN32
+	libsinsp::proc_lookup_result res;
+
+	while(m_inspector->m_completed_proc_lookups.try_pop(res))
+	{
+		merge_proc_lookup(res.m_tid, res.m_proc);
+	}
+
+	//
+	// Requests the sources dropped without an answer
+	//
+	uint64_t ts = m_inspector->m_lastevent_ts;
+
+	if(!m_pending_proc_lookups.empty() && ts >= m_next_proc_lookup_check_ns)
+	{
+		uint64_t now = sinsp_utils::get_current_time_ns();
+
+		m_next_proc_lookup_check_ns = ts + ONE_SECOND_IN_NS;
+
+		for(auto it = m_pending_proc_lookups.begin(); it != m_pending_proc_lookups.end();)
+		{
+			if(now > it->second + 2 * m_proc_lookup_ttl_ms * 1000000)
+			{
+				sinsp_threadinfo* tinfo = m_threadtable.get(it->first);
+				if(tinfo != nullptr)
+				{
+					tinfo->m_proc_lookup_pending = false;
+				}
+#ifdef GATHER_INTERNAL_STATS
+				m_inspector->m_stats.m_n_async_proc_lookup_drops++;
+#endif
+				it = m_pending_proc_lookups.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+#endif
+}
+
+void sinsp_thread_manager::merge_proc_lookup(int64_t tid, const std::shared_ptr<scap_threadinfo>& proc)
+{
+	auto pending = m_pending_proc_lookups.find(tid);
+	if(pending != m_pending_proc_lookups.end())
+	{
+#ifdef GATHER_INTERNAL_STATS
+		uint64_t latency = sinsp_utils::get_current_time_ns() - pending->second;
+
+		m_inspector->m_stats.m_n_async_proc_lookups_done++;
+		m_inspector->m_stats.m_async_proc_lookup_latency_ns += latency;
+		if(latency > m_inspector->m_stats.m_async_proc_lookup_max_latency_ns)
+		{
+			m_inspector->m_stats.m_async_proc_lookup_max_latency_ns = latency;
+		}
+#endif
+		m_pending_proc_lookups.erase(pending);
+	}
+
+	threadinfo_map_t::ptr_t placeholder = m_threadtable.get_ref(tid);
+	if(!placeholder || !placeholder->m_proc_lookup_pending)
+	{
+		//
+		// An event created the thread for real in the meantime
+		//
+		return;
+	}
+
+	placeholder->m_proc_lookup_pending = false;
+
+	if(!proc)
+	{
+		//
+		// Not in /proc (anymore), keep the placeholder as the
+		// synchronous lookup would
+		//
+		return;
+	}
+
+	//
+	// The lookup ran on a worker, the vtid maps are written from here
+	//
+	scap_proc_put_vtid_map(m_inspector->m_h, proc.get());
+
+	threadinfo_map_t::ptr_t newti(m_inspector->build_threadinfo());
+	newti->init(proc.get());
+
+	//
+	// Keep what the events told us since the placeholder went in: the
+	// syscall in progress, and an execve that /proc might predate
+	//
+	std::swap(newti->m_lastevent_data, placeholder->m_lastevent_data);
+	newti->set_lastevent_data_validity(placeholder->is_lastevent_data_valid());
+	newti->m_lastevent_type = placeholder->m_lastevent_type;
+	newti->m_lastevent_ts = placeholder->m_lastevent_ts;
+	newti->m_prevevent_ts = placeholder->m_prevevent_ts;
+	newti->m_lastevent_fd = placeholder->m_lastevent_fd;
+	newti->m_lastevent_category = placeholder->m_lastevent_category;
+	newti->m_lastaccess_ts = placeholder->m_lastaccess_ts;
+
+	if(placeholder->m_exe != "<NA>")
+	{
+		newti->m_comm = placeholder->m_comm;
+		newti->m_exe = placeholder->m_exe;
+		newti->m_exepath = placeholder->m_exepath;
+		newti->m_args = placeholder->m_args;
+		newti->m_env = placeholder->m_env;
+	}
+
+	if(!add_thread(newti.get(), false))
+	{
+		std::swap(newti->m_lastevent_data, placeholder->m_lastevent_data);
+		return;
+	}
+
+	//
+	// The fds seen since are newer than the /proc snapshot
+	//
+	sinsp_fdtable* fdt = newti->get_fd_table();
+	if(fdt != NULL)
+	{
+		for(auto& it : placeholder->m_fdtable.m_table)
+		{
+			fdt->add(it.first, &it.second);
+		}
+	}
+}
+
+void sinsp_thread_manager::stop_proc_lookups()
+{
+	m_proc_lookup_sources.clear();
+
+	for(const auto& it : m_pending_proc_lookups)
+	{
+		sinsp_threadinfo* tinfo = m_threadtable.get(it.first);
+		if(tinfo != nullptr)
+		{
+			tinfo->m_proc_lookup_pending = false;
+		}
+	}
+
+	m_pending_proc_lookups.clear();
+	m_next_proc_lookup_check_ns = 0;
+
+#ifndef _WIN32
+	libsinsp::proc_lookup_result res;
+	while(m_inspector->m_completed_proc_lookups.try_pop(res))
+	{
+	}
+#endif
+}
+
 void sinsp_thread_manager::update_statistics()
 {
 #ifdef GATHER_INTERNAL_STATS
 	m_inspector->m_stats.m_n_threads = get_thread_count();
+	m_inspector->m_stats.m_n_async_proc_lookups_pending = m_pending_proc_lookups.size();
 
 	m_inspector->m_stats.m_n_fds = 0;
 	for(threadinfo_map_iterator_t it = m_threadtable.begin(); it != m_threadtable.end(); it++)
@@ -1618,7 +2166,7 @@ void sinsp_thread_manager::dump_threads_to_file(scap_dumper_t* dumper)
 			//
 			// Add the FDs
 			//
-			unordered_map<int64_t, sinsp_fdinfo_t>& fdtable = tinfo.get_fd_table()->m_table;
+			sinsp_fdtable::table_t& fdtable = tinfo.get_fd_table()->m_table;
 			for(auto it = fdtable.begin(); it != fdtable.end(); ++it)
 			{
 				//
@@ -1684,9 +2232,10 @@ threadinfo_map_t::ptr_t sinsp_thread_manager::get_thread_ref(int64_t tid, bool q
         }
 
         scap_threadinfo* scap_proc = NULL;
+        bool lookup_queued = false;
 
 		// unfortunately, sinsp owns the threade factory
-        sinsp_threadinfo* newti = m_inspector->build_threadinfo();
+        threadinfo_map_t::ptr_t newti(m_inspector->build_threadinfo());
 
         m_n_proc_lookups++;
 
@@ -1721,17 +2270,30 @@ threadinfo_map_t::ptr_t sinsp_thread_manager::get_thread_ref(int64_t tid, bool q
                 }
             }
 
+            if(m_n_proc_lookup_workers != 0 && m_inspector->m_suppressed_comms.empty())
+            {
+                //
+                // Don't wait for /proc: a placeholder goes in the table
+                // and is replaced when the lookup completes
+                //
+                lookup_queued = queue_proc_lookup(tid, scan_sockets);
+            }
+            else
+            {
 #ifdef HAS_ANALYZER
-            uint64_t ts = sinsp_utils::get_current_time_ns();
+                uint64_t ts = sinsp_utils::get_current_time_ns();
 #endif
-            scap_proc = scap_proc_get(m_inspector->m_h, tid, scan_sockets);
+                char error[SCAP_LASTERR_SIZE];
+                scap_proc = scap_proc_get(m_inspector->m_h, tid, scan_sockets, error);
 #ifdef HAS_ANALYZER
-            m_n_proc_lookups_duration_ns += sinsp_utils::get_current_time_ns() - ts;
+                m_n_proc_lookups_duration_ns += sinsp_utils::get_current_time_ns() - ts;
 #endif
+            }
         }
 
         if(scap_proc)
         {
+            scap_proc_put_vtid_map(m_inspector->m_h, scap_proc);
             newti->init(scap_proc);
             scap_proc_free(m_inspector->m_h, scap_proc);
         }
@@ -1749,6 +2311,7 @@ threadinfo_map_t::ptr_t sinsp_thread_manager::get_thread_ref(int64_t tid, bool q
             newti->m_gid = 0xffffffff;
             newti->m_nchilds = 0;
             newti->m_loginuid = 0xffffffff;
+            newti->m_proc_lookup_pending = lookup_queued;
         }
 
         //
@@ -1762,11 +2325,12 @@ threadinfo_map_t::ptr_t sinsp_thread_manager::get_thread_ref(int64_t tid, bool q
             }
             return true;
         });
+        m_orphan_nchilds.erase(tid);
 
         //
         // Done. Add the new thread to the list.
         //
-        add_thread(newti, false);
+        add_thread(newti.get(), false);
         sinsp_proc = find_thread(tid, lookup_only);
     }
 
@@ -1781,7 +2345,7 @@ threadinfo_map_t::ptr_t sinsp_thread_manager::find_thread(int64_t tid, bool look
 	//
 	if(tid == m_last_tid)
 	{
-		thr = m_last_tinfo.lock();
+		thr = m_last_tinfo;
 		if (thr)                                                                                     {
 #ifdef GATHER_INTERNAL_STATS
 			m_cached_lookups->increment();
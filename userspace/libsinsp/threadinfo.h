@@ -33,12 +33,24 @@ struct iovec {
 #include <functional>
 #include <memory>
 #include <set>
+#include <queue>
+#include <unordered_map>
+#include <atomic>
 #include "fdinfo.h"
 #include "internal_metrics.h"
+#include "intrusive_ptr.h"
+#include "cow_vector.h"
+#include "interned_string.h"
+#include "slab_pool.h"
 
 class sinsp_delays_info;
 class sinsp_tracerparser;
 class blprogram;
+namespace libsinsp
+{
+class thread_liveness_source;
+class proc_lookup_source;
+}
 
 typedef struct erase_fd_params
 {
@@ -115,8 +127,8 @@ public:
 	*/
 	inline sinsp_threadinfo* get_main_thread() const
 	{
-		auto main_thread = m_main_thread.lock();
-		if(!main_thread)
+		sinsp_threadinfo* main_thread = m_main_thread.get();
+		if(!main_thread || main_thread->m_removed)
 		{
 			//
 			// Is this a child thread?
@@ -147,7 +159,7 @@ public:
 			}
 		}
 
-		return &*main_thread;
+		return main_thread;
 	}
 
 	/*!
@@ -180,7 +192,7 @@ public:
 				// Its current name is now its old
 				// name. The name might change as a
 				// result of parsing.
-				fdinfo->m_oldname = fdinfo->m_name;
+				fdinfo->reset_oldname();
 				return fdinfo;
 			}
 		}
@@ -249,13 +261,13 @@ public:
 	int64_t m_pid; ///< The id of the process containing this thread. In single thread threads, this is equal to tid.
 	int64_t m_ptid; ///< The id of the process that started this thread.
 	int64_t m_sid; ///< The session id of the process containing this thread.
-	std::string m_comm; ///< Command name (e.g. "top")
-	std::string m_exe; ///< argv[0] (e.g. "sshd: user@pts/4")
-	std::string m_exepath; ///< full executable path
-	std::vector<std::string> m_args; ///< Command line arguments (e.g. "-d1")
-	std::vector<std::string> m_env; ///< Environment variables
-	std::vector<std::pair<std::string, std::string>> m_cgroups; ///< subsystem-cgroup pairs
-	std::string m_container_id; ///< heuristic-based container id
+	libsinsp::interned_string m_comm; ///< Command name (e.g. "top")
+	libsinsp::interned_string m_exe; ///< argv[0] (e.g. "sshd: user@pts/4")
+	libsinsp::interned_string m_exepath; ///< full executable path
+	libsinsp::cow_vector<std::string> m_args; ///< Command line arguments (e.g. "-d1"), shared copy-on-write
+	libsinsp::cow_vector<std::string> m_env; ///< Environment variables, shared copy-on-write
+	libsinsp::cow_vector<std::pair<std::string, std::string>> m_cgroups; ///< subsystem-cgroup pairs, shared copy-on-write
+	libsinsp::interned_string m_container_id; ///< heuristic-based container id
 	uint32_t m_flags; ///< The thread flags. See the PPM_CL_* declarations in ppm_events_public.h.
 	int64_t m_fdlimit;  ///< The maximum number of FDs this thread can open
 	uint32_t m_uid; ///< user id
@@ -406,7 +418,7 @@ VISIBILITY_PRIVATE
 	}
 	void allocate_private_state();
 	void compute_program_hash();
-	std::shared_ptr<sinsp_threadinfo> lookup_thread() const;
+	libsinsp::intrusive_ptr<sinsp_threadinfo> lookup_thread() const;
 
 	size_t strvec_len(const std::vector<std::string> &strs) const;
 	void strvec_to_iovec(const std::vector<std::string> &strs,
@@ -430,8 +442,14 @@ VISIBILITY_PRIVATE
 	// parent thread info
 	//
 	sinsp_fdtable m_fdtable; // The fd table of this thread
-	std::string m_cwd; // current working directory
-	mutable std::weak_ptr<sinsp_threadinfo> m_main_thread;
+	libsinsp::interned_string m_cwd; // current working directory
+	mutable libsinsp::intrusive_ptr<sinsp_threadinfo> m_main_thread;
+	std::atomic<uint32_t> m_refcount; // Number of threadinfo_map_t::ptr_t pointing to this thread
+	libsinsp::slab_pool* m_pool; // The pool this object was allocated from, NULL if it comes from new
+	bool m_removed; // True once the thread manager dropped this thread from the table
+	bool m_purge_probe_pending; // True while a liveness probe for this thread is in flight
+	uint64_t m_purge_deadline; // When the thread manager looks at this thread again, 0 if it isn't queued
+	bool m_proc_lookup_pending; // True while this is a placeholder waiting for an async /proc lookup
 	uint8_t* m_lastevent_data; // Used by some event parsers to store the last enter event
 	std::vector<void*> m_private_state;
 
@@ -451,20 +469,51 @@ VISIBILITY_PRIVATE
 	friend class sinsp_tracerparser;
 	friend class lua_cbacks;
 	friend class sinsp_baseliner;
+	friend class threadinfo_map_t;
+	friend void intrusive_ptr_add_ref(sinsp_threadinfo* tinfo);
+	friend void intrusive_ptr_release(sinsp_threadinfo* tinfo);
 };
 
 /*@}*/
 
+inline void intrusive_ptr_add_ref(sinsp_threadinfo* tinfo)
+{
+	tinfo->m_refcount.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void intrusive_ptr_release(sinsp_threadinfo* tinfo)
+{
+	if(tinfo->m_refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		libsinsp::slab_pool* pool = tinfo->m_pool;
+		if(pool != NULL)
+		{
+			tinfo->~sinsp_threadinfo();
+			pool->deallocate(tinfo);
+		}
+		else
+		{
+			delete tinfo;
+		}
+	}
+}
+
 class threadinfo_map_t
 {
 public:
 	typedef std::function<bool(const sinsp_threadinfo&)> const_visitor_t;
 	typedef std::function<bool(sinsp_threadinfo&)> visitor_t;
-	typedef std::shared_ptr<sinsp_threadinfo> ptr_t;
+	typedef libsinsp::intrusive_ptr<sinsp_threadinfo> ptr_t;
 
 	inline void put(sinsp_threadinfo* tinfo)
 	{
-		m_threads[tinfo->m_tid] = ptr_t(tinfo);
+		ptr_t& entry = m_threads[tinfo->m_tid];
+		if(entry && entry.get() != tinfo)
+		{
+			entry->m_removed = true;
+		}
+		tinfo->m_removed = false;
+		entry = ptr_t(tinfo);
 	}
 
 	inline sinsp_threadinfo* get(uint64_t tid)
@@ -489,11 +538,22 @@ public:
 
 	inline void erase(uint64_t tid)
 	{
-		m_threads.erase(tid);
+		auto it = m_threads.find(tid);
+		if(it != m_threads.end())
+		{
+			it->second->m_removed = true;
+			it->second->m_main_thread.reset();
+			m_threads.erase(it);
+		}
 	}
 
 	inline void clear()
 	{
+		for(auto& it : m_threads)
+		{
+			it.second->m_removed = true;
+			it.second->m_main_thread.reset();
+		}
 		m_threads.clear();
 	}
 
@@ -564,11 +624,14 @@ class SINSP_PUBLIC sinsp_thread_manager
 {
 public:
 	sinsp_thread_manager(sinsp* inspector);
+	~sinsp_thread_manager();
 	void clear();
 
 	bool add_thread(sinsp_threadinfo *threadinfo, bool from_scap_proctable);
 	void remove_thread(int64_t tid, bool force);
-	// Returns true if the table is actually scanned
+	// Looks at a bounded number of threads whose inactivity deadline
+	// passed, and collects the results of the liveness probes.
+	// Returns true if any thread was looked at.
 	// NOTE: this is implemented in sinsp.cpp so we can inline it from there
 	inline bool remove_inactive_threads();
 	void fix_sockets_coming_from_proc();
@@ -576,6 +639,29 @@ public:
 	void create_child_dependencies();
 	void recreate_child_dependencies();
 
+	/*!
+	  \brief Read threads missing from the table from /proc on nworkers
+	   background threads, 0 to read them synchronously (the default).
+
+	  In async mode get_thread_ref() adds a placeholder thread right away
+	  and queues the /proc read. The result replaces the placeholder
+	  from sinsp::next(), keeping the fds and the state the events
+	  added to it in the meantime.
+	*/
+	void set_async_proc_lookups(uint32_t nworkers);
+	uint32_t get_async_proc_lookups() const { return m_n_proc_lookup_workers; }
+
+	/*!
+	  \brief Number of async /proc lookups queued and not merged yet.
+	*/
+	size_t get_n_pending_proc_lookups() const { return m_pending_proc_lookups.size(); }
+
+	/*!
+	  \brief Merge the async /proc lookups completed so far into the
+	   thread table.
+	*/
+	void merge_proc_lookups();
+
 	/*!
       \brief Look up a thread given its tid and return its information,
        and optionally go dig into proc if the thread is not in the thread table.
@@ -632,18 +718,76 @@ public:
 
 	void set_m_max_n_proc_lookups(int32_t val) { m_max_n_proc_lookups = val; }
 	void set_m_max_n_proc_socket_lookups(int32_t val) { m_max_n_proc_socket_lookups = val; }
+
+	/*!
+	  \brief Make the given vector share its storage with an equal one
+	   already used by another thread, if there is one.
+	*/
+	void intern(libsinsp::cow_vector<std::string>& strs) { m_strvec_table.intern(strs); }
+	void intern(libsinsp::cow_vector<std::pair<std::string, std::string>>& cgroups) { m_cgroups_table.intern(cgroups); }
 private:
 	void increment_mainthread_childcount(sinsp_threadinfo* threadinfo);
+	void decrement_mainthread_childcount(sinsp_threadinfo* threadinfo);
 	inline void clear_thread_pointers(sinsp_threadinfo& threadinfo);
+	inline void schedule_purge(sinsp_threadinfo& tinfo, uint64_t deadline);
+	inline uint64_t inactive_deadline(const sinsp_threadinfo& tinfo) const;
+	bool purge_due_threads();
+	void probe_thread(sinsp_threadinfo& tinfo);
+	void collect_probe_results();
+	void on_probe_result(int64_t tid, bool alive);
+	void stop_liveness_probes();
+	bool queue_proc_lookup(int64_t tid, bool scan_sockets);
+	void merge_proc_lookup(int64_t tid, const std::shared_ptr<scap_threadinfo>& proc);
+	void stop_proc_lookups();
 	void free_dump_fdinfos(std::vector<scap_fdinfo*>* fdinfos_to_free);
 	void thread_to_scap(sinsp_threadinfo& tinfo, scap_threadinfo* sctinfo);
 
 	sinsp* m_inspector;
 	threadinfo_map_t m_threadtable;
 	int64_t m_last_tid;
-	std::weak_ptr<sinsp_threadinfo> m_last_tinfo;
-	uint64_t m_last_flush_time_ns;
+	threadinfo_map_t::ptr_t m_last_tinfo;
+	libsinsp::cow_intern_table<std::string> m_strvec_table;
+	libsinsp::cow_intern_table<std::pair<std::string, std::string>> m_cgroups_table;
 	uint32_t m_n_drops;
+
+	//
+	// Incremental purge of inactive threads. Every thread is in
+	// m_purge_queue with the time it must be looked at again, entries
+	// whose deadline doesn't match the thread's m_purge_deadline are
+	// stale and skipped. Threads found inactive are probed in /proc by
+	// m_liveness_source, on its own thread, in live captures; offline
+	// they're removed right away.
+	//
+	typedef std::pair<uint64_t, int64_t> purge_entry; // (deadline, tid)
+	std::priority_queue<purge_entry, std::vector<purge_entry>, std::greater<purge_entry>> m_purge_queue;
+	uint64_t m_purge_start_ns;
+	std::unique_ptr<libsinsp::thread_liveness_source> m_liveness_source;
+	std::unordered_map<int64_t, uint64_t> m_pending_probes; // tid -> probe time
+	uint64_t m_next_probe_check_ns;
+	const uint32_t m_purge_batch_size = 64;
+	const uint32_t m_max_pending_probes = 256;
+	const uint64_t m_probe_check_interval_ns = ONE_SECOND_IN_NS / 100;
+	const uint64_t m_probe_ttl_ms = 60 * 1000;
+
+	//
+	// Number of children still in the table for main threads that
+	// were removed before them, by pid. Inherited by the next main
+	// thread with that pid, so that child counts stay exact without
+	// rescanning the table.
+	//
+	std::unordered_map<int64_t, uint64_t> m_orphan_nchilds;
+
+	//
+	// Async /proc lookups. Requests are spread over the sources by
+	// tid, the results come back through sinsp::m_completed_proc_lookups.
+	//
+	uint32_t m_n_proc_lookup_workers = 0;
+	std::vector<std::unique_ptr<libsinsp::proc_lookup_source>> m_proc_lookup_sources;
+	std::unordered_map<int64_t, uint64_t> m_pending_proc_lookups; // tid -> request time
+	uint64_t m_next_proc_lookup_check_ns = 0;
+	const uint32_t m_max_pending_proc_lookups = 1024;
+	const uint64_t m_proc_lookup_ttl_ms = 10 * 1000;
+
 	const uint32_t m_thread_table_absolute_max_size = 131072;
 	uint32_t m_max_thread_table_size;
 	int32_t m_n_proc_lookups = 0;